@@ -37,6 +37,7 @@
 #include <circle/devicenameservice.h>
 #include <circle/util.h>
 #include <circle/stdarg.h>
+#include <circle/metrics.h>
 #include <assert.h>
 #ifndef USE_SDHOST
 	#include <circle/bcm2835.h>
@@ -476,6 +477,10 @@ const u32 CEMMCDevice::sd_acommands[] =
 
 #define SD_BLOCK_SIZE		512
 
+static CMetricCounter s_BytesRead ("circle_emmc_read_bytes_total", "Bytes read from SD card");
+static CMetricCounter s_BytesWritten ("circle_emmc_written_bytes_total", "Bytes written to SD card");
+static CMetricCounter s_Errors ("circle_emmc_errors_total", "Failed SD card read and write requests");
+
 CEMMCDevice::CEMMCDevice (CInterruptSystem *pInterruptSystem, CTimer *pTimer, CActLED *pActLED)
 :	m_pInterruptSystem (pInterruptSystem),
 	m_pTimer (pTimer),
@@ -601,6 +606,8 @@ int CEMMCDevice::Read (void *pBuffer, size_t nCount)
 	{
 		PeripheralExit ();
 
+		s_Errors.Inc ();
+
 		if (m_pActLED != 0)
 		{
 			m_pActLED->Off ();
@@ -616,6 +623,8 @@ int CEMMCDevice::Read (void *pBuffer, size_t nCount)
 		m_pActLED->Off ();
 	}
 
+	s_BytesRead.Add (nCount);
+
 	return nCount;
 }
 
@@ -638,6 +647,8 @@ int CEMMCDevice::Write (const void *pBuffer, size_t nCount)
 	{
 		PeripheralExit ();
 
+		s_Errors.Inc ();
+
 		if (m_pActLED != 0)
 		{
 			m_pActLED->Off ();
@@ -653,6 +664,8 @@ int CEMMCDevice::Write (const void *pBuffer, size_t nCount)
 		m_pActLED->Off ();
 	}
 
+	s_BytesWritten.Add (nCount);
+
 	return nCount;
 }
 
@@ -0,0 +1,65 @@
+//
+// fatfsfile.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <fatfs/fatfsfile.h>
+
+CFatFsFile::CFatFsFile (const char *pFileName, boolean bWrite)
+{
+	m_bOpen = f_open (&m_File, pFileName,
+			  bWrite ? FA_WRITE | FA_CREATE_ALWAYS : FA_READ | FA_OPEN_EXISTING) == FR_OK;
+}
+
+CFatFsFile::~CFatFsFile (void)
+{
+	if (m_bOpen)
+	{
+		f_close (&m_File);
+
+		m_bOpen = FALSE;
+	}
+}
+
+boolean CFatFsFile::IsOpen (void) const
+{
+	return m_bOpen;
+}
+
+int CFatFsFile::Read (void *pBuffer, size_t nCount)
+{
+	UINT nBytesRead;
+	if (   !m_bOpen
+	    || f_read (&m_File, pBuffer, nCount, &nBytesRead) != FR_OK)
+	{
+		return -1;
+	}
+
+	return (int) nBytesRead;
+}
+
+int CFatFsFile::Write (const void *pBuffer, size_t nCount)
+{
+	UINT nBytesWritten;
+	if (   !m_bOpen
+	    || f_write (&m_File, pBuffer, nCount, &nBytesWritten) != FR_OK)
+	{
+		return -1;
+	}
+
+	return (int) nBytesWritten;
+}
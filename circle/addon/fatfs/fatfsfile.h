@@ -0,0 +1,56 @@
+//
+// fatfsfile.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _fatfs_fatfsfile_h
+#define _fatfs_fatfsfile_h
+
+#include <circle/device.h>
+#include <circle/types.h>
+#include <fatfs/ff.h>
+
+/// \note The FatFs volume has to be mounted before using this class.
+
+class CFatFsFile : public CDevice	/// Accesses a file on a FatFs volume via the CDevice interface
+{
+public:
+	/// \param pFileName Path of the file to be opened (e.g. "SD:/trace.json")
+	/// \param bWrite    TRUE if file is written (created or truncated), FALSE if file is read
+	CFatFsFile (const char *pFileName, boolean bWrite = TRUE);
+
+	~CFatFsFile (void);
+
+	/// \return Is file open for access?
+	boolean IsOpen (void) const;
+
+	/// \param pBuffer Pointer to buffer for read data
+	/// \param nCount Maximum number of bytes to be read
+	/// \return Number of bytes read (0 on EOF, < 0 on error)
+	int Read (void *pBuffer, size_t nCount);
+
+	/// \param pBuffer Pointer to data to be written
+	/// \param nCount Number of bytes to be written
+	/// \return Number of bytes successfully written (< 0 on error)
+	int Write (const void *pBuffer, size_t nCount);
+
+private:
+	FIL m_File;
+	boolean m_bOpen;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+#
+# foldsym.py - Symbolize folded stacks, saved by CSamplingProfiler::SaveFoldedStacks()
+#
+# Usage: python3 foldsym.py KERNEL.ELF STACKS.TXT [ADDR2LINE] > stacks.folded
+#
+# ADDR2LINE defaults to aarch64-none-elf-addr2line (use arm-none-eabi-addr2line for AArch32).
+# The output can be fed to flamegraph.pl (https://github.com/brendangregg/FlameGraph).
+#
+
+import subprocess
+import sys
+
+try:
+	elffile = sys.argv[1]
+	stackfile = sys.argv[2]
+	addr2line = sys.argv[3] if len(sys.argv) > 3 else 'aarch64-none-elf-addr2line'
+except Exception:
+	print("Usage: python3 foldsym.py KERNEL.ELF STACKS.TXT [ADDR2LINE]")
+	exit(1)
+
+stacks = []
+addresses = set()
+with open(stackfile) as f:
+	for line in f:
+		frames, count = line.rsplit(' ', 1)
+		frames = frames.split(';')
+		stacks.append((frames, int(count)))
+		addresses.update(frames)
+
+addresses = sorted(addresses)
+result = subprocess.run([addr2line, '-f', '-C', '-e', elffile] + ['0x' + a for a in addresses],
+			stdout=subprocess.PIPE, universal_newlines=True, check=True)
+lines = result.stdout.splitlines()
+symbol = {}
+for i, address in enumerate(addresses):
+	name = lines[2*i]
+	symbol[address] = name if name != '??' else '0x' + address
+
+folded = {}
+for frames, count in stacks:
+	key = ';'.join(symbol[a].replace(';', ':') for a in frames)
+	folded[key] = folded.get(key, 0) + count
+
+for key in sorted(folded):
+	print(key, folded[key])
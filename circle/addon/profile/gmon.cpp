@@ -26,6 +26,12 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#ifdef __circle__
+#include <circle/sysconfig.h>
+#endif
+
+#ifndef ARM_ALLOW_MULTI_CORE	// gprof profiling supports single core programs only
+
 #ifndef __circle__
 #include <sys/param.h>
 #include <sys/time.h>
@@ -472,3 +478,5 @@ _mcleanup (void)
   /* free the memory. */
   free (_gmonparam.tos);
 }
+
+#endif
@@ -27,6 +27,12 @@
  * SUCH DAMAGE.
  */
 
+#ifdef __circle__
+#include <circle/sysconfig.h>
+#endif
+
+#ifndef ARM_ALLOW_MULTI_CORE	// gprof profiling supports single core programs only
+
 #if !defined(lint) && !defined(KERNEL) && defined(LIBC_SCCS)
 static char sccsid[] = "@(#)mcount.c	8.1 (Berkeley) 6/4/93";
 #endif
@@ -191,3 +197,5 @@ overflow:
  */
 MCOUNT
 #endif
+
+#endif
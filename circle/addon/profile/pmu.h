@@ -0,0 +1,232 @@
+//
+// pmu.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _profile_pmu_h
+#define _profile_pmu_h
+
+#include <circle/synchronize.h>
+#include <circle/types.h>
+
+#if RASPPI == 1
+	#error The ARM Performance Monitors Unit is supported on Raspberry Pi 2 and newer only!
+#endif
+
+// common architectural and microarchitectural events (ARMv7 and ARMv8)
+enum TPMUEvent
+{
+	PMUEventL1IRefill		= 0x01,
+	PMUEventL1DRefill		= 0x03,
+	PMUEventL1DAccess		= 0x04,
+	PMUEventInstructions		= 0x08,
+	PMUEventBranchMispredict	= 0x10,
+	PMUEventCycles			= 0x11,
+	PMUEventL2DAccess		= 0x16,
+	PMUEventL2DRefill		= 0x17,
+	PMUEventStallFrontend		= 0x23,		// ARMv8 only, optional
+	PMUEventStallBackend		= 0x24		// ARMv8 only, optional
+};
+
+#define PMU_CYCLE_COUNTER	31			// bit number in counter masks
+
+#if AARCH == 32
+	#define PMU_SYSREG(name, crm, op2)						\
+		static u32 Read##name (void)						\
+		{									\
+			u32 nValue;							\
+			asm volatile ("mrc p15, 0, %0, c9, " #crm ", " #op2 : "=r" (nValue)); \
+			return nValue;							\
+		}									\
+		static void Write##name (u32 nValue)					\
+		{									\
+			asm volatile ("mcr p15, 0, %0, c9, " #crm ", " #op2 : : "r" (nValue)); \
+		}
+#else
+	#define PMU_SYSREG(name, reg)							\
+		static u32 Read##name (void)						\
+		{									\
+			u64 nValue;							\
+			asm volatile ("mrs %0, " #reg : "=r" (nValue));			\
+			return (u32) nValue;						\
+		}									\
+		static void Write##name (u32 nValue)					\
+		{									\
+			asm volatile ("msr " #reg ", %0" : : "r" ((u64) nValue));	\
+		}
+#endif
+
+class CPMU	/// Access to the ARM Performance Monitors Unit of the current core
+{
+public:
+	/// \return Number of implemented event counters (without cycle counter)
+	static unsigned GetEventCounters (void)
+	{
+		return (ReadPMCR () >> 11) & 0x1F;
+	}
+
+	/// \param nEvent Event number (see TPMUEvent)
+	/// \return Is this common event implemented on this core?
+	static boolean IsEventSupported (unsigned nEvent)
+	{
+		if (nEvent < 32)
+		{
+			return !!(ReadPMCEID0 () & (1 << nEvent));
+		}
+
+		if (nEvent < 64)
+		{
+			return !!(ReadPMCEID1 () & (1 << (nEvent-32)));
+		}
+
+		return TRUE;			// implementation defined event, cannot check
+	}
+
+	/// \brief Reset all counters and start the cycle counter
+	static void Start (void)
+	{
+		WritePMINTENCLR (~0U);
+		WritePMCNTENCLR (~0U);
+		WritePMOVSR (~0U);
+#if AARCH == 64
+		WritePMCCFILTR (0);		// count cycles at EL0 and EL1
+#endif
+		WritePMCR (PMCR_E | PMCR_P | PMCR_C);	// PMCR.LC=0: overflow at 32 bits
+		WritePMCNTENSET (1U << PMU_CYCLE_COUNTER);
+		InstructionSyncBarrier ();
+	}
+
+	/// \brief Stop all counters and disable overflow interrupts
+	static void Stop (void)
+	{
+		WritePMINTENCLR (~0U);
+		WritePMCNTENCLR (~0U);
+		WritePMCR (0);
+		WritePMOVSR (~0U);
+		InstructionSyncBarrier ();
+	}
+
+	/// \param nCounter Event counter number (0..GetEventCounters()-1)
+	/// \param nEvent Event to be counted (see TPMUEvent)
+	/// \note Starts the event counter
+	static void SetupEventCounter (unsigned nCounter, unsigned nEvent)
+	{
+		Select (nCounter);
+		WritePMXEVTYPER (nEvent & 0xFFFF);	// count at EL1 (PL1) and EL0 (PL0)
+		WritePMCNTENSET (1U << nCounter);
+		InstructionSyncBarrier ();
+	}
+
+	/// \return Lower 32 bits of the cycle counter
+	static u32 ReadCycleCounter (void)
+	{
+		return ReadPMCCNTR ();
+	}
+
+	/// \param nCounter Event counter number (0..GetEventCounters()-1)
+	static u32 ReadEventCounter (unsigned nCounter)
+	{
+		Select (nCounter);
+		return ReadPMXEVCNTR ();
+	}
+
+	/// \param nCounter Event counter number (0..GetEventCounters()-1)
+	/// \param nValue Value to be loaded (overflow occurs after 0xFFFFFFFF)
+	static void WriteEventCounter (unsigned nCounter, u32 nValue)
+	{
+		Select (nCounter);
+		WritePMXEVCNTR (nValue);
+	}
+
+	/// \param nCounter Event counter number (0..GetEventCounters()-1)
+	static void EnableOverflowInterrupt (unsigned nCounter)
+	{
+		WritePMINTENSET (1U << nCounter);
+	}
+
+	/// \param nCounter Event counter number (0..GetEventCounters()-1)
+	static void DisableOverflowInterrupt (unsigned nCounter)
+	{
+		WritePMINTENCLR (1U << nCounter);
+	}
+
+	/// \return Bit mask of counters, which have overflowed since the last call
+	static u32 GetAndClearOverflowStatus (void)
+	{
+		u32 nStatus = ReadPMOVSR ();
+		WritePMOVSR (nStatus);
+
+		return nStatus;
+	}
+
+	/// \return Current counter selection (to be restored in interrupt handlers)
+	static u32 SaveSelection (void)
+	{
+		return ReadPMSELR ();
+	}
+
+	/// \param nSelection Value returned by SaveSelection() before
+	static void RestoreSelection (u32 nSelection)
+	{
+		Select (nSelection);
+	}
+
+private:
+	static void Select (unsigned nCounter)
+	{
+		WritePMSELR (nCounter);
+		InstructionSyncBarrier ();
+	}
+
+private:
+#if AARCH == 32
+	PMU_SYSREG (PMCR,	c12, 0)
+	PMU_SYSREG (PMCNTENSET,	c12, 1)
+	PMU_SYSREG (PMCNTENCLR,	c12, 2)
+	PMU_SYSREG (PMOVSR,	c12, 3)
+	PMU_SYSREG (PMSELR,	c12, 5)
+	PMU_SYSREG (PMCEID0,	c12, 6)
+	PMU_SYSREG (PMCEID1,	c12, 7)
+	PMU_SYSREG (PMCCNTR,	c13, 0)
+	PMU_SYSREG (PMXEVTYPER,	c13, 1)
+	PMU_SYSREG (PMXEVCNTR,	c13, 2)
+	PMU_SYSREG (PMINTENSET,	c14, 1)
+	PMU_SYSREG (PMINTENCLR,	c14, 2)
+#else
+	PMU_SYSREG (PMCR,	pmcr_el0)
+	PMU_SYSREG (PMCNTENSET,	pmcntenset_el0)
+	PMU_SYSREG (PMCNTENCLR,	pmcntenclr_el0)
+	PMU_SYSREG (PMOVSR,	pmovsclr_el0)
+	PMU_SYSREG (PMSELR,	pmselr_el0)
+	PMU_SYSREG (PMCEID0,	pmceid0_el0)
+	PMU_SYSREG (PMCEID1,	pmceid1_el0)
+	PMU_SYSREG (PMCCNTR,	pmccntr_el0)
+	PMU_SYSREG (PMXEVTYPER,	pmxevtyper_el0)
+	PMU_SYSREG (PMXEVCNTR,	pmxevcntr_el0)
+	PMU_SYSREG (PMINTENSET,	pmintenset_el1)
+	PMU_SYSREG (PMINTENCLR,	pmintenclr_el1)
+	PMU_SYSREG (PMCCFILTR,	pmccfiltr_el0)
+#endif
+
+	static const u32 PMCR_E = 1 << 0;	// enable all counters
+	static const u32 PMCR_P = 1 << 1;	// reset event counters
+	static const u32 PMCR_C = 1 << 2;	// reset cycle counter
+};
+
+#undef PMU_SYSREG
+
+#endif
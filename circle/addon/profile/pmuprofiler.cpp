@@ -0,0 +1,611 @@
+//
+// pmuprofiler.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#if RASPPI >= 2
+
+#include <profile/pmuprofiler.h>
+#include <circle/interrupt.h>
+#include <circle/exceptionstub.h>
+#include <circle/bcm2835int.h>
+#include <circle/multicore.h>
+#include <circle/logger.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define EXPORT_CHUNK_SIZE	4096
+
+static const unsigned DefaultEvents[] =
+{
+	PMUEventInstructions,
+	PMUEventL1DRefill,
+	PMUEventL2DRefill,
+	PMUEventBranchMispredict,
+	PMUEventStallFrontend
+};
+
+static const struct
+{
+	unsigned nEvent;
+	const char *pName;
+}
+EventNames[] =
+{
+	{PMUEventL1IRefill,		"L1I-refill"},
+	{PMUEventL1DRefill,		"L1D-refill"},
+	{PMUEventL1DAccess,		"L1D-access"},
+	{PMUEventInstructions,		"instr"},
+	{PMUEventBranchMispredict,	"br-mispred"},
+	{PMUEventCycles,		"cycles"},
+	{PMUEventL2DAccess,		"L2D-access"},
+	{PMUEventL2DRefill,		"L2D-refill"},
+	{PMUEventStallFrontend,		"stall-fe"},
+	{PMUEventStallBackend,		"stall-be"}
+};
+
+LOGMODULE ("pmuprof");
+
+CPMURegion *CPMURegion::s_pFirst = 0;
+
+unsigned CPMUProfiler::s_nEvents = 0;
+volatile boolean CPMUProfiler::s_bActive = FALSE;
+CPMUProfiler *CPMUProfiler::s_pThis = 0;
+
+CPMURegion::CPMURegion (const char *pName)
+:	m_pName (pName)
+{
+	assert (m_pName != 0);
+
+	Reset ();
+
+	// regions may be constructed concurrently on different cores
+	CPMURegion *pFirst = __atomic_load_n (&s_pFirst, __ATOMIC_RELAXED);
+	do
+	{
+		m_pNext = pFirst;
+	}
+	while (!__atomic_compare_exchange_n (&s_pFirst, &pFirst, this, TRUE,
+					     __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void CPMURegion::Reset (void)
+{
+	memset (m_Counts, 0, sizeof m_Counts);
+}
+
+void CPMURegion::Add (const TPMUCounts &rStart, const TPMUCounts &rEnd)
+{
+	TCoreCounts *pCounts = &m_Counts[CPMUProfiler::ThisCore ()];
+
+	pCounts->nCalls++;
+	pCounts->nCycles += rEnd.nCycles - rStart.nCycles;
+
+	for (unsigned i = 0; i < CPMUProfiler::s_nEvents; i++)
+	{
+		pCounts->nEvent[i] += rEnd.nEvent[i] - rStart.nEvent[i];
+	}
+}
+
+CPMUProfiler::CPMUProfiler (const unsigned *pEvents, unsigned nEvents,
+			    unsigned nSamplePeriod, unsigned nSampleEvent)
+:	m_nInstructionsIndex (-1),
+	m_nSamplePeriod (nSamplePeriod),
+	m_nSampleEvent (nSampleEvent),
+	m_nSampleCounter (0),
+	m_nTextStart (0),
+	m_nBucketShift (0),
+	m_nBuckets (0),
+	m_pBucket (0),
+	m_nSamples (0),
+	m_nSamplesOutside (0),
+	m_bInitialized (FALSE)
+{
+	assert (s_pThis == 0);
+	s_pThis = this;
+
+	if (pEvents == 0)
+	{
+		pEvents = DefaultEvents;
+		nEvents = sizeof DefaultEvents / sizeof DefaultEvents[0];
+	}
+
+	if (nEvents > PMU_MAX_EVENTS)
+	{
+		nEvents = PMU_MAX_EVENTS;
+	}
+
+	for (m_nEvents = 0; m_nEvents < nEvents; m_nEvents++)
+	{
+		m_Event[m_nEvents] = pEvents[m_nEvents];
+	}
+}
+
+CPMUProfiler::~CPMUProfiler (void)
+{
+	s_bActive = FALSE;
+
+	if (m_bInitialized)
+	{
+		CPMU::Stop ();
+
+		if (m_nSamplePeriod != 0)
+		{
+#if RASPPI >= 4
+			for (unsigned nCore = 0; nCore < PMU_PROFILER_CORES; nCore++)
+			{
+				CInterruptSystem::Get ()->DisconnectIRQ (ARM_IRQ_PMU0 + nCore);
+			}
+#else
+			CInterruptSystem::Get ()->DisconnectIRQ (ARM_IRQLOCAL0_PMU);
+#endif
+		}
+	}
+
+	s_nEvents = 0;
+
+	delete [] m_pBucket;
+	m_pBucket = 0;
+
+	s_pThis = 0;
+}
+
+boolean CPMUProfiler::Initialize (uintptr nTextStart, uintptr nTextEnd, unsigned nBucketShift)
+{
+	assert (!m_bInitialized);
+	assert (ThisCore () == 0);
+
+	unsigned nCounters = CPMU::GetEventCounters ();
+	if (m_nSamplePeriod != 0)
+	{
+		if (nCounters == 0)
+		{
+			LOGERR ("No event counter available for sampling");
+
+			return FALSE;
+		}
+
+		nCounters--;
+	}
+
+	if (m_nEvents > nCounters)
+	{
+		LOGWARN ("Only %u events can be counted", nCounters);
+
+		m_nEvents = nCounters;
+	}
+
+	for (unsigned i = 0; i < m_nEvents; i++)
+	{
+		if (!CPMU::IsEventSupported (m_Event[i]))
+		{
+			LOGWARN ("Event 0x%X is not supported", m_Event[i]);
+		}
+
+		if (m_Event[i] == PMUEventInstructions)
+		{
+			m_nInstructionsIndex = i;
+		}
+	}
+
+	if (m_nSamplePeriod != 0)
+	{
+		assert (nTextStart < nTextEnd);
+		m_nTextStart = nTextStart;
+		m_nBucketShift = nBucketShift;
+		m_nBuckets = ((nTextEnd - nTextStart) >> nBucketShift) + 1;
+
+		m_pBucket = new TSampleBucket[m_nBuckets];
+		if (m_pBucket == 0)
+		{
+			LOGERR ("Cannot allocate %u sample buckets", m_nBuckets);
+
+			return FALSE;
+		}
+
+		memset (m_pBucket, 0, m_nBuckets * sizeof (TSampleBucket));
+
+		m_nSampleCounter = m_nEvents;
+	}
+
+	s_nEvents = m_nEvents;
+
+	SetupCore (0);
+
+	if (m_nSamplePeriod != 0)
+	{
+#if RASPPI >= 4
+		// each core has its own PMU interrupt, which is routed to this core
+		for (unsigned nCore = 0; nCore < PMU_PROFILER_CORES; nCore++)
+		{
+			CInterruptSystem::Get ()->ConnectIRQ (ARM_IRQ_PMU0 + nCore,
+							      InterruptHandler, this);
+		}
+#else
+		// enables the PMU interrupt for core 0 only
+		CInterruptSystem::Get ()->ConnectIRQ (ARM_IRQLOCAL0_PMU, InterruptHandler, this);
+#endif
+	}
+
+	m_bInitialized = TRUE;
+
+	return TRUE;
+}
+
+void CPMUProfiler::InitializeSecondary (void)
+{
+	assert (m_bInitialized);
+
+	unsigned nCore = ThisCore ();
+	assert (nCore != 0);
+
+	SetupCore (nCore);
+
+#if RASPPI <= 3
+	if (m_nSamplePeriod != 0)
+	{
+		CInterruptSystem::EnableIRQ (ARM_IRQLOCAL0_PMU);
+	}
+#endif
+}
+
+void CPMUProfiler::Start (void)
+{
+	assert (m_bInitialized);
+
+	s_bActive = TRUE;
+}
+
+void CPMUProfiler::Stop (void)
+{
+	s_bActive = FALSE;
+}
+
+void CPMUProfiler::Reset (void)
+{
+	for (CPMURegion *pRegion = CPMURegion::s_pFirst; pRegion != 0; pRegion = pRegion->m_pNext)
+	{
+		pRegion->Reset ();
+	}
+
+	m_SpinLock.Acquire ();
+
+	if (m_pBucket != 0)
+	{
+		memset (m_pBucket, 0, m_nBuckets * sizeof (TSampleBucket));
+	}
+
+	m_nSamples = 0;
+	m_nSamplesOutside = 0;
+
+	m_SpinLock.Release ();
+}
+
+void CPMUProfiler::Dump (unsigned nMaxSamples)
+{
+	LOGNOTE ("Events per 1000 %s", m_nInstructionsIndex >= 0 ? "instructions" : "cycles");
+	DumpHeader ("Region", "Calls");
+
+	for (CPMURegion *pRegion = CPMURegion::s_pFirst; pRegion != 0; pRegion = pRegion->m_pNext)
+	{
+		unsigned nCalls = 0;
+		u64 nCycles = 0;
+		u64 Events[PMU_MAX_EVENTS] = {0};
+
+		for (unsigned nCore = 0; nCore < PMU_PROFILER_CORES; nCore++)
+		{
+			const CPMURegion::TCoreCounts *pCounts = &pRegion->m_Counts[nCore];
+
+			nCalls += pCounts->nCalls;
+			nCycles += pCounts->nCycles;
+
+			for (unsigned i = 0; i < m_nEvents; i++)
+			{
+				Events[i] += pCounts->nEvent[i];
+			}
+		}
+
+		if (nCalls != 0)
+		{
+			DumpLine (pRegion->GetName (), nCalls, nCycles, Events);
+		}
+	}
+
+	if (m_pBucket == 0)
+	{
+		return;
+	}
+
+	LOGNOTE ("%u samples (%u outside the text segment), top %u addresses:",
+		 m_nSamples, m_nSamplesOutside, nMaxSamples);
+	DumpHeader ("Address", "Samples");
+
+	// selection of the buckets with most samples
+	unsigned *pTop = new unsigned[nMaxSamples];
+	if (pTop == 0)
+	{
+		return;
+	}
+
+	m_SpinLock.Acquire ();
+
+	unsigned nTop = 0;
+	for (unsigned nBucket = 0; nBucket < m_nBuckets; nBucket++)
+	{
+		unsigned nSamples = m_pBucket[nBucket].nSamples;
+		if (   nSamples == 0
+		    || (   nTop == nMaxSamples
+			&& nSamples <= m_pBucket[pTop[nTop-1]].nSamples))
+		{
+			continue;
+		}
+
+		unsigned i = nTop < nMaxSamples ? nTop++ : nTop-1;
+		for (; i > 0 && m_pBucket[pTop[i-1]].nSamples < nSamples; i--)
+		{
+			pTop[i] = pTop[i-1];
+		}
+
+		pTop[i] = nBucket;
+	}
+
+	m_SpinLock.Release ();
+
+	for (unsigned i = 0; i < nTop; i++)
+	{
+		const TSampleBucket *pBucket = &m_pBucket[pTop[i]];
+
+		CString Address;
+		Address.Format ("%lX", (unsigned long) (m_nTextStart + (pTop[i] << m_nBucketShift)));
+
+		DumpLine (Address, pBucket->nSamples, pBucket->nCycles, pBucket->nEvent);
+	}
+
+	delete [] pTop;
+}
+
+boolean CPMUProfiler::Export (CDevice *pTarget)
+{
+	assert (pTarget != 0);
+
+	if (m_pBucket == 0)
+	{
+		return FALSE;
+	}
+
+	CString Buffer;
+	Buffer.Append ("# address samples cycles");
+	for (unsigned i = 0; i < m_nEvents; i++)
+	{
+		Buffer.Append (" ");
+		Buffer.Append (GetEventName (m_Event[i]));
+	}
+	Buffer.Append ("\n");
+
+	for (unsigned nBucket = 0; nBucket < m_nBuckets; nBucket++)
+	{
+		const TSampleBucket *pBucket = &m_pBucket[nBucket];
+		if (pBucket->nSamples == 0)
+		{
+			continue;
+		}
+
+		CString Line;
+		Line.Format ("%lX %u %.0f", (unsigned long) (m_nTextStart + (nBucket << m_nBucketShift)),
+			     pBucket->nSamples, ToDouble (pBucket->nCycles));
+		Buffer.Append (Line);
+
+		for (unsigned i = 0; i < m_nEvents; i++)
+		{
+			Line.Format (" %.0f", ToDouble (pBucket->nEvent[i]));
+			Buffer.Append (Line);
+		}
+		Buffer.Append ("\n");
+
+		if (Buffer.GetLength () >= EXPORT_CHUNK_SIZE)
+		{
+			if (pTarget->Write (Buffer, Buffer.GetLength ()) != (int) Buffer.GetLength ())
+			{
+				return FALSE;
+			}
+
+			Buffer = "";
+		}
+	}
+
+	return pTarget->Write (Buffer, Buffer.GetLength ()) == (int) Buffer.GetLength ();
+}
+
+const char *CPMUProfiler::GetEventName (unsigned nEvent)
+{
+	for (unsigned i = 0; i < sizeof EventNames / sizeof EventNames[0]; i++)
+	{
+		if (EventNames[i].nEvent == nEvent)
+		{
+			return EventNames[i].pName;
+		}
+	}
+
+	return "unknown";
+}
+
+CPMUProfiler *CPMUProfiler::Get (void)
+{
+	assert (s_pThis != 0);
+	return s_pThis;
+}
+
+void CPMUProfiler::SetupCore (unsigned nCore)
+{
+	assert (nCore < PMU_PROFILER_CORES);
+
+	CPMU::Start ();
+
+	for (unsigned i = 0; i < m_nEvents; i++)
+	{
+		CPMU::SetupEventCounter (i, m_Event[i]);
+	}
+
+	ReadCounters (&m_LastSample[nCore]);
+
+	if (m_nSamplePeriod != 0)
+	{
+		CPMU::SetupEventCounter (m_nSampleCounter, m_nSampleEvent);
+		CPMU::WriteEventCounter (m_nSampleCounter, -m_nSamplePeriod);
+		CPMU::EnableOverflowInterrupt (m_nSampleCounter);
+	}
+}
+
+void CPMUProfiler::Sample (unsigned nCore)
+{
+	assert (nCore < PMU_PROFILER_CORES);
+
+	// the counts since the previous sample are attributed to the sampled address
+	TPMUCounts Counts;
+	ReadCounters (&Counts);
+
+	TPMUCounts Delta;
+	TPMUCounts *pLast = &m_LastSample[nCore];
+	Delta.nCycles = Counts.nCycles - pLast->nCycles;
+	for (unsigned i = 0; i < m_nEvents; i++)
+	{
+		Delta.nEvent[i] = Counts.nEvent[i] - pLast->nEvent[i];
+	}
+
+	*pLast = Counts;
+
+	if (!s_bActive)
+	{
+		return;
+	}
+
+	uintptr nPC = IRQReturnAddressCore[nCore];
+
+	m_SpinLock.Acquire ();
+
+	m_nSamples++;
+
+	unsigned nBucket = (nPC - m_nTextStart) >> m_nBucketShift;
+	if (   nPC >= m_nTextStart
+	    && nBucket < m_nBuckets)
+	{
+		TSampleBucket *pBucket = &m_pBucket[nBucket];
+
+		pBucket->nSamples++;
+		pBucket->nCycles += Delta.nCycles;
+
+		for (unsigned i = 0; i < m_nEvents; i++)
+		{
+			pBucket->nEvent[i] += Delta.nEvent[i];
+		}
+	}
+	else
+	{
+		m_nSamplesOutside++;
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CPMUProfiler::DumpHeader (const char *pName, const char *pCount)
+{
+	CString Header;
+	Header.Format ("%-20s %8s %10s", pName, pCount, "Mcycles");
+	if (m_nInstructionsIndex >= 0)
+	{
+		Header.Append ("   IPC");
+	}
+
+	for (unsigned i = 0; i < m_nEvents; i++)
+	{
+		if ((int) i != m_nInstructionsIndex)
+		{
+			CString Column;
+			Column.Format (" %10s", GetEventName (m_Event[i]));
+			Header.Append (Column);
+		}
+	}
+
+	LOGNOTE ("%s", (const char *) Header);
+}
+
+void CPMUProfiler::DumpLine (const char *pName, unsigned nCalls, u64 nCycles, const u64 *pEvents)
+{
+	CString Line;
+	Line.Format ("%-20s %8u %10.3f", pName, nCalls, ToDouble (nCycles) / 1000000.0);
+
+	double fCycles = ToDouble (nCycles);
+	double fBase = fCycles / 1000.0;
+	if (m_nInstructionsIndex >= 0)
+	{
+		double fInstructions = ToDouble (pEvents[m_nInstructionsIndex]);
+
+		CString IPC;
+		IPC.Format (" %5.2f", fCycles != 0.0 ? fInstructions / fCycles : 0.0);
+		Line.Append (IPC);
+
+		fBase = fInstructions / 1000.0;
+	}
+
+	for (unsigned i = 0; i < m_nEvents; i++)
+	{
+		if ((int) i != m_nInstructionsIndex)
+		{
+			CString Column;
+			Column.Format (" %10.2f", fBase != 0.0 ? ToDouble (pEvents[i]) / fBase : 0.0);
+			Line.Append (Column);
+		}
+	}
+
+	LOGNOTE ("%s", (const char *) Line);
+}
+
+void CPMUProfiler::InterruptHandler (void *pParam)
+{
+	CPMUProfiler *pThis = (CPMUProfiler *) pParam;
+	assert (pThis != 0);
+
+	// we may have interrupted a CPMUScope, which has selected an event counter
+	u32 nSelection = CPMU::SaveSelection ();
+
+	if (CPMU::GetAndClearOverflowStatus () & (1 << pThis->m_nSampleCounter))
+	{
+		CPMU::WriteEventCounter (pThis->m_nSampleCounter, -pThis->m_nSamplePeriod);
+
+		pThis->Sample (ThisCore ());
+	}
+
+	CPMU::RestoreSelection (nSelection);
+}
+
+unsigned CPMUProfiler::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
+
+double CPMUProfiler::ToDouble (u64 ulValue)
+{
+	// avoids the 64-bit conversion helper, which is not available on AArch32
+	return (double) (u32) (ulValue >> 32) * 4294967296.0 + (double) (u32) ulValue;
+}
+
+#endif
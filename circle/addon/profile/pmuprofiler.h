@@ -0,0 +1,235 @@
+//
+// pmuprofiler.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _profile_pmuprofiler_h
+#define _profile_pmuprofiler_h
+
+#include <profile/pmu.h>
+#include <circle/device.h>
+#include <circle/spinlock.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/memorymap.h>
+	#define PMU_PROFILER_CORES	CORES
+#else
+	#define PMU_PROFILER_CORES	1
+#endif
+
+#define PMU_MAX_EVENTS		5		// counted events (without cycles)
+
+extern u8 _start, _etext;
+
+struct TPMUCounts
+{
+	u32 nCycles;
+	u32 nEvent[PMU_MAX_EVENTS];
+};
+
+class CPMURegion	/// A named code region, for which PMU counts are accumulated
+{
+public:
+	/// \param pName Name of the region (must remain valid)
+	/// \note Regions register themselves in a global list and must be static objects.
+	CPMURegion (const char *pName);
+
+	const char *GetName (void) const	{ return m_pName; }
+
+	/// \brief Clear the accumulated counts
+	void Reset (void);
+
+private:
+	void Add (const TPMUCounts &rStart, const TPMUCounts &rEnd);
+
+private:
+	const char *m_pName;
+
+	struct TCoreCounts
+	{
+		unsigned nCalls;
+		u64 nCycles;
+		u64 nEvent[PMU_MAX_EVENTS];
+	};
+
+	TCoreCounts m_Counts[PMU_PROFILER_CORES];
+
+	CPMURegion *m_pNext;
+
+	static CPMURegion *s_pFirst;
+
+	friend class CPMUScope;
+	friend class CPMUProfiler;
+};
+
+/// \note The PMU must be setup with Initialize() on core 0 and InitializeSecondary() on\n
+///	  each other core to be profiled. Afterwards PMU events are counted for code regions,\n
+///	  marked with PMU_SCOPE(), and if a sample period is given, the PC is sampled on\n
+///	  overflow of a PMU counter. The event counts since the previous sample are attributed\n
+///	  to the sampled address, which gives IPC and cache misses per code address.
+/// \note Sample addresses can be mapped to functions on the host with:\n
+///	  addr2line -f -e kernel.elf ADDRESS
+
+class CPMUProfiler	/// Hardware event profiling with the ARM Performance Monitors Unit
+{
+public:
+	/// \param pEvents Events to be counted (see TPMUEvent, 0 for default set)
+	/// \param nEvents Number of events (max. PMU_MAX_EVENTS)
+	/// \param nSamplePeriod Sample the PC every nSamplePeriod events of nSampleEvent (0: off)
+	/// \param nSampleEvent Event, which triggers sampling
+	/// \note The default event set is instructions, L1D and L2D refills, branch\n
+	///	  mispredicts and frontend stalls. Events are dropped from the end of the\n
+	///	  list, if the PMU does not have enough counters (Cortex-A7 has four).
+	CPMUProfiler (const unsigned *pEvents = 0, unsigned nEvents = 0,
+		      unsigned nSamplePeriod = 0, unsigned nSampleEvent = PMUEventCycles);
+
+	~CPMUProfiler (void);
+
+	/// \brief Setup the PMU of core 0 and connect the overflow interrupt
+	/// \param nTextStart Start address of the code to be sampled
+	/// \param nTextEnd End address of the code to be sampled
+	/// \param nBucketShift Sampled addresses are collected in buckets of (1 << nBucketShift) bytes
+	boolean Initialize (uintptr nTextStart = (uintptr) &_start,
+			    uintptr nTextEnd = (uintptr) &_etext,
+			    unsigned nBucketShift = 5);
+
+	/// \brief Setup the PMU of a secondary core
+	/// \note Must be called on each secondary core to be profiled (e.g. from CMultiCoreSupport::Run())
+	void InitializeSecondary (void);
+
+	/// \brief Start accumulating counts and samples (on all cores)
+	void Start (void);
+	/// \brief Stop accumulating counts and samples (on all cores)
+	void Stop (void);
+
+	/// \brief Clear all regions and samples
+	void Reset (void);
+
+	/// \brief Write the region counts and the most frequent sample addresses to the logger
+	/// \param nMaxSamples Maximum number of sample buckets to be listed
+	void Dump (unsigned nMaxSamples = 20);
+
+	/// \brief Write all non-empty sample buckets as text lines to a device or file
+	/// \param pTarget Device to be written (e.g. CFatFsFile or CQEMUHostFile)
+	/// \return Operation successful?
+	/// \note Format: "address samples cycles event..." (one bucket per line)
+	boolean Export (CDevice *pTarget);
+
+	/// \param nEvent Event number (see TPMUEvent)
+	/// \return Short name of the event
+	static const char *GetEventName (unsigned nEvent);
+
+	/// \brief Read the cycle counter and the event counters of this core
+	static void ReadCounters (TPMUCounts *pCounts)
+	{
+		pCounts->nCycles = CPMU::ReadCycleCounter ();
+
+		for (unsigned i = 0; i < s_nEvents; i++)
+		{
+			pCounts->nEvent[i] = CPMU::ReadEventCounter (i);
+		}
+	}
+
+	static boolean IsActive (void)		{ return s_bActive; }
+
+	static CPMUProfiler *Get (void);
+
+private:
+	void SetupCore (unsigned nCore);
+
+	void Sample (unsigned nCore);
+
+	void DumpHeader (const char *pName, const char *pCount);
+	void DumpLine (const char *pName, unsigned nCalls, u64 nCycles, const u64 *pEvents);
+
+	static void InterruptHandler (void *pParam);
+
+	static unsigned ThisCore (void);
+
+	static double ToDouble (u64 ulValue);
+
+private:
+	unsigned m_nEvents;
+	unsigned m_Event[PMU_MAX_EVENTS];
+	int m_nInstructionsIndex;		// index of PMUEventInstructions or -1
+
+	unsigned m_nSamplePeriod;
+	unsigned m_nSampleEvent;
+	unsigned m_nSampleCounter;
+
+	uintptr m_nTextStart;
+	unsigned m_nBucketShift;
+	unsigned m_nBuckets;
+
+	struct TSampleBucket
+	{
+		unsigned nSamples;
+		u64 nCycles;
+		u64 nEvent[PMU_MAX_EVENTS];
+	};
+
+	TSampleBucket *m_pBucket;
+	unsigned m_nSamples;
+	unsigned m_nSamplesOutside;
+	CSpinLock m_SpinLock;
+
+	TPMUCounts m_LastSample[PMU_PROFILER_CORES];
+
+	boolean m_bInitialized;
+
+	static unsigned s_nEvents;
+	static volatile boolean s_bActive;
+
+	static CPMUProfiler *s_pThis;
+
+	friend class CPMURegion;
+};
+
+class CPMUScope		/// Counts PMU events from construction to destruction of this object
+{
+public:
+	CPMUScope (CPMURegion *pRegion)
+	:	m_pRegion (pRegion)
+	{
+		CPMUProfiler::ReadCounters (&m_Start);
+	}
+
+	~CPMUScope (void)
+	{
+		TPMUCounts End;
+		CPMUProfiler::ReadCounters (&End);
+
+		if (CPMUProfiler::IsActive ())
+		{
+			m_pRegion->Add (m_Start, End);
+		}
+	}
+
+private:
+	CPMURegion *m_pRegion;
+	TPMUCounts m_Start;
+};
+
+// Counts PMU events from here to the end of the enclosing block in the region "name"
+#define PMU_SCOPE(name)		PMU_SCOPE_ (name, __LINE__)
+#define PMU_SCOPE_(name, line)	PMU_SCOPE__ (name, line)
+#define PMU_SCOPE__(name, line)	static CPMURegion PMURegion##line (name);	\
+				CPMUScope PMUScope##line (&PMURegion##line)
+
+#endif
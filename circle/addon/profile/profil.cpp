@@ -16,6 +16,12 @@
    License along with the GNU C Library; if not, see
    <https://www.gnu.org/licenses/>.  */
 
+#ifdef __circle__
+#include <circle/sysconfig.h>
+#endif
+
+#ifndef ARM_ALLOW_MULTI_CORE	// gprof profiling supports single core programs only
+
 #ifndef __circle__
 #include <sys/types.h>
 #include <unistd.h>
@@ -157,3 +163,5 @@ __profil (u_short *sample_buffer, size_t size, size_t offset, u_int scale)
 weak_alias (__profil, profil)
 
 #endif
+
+#endif
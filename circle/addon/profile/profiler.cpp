@@ -2,7 +2,7 @@
 // profile.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2020-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -17,16 +17,15 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
+#include <circle/sysconfig.h>
+
+#ifndef ARM_ALLOW_MULTI_CORE	// see profiler.h
+
 #include <profile/profiler.h>
 #include <profile/gmon.h>
 #include <circle/devicenameservice.h>
-#include <circle/sysconfig.h>
 #include <circle/logger.h>
 
-#ifdef ARM_ALLOW_MULTI_CORE
-	#error Multi-core programs are not supported by this profile library!
-#endif
-
 static const char From[] = "prof";
 
 CProfiler::CProfiler (uintptr nTextStart, uintptr nTextEnd)
@@ -78,3 +77,5 @@ void CProfiler::SaveResults (FATFS *pFileSystem, const char *pDriveName)
 
 	CLogger::Get ()->Write (From, LogDebug, "Profiling results saved");
 }
+
+#endif
@@ -23,6 +23,11 @@
 #include <circle/fs/fat/fatfs.h>
 #include <circle/types.h>
 #include <fatfs/ff.h>
+#include <circle/sysconfig.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#error Multi-core programs are not supported by CProfiler (use CPMUProfiler instead)!
+#endif
 
 extern u8 _start, _etext;
 
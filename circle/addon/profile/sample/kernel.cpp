@@ -2,7 +2,7 @@
 // kernel.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,11 +21,17 @@
 #include "screentask.h"
 #include "primetask.h"
 #include "ledtask.h"
-#include <profile/profiler.h>
 #include <circle/string.h>
 #include <assert.h>
 
+#ifndef ARM_ALLOW_MULTI_CORE
+	#include <profile/profiler.h>
+#else
+	#include <fatfs/fatfsfile.h>
+#endif
+
 #define PARTITION	"emmc1-1"
+#define DRIVE		"SD:"
 
 static const char FromKernel[] = "kernel";
 
@@ -89,7 +95,27 @@ TShutdownMode CKernel::Run (void)
 {
 	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
 
+#ifndef ARM_ALLOW_MULTI_CORE
 	CProfiler Profiler;
+#else
+	CSamplingProfiler Profiler;
+	if (!Profiler.Initialize ())
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot initialize profiler");
+
+		return ShutdownHalt;
+	}
+
+	CSecondaryCores SecondaryCores (CMemorySystem::Get (), &Profiler);
+	if (!SecondaryCores.Initialize ())
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot start secondary cores");
+
+		return ShutdownHalt;
+	}
+
+	Profiler.Start ();
+#endif
 
 	// start tasks
 	for (unsigned nTaskID = 1; nTaskID <= 4; nTaskID++)
@@ -112,7 +138,16 @@ TShutdownMode CKernel::Run (void)
 		m_Event.Wait ();
 	}
 
+#ifndef ARM_ALLOW_MULTI_CORE
 	Profiler.SaveResults (PARTITION);
+#else
+	Profiler.Stop ();
+	SecondaryCores.Stop ();
+
+	Profiler.Dump ();
+
+	SaveResults (&Profiler);
+#endif
 
 	return ShutdownHalt;
 }
@@ -124,3 +159,80 @@ void CKernel::TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pCont
 
 	pThis->m_Event.Set ();
 }
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+void CKernel::SaveResults (CSamplingProfiler *pProfiler)
+{
+	assert (pProfiler != 0);
+
+	if (f_mount (&m_FileSystem, DRIVE, 1) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot mount drive: %s", DRIVE);
+
+		return;
+	}
+
+	CFatFsFile GmonFile (DRIVE "/GMON.OUT");
+	CFatFsFile StacksFile (DRIVE "/STACKS.TXT");
+	if (   !GmonFile.IsOpen ()
+	    || !StacksFile.IsOpen ()
+	    || !pProfiler->SaveGmon (&GmonFile)
+	    || !pProfiler->SaveFoldedStacks (&StacksFile))
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot save profiling results");
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Profiling results saved");
+	}
+}
+
+CSecondaryCores::CSecondaryCores (CMemorySystem *pMemorySystem, CSamplingProfiler *pProfiler)
+:	CMultiCoreSupport (pMemorySystem),
+	m_pProfiler (pProfiler),
+	m_bRunning (TRUE)
+{
+}
+
+CSecondaryCores::~CSecondaryCores (void)
+{
+	m_pProfiler = 0;
+}
+
+void CSecondaryCores::Run (unsigned nCore)
+{
+	if (nCore == 0)
+	{
+		return;
+	}
+
+	assert (m_pProfiler != 0);
+	m_pProfiler->InitializeSecondary ();
+
+	// count the prime numbers by trial division, until the profiling is stopped
+	while (m_bRunning)
+	{
+		volatile unsigned nPrimes = 0;
+		for (unsigned i = 2; i < 100000 && m_bRunning; i++)
+		{
+			unsigned j;
+			for (j = 2; j * j <= i && i % j != 0; j++)
+			{
+				// just loop
+			}
+
+			if (j * j > i)
+			{
+				nPrimes++;
+			}
+		}
+	}
+}
+
+void CSecondaryCores::Stop (void)
+{
+	m_bRunning = FALSE;
+}
+
+#endif
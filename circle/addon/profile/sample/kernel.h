@@ -2,7 +2,7 @@
 // kernel.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -32,8 +32,16 @@
 #include <SDCard/emmc.h>
 #include <circle/sched/scheduler.h>
 #include <circle/sched/synchronizationevent.h>
+#include <circle/sysconfig.h>
 #include <circle/types.h>
 
+#ifdef ARM_ALLOW_MULTI_CORE
+#include <circle/multicore.h>
+#include <circle/memory.h>
+#include <profile/samplingprofiler.h>
+#include <fatfs/ff.h>
+#endif
+
 enum TShutdownMode
 {
 	ShutdownNone,
@@ -41,6 +49,26 @@ enum TShutdownMode
 	ShutdownReboot
 };
 
+#ifdef ARM_ALLOW_MULTI_CORE
+
+class CSecondaryCores : public CMultiCoreSupport	// keeps the secondary cores busy
+{
+public:
+	CSecondaryCores (CMemorySystem *pMemorySystem, CSamplingProfiler *pProfiler);
+	~CSecondaryCores (void);
+
+	void Run (unsigned nCore);
+
+	void Stop (void);
+
+private:
+	CSamplingProfiler *m_pProfiler;
+
+	volatile boolean m_bRunning;
+};
+
+#endif
+
 class CKernel
 {
 public:
@@ -54,6 +82,10 @@ public:
 private:
 	static void TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext);
 
+#ifdef ARM_ALLOW_MULTI_CORE
+	void SaveResults (CSamplingProfiler *pProfiler);
+#endif
+
 private:
 	// do not change this order
 	CActLED			m_ActLED;
@@ -69,6 +101,10 @@ private:
 
 	CScheduler		m_Scheduler;
 	CSynchronizationEvent	m_Event;
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	FATFS			m_FileSystem;
+#endif
 };
 
 #endif
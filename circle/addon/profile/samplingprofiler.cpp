@@ -0,0 +1,501 @@
+//
+// samplingprofiler.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#if RASPPI >= 2
+
+#include <profile/samplingprofiler.h>
+#include <profile/gmon_out.h>
+#include <circle/interrupt.h>
+#include <circle/exceptionstub.h>
+#include <circle/bcm2835int.h>
+#include <circle/memory.h>
+#include <circle/memorymap.h>
+#include <circle/multicore.h>
+#include <circle/logger.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define EXPORT_CHUNK_SIZE	4096
+#define MAX_PROBES		32		// in stack hash table
+
+LOGMODULE ("sampprof");
+
+CSamplingProfiler *CSamplingProfiler::s_pThis = 0;
+
+CSamplingProfiler::CSamplingProfiler (unsigned nFrequency, unsigned nMaxDepth, unsigned nMaxStacks)
+:	m_nFrequency (nFrequency),
+	m_nMaxDepth (nMaxDepth),
+	m_nTimerPeriod (0),
+	m_nTextStart (0),
+	m_nTextEnd (0),
+	m_nBinShift (0),
+	m_nBins (0),
+	m_pHistogram (0),
+	m_nStackLimitLow (0),
+	m_nStackLimitHigh (0),
+	m_pStackCount (0),
+	m_pStackDepth (0),
+	m_pStackFrame (0),
+	m_bActive (FALSE),
+	m_nSamples (0),
+	m_nSamplesOutside (0),
+	m_nStacksDropped (0),
+	m_bInitialized (FALSE)
+{
+	assert (s_pThis == 0);
+	s_pThis = this;
+
+	assert (m_nFrequency > 0);
+	assert (1 <= m_nMaxDepth && m_nMaxDepth <= SAMPLING_PROFILER_MAX_DEPTH);
+
+	// size of the stack hash table must be a power of 2
+	for (m_nStackSlots = 64; m_nStackSlots < nMaxStacks; m_nStackSlots <<= 1)
+	{
+		// just shift
+	}
+}
+
+CSamplingProfiler::~CSamplingProfiler (void)
+{
+	m_bActive = FALSE;
+
+	if (m_bInitialized)
+	{
+		StopTimer ();
+
+		CInterruptSystem::Get ()->DisconnectIRQ (ARM_IRQLOCAL0_CNTV);
+	}
+
+	delete [] m_pStackFrame;
+	delete [] m_pStackDepth;
+	delete [] m_pStackCount;
+	delete [] m_pHistogram;
+
+	s_pThis = 0;
+}
+
+boolean CSamplingProfiler::Initialize (uintptr nTextStart, uintptr nTextEnd, unsigned nBinShift)
+{
+	assert (!m_bInitialized);
+	assert (ThisCore () == 0);
+
+	assert (nTextStart < nTextEnd);
+	m_nBinShift = nBinShift;
+	m_nTextStart = nTextStart & ~(((uintptr) 1 << nBinShift) - 1);
+	m_nBins = ((nTextEnd - m_nTextStart) >> nBinShift) + 1;
+	m_nTextEnd = m_nTextStart + ((uintptr) m_nBins << nBinShift);
+
+	// stacks are located above the kernel image (kernel, exception and task stacks)
+	m_nStackLimitLow = MEM_KERNEL_END;
+	m_nStackLimitHigh = CMemorySystem::Get ()->GetMemSize ();
+
+	m_pHistogram = new u32[m_nBins];
+	m_pStackCount = new unsigned[m_nStackSlots];
+	m_pStackDepth = new u8[m_nStackSlots];
+	m_pStackFrame = new uintptr[m_nStackSlots * m_nMaxDepth];
+	if (   m_pHistogram == 0
+	    || m_pStackCount == 0
+	    || m_pStackDepth == 0
+	    || m_pStackFrame == 0)
+	{
+		LOGERR ("Cannot allocate sample buffers");
+
+		return FALSE;
+	}
+
+	Reset ();
+
+	m_nTimerPeriod = GetTimerFrequency () / m_nFrequency;
+	if (m_nTimerPeriod == 0)
+	{
+		LOGERR ("Sampling rate too high (%u Hz)", m_nFrequency);
+
+		return FALSE;
+	}
+
+	// enables the virtual timer IRQ on core 0 only
+	CInterruptSystem::Get ()->ConnectIRQ (ARM_IRQLOCAL0_CNTV, InterruptHandler, this);
+
+	StartTimer ();
+
+	m_bInitialized = TRUE;
+
+	return TRUE;
+}
+
+void CSamplingProfiler::InitializeSecondary (void)
+{
+	assert (m_bInitialized);
+	assert (ThisCore () != 0);
+
+	CInterruptSystem::EnableIRQ (ARM_IRQLOCAL0_CNTV);
+
+	StartTimer ();
+}
+
+void CSamplingProfiler::Start (void)
+{
+	assert (m_bInitialized);
+
+	m_bActive = TRUE;
+}
+
+void CSamplingProfiler::Stop (void)
+{
+	m_bActive = FALSE;
+}
+
+void CSamplingProfiler::Reset (void)
+{
+	m_SpinLock.Acquire ();
+
+	memset (m_pHistogram, 0, m_nBins * sizeof (u32));
+	memset (m_pStackCount, 0, m_nStackSlots * sizeof (unsigned));
+
+	m_nSamples = 0;
+	m_nSamplesOutside = 0;
+	m_nStacksDropped = 0;
+
+	m_SpinLock.Release ();
+}
+
+void CSamplingProfiler::Dump (unsigned nMaxEntries)
+{
+	assert (m_bInitialized);
+
+	unsigned *pTop = new unsigned[nMaxEntries];
+	if (pTop == 0)
+	{
+		return;
+	}
+
+	m_SpinLock.Acquire ();
+
+	// selection of the bins with most samples
+	unsigned nTop = 0;
+	for (unsigned nBin = 0; nBin < m_nBins; nBin++)
+	{
+		u32 nCount = m_pHistogram[nBin];
+		if (   nCount == 0
+		    || (   nTop == nMaxEntries
+			&& nCount <= m_pHistogram[pTop[nTop-1]]))
+		{
+			continue;
+		}
+
+		unsigned i = nTop < nMaxEntries ? nTop++ : nTop-1;
+		for (; i > 0 && m_pHistogram[pTop[i-1]] < nCount; i--)
+		{
+			pTop[i] = pTop[i-1];
+		}
+
+		pTop[i] = nBin;
+	}
+
+	unsigned nSamples = m_nSamples;
+	unsigned nSamplesOutside = m_nSamplesOutside;
+
+	m_SpinLock.Release ();
+
+	LOGNOTE ("%u samples (%u outside the text segment, %u stacks dropped)",
+		 nSamples, nSamplesOutside, m_nStacksDropped);
+
+	for (unsigned i = 0; i < nTop; i++)
+	{
+		u32 nCount = m_pHistogram[pTop[i]];
+
+		LOGNOTE ("%08lX %8u %6.2f%%", (unsigned long) (m_nTextStart + (pTop[i] << m_nBinShift)),
+			 nCount, nSamples != 0 ? 100.0 * nCount / nSamples : 0.0);
+	}
+
+	delete [] pTop;
+}
+
+boolean CSamplingProfiler::SaveGmon (CDevice *pTarget)
+{
+	assert (m_bInitialized);
+	assert (pTarget != 0);
+
+	u8 Buffer[EXPORT_CHUNK_SIZE];
+
+	gmon_hdr Header;
+	memset (&Header, 0, sizeof Header);
+	memcpy (Header.cookie, GMON_MAGIC, sizeof Header.cookie);
+	u32 nVersion = GMON_VERSION;
+	memcpy (Header.version, &nVersion, sizeof Header.version);
+
+	// only a histogram record, the call graph arcs of gprof are call counts,
+	// which cannot be derived from samples (see SaveFoldedStacks() instead)
+	gmon_hist_hdr HistHeader;
+	memset (&HistHeader, 0, sizeof HistHeader);
+	memcpy (HistHeader.low_pc, &m_nTextStart, sizeof HistHeader.low_pc);
+	memcpy (HistHeader.high_pc, &m_nTextEnd, sizeof HistHeader.high_pc);
+	u32 nValue = m_nBins;
+	memcpy (HistHeader.hist_size, &nValue, sizeof HistHeader.hist_size);
+	nValue = m_nFrequency;
+	memcpy (HistHeader.prof_rate, &nValue, sizeof HistHeader.prof_rate);
+	strcpy (HistHeader.dimen, "seconds");
+	HistHeader.dimen_abbrev = 's';
+
+	unsigned nLength = 0;
+	memcpy (Buffer, &Header, sizeof Header);
+	nLength += sizeof Header;
+	Buffer[nLength++] = GMON_TAG_TIME_HIST;
+	memcpy (Buffer + nLength, &HistHeader, sizeof HistHeader);
+	nLength += sizeof HistHeader;
+
+	for (unsigned nBin = 0; nBin < m_nBins; nBin++)
+	{
+		// gprof uses 16-bit counters
+		u32 nCount = m_pHistogram[nBin];
+		u16 usCount = nCount <= 0xFFFF ? nCount : 0xFFFF;
+		memcpy (Buffer + nLength, &usCount, sizeof usCount);
+		nLength += sizeof usCount;
+
+		if (nLength > EXPORT_CHUNK_SIZE - sizeof usCount)
+		{
+			if (pTarget->Write (Buffer, nLength) != (int) nLength)
+			{
+				return FALSE;
+			}
+
+			nLength = 0;
+		}
+	}
+
+	return pTarget->Write (Buffer, nLength) == (int) nLength;
+}
+
+boolean CSamplingProfiler::SaveFoldedStacks (CDevice *pTarget)
+{
+	assert (m_bInitialized);
+	assert (pTarget != 0);
+
+	CString Buffer;
+	for (unsigned nSlot = 0; nSlot < m_nStackSlots; nSlot++)
+	{
+		unsigned nCount = m_pStackCount[nSlot];
+		if (nCount == 0)
+		{
+			continue;
+		}
+
+		// root first
+		const uintptr *pFrame = &m_pStackFrame[nSlot * m_nMaxDepth];
+		for (unsigned i = m_pStackDepth[nSlot]; i > 0; i--)
+		{
+			CString Frame;
+			Frame.Format (i > 1 ? "%lx;" : "%lx", (unsigned long) pFrame[i-1]);
+			Buffer.Append (Frame);
+		}
+
+		CString Count;
+		Count.Format (" %u\n", nCount);
+		Buffer.Append (Count);
+
+		if (Buffer.GetLength () >= EXPORT_CHUNK_SIZE)
+		{
+			if (pTarget->Write (Buffer, Buffer.GetLength ()) != (int) Buffer.GetLength ())
+			{
+				return FALSE;
+			}
+
+			Buffer = "";
+		}
+	}
+
+	return pTarget->Write (Buffer, Buffer.GetLength ()) == (int) Buffer.GetLength ();
+}
+
+CSamplingProfiler *CSamplingProfiler::Get (void)
+{
+	assert (s_pThis != 0);
+	return s_pThis;
+}
+
+void CSamplingProfiler::Sample (unsigned nCore)
+{
+	uintptr Frame[SAMPLING_PROFILER_MAX_DEPTH];
+	unsigned nDepth = Backtrace (nCore, Frame);
+	assert (nDepth >= 1);
+
+	u32 nHash = 2166136261U;		// FNV-1a
+	for (unsigned i = 0; i < nDepth; i++)
+	{
+		nHash = (nHash ^ (u32) Frame[i]) * 16777619U;
+	}
+
+	m_SpinLock.Acquire ();
+
+	m_nSamples++;
+
+	uintptr nPC = Frame[0];
+	if (   nPC >= m_nTextStart
+	    && nPC < m_nTextEnd)
+	{
+		m_pHistogram[(nPC - m_nTextStart) >> m_nBinShift]++;
+	}
+	else
+	{
+		m_nSamplesOutside++;
+	}
+
+	unsigned nSlot = nHash & (m_nStackSlots-1);
+	unsigned nProbe;
+	for (nProbe = 0; nProbe < MAX_PROBES; nProbe++, nSlot = (nSlot+1) & (m_nStackSlots-1))
+	{
+		uintptr *pFrame = &m_pStackFrame[nSlot * m_nMaxDepth];
+
+		if (m_pStackCount[nSlot] == 0)
+		{
+			m_pStackCount[nSlot] = 1;
+			m_pStackDepth[nSlot] = nDepth;
+			memcpy (pFrame, Frame, nDepth * sizeof (uintptr));
+
+			break;
+		}
+
+		if (   m_pStackDepth[nSlot] == nDepth
+		    && memcmp (pFrame, Frame, nDepth * sizeof (uintptr)) == 0)
+		{
+			m_pStackCount[nSlot]++;
+
+			break;
+		}
+	}
+
+	if (nProbe == MAX_PROBES)
+	{
+		m_nStacksDropped++;
+	}
+
+	m_SpinLock.Release ();
+}
+
+unsigned CSamplingProfiler::Backtrace (unsigned nCore, uintptr *pFrame)
+{
+	assert (nCore < SAMPLING_PROFILER_CORES);
+	assert (pFrame != 0);
+
+	pFrame[0] = IRQReturnAddressCore[nCore];
+	unsigned nDepth = 1;
+
+	// The frame pointer may be used as general purpose register, when the code
+	// has been built without -fno-omit-frame-pointer. Therefore it is validated,
+	// before it is dereferenced, and frames must be located at increasing addresses.
+	uintptr nFP = IRQFramePointerCore[nCore];
+	while (   nDepth < m_nMaxDepth
+	       && nFP >= m_nStackLimitLow + sizeof (uintptr)
+	       && nFP < m_nStackLimitHigh - sizeof (uintptr)
+	       && !(nFP & (sizeof (uintptr)-1)))
+	{
+		const uintptr *pRecord = (const uintptr *) nFP;
+#if AARCH == 32
+		uintptr nReturn = pRecord[0];		// GCC ARM frame: fp points to saved lr
+		uintptr nNextFP = pRecord[-1];		// saved fp below it
+#else
+		uintptr nReturn = pRecord[1];		// AAPCS64 frame record: {x29, x30}
+		uintptr nNextFP = pRecord[0];
+#endif
+
+		if (   nReturn < m_nTextStart + 4
+		    || nReturn >= m_nTextEnd)
+		{
+			break;
+		}
+
+		pFrame[nDepth++] = nReturn - 4;		// address of the call instruction
+
+		if (nNextFP <= nFP)
+		{
+			break;
+		}
+
+		nFP = nNextFP;
+	}
+
+	return nDepth;
+}
+
+void CSamplingProfiler::StartTimer (void)
+{
+	WriteTimerValue (m_nTimerPeriod);
+	WriteTimerControl (CNTV_CTL_ENABLE);
+}
+
+void CSamplingProfiler::StopTimer (void)
+{
+	WriteTimerControl (0);
+}
+
+void CSamplingProfiler::InterruptHandler (void *pParam)
+{
+	CSamplingProfiler *pThis = (CSamplingProfiler *) pParam;
+	assert (pThis != 0);
+
+	WriteTimerValue (pThis->m_nTimerPeriod);
+
+	if (pThis->m_bActive)
+	{
+		pThis->Sample (ThisCore ());
+	}
+}
+
+unsigned CSamplingProfiler::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
+
+unsigned CSamplingProfiler::GetTimerFrequency (void)
+{
+#if AARCH == 32
+	u32 nCNTFRQ;
+	asm volatile ("mrc p15, 0, %0, c14, c0, 0" : "=r" (nCNTFRQ));
+#else
+	u64 nCNTFRQ;
+	asm volatile ("mrs %0, CNTFRQ_EL0" : "=r" (nCNTFRQ));
+#endif
+
+	return nCNTFRQ;
+}
+
+void CSamplingProfiler::WriteTimerValue (u32 nValue)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c14, c3, 0" :: "r" (nValue));
+#else
+	asm volatile ("msr CNTV_TVAL_EL0, %0" :: "r" ((u64) nValue));
+#endif
+}
+
+void CSamplingProfiler::WriteTimerControl (u32 nValue)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c14, c3, 1" :: "r" (nValue));
+#else
+	asm volatile ("msr CNTV_CTL_EL0, %0" :: "r" ((u64) nValue));
+#endif
+}
+
+#endif
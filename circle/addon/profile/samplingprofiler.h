@@ -0,0 +1,152 @@
+//
+// samplingprofiler.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _profile_samplingprofiler_h
+#define _profile_samplingprofiler_h
+
+#include <circle/device.h>
+#include <circle/spinlock.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#if RASPPI == 1
+	#error The sampling profiler is supported on Raspberry Pi 2 and newer only!
+#endif
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/memorymap.h>
+	#define SAMPLING_PROFILER_CORES	CORES
+#else
+	#define SAMPLING_PROFILER_CORES	1
+#endif
+
+#define SAMPLING_PROFILER_MAX_DEPTH	32
+
+extern u8 _start, _etext;
+
+/// \note The interrupted PC is sampled on each core at a fixed rate, using the virtual\n
+///	  timer of the ARM generic timer as IRQ source. A backtrace is taken by following\n
+///	  the frame pointer chain, which requires the code to be built with:\n
+///	  CFLAGS += -fno-omit-frame-pointer\n
+///	  Without, only the PC is recorded reliably.
+/// \note Samples are aggregated into a PC histogram, which can be saved as gmon.out for\n
+///	  gprof (flat profile only), and into a table of unique backtraces, which can be\n
+///	  saved as folded stacks for flame graphs (see addon/profile/foldsym.py).
+/// \note IRQ handlers and code with disabled IRQs cannot be sampled before IRQs are\n
+///	  enabled again.
+
+class CSamplingProfiler		/// Statistical PC sampling profiler for all cores
+{
+public:
+	/// \param nFrequency Sampling rate per core in Hz
+	/// \param nMaxDepth Maximum number of frames per backtrace (1 for PC only)
+	/// \param nMaxStacks Maximum number of unique backtraces to be recorded
+	CSamplingProfiler (unsigned nFrequency = 1000, unsigned nMaxDepth = 8,
+			   unsigned nMaxStacks = 4096);
+
+	~CSamplingProfiler (void);
+
+	/// \brief Setup the sampling timer of core 0
+	/// \param nTextStart Start address of the code to be sampled
+	/// \param nTextEnd End address of the code to be sampled
+	/// \param nBinShift The PC histogram has a bin per (1 << nBinShift) bytes
+	boolean Initialize (uintptr nTextStart = (uintptr) &_start,
+			    uintptr nTextEnd = (uintptr) &_etext,
+			    unsigned nBinShift = 2);
+
+	/// \brief Setup the sampling timer of a secondary core
+	/// \note Must be called on each secondary core to be profiled (e.g. from CMultiCoreSupport::Run())
+	void InitializeSecondary (void);
+
+	/// \brief Start sampling (on all cores)
+	void Start (void);
+	/// \brief Stop sampling (on all cores)
+	void Stop (void);
+
+	/// \brief Clear all samples
+	void Reset (void);
+
+	/// \return Number of samples taken
+	unsigned GetSamples (void) const	{ return m_nSamples; }
+
+	/// \brief Write the most frequent PC histogram bins to the logger
+	/// \param nMaxEntries Maximum number of bins to be listed
+	void Dump (unsigned nMaxEntries = 20);
+
+	/// \brief Save the PC histogram in gmon.out format
+	/// \param pTarget Device to be written (e.g. CFatFsFile or CQEMUHostFile)
+	/// \return Operation successful?
+	boolean SaveGmon (CDevice *pTarget);
+
+	/// \brief Save the backtraces as folded stacks ("addr;addr;addr count" per line)
+	/// \param pTarget Device to be written (e.g. CFatFsFile or CQEMUHostFile)
+	/// \return Operation successful?
+	boolean SaveFoldedStacks (CDevice *pTarget);
+
+	static CSamplingProfiler *Get (void);
+
+private:
+	void Sample (unsigned nCore);
+
+	unsigned Backtrace (unsigned nCore, uintptr *pFrame);
+
+	void StartTimer (void);
+	static void StopTimer (void);
+
+	static void InterruptHandler (void *pParam);
+
+	static unsigned ThisCore (void);
+
+	static unsigned GetTimerFrequency (void);
+	static void WriteTimerValue (u32 nValue);
+	static void WriteTimerControl (u32 nValue);
+
+	static const u32 CNTV_CTL_ENABLE = 1 << 0;
+
+private:
+	unsigned m_nFrequency;
+	unsigned m_nMaxDepth;
+	unsigned m_nStackSlots;
+	unsigned m_nTimerPeriod;
+
+	uintptr m_nTextStart;
+	uintptr m_nTextEnd;
+	unsigned m_nBinShift;
+	unsigned m_nBins;
+	u32 *m_pHistogram;
+
+	uintptr m_nStackLimitLow;
+	uintptr m_nStackLimitHigh;
+
+	unsigned *m_pStackCount;		// 0 for empty slot
+	u8 *m_pStackDepth;
+	uintptr *m_pStackFrame;			// m_nMaxDepth entries per slot, leaf first
+
+	volatile boolean m_bActive;
+	unsigned m_nSamples;
+	unsigned m_nSamplesOutside;
+	unsigned m_nStacksDropped;
+	CSpinLock m_SpinLock;
+
+	boolean m_bInitialized;
+
+	static CSamplingProfiler *s_pThis;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // bcm4343.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2020-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2020-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -115,7 +115,7 @@ boolean CBcm4343Device::SendFrame (const void *pBuffer, unsigned nLength)
 boolean CBcm4343Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 {
 	assert (pBuffer != 0);
-	unsigned nLength = m_RxQueue.Dequeue (pBuffer);
+	unsigned nLength = m_RxQueue.Dequeue (pBuffer, FRAME_BUFFER_SIZE);
 	if (nLength == 0)
 	{
 		return FALSE;
@@ -163,7 +163,7 @@ boolean CBcm4343Device::Control (const char *pFormat, ...)
 boolean CBcm4343Device::ReceiveScanResult (void *pBuffer, unsigned *pResultLength)
 {
 	assert (pBuffer != 0);
-	unsigned nLength = m_ScanResultQueue.Dequeue (pBuffer);
+	unsigned nLength = m_ScanResultQueue.Dequeue (pBuffer, FRAME_BUFFER_SIZE);
 	if (nLength == 0)
 	{
 		return FALSE;
@@ -27,8 +27,13 @@
 #define GIC_SPI(n)		(32 + (n))	// shared between cores
 
 // IRQs
+#define ARM_IRQLOCAL0_CNTV	GIC_PPI (11)
 #define ARM_IRQLOCAL0_CNTPNS	GIC_PPI (14)
 
+#define ARM_IRQ_PMU0		GIC_SPI (16)	// private to core 0
+#define ARM_IRQ_PMU1		GIC_SPI (17)	// private to core 1
+#define ARM_IRQ_PMU2		GIC_SPI (18)	// private to core 2
+#define ARM_IRQ_PMU3		GIC_SPI (19)	// private to core 3
 #define ARM_IRQ_ARM_DOORBELL_0	GIC_SPI (34)
 #define ARM_IRQ_TIMER1		GIC_SPI (65)
 #define ARM_IRQ_DMA0		GIC_SPI (80)
@@ -8,7 +8,7 @@
 //	Licensed under GPLv2
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -83,9 +83,14 @@ public:
 	boolean IsSendFrameAdvisable (void);
 
 	boolean SendFrame (const void *pBuffer, unsigned nLength);
+	boolean SendFrame (const void *pBuffer, unsigned nLength, const TNetFrameInfo &rInfo);
 
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
+	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength, TNetFrameInfo *pInfo);
+
+	// returns NET_OFFLOAD_* flags (TCP/UDP checksum offload)
+	u32 GetOffloadCapabilities (void);
 
 	// returns TRUE if PHY link is up
 	boolean IsLinkUp (void);
@@ -102,6 +107,9 @@ private:
 	void init_umac(void);
 	void umac_enable_set(u32 mask, bool enable);
 
+	// checksum offload
+	void init_offload(void);
+
 	// interrupt disable/enable
 	void intr_disable(void);
 	void enable_tx_intr(void);
@@ -0,0 +1,140 @@
+//
+// checksum.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_checksum_h
+#define _circle_checksum_h
+
+#include <circle/types.h>
+
+/// \note All checksum classes support a streaming interface: Reset() the object (done
+///	  by the constructor), call Update() for any number of data chunks of any size and
+///	  get the result with Get(). Get() does not modify the state, so Update() may be
+///	  continued afterwards. Calculate() can be used to checksum a single buffer.
+///
+/// \note On AArch64 the CRC classes use the ARMv8 CRC32 instructions and CAdler32
+///	  uses NEON. On AArch32 portable table driven (slicing-by-4) or scalar code is used.
+
+class CCRC32		/// CRC-32 (IEEE 802.3, polynomial 0x04C11DB7, as used by Ethernet, zlib, PNG)
+{
+public:
+	CCRC32 (void);
+
+	/// \brief Restart calculation
+	void Reset (void);
+
+	/// \brief Add data to the checksum
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	void Update (const void *pBuffer, size_t nLength);
+
+	/// \return CRC of the data, which was added since the last Reset()
+	u32 Get (void) const;
+
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	/// \return CRC of the data
+	static u32 Calculate (const void *pBuffer, size_t nLength);
+
+private:
+	u32 m_nCRC;
+};
+
+class CCRC32C		/// CRC-32C (Castagnoli, polynomial 0x1EDC6F41, as used by iSCSI, SCTP, ext4)
+{
+public:
+	CCRC32C (void);
+
+	/// \brief Restart calculation
+	void Reset (void);
+
+	/// \brief Add data to the checksum
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	void Update (const void *pBuffer, size_t nLength);
+
+	/// \return CRC of the data, which was added since the last Reset()
+	u32 Get (void) const;
+
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	/// \return CRC of the data
+	static u32 Calculate (const void *pBuffer, size_t nLength);
+
+private:
+	u32 m_nCRC;
+};
+
+class CAdler32		/// Adler-32 checksum (RFC 1950, as used by zlib)
+{
+public:
+	CAdler32 (void);
+
+	/// \brief Restart calculation
+	void Reset (void);
+
+	/// \brief Add data to the checksum
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	void Update (const void *pBuffer, size_t nLength);
+
+	/// \return Checksum of the data, which was added since the last Reset()
+	u32 Get (void) const;
+
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	/// \return Checksum of the data
+	static u32 Calculate (const void *pBuffer, size_t nLength);
+
+private:
+	u32 m_nSum1;
+	u32 m_nSum2;
+};
+
+class CFletcher32	/// Fletcher-32 checksum over 16-bit little-endian words
+{
+public:
+	CFletcher32 (void);
+
+	/// \brief Restart calculation
+	void Reset (void);
+
+	/// \brief Add data to the checksum
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	/// \note Chunks may have an odd length, the data is treated as one continuous stream.
+	void Update (const void *pBuffer, size_t nLength);
+
+	/// \return Checksum of the data, which was added since the last Reset()
+	/// \note If the total length is odd, the last byte is padded with a zero byte.
+	u32 Get (void) const;
+
+	/// \param pBuffer Pointer to the data
+	/// \param nLength Length of the data in bytes
+	/// \return Checksum of the data
+	static u32 Calculate (const void *pBuffer, size_t nLength);
+
+private:
+	u32 m_nSum1;
+	u32 m_nSum2;
+
+	boolean m_bOddByte;		// a byte of an incomplete word is pending
+	u8 m_uchOddByte;
+};
+
+#endif
@@ -0,0 +1,174 @@
+//
+// deferredwork.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_deferredwork_h
+#define _circle_deferredwork_h
+
+#include <circle/spinlock.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/memorymap.h>
+	#define DEFERRED_WORK_CORES	CORES
+#else
+	#define DEFERRED_WORK_CORES	1
+#endif
+
+#define DEFERRED_WORK_THIS_CORE	((unsigned) -1)
+
+typedef void TDeferredWorkHandler (void *pParam);
+
+typedef void TDeferredWorkNotificationHandler (void *pParam);
+
+enum TDeferredWorkLevel
+{
+	DeferredWorkTask,	///< Run on TASK_LEVEL by CDeferredWork::Process() (e.g. from CDeferredWorkTask)
+	DeferredWorkIRQ,	///< Run on exit from the IRQ handler, with IRQs enabled (AArch64 only),\n
+				///< CurrentExecutionLevel() returns IRQ_LEVEL in any case
+	DeferredWorkLevels
+};
+
+class CDeferredWork;
+
+class CDeferredWorkItem		/// A unit of work, which is queued from interrupt context and run later
+{
+public:
+	/// \param pHandler Handler to be called, when this item is run
+	/// \param pParam   User parameter to be handed over to the handler
+	/// \param pName    Name of this item in the statistics (must remain valid)
+	/// \param Level    Level on which this item is run
+	CDeferredWorkItem (TDeferredWorkHandler *pHandler, void *pParam = 0,
+			   const char *pName = "work", TDeferredWorkLevel Level = DeferredWorkTask);
+
+	~CDeferredWorkItem (void);
+
+	/// \brief Queue this item for execution
+	/// \param nCore Core on which the item is run (DeferredWorkTask only, default: this core)
+	/// \return FALSE, if the item was already queued (it will run only once then)
+	/// \note Can be called from IRQ_LEVEL or TASK_LEVEL.
+	boolean Queue (unsigned nCore = DEFERRED_WORK_THIS_CORE);
+
+	/// \return Has this item been queued, but is not run yet?
+	boolean IsQueued (void) const		{ return m_bQueued; }
+
+	/// \return Number of times this item has been run
+	unsigned GetRuns (void) const		{ return m_nRuns; }
+	/// \return Maximum time from queueing until start of the handler in microseconds
+	unsigned GetMaxLatency (void) const	{ return m_nMaxLatency; }
+	/// \return Average time from queueing until start of the handler in microseconds
+	unsigned GetAvgLatency (void) const;
+	/// \return Maximum run time of the handler in microseconds
+	unsigned GetMaxRunTime (void) const	{ return m_nMaxRunTime; }
+
+private:
+	TDeferredWorkHandler *m_pHandler;
+	void *m_pParam;
+	const char *m_pName;
+	TDeferredWorkLevel m_Level;
+
+	volatile boolean m_bQueued;
+	unsigned m_nQueuedTicks;
+	CDeferredWorkItem *m_pNext;		// in queue
+
+	// updated atomically, an item may run on multiple cores concurrently
+	volatile unsigned m_nRuns;
+	volatile unsigned m_nMaxLatency;
+	volatile unsigned m_nMaxRunTime;
+	volatile unsigned m_nLatencyAccu;		// for average latency
+	volatile unsigned m_nLatencySamples;
+
+	CDeferredWorkItem *m_pNextItem;		// in list of all items (for statistics)
+	CDeferredWorkItem *m_pPrevItem;
+
+	friend class CDeferredWork;
+};
+
+class CDeferredWork	/// Runs work items, which have been queued from interrupt context, on a lower level
+{
+public:
+	CDeferredWork (void);
+	~CDeferredWork (void);
+
+	/// \brief Run pending DeferredWorkTask items of this core
+	/// \param nMaxItems Maximum number of items to run in this batch (0 for all pending)
+	/// \return Number of items, which have been run
+	/// \note Must be called on TASK_LEVEL. On core 0 this is done by CDeferredWorkTask,
+	///	  if the scheduler is used, secondary cores have to call it from their own loop.
+	unsigned Process (unsigned nMaxItems = 0);
+
+	/// \param pHandler Called (from IRQ context too), when a DeferredWorkTask item is queued\n
+	///		    on an empty queue of the given core
+	/// \param pParam   User parameter to be handed over to the handler
+	/// \param nCore    Core, for which this handler is registered (default: this core)
+	void RegisterNotificationHandler (TDeferredWorkNotificationHandler *pHandler, void *pParam = 0,
+					  unsigned nCore = DEFERRED_WORK_THIS_CORE);
+
+	/// \brief Dump statistics of all work items and batches to the logger
+	void Dump (void);
+
+	/// \brief Called on exit from the IRQ handler to run DeferredWorkIRQ items
+	static void InterruptExit (void);
+
+	/// \return Are DeferredWorkIRQ items run on this core at the moment?
+	/// \note Used by CurrentExecutionLevel() on AArch64, where IRQs are enabled then.
+	static boolean IsIRQWorkActive (void);
+
+	/// \return Pointer to the only CDeferredWork object in the system (0 if not available)
+	static CDeferredWork *Get (void);
+
+private:
+	boolean Enqueue (CDeferredWorkItem *pItem, unsigned nCore);
+	friend class CDeferredWorkItem;
+
+	unsigned Run (unsigned nCore, TDeferredWorkLevel Level, unsigned nMaxItems);
+
+	static void AddItem (CDeferredWorkItem *pItem);
+	static void RemoveItem (CDeferredWorkItem *pItem);
+
+	static unsigned ThisCore (void);
+
+	static void AtomicMax (volatile unsigned *pValue, unsigned nValue);
+
+private:
+	struct TQueue
+	{
+		CDeferredWorkItem *pFirst;
+		CDeferredWorkItem *pLast;
+	};
+
+	TQueue m_Queue[DEFERRED_WORK_CORES][DeferredWorkLevels];
+	CSpinLock m_SpinLock[DEFERRED_WORK_CORES];
+
+	TDeferredWorkNotificationHandler *m_pNotificationHandler[DEFERRED_WORK_CORES];
+	void *m_pNotificationParam[DEFERRED_WORK_CORES];
+
+	volatile boolean m_bInIRQWork[DEFERRED_WORK_CORES];
+
+	// per core and level, so that each counter is updated by one context only
+	unsigned m_nBatches[DEFERRED_WORK_CORES][DeferredWorkLevels];
+	unsigned m_nMaxBatchSize[DEFERRED_WORK_CORES][DeferredWorkLevels];
+
+	static CDeferredWorkItem *s_pFirstItem;
+	static CSpinLock s_ItemListSpinLock;
+
+	static CDeferredWork *s_pThis;
+};
+
+#endif
@@ -0,0 +1,174 @@
+//
+// deflate.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_deflate_h
+#define _circle_deflate_h
+
+#include <circle/inflate.h>
+#include <circle/checksum.h>
+#include <circle/types.h>
+
+#define DEFLATE_WINDOW_SIZE	32768
+#define DEFLATE_HASH_BITS	14
+#define DEFLATE_MAX_SYMBOLS	8192			// per block
+#define DEFLATE_PENDING_SIZE	(DEFLATE_WINDOW_SIZE + 1024)
+
+/// \note The working memory of CDeflater is part of the object (about 230 KB), no memory
+///	  is allocated while processing data. The object may be reused after Reset().
+///
+/// \note Each block is encoded with a dynamic or the fixed Huffman code or is stored,
+///	  whatever is shorter.
+
+struct TDeflateHuffmanCode
+{
+	u16 Code[288];				// bit-reversed for output LSB first
+	u8 Length[288];
+};
+
+class CDeflater		/// Streaming compressor for data in deflate, zlib or gzip format
+{
+public:
+	/// \param Format Format of the compressed data (CompressionFormatAuto is not allowed)
+	/// \param nLevel Compression level (0: store only, 1: fastest .. 9: best compression)
+	CDeflater (TCompressionFormat Format = CompressionFormatZlib, unsigned nLevel = 6);
+
+	~CDeflater (void);
+
+	/// \brief Restart with a new stream
+	void Reset (void);
+
+	/// \brief Compress data
+	/// \param pInput Pointer to the uncompressed input data
+	/// \param nInputLength Number of available input bytes
+	/// \param pInputUsed Number of consumed input bytes is returned here
+	/// \param pOutput Pointer to the buffer for the compressed data
+	/// \param nOutputSize Size of the output buffer in bytes
+	/// \param pOutputUsed Number of produced output bytes is returned here
+	/// \param bFinish Set to TRUE, if pInput contains the last data of the stream
+	/// \return CompressionStatusOK, if more input is needed or the output buffer is full,\n
+	///	    CompressionStatusStreamEnd, if the stream has been finished and written completely
+	/// \note Input bytes, which have not been consumed, have to be passed again on the next call.
+	///	  Once bFinish has been set, it has to be set on all following calls too.
+	TCompressionStatus Process (const void *pInput, size_t nInputLength, size_t *pInputUsed,
+				    void *pOutput, size_t nOutputSize, size_t *pOutputUsed,
+				    boolean bFinish = FALSE);
+
+	/// \return Total number of uncompressed bytes since Reset()
+	u64 GetTotalInput (void) const;
+
+	/// \brief Compress a complete buffer at once
+	/// \param pInput Pointer to the uncompressed data
+	/// \param nInputLength Length of the uncompressed data in bytes
+	/// \param pOutput Pointer to the buffer for the compressed data
+	/// \param nOutputSize Size of the output buffer in bytes
+	/// \param Format Format of the compressed data
+	/// \param nLevel Compression level (0..9)
+	/// \return Length of the compressed data, or -1 if the buffer is too small
+	static int Compress (const void *pInput, size_t nInputLength,
+			     void *pOutput, size_t nOutputSize,
+			     TCompressionFormat Format = CompressionFormatZlib, unsigned nLevel = 6);
+
+private:
+	void FlushPending (void);
+	boolean FillWindow (void);		// returns FALSE, if the current block must be emitted
+	void DeflateStep (void);
+	unsigned FindMatch (unsigned *pDistance);
+	void InsertString (unsigned nPos);
+	static unsigned Hash (const u8 *pString);
+
+	void WriteHeader (void);
+	void WriteTrailer (void);
+	void EmitBlock (boolean bLast);
+	void EmitStoredBlock (boolean bLast);
+	void EmitDynamicHeader (unsigned nLitLenCodes, unsigned nDistanceCodes,
+				unsigned nCodeLengthCodes);
+	void EmitSymbols (const TDeflateHuffmanCode &rLitLenCode,
+			  const TDeflateHuffmanCode &rDistanceCode);
+
+	void BuildCode (const u16 *pFrequency, unsigned nSymbols, unsigned nMaxLength,
+			TDeflateHuffmanCode *pCode);
+	void EncodeCodeLengths (unsigned nLitLenCodes, unsigned nDistanceCodes);
+
+	void PutBits (u32 nValue, unsigned nBits);
+	void PutByte (u8 uchByte);
+	void AlignBits (void);
+
+private:
+	enum TState
+	{
+		StateHeader,
+		StateData,
+		StateDone
+	};
+
+	TCompressionFormat m_Format;
+	unsigned m_nLevel;
+	unsigned m_nMaxChain;			// depends on the compression level
+	unsigned m_nNiceLength;
+	TState m_State;
+
+	const u8 *m_pIn;			// valid during Process()
+	const u8 *m_pInEnd;
+
+	u8 m_Window[2 * DEFLATE_WINDOW_SIZE];
+	unsigned m_nStrStart;			// position of the current string in m_Window
+	unsigned m_nLookahead;			// valid bytes after m_nStrStart
+	unsigned m_nBlockStart;			// position of the first byte of the current block
+
+	u16 m_Head[1 << DEFLATE_HASH_BITS];	// most recent position of each hash value
+	u16 m_Prev[DEFLATE_WINDOW_SIZE];	// previous position with the same hash value
+
+	unsigned m_nSymbols;			// in current block
+	u16 m_SymbolLitLen[DEFLATE_MAX_SYMBOLS];	// literal or match length
+	u16 m_SymbolDistance[DEFLATE_MAX_SYMBOLS];	// 0 for literal
+
+	u16 m_LitLenFrequency[288];		// statistics of the current block
+	u16 m_DistanceFrequency[30];
+	unsigned m_nExtraBits;
+
+	TDeflateHuffmanCode m_LitLenCode;	// dynamic codes of the current block
+	TDeflateHuffmanCode m_DistanceCode;
+	TDeflateHuffmanCode m_CodeLengthCode;
+	u16 m_CodeLengthFrequency[19];
+	u8 m_CodeLengths[286+30];
+	unsigned m_nCodeLengthSymbols;
+	u8 m_CodeLengthSymbol[286+30];		// run-length encoded code lengths
+	u8 m_CodeLengthExtra[286+30];
+
+	u32 m_TreeFrequency[2*288];		// temporary, used by BuildCode()
+	u16 m_TreeParent[2*288];
+	u8 m_TreeDepth[2*288];
+	u16 m_TreeSymbol[288];
+
+	u8 m_Pending[DEFLATE_PENDING_SIZE];	// compressed data, not yet written to the output
+	unsigned m_nPendingStart;
+	unsigned m_nPendingLength;
+	u32 m_nBitBuffer;
+	unsigned m_nBitCount;
+
+	u8 *m_pOut;				// valid during Process()
+	u8 *m_pOutEnd;
+
+	u64 m_nTotalInput;
+
+	CAdler32 m_Adler32;
+	CCRC32 m_CRC32;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // devicenameservice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,12 +21,14 @@
 #define _circle_devicenameservice_h
 
 #include <circle/device.h>
+#include <circle/hashmap.h>
+#include <circle/intrusivelist.h>
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
 struct TDeviceInfo
 {
-	TDeviceInfo	*pNext;
+	TIntrusiveListLink<TDeviceInfo> Link;
 	char		*pName;
 	CDevice		*pDevice;
 	boolean		 bBlockDevice;
@@ -74,7 +76,9 @@ public:
 	static CDeviceNameService *Get (void);
 
 private:
-	TDeviceInfo *m_pList;
+	CIntrusiveList<TDeviceInfo, &TDeviceInfo::Link> m_List;	// for ListDevices()
+
+	CHashMap<const char *, TDeviceInfo *> m_Map[2];		// index is bBlockDevice
 
 	CSpinLock m_SpinLock;
 
@@ -148,6 +148,8 @@ PACKED;
 extern TFIQData FIQData;
 
 extern uintptr IRQReturnAddress;		// for profiling
+extern uintptr IRQReturnAddressCore[];		// for profiling (per core)
+extern uintptr IRQFramePointerCore[];		// for profiling (per core)
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,405 @@
+//
+// hashmap.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_hashmap_h
+#define _circle_hashmap_h
+
+#include <circle/util.h>
+#include <circle/types.h>
+#include <assert.h>
+
+/// \brief Hash and compare functions for keys of type TKey
+/// \note The default works for integer and enum types. There are specializations for
+///	  pointers and C strings (const char *). Other key types need own traits.
+template <class TKey>
+struct THashTraits
+{
+	static u32 Hash (const TKey &Key)
+	{
+		u64 nKey = (u64) Key;
+
+		return HashWord ((u32) nKey ^ HashWord ((u32) (nKey >> 32)));
+	}
+
+	static boolean Equal (const TKey &Key1, const TKey &Key2)
+	{
+		return Key1 == Key2;
+	}
+
+	/// \brief Mixes all bits of a 32-bit word
+	static u32 HashWord (u32 nWord)
+	{
+		nWord ^= nWord >> 16;
+		nWord *= 0x7FEB352DU;
+		nWord ^= nWord >> 15;
+		nWord *= 0x846CA68BU;
+		nWord ^= nWord >> 16;
+
+		return nWord;
+	}
+};
+
+template <class T>
+struct THashTraits<T *>
+{
+	static u32 Hash (T * const &pKey)
+	{
+		return THashTraits<uintptr>::Hash ((uintptr) pKey);
+	}
+
+	static boolean Equal (T * const &pKey1, T * const &pKey2)
+	{
+		return pKey1 == pKey2;
+	}
+};
+
+template <>
+struct THashTraits<const char *>
+{
+	static u32 Hash (const char * const &pKey)	// FNV-1a
+	{
+		u32 nHash = 2166136261U;
+		for (const char *p = pKey; *p != '\0'; p++)
+		{
+			nHash ^= (u8) *p;
+			nHash *= 16777619U;
+		}
+
+		return nHash;
+	}
+
+	static boolean Equal (const char * const &pKey1, const char * const &pKey2)
+	{
+		return strcmp (pKey1, pKey2) == 0;
+	}
+};
+
+/// \brief Hash map with open addressing and linear probing
+/// \note Entries are stored in a single array of slots, there is no allocation per entry.\n
+///	  The array is allocated on the first insert and grows, when it is 3/4 full.
+///	  Initialize it with a sufficient capacity and call Reserve(), if inserts must not\n
+///	  allocate memory.\n
+///	  TKey and TValue must be simple types (integers, pointers, POD structs).\n
+///	  The map is not thread-safe, the user has to provide locking.
+template <class TKey, class TValue, class TTraits = THashTraits<TKey> >
+class CHashMap
+{
+public:
+	/// \param nCapacity Initial number of slots (will be rounded up to a power of 2)
+	CHashMap (unsigned nCapacity = 16);
+	~CHashMap (void);
+
+	/// \brief Allocate the slot array now, instead of on the first insert
+	/// \note Afterwards up to 3/4 of the capacity can be inserted without allocation.
+	void Reserve (void);
+
+	/// \brief Insert an entry or replace the value of an existing entry
+	/// \param Key   Key of the entry
+	/// \param Value Value of the entry
+	void Set (const TKey &Key, const TValue &Value);
+
+	/// \param Key Key to look for
+	/// \return Pointer to the value of the entry or 0 if not found
+	TValue *Find (const TKey &Key);
+
+	/// \param Key Key of the entry to be removed
+	/// \return TRUE if the entry has been found and removed
+	boolean Remove (const TKey &Key);
+
+	/// \brief Remove all entries
+	void RemoveAll (void);
+
+	/// \return Number of entries in the map
+	unsigned GetCount (void) const		{ return m_nCount; }
+
+	/// \brief Iterate over all entries in undefined order
+	/// \return Slot number of the first entry or -1 if map is empty
+	/// \note The map must not be modified during iteration.
+	int GetFirst (void) const		{ return GetNext (-1); }
+	/// \param nSlot Slot number returned by GetFirst() or GetNext()
+	/// \return Slot number of the next entry or -1 if no more entries
+	int GetNext (int nSlot) const;
+
+	/// \param nSlot Slot number returned by GetFirst() or GetNext()
+	const TKey &GetKey (int nSlot) const;
+	/// \param nSlot Slot number returned by GetFirst() or GetNext()
+	TValue &GetValue (int nSlot);
+
+private:
+	struct TSlot
+	{
+		u32	nHash;			// 0 if slot is not used
+		TKey	Key;
+		TValue	Value;
+	};
+
+	static u32 HashOf (const TKey &Key)
+	{
+		u32 nHash = TTraits::Hash (Key);
+
+		return nHash != 0 ? nHash : 1;
+	}
+
+	unsigned Lookup (const TKey &Key, u32 nHash) const;	// returns m_nCapacity if not found
+	void Resize (unsigned nCapacity);
+
+	CHashMap (const CHashMap &) = delete;
+	CHashMap &operator= (const CHashMap &) = delete;
+
+private:
+	TSlot	 *m_pSlot;
+	unsigned  m_nCapacity;			// power of 2
+	unsigned  m_nCount;
+};
+
+template <class TKey, class TValue, class TTraits>
+CHashMap<TKey, TValue, TTraits>::CHashMap (unsigned nCapacity)
+:	m_pSlot (0),
+	m_nCapacity (4),
+	m_nCount (0)
+{
+	while (m_nCapacity < nCapacity)
+	{
+		m_nCapacity <<= 1;
+	}
+}
+
+template <class TKey, class TValue, class TTraits>
+CHashMap<TKey, TValue, TTraits>::~CHashMap (void)
+{
+	delete [] m_pSlot;
+	m_pSlot = 0;
+}
+
+template <class TKey, class TValue, class TTraits>
+void CHashMap<TKey, TValue, TTraits>::Reserve (void)
+{
+	if (m_pSlot == 0)
+	{
+		Resize (m_nCapacity);
+	}
+}
+
+template <class TKey, class TValue, class TTraits>
+void CHashMap<TKey, TValue, TTraits>::Set (const TKey &Key, const TValue &Value)
+{
+	if (m_pSlot == 0)
+	{
+		Resize (m_nCapacity);
+	}
+
+	u32 nHash = HashOf (Key);
+	unsigned nSlot = Lookup (Key, nHash);
+	if (nSlot < m_nCapacity)
+	{
+		m_pSlot[nSlot].Value = Value;
+
+		return;
+	}
+
+	if ((m_nCount+1) * 4 > m_nCapacity * 3)
+	{
+		Resize (m_nCapacity * 2);
+	}
+
+	unsigned nMask = m_nCapacity-1;
+	for (nSlot = nHash & nMask; m_pSlot[nSlot].nHash != 0; nSlot = (nSlot+1) & nMask)
+	{
+		// just probing
+	}
+
+	m_pSlot[nSlot].nHash = nHash;
+	m_pSlot[nSlot].Key = Key;
+	m_pSlot[nSlot].Value = Value;
+
+	m_nCount++;
+}
+
+template <class TKey, class TValue, class TTraits>
+TValue *CHashMap<TKey, TValue, TTraits>::Find (const TKey &Key)
+{
+	if (m_nCount == 0)
+	{
+		return 0;
+	}
+
+	unsigned nSlot = Lookup (Key, HashOf (Key));
+	if (nSlot >= m_nCapacity)
+	{
+		return 0;
+	}
+
+	return &m_pSlot[nSlot].Value;
+}
+
+template <class TKey, class TValue, class TTraits>
+boolean CHashMap<TKey, TValue, TTraits>::Remove (const TKey &Key)
+{
+	if (m_nCount == 0)
+	{
+		return FALSE;
+	}
+
+	unsigned nSlot = Lookup (Key, HashOf (Key));
+	if (nSlot >= m_nCapacity)
+	{
+		return FALSE;
+	}
+
+	// backward shift deletion: move following entries of the probe sequence into the
+	// hole, unless their home slot is cyclically behind the hole and before them
+	unsigned nMask = m_nCapacity-1;
+	unsigned nNext = nSlot;
+	while (1)
+	{
+		nNext = (nNext+1) & nMask;
+		if (m_pSlot[nNext].nHash == 0)
+		{
+			break;
+		}
+
+		unsigned nHome = m_pSlot[nNext].nHash & nMask;
+		if (  nSlot <= nNext
+		    ? nSlot < nHome && nHome <= nNext
+		    : nSlot < nHome || nHome <= nNext)
+		{
+			continue;
+		}
+
+		m_pSlot[nSlot] = m_pSlot[nNext];
+		nSlot = nNext;
+	}
+
+	m_pSlot[nSlot].nHash = 0;
+
+	m_nCount--;
+
+	return TRUE;
+}
+
+template <class TKey, class TValue, class TTraits>
+void CHashMap<TKey, TValue, TTraits>::RemoveAll (void)
+{
+	if (m_pSlot != 0)
+	{
+		for (unsigned i = 0; i < m_nCapacity; i++)
+		{
+			m_pSlot[i].nHash = 0;
+		}
+	}
+
+	m_nCount = 0;
+}
+
+template <class TKey, class TValue, class TTraits>
+int CHashMap<TKey, TValue, TTraits>::GetNext (int nSlot) const
+{
+	if (m_nCount == 0)
+	{
+		return -1;
+	}
+
+	for (unsigned i = nSlot+1; i < m_nCapacity; i++)
+	{
+		if (m_pSlot[i].nHash != 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+template <class TKey, class TValue, class TTraits>
+const TKey &CHashMap<TKey, TValue, TTraits>::GetKey (int nSlot) const
+{
+	assert (0 <= nSlot && (unsigned) nSlot < m_nCapacity);
+	assert (m_pSlot[nSlot].nHash != 0);
+
+	return m_pSlot[nSlot].Key;
+}
+
+template <class TKey, class TValue, class TTraits>
+TValue &CHashMap<TKey, TValue, TTraits>::GetValue (int nSlot)
+{
+	assert (0 <= nSlot && (unsigned) nSlot < m_nCapacity);
+	assert (m_pSlot[nSlot].nHash != 0);
+
+	return m_pSlot[nSlot].Value;
+}
+
+template <class TKey, class TValue, class TTraits>
+unsigned CHashMap<TKey, TValue, TTraits>::Lookup (const TKey &Key, u32 nHash) const
+{
+	unsigned nMask = m_nCapacity-1;
+	for (unsigned nSlot = nHash & nMask; m_pSlot[nSlot].nHash != 0; nSlot = (nSlot+1) & nMask)
+	{
+		if (   m_pSlot[nSlot].nHash == nHash
+		    && TTraits::Equal (m_pSlot[nSlot].Key, Key))
+		{
+			return nSlot;
+		}
+	}
+
+	return m_nCapacity;
+}
+
+template <class TKey, class TValue, class TTraits>
+void CHashMap<TKey, TValue, TTraits>::Resize (unsigned nCapacity)
+{
+	TSlot *pOldSlot = m_pSlot;
+	unsigned nOldCapacity = m_nCapacity;
+
+	m_pSlot = new TSlot[nCapacity];
+	assert (m_pSlot != 0);
+	m_nCapacity = nCapacity;
+
+	for (unsigned i = 0; i < nCapacity; i++)
+	{
+		m_pSlot[i].nHash = 0;
+	}
+
+	if (pOldSlot == 0)
+	{
+		return;
+	}
+
+	unsigned nMask = nCapacity-1;
+	for (unsigned i = 0; i < nOldCapacity; i++)
+	{
+		if (pOldSlot[i].nHash == 0)
+		{
+			continue;
+		}
+
+		unsigned nSlot;
+		for (nSlot = pOldSlot[i].nHash & nMask;
+		     m_pSlot[nSlot].nHash != 0;
+		     nSlot = (nSlot+1) & nMask)
+		{
+			// just probing
+		}
+
+		m_pSlot[nSlot] = pOldSlot[i];
+	}
+
+	delete [] pOldSlot;
+}
+
+#endif
@@ -0,0 +1,179 @@
+//
+// inflate.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_inflate_h
+#define _circle_inflate_h
+
+#include <circle/checksum.h>
+#include <circle/types.h>
+
+#define INFLATE_WINDOW_SIZE	32768			// maximum distance of a back reference
+#define INFLATE_FAST_BITS	10			// bits resolved by one table lookup
+
+enum TCompressionFormat
+{
+	CompressionFormatRaw,		///< Raw deflate data (RFC 1951)
+	CompressionFormatZlib,		///< zlib format (RFC 1950)
+	CompressionFormatGzip,		///< gzip format (RFC 1952), single member
+	CompressionFormatAuto		///< zlib or gzip, detected from the header (inflate only)
+};
+
+enum TCompressionStatus
+{
+	CompressionStatusOK,		///< Progress made, call again with more input or output space
+	CompressionStatusStreamEnd,	///< End of stream reached (and trailer checked)
+	CompressionStatusError		///< Invalid data (inflate) or parameters
+};
+
+/// \note The working memory of CInflater is part of the object (about 38 KB), no memory is
+///	  allocated while processing data. The object may be reused after Reset().
+
+class CInflater		/// Streaming decompressor for data in deflate, zlib or gzip format
+{
+public:
+	/// \param Format Format of the compressed data
+	CInflater (TCompressionFormat Format = CompressionFormatAuto);
+
+	~CInflater (void);
+
+	/// \brief Restart with a new stream
+	void Reset (void);
+
+	/// \brief Decompress data
+	/// \param pInput Pointer to the compressed input data
+	/// \param nInputLength Number of available input bytes
+	/// \param pInputUsed Number of consumed input bytes is returned here
+	/// \param pOutput Pointer to the buffer for the decompressed data
+	/// \param nOutputSize Size of the output buffer in bytes
+	/// \param pOutputUsed Number of produced output bytes is returned here
+	/// \return Status of the operation
+	/// \note Input bytes, which have not been consumed, have to be passed again on the next call.
+	///	  The input is consumed completely, unless the output buffer is full or the
+	///	  end of the stream has been reached.
+	TCompressionStatus Process (const void *pInput, size_t nInputLength, size_t *pInputUsed,
+				    void *pOutput, size_t nOutputSize, size_t *pOutputUsed);
+
+	/// \return Total number of decompressed bytes since Reset()
+	u64 GetTotalOutput (void) const;
+
+	/// \return Description of the error, after CompressionStatusError has been returned
+	const char *GetErrorMessage (void) const;
+
+	/// \brief Decompress a complete stream at once
+	/// \param pInput Pointer to the compressed data
+	/// \param nInputLength Length of the compressed data in bytes
+	/// \param pOutput Pointer to the buffer for the decompressed data
+	/// \param nOutputSize Size of the output buffer in bytes
+	/// \param Format Format of the compressed data
+	/// \return Length of the decompressed data, or -1 on error or if the buffer is too small
+	static int Decompress (const void *pInput, size_t nInputLength,
+			       void *pOutput, size_t nOutputSize,
+			       TCompressionFormat Format = CompressionFormatAuto);
+
+private:
+	struct THuffmanTable
+	{
+		u16 Count[16];				// number of codes of each length
+		u16 Symbol[288];			// symbols ordered by code
+		u16 Fast[1 << INFLATE_FAST_BITS];	// (symbol << 4) | length, 0 if not direct
+	};
+
+	TCompressionStatus Run (void);
+	boolean DecodeLengths (void);		// returns FALSE, if more input is needed
+	boolean DecodeCodes (void);		// returns FALSE, if more input or output space is needed
+	void DecodeCodesFast (void);
+	boolean CopyMatch (void);		// returns FALSE, if more output space is needed
+	void Error (const char *pMessage);
+
+	void PutByte (u8 uchByte);
+	void PutBytes (const u8 *pBuffer, size_t nLength);
+	void UpdateChecksum (void);
+	void UpdateWindow (void);
+
+	boolean NeedBits (unsigned nBits);
+	void RefillBits (void);
+	u32 PeekBits (unsigned nBits) const;
+	void DropBits (unsigned nBits);
+
+	static boolean BuildTable (THuffmanTable *pTable, const u8 *pLengths, unsigned nCodes,
+				   boolean bAllowIncomplete);
+	int DecodeSymbol (const THuffmanTable &rTable, unsigned *pLength) const;
+
+private:
+	enum TState
+	{
+		StateHeader,
+		StateGzipHeader,
+		StateGzipTime,
+		StateGzipExtraLength,
+		StateGzipExtra,
+		StateGzipName,
+		StateGzipComment,
+		StateGzipHeaderCRC,
+		StateBlockHeader,
+		StateStoredLength,
+		StateStored,
+		StateDynamicHeader,
+		StateCodeLengths,
+		StateLengths,
+		StateCodes,
+		StateCopy,
+		StateTrailer,
+		StateDone,
+		StateError
+	};
+
+	TCompressionFormat m_Format;
+	TCompressionFormat m_StreamFormat;	// actual format of the stream
+	TState m_State;
+	const char *m_pErrorMessage;
+
+	const u8 *m_pIn;			// valid during Process()
+	const u8 *m_pInEnd;
+	u8 *m_pOutBegin;
+	u8 *m_pOut;
+	u8 *m_pOutEnd;
+	u8 *m_pOutChecked;			// output before this has been checksummed
+
+	u64 m_nBitBuffer;			// input bits, LSB first
+	unsigned m_nBitCount;
+
+	boolean m_bLastBlock;
+	unsigned m_nGzipFlags;
+	unsigned m_nRemaining;			// stored bytes, gzip extra bytes or copy length
+	unsigned m_nDistance;
+
+	unsigned m_nLitLenCodes;
+	unsigned m_nDistanceCodes;
+	unsigned m_nCodeLengthCodes;
+	unsigned m_nIndex;
+	u8 m_Lengths[288+32];
+
+	THuffmanTable m_LitLenTable;
+	THuffmanTable m_DistanceTable;
+
+	u8 m_Window[INFLATE_WINDOW_SIZE];	// output of previous calls of Process()
+	unsigned m_nWindowPos;
+	u64 m_nTotalOutput;
+
+	CAdler32 m_Adler32;
+	CCRC32 m_CRC32;
+};
+
+#endif
@@ -24,6 +24,8 @@
 #include <circle/exceptionstub.h>
 #include <circle/types.h>
 
+class CLatencyHistogram;
+
 typedef void TIRQHandler (void *pParam);
 
 class CInterruptSystem
@@ -36,6 +38,7 @@ public:
 
 	void ConnectIRQ (unsigned nIRQ, TIRQHandler *pHandler, void *pParam);
 	void DisconnectIRQ (unsigned nIRQ);
+	boolean IsConnected (unsigned nIRQ) const;
 
 	void ConnectFIQ (unsigned nFIQ, TFIQHandler *pHandler, void *pParam);
 	void DisconnectFIQ (void);
@@ -46,6 +49,11 @@ public:
 	static void EnableFIQ (unsigned nFIQ);
 	static void DisableFIQ (void);
 
+	/// \brief Enable measuring the latency from IRQ entry to handler call
+	/// \param ppHistogram Array of IRQ_LINES histogram pointers (0 to ignore an IRQ line),\n
+	///	 values are added in units of CTracer::GetTimestamp(), 0 to disable measuring
+	void SetLatencyHistograms (CLatencyHistogram **ppHistogram);
+
 	static CInterruptSystem *Get (void);
 
 	static void InterruptHandler (void);
@@ -60,12 +68,14 @@ public:
 #endif
 
 private:
-	boolean CallIRQHandler (unsigned nIRQ);
+	boolean CallIRQHandler (unsigned nIRQ, u32 nEntryTime);
 
 private:
 	TIRQHandler	*m_apIRQHandler[IRQ_LINES];
 	void		*m_pParam[IRQ_LINES];
 
+	CLatencyHistogram ** volatile m_ppLatencyHistogram;
+
 	static CInterruptSystem *s_pThis;
 };
 
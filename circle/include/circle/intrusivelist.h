@@ -0,0 +1,172 @@
+//
+// intrusivelist.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_intrusivelist_h
+#define _circle_intrusivelist_h
+
+#include <circle/types.h>
+#include <assert.h>
+
+/// \brief Link, which has to be embedded into the elements of a CIntrusiveList
+template <class T>
+struct TIntrusiveListLink
+{
+	T *pPrev;
+	T *pNext;
+};
+
+/// \brief Doubly linked list of elements, which contain their own link
+/// \note Inserting and removing elements does not allocate memory and is O(1).\n
+///	  An element can be member of multiple lists, if it has a link for each of them.\n
+///	  The list is not thread-safe, the user has to provide locking.
+/// \param T	Element type
+/// \param Link	Pointer to the link member of T (e.g. &TMyElement::Link)
+template <class T, TIntrusiveListLink<T> T::*Link>
+class CIntrusiveList
+{
+public:
+	CIntrusiveList (void)
+	:	m_pFirst (0),
+		m_pLast (0),
+		m_nCount (0)
+	{
+	}
+
+	~CIntrusiveList (void)
+	{
+		assert (m_pFirst == 0);		// all elements have to be removed before
+	}
+
+	boolean IsEmpty (void) const		{ return m_pFirst == 0; }
+	unsigned GetCount (void) const		{ return m_nCount; }
+
+	/// \return First element or 0 if list is empty
+	T *GetFirst (void) const		{ return m_pFirst; }
+	/// \return Last element or 0 if list is empty
+	T *GetLast (void) const			{ return m_pLast; }
+
+	/// \return Element after pElement or 0 if pElement is the last one
+	static T *GetNext (const T *pElement)	{ return (pElement->*Link).pNext; }
+	/// \return Element before pElement or 0 if pElement is the first one
+	static T *GetPrev (const T *pElement)	{ return (pElement->*Link).pPrev; }
+
+	/// \param pElement Element to be inserted at the head of the list
+	void InsertHead (T *pElement)
+	{
+		InsertAfter (0, pElement);
+	}
+
+	/// \param pElement Element to be appended to the list
+	void InsertTail (T *pElement)
+	{
+		InsertAfter (m_pLast, pElement);
+	}
+
+	/// \param pPosition Element in this list to insert after (0 to insert at the head)
+	/// \param pElement  Element to be inserted
+	void InsertAfter (T *pPosition, T *pElement);
+
+	/// \param pElement Element in this list to be removed
+	void Remove (T *pElement);
+
+	/// \return Removed first element or 0 if list is empty
+	T *RemoveHead (void)
+	{
+		T *pElement = m_pFirst;
+		if (pElement != 0)
+		{
+			Remove (pElement);
+		}
+
+		return pElement;
+	}
+
+private:
+	T	 *m_pFirst;
+	T	 *m_pLast;
+	unsigned  m_nCount;
+};
+
+template <class T, TIntrusiveListLink<T> T::*Link>
+void CIntrusiveList<T, Link>::InsertAfter (T *pPosition, T *pElement)
+{
+	assert (pElement != 0);
+
+	T *pNext = pPosition != 0 ? (pPosition->*Link).pNext : m_pFirst;
+
+	(pElement->*Link).pPrev = pPosition;
+	(pElement->*Link).pNext = pNext;
+
+	if (pPosition != 0)
+	{
+		(pPosition->*Link).pNext = pElement;
+	}
+	else
+	{
+		m_pFirst = pElement;
+	}
+
+	if (pNext != 0)
+	{
+		(pNext->*Link).pPrev = pElement;
+	}
+	else
+	{
+		m_pLast = pElement;
+	}
+
+	m_nCount++;
+}
+
+template <class T, TIntrusiveListLink<T> T::*Link>
+void CIntrusiveList<T, Link>::Remove (T *pElement)
+{
+	assert (pElement != 0);
+	assert (m_nCount > 0);
+
+	T *pPrev = (pElement->*Link).pPrev;
+	T *pNext = (pElement->*Link).pNext;
+
+	if (pPrev != 0)
+	{
+		(pPrev->*Link).pNext = pNext;
+	}
+	else
+	{
+		assert (m_pFirst == pElement);
+		m_pFirst = pNext;
+	}
+
+	if (pNext != 0)
+	{
+		(pNext->*Link).pPrev = pPrev;
+	}
+	else
+	{
+		assert (m_pLast == pElement);
+		m_pLast = pPrev;
+	}
+
+	(pElement->*Link).pPrev = 0;
+	(pElement->*Link).pNext = 0;
+
+	m_nCount--;
+}
+
+#endif
@@ -0,0 +1,70 @@
+//
+// latencyhistogram.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_latencyhistogram_h
+#define _circle_latencyhistogram_h
+
+#include <circle/types.h>
+
+// values 0-15 have an own bucket, above each power of 2 is divided into 8 buckets
+#define LATENCY_HISTOGRAM_BUCKETS	(16 + 28*8)
+
+class CLatencyHistogram		/// Log-scale histogram of latency values with percentiles
+{
+public:
+	CLatencyHistogram (void);
+
+	/// \brief Clear all values
+	void Reset (void);
+
+	/// \brief Add a value
+	/// \param nValue Latency value (in any unit)
+	/// \note Lock-free, can be called from any core and execution level
+	void Add (unsigned nValue);
+
+	/// \brief Add all values of another histogram (e.g. to sum up per-core histograms)
+	/// \param rHistogram Histogram to be added
+	void Add (const CLatencyHistogram &rHistogram);
+
+	/// \return Number of values
+	unsigned GetCount (void) const;
+
+	/// \return Minimum value (0 if empty)
+	unsigned GetMin (void) const;
+	/// \return Maximum value
+	unsigned GetMax (void) const;
+
+	/// \param nPermille Wanted percentile in 1/1000 (e.g. 500 for p50, 999 for p99.9)
+	/// \return Value, which is not exceeded by nPermille/1000 of all values
+	/// \note The result is rounded up to the bucket limit (max. 12.5% above the exact value).
+	unsigned GetPercentile (unsigned nPermille) const;
+
+private:
+	static unsigned GetBucket (unsigned nValue);
+	static unsigned GetBucketLimit (unsigned nBucket);
+
+private:
+	volatile unsigned m_nCount;
+	volatile unsigned m_nMin;
+	volatile unsigned m_nMax;
+
+	volatile unsigned m_nBucket[LATENCY_HISTOGRAM_BUCKETS];
+};
+
+#endif
@@ -2,7 +2,7 @@
 // latencytester.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,10 +21,19 @@
 #define _circle_latencytester_h
 
 #include <circle/interrupt.h>
-#include <circle/spinlock.h>
+#include <circle/latencyhistogram.h>
 #include <circle/types.h>
 
-/// \note CLatencyTester blocks the system timer 1, which is used by the class CUserTimer too.
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/memorymap.h>
+	#define LATENCY_CORES	CORES
+#else
+	#define LATENCY_CORES	1
+#endif
+
+/// \note On the Raspberry Pi 1 CLatencyTester blocks the system timer 1, which is used by the
+///	  class CUserTimer too. On other models it uses the virtual timer of each core, which is
+///	  used by the class CSamplingProfiler too.
 
 class CLatencyTester		/// Measures the IRQ latency of the running code
 {
@@ -32,10 +41,16 @@ public:
 	CLatencyTester (CInterruptSystem *pInterruptSystem);
 	~CLatencyTester (void);
 
-	/// \brief Start measurement
-	/// \param nSampleRateHZ Sample rate in Hz
-	void Start (unsigned nSampleRateHZ);
-	/// \brief Stop measurement
+	/// \brief Start measurement (on core 0)
+	/// \param nSampleRateHZ Sample rate in Hz (per core)
+	/// \param bIRQStatistics Measure the latency from IRQ entry to handler call\n
+	///	   for all IRQ lines, which are connected at this time, too
+	void Start (unsigned nSampleRateHZ, boolean bIRQStatistics = FALSE);
+#if RASPPI >= 2
+	/// \brief Start measurement on a secondary core too (after Start() has been called)
+	void StartSecondary (void);
+#endif
+	/// \brief Stop measurement (on all cores)
 	void Stop (void);
 
 	/// \return Minimum IRQ latency in microseconds
@@ -45,27 +60,52 @@ public:
 	/// \return Average IRQ latency in microseconds
 	unsigned GetAvg (void);
 
+	/// \param nPermille Wanted percentile in 1/1000 (e.g. 990 for p99)
+	/// \return IRQ latency in nanoseconds, which is not exceeded by this percentile
+	unsigned GetPercentile (unsigned nPermille) const;
+
 	/// \brief Dump results to logger
 	void Dump (void);
 
 private:
+	void GetTotal (CLatencyHistogram *pHistogram) const;
+
 	void InterruptHandler (void);
 	static void InterruptStub (void *pParam);
 
+	void StartTimer (void);
+	void StopTimer (void);
+
+	static unsigned ToNanoSeconds (unsigned nTicks, unsigned nFrequency);
+
+	static unsigned ThisCore (void);
+
+#if RASPPI >= 2
+	static u32 GetTimerFrequency (void);
+	static s32 ReadTimerValue (void);
+	static void WriteTimerValue (u32 nValue);
+	static void WriteTimerControl (u32 nValue);
+
+	static const u32 CNTV_CTL_ENABLE = 1 << 0;
+#endif
+
 private:
 	CInterruptSystem *m_pInterruptSystem;
 
-	boolean m_bRunning;
-	unsigned m_nWantedDelay;
-
-	unsigned m_nMinDelay;
-	unsigned m_nMaxDelay;
+	volatile boolean m_bRunning;
+	volatile boolean m_bTimerActive[LATENCY_CORES];	// timer of this core is enabled
+	unsigned m_nTimerFrequency;		// Hz
+	unsigned m_nWantedDelay;		// timer ticks
 
-	unsigned m_nDelayAccu;
-	unsigned m_nSamples;
-	boolean  m_bOverflow;
+	struct TCoreStatistics
+	{
+		CLatencyHistogram Histogram;	// timer ticks
+		u64		  nDelaySum;
+	}
+	m_CoreStatistics[LATENCY_CORES];
 
-	CSpinLock m_SpinLock;
+	CLatencyHistogram *m_pIRQHistogram[IRQ_LINES];	// CTracer::GetTimestamp() units
+	boolean m_bIRQStatistics;
 };
 
 #endif
@@ -2,7 +2,7 @@
 /// \file logger.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,12 +27,23 @@
 #include <circle/time.h>
 #include <circle/types.h>
 
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/memorymap.h>
+	#define LOGGER_CORES	CORES
+#else
+	#define LOGGER_CORES	1
+#endif
+
 #define LOG_MAX_SOURCE		50
 #define LOG_MAX_MESSAGE		200
 #define LOG_QUEUE_SIZE		50
 
 #define LOGGER_BUFSIZE		0x4000		///< Size of the text ring buffer
 
+#define LOG_DEFERRED_SLOTS	256		///< Default number of deferred messages per core
+#define LOG_DEFERRED_MAX_ARGS	6		///< Maximum number of arguments of a deferred message
+#define LOG_DEFERRED_STRINGS	48		///< Space for copies of %s arguments in bytes
+
 enum TLogSeverity
 {
 	LogPanic,	///< Halt the system after processing this message
@@ -43,8 +54,10 @@ enum TLogSeverity
 };
 
 struct TLogEvent;
+struct TLogRecord;
 
 typedef void TLogEventNotificationHandler (void);
+typedef void TLogDeferredNotificationHandler (void *pParam);
 typedef void TLogPanicHandler (void);
 
 class CLogger		/// Writing logging messages to a target device
@@ -77,6 +90,39 @@ public:
 	/// \brief Does not allocate memory, for critical (low memory) messages
 	void WriteNoAlloc (const char *pSource, TLogSeverity Severity, const char *pMessage);
 
+	/// \brief Enable binary deferred logging with WriteDeferred()
+	/// \param nSlotsPerCore Number of messages, which can be stored per core (power of 2)
+	/// \return Operation successful?
+	/// \note Call this on core 0, before any message is written with WriteDeferred().
+	boolean EnableDeferred (unsigned nSlotsPerCore = LOG_DEFERRED_SLOTS);
+
+	/// \brief Store a log message, which will be formatted and written by ProcessDeferred()
+	/// \param pSource  Module name of the originator of the log message (static string)
+	/// \param Severity Severity of the log message
+	/// \param pMessage Format string of the log message (static string, arguments follow)
+	/// \note Lock-free, can be called on any core from any execution level. Only the format
+	///	  string pointer and the raw arguments are stored. %s arguments are copied
+	///	  (truncated to LOG_DEFERRED_STRINGS bytes in total per message).
+	/// \note Messages with (Severity > nLogLevel) are discarded immediately. If the ring of
+	///	  this core is full, the message is dropped. Without EnableDeferred() and for
+	///	  LogPanic messages this is the same as Write().
+	void WriteDeferred (const char *pSource, TLogSeverity Severity, const char *pMessage, ...);
+
+	/// \brief Format and write deferred messages in the order of their creation
+	/// \param nMaxMessages Maximum number of messages to be processed (0 for all)
+	/// \return Number of processed messages
+	/// \note Call this from TASK_LEVEL on one core only (e.g. by CLogDrainTask).
+	/// \note The messages are time-stamped with the time of WriteDeferred().
+	unsigned ProcessDeferred (unsigned nMaxMessages = 0);
+
+	/// \brief Register handler which is called, when a deferred message has been stored
+	/// \param pHandler Pointer to the handler (0 to unregister)
+	/// \param pParam   Parameter handed over to the handler
+	/// \note The handler is called on the core and from the execution level of
+	///	  WriteDeferred() and must be lock-free too.
+	void RegisterDeferredNotificationHandler (TLogDeferredNotificationHandler *pHandler,
+						  void *pParam = 0);
+
 	/// \brief Read log message text from the log text ring buffer
 	/// \param pBuffer Read text is copied to this buffer
 	/// \param nCount  Size of the buffer
@@ -107,7 +153,14 @@ public:
 private:
 	void Write (const char *pString);
 
-	void WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage);
+	// nAge is the age of the message in microseconds (deferred messages)
+	void WriteMessage (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			   unsigned nAge = 0);
+
+	void WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			 unsigned nAge);
+
+	static unsigned ThisCore (void);
 
 private:
 	unsigned m_nLogLevel;
@@ -129,6 +182,14 @@ private:
 	TLogEventNotificationHandler *m_pEventNotificationHandler;
 	TLogPanicHandler *m_pPanicHandler;
 
+	unsigned m_nDeferredSlots;			// 0 if deferred logging is disabled
+	TLogRecord *m_pDeferredRing[LOGGER_CORES];
+	volatile unsigned m_nDeferredIn[LOGGER_CORES];	// reserved by producers
+	unsigned m_nDeferredOut[LOGGER_CORES];		// consumed by ProcessDeferred()
+	volatile unsigned m_nDeferredDropped;
+	TLogDeferredNotificationHandler * volatile m_pDeferredNotificationHandler;
+	void *m_pDeferredNotificationParam;
+
 	static CLogger *s_pThis;
 };
 
@@ -141,4 +202,10 @@ private:
 #define LOGNOTE(...)		CLogger::Get ()->Write (From, LogNotice, __VA_ARGS__)
 #define LOGDBG(...)		CLogger::Get ()->Write (From, LogDebug, __VA_ARGS__)
 
+/// Deferred variants, the format string must be a string literal
+#define LOGERR_DEFERRED(...)	CLogger::Get ()->WriteDeferred (From, LogError, __VA_ARGS__)
+#define LOGWARN_DEFERRED(...)	CLogger::Get ()->WriteDeferred (From, LogWarning, __VA_ARGS__)
+#define LOGNOTE_DEFERRED(...)	CLogger::Get ()->WriteDeferred (From, LogNotice, __VA_ARGS__)
+#define LOGDBG_DEFERRED(...)	CLogger::Get ()->WriteDeferred (From, LogDebug, __VA_ARGS__)
+
 #endif
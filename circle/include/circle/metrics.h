@@ -0,0 +1,203 @@
+//
+// metrics.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_metrics_h
+#define _circle_metrics_h
+
+#include <circle/string.h>
+#include <circle/synchronize.h>
+#include <circle/types.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/memorymap.h>
+	#define METRICS_CORES		CORES
+#else
+	#define METRICS_CORES		1
+#endif
+
+#define METRICS_MAX_BUCKETS	16		///< Maximum number of buckets of a histogram
+
+enum TMetricType
+{
+	MetricTypeCounter,
+	MetricTypeGauge,
+	MetricTypeHistogram,
+	MetricTypeUnknown
+};
+
+/// \note Metrics are normally defined as static objects in a module. The name should follow
+///	  the Prometheus naming conventions (e.g. "circle_net_tcp_segments_sent_total").
+///	  Name and help text must be static strings.
+
+class CMetric		/// Base class of a named runtime metric, which is registered in a global list
+{
+public:
+	/// \param pName Name of the metric
+	/// \param pHelp Short description of the metric
+	/// \param Type  Type of the metric
+	CMetric (const char *pName, const char *pHelp, TMetricType Type);
+
+	virtual ~CMetric (void);
+
+	/// \return Name of the metric
+	const char *GetName (void) const;
+	/// \return Short description of the metric
+	const char *GetHelp (void) const;
+	/// \return Type of the metric
+	TMetricType GetType (void) const;
+
+	/// \brief Dump all metrics to the logger
+	static void DumpAll (void);
+
+	/// \brief Format all metrics in the Prometheus text exposition format (version 0.0.4)
+	/// \param pBuffer Pointer to the buffer for the text (not 0-terminated)
+	/// \param nBufferSize Size of the buffer in bytes
+	/// \return Length of the text, 0 if the buffer is too small
+	static unsigned FormatPrometheusAll (char *pBuffer, unsigned nBufferSize);
+
+protected:
+	/// \brief Append the value(s) of this metric in human readable format
+	virtual void Format (CString *pResult) const = 0;
+	/// \brief Append the sample line(s) of this metric in Prometheus format
+	virtual void FormatPrometheus (CString *pResult) const = 0;
+
+	/// \brief Append a 64-bit value in decimal format
+	static void AppendValue (CString *pResult, u64 nValue);
+
+	static unsigned ThisCore (void);
+
+private:
+	const char *m_pName;
+	const char *m_pHelp;
+	TMetricType m_Type;
+
+	CMetric *m_pNext;
+	CMetric *m_pPrev;
+
+	static CMetric *s_pFirst;
+	static u32 s_nListLock;
+};
+
+class CMetricCounter : public CMetric	/// Monotonic counter with per-core values
+{
+public:
+	CMetricCounter (const char *pName, const char *pHelp);
+	~CMetricCounter (void);
+
+	/// \brief Increment the counter of the calling core
+	void Inc (void)
+	{
+		__atomic_fetch_add (&m_Core[ThisCore ()].nValue, 1, __ATOMIC_RELAXED);
+	}
+
+	/// \brief Add a value to the counter of the calling core
+	void Add (u64 nValue)
+	{
+		__atomic_fetch_add (&m_Core[ThisCore ()].nValue, nValue, __ATOMIC_RELAXED);
+	}
+
+	/// \return Sum of the counters of all cores
+	u64 Get (void) const;
+
+protected:
+	void Format (CString *pResult) const;
+	void FormatPrometheus (CString *pResult) const;
+
+private:
+	struct TCoreValue
+	{
+		volatile u64	nValue;
+		u8		Padding[DATA_CACHE_LINE_LENGTH_MAX - sizeof (u64)];
+	}
+	m_Core[METRICS_CORES];
+};
+
+class CMetricGauge : public CMetric	/// Value, which can go up and down
+{
+public:
+	CMetricGauge (const char *pName, const char *pHelp);
+	~CMetricGauge (void);
+
+	void Set (s64 nValue)
+	{
+		__atomic_store_n (&m_nValue, nValue, __ATOMIC_RELAXED);
+	}
+
+	void Add (s64 nValue)
+	{
+		__atomic_fetch_add (&m_nValue, nValue, __ATOMIC_RELAXED);
+	}
+
+	void Sub (s64 nValue)
+	{
+		__atomic_fetch_sub (&m_nValue, nValue, __ATOMIC_RELAXED);
+	}
+
+	s64 Get (void) const
+	{
+		return __atomic_load_n (&m_nValue, __ATOMIC_RELAXED);
+	}
+
+protected:
+	void Format (CString *pResult) const;
+	void FormatPrometheus (CString *pResult) const;
+
+private:
+	volatile s64 m_nValue;
+};
+
+class CMetricHistogram : public CMetric	/// Distribution of values in fixed buckets with per-core counts
+{
+public:
+	/// \param pName Name of the metric
+	/// \param pHelp Short description of the metric
+	/// \param pUpperBounds Upper bounds of the buckets (inclusive, ascending order, static array)
+	/// \param nBuckets Number of buckets (without the implicit "+Inf" bucket)
+	CMetricHistogram (const char *pName, const char *pHelp,
+			  const unsigned *pUpperBounds, unsigned nBuckets);
+	~CMetricHistogram (void);
+
+	/// \brief Add a value to the distribution
+	void Observe (unsigned nValue);
+
+	/// \return Number of observed values
+	u64 GetCount (void) const;
+	/// \return Sum of all observed values
+	u64 GetSum (void) const;
+	/// \param nBucket Bucket index (nBuckets for the "+Inf" bucket)
+	/// \return Number of values in this bucket (not cumulative)
+	u64 GetBucketCount (unsigned nBucket) const;
+
+protected:
+	void Format (CString *pResult) const;
+	void FormatPrometheus (CString *pResult) const;
+
+private:
+	const unsigned *m_pUpperBounds;
+	unsigned m_nBuckets;
+
+	struct TCoreValues
+	{
+		volatile u64	nBucket[METRICS_MAX_BUCKETS+1];
+		volatile u64	nSum;
+	}
+	m_Core[METRICS_CORES];
+};
+
+#endif
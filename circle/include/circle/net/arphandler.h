@@ -2,7 +2,7 @@
 // arphandler.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,10 +23,12 @@
 #include <circle/net/netconfig.h>
 #include <circle/net/netdevlayer.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/net/ipaddress.h>
 #include <circle/macaddress.h>
 #include <circle/timer.h>
 #include <circle/spinlock.h>
+#include <circle/hashmap.h>
 #include <circle/types.h>
 
 #define ARP_MAX_ENTRIES		20
@@ -63,9 +65,9 @@ public:
 
 	void Process (void);
 
-	// frame is queued, if resolve fails
+	// frame is queued (and its reference is taken over), if resolve fails
 	boolean Resolve (const CIPAddress &rIPAddress, CMACAddress *pMACAddress,
-			 const void *pFrame, unsigned nFrameLength);
+			 CNetBuffer *pFrame);
 	
 private:
 	void ReplyReceived (const CIPAddress &rForeignIP, const CMACAddress &rForeignMAC);
@@ -73,6 +75,8 @@ private:
 
 	void SendPacket (boolean bRequest, const CIPAddress &rForeignIP, const CMACAddress &rForeignMAC);
 
+	void FreeEntry (unsigned nEntry);		// m_SpinLock must be acquired
+
 	static void TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext);
 
 private:
@@ -83,6 +87,11 @@ private:
 
 	unsigned  m_nEntries;
 	TARPEntry m_Entry[ARP_MAX_ENTRIES];
+
+	// IP address to index into m_Entry for all used entries,
+	// allocated in the constructor and sized, so that it never grows
+	// (no allocation with m_SpinLock acquired)
+	CHashMap<u32, unsigned> m_EntryIndex;
 	CSpinLock m_SpinLock;
 
 	unsigned m_nTicksLastCleanup;
@@ -2,7 +2,7 @@
 // checksumcalculator.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -48,12 +48,31 @@ public:
 	
 	u16 Calculate (const void *pBuffer, unsigned nLength);
 
+	// calculate the checksum of a header (nHeaderLength must be even), which is followed
+	// by a payload, which has been summed before (e.g. with CopyAndSum())
+	u16 Calculate (const void *pHeader, unsigned nHeaderLength,
+		       u16 nPayloadSum, unsigned nPayloadLength);
+
+	// returns the sum of the pseudo header only (not complemented), which is preset
+	// in the checksum field, if the net device completes the checksum (TX offload)
+	u16 PseudoHeaderSum (unsigned nLength);
+
 	static u16 SimpleCalculate (const void *pBuffer, unsigned nLength);
 
+	// partial sums are not complemented, they can be added using CombineSums()
+	static u16 Sum (const void *pBuffer, unsigned nLength);
+	static u16 CopyAndSum (void *pDest, const void *pSource, unsigned nLength);
+	static u16 CombineSums (u16 nSum1, u16 nSum2, unsigned nLength1);	// nLength1 of block 1
+
+	// incremental update of nChecksum, after a 16- or 32-bit value has changed
+	// in the checksummed data (RFC 1624), all values as stored in memory
+	static u16 Update (u16 nChecksum, u16 nOldValue, u16 nNewValue);
+	static u16 Update32 (u16 nChecksum, u32 nOldValue, u32 nNewValue);
+
 private:
-	static u32 CalculateChunk (const void *pBuffer, unsigned nLength, u32 nChecksum);
+	static u64 CalculateChunk (const void *pBuffer, unsigned nLength, u64 nChecksum);
 
-	static u16 FoldResult (u32 nChecksum);
+	static u16 FoldResult (u64 nChecksum);
 	
 private:
 	TPseudoHeader m_Header;
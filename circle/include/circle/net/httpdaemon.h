@@ -2,7 +2,7 @@
 // httpdaemon.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -24,9 +24,22 @@
 #include <circle/net/netsubsystem.h>
 #include <circle/net/http.h>
 #include <circle/net/socket.h>
+#include <circle/net/socketpoller.h>
 #include <circle/net/ipaddress.h>
 #include <circle/types.h>
 
+#define HTTP_CONTENT_LENGTH_UNKNOWN	0xFFFFFFFFU	// from OpenContent(): send chunked content
+#define HTTP_CHUNK_SIZE			8192		// max. size requested by ReadContent()
+
+// Connections are persistent (HTTP/1.1 keep-alive) and pipelined requests are processed
+// in order. A worker task is only bound to a connection, while it processes requests.
+// Idle connections are watched by the listener task with a CSocketPoller and handed to
+// a new worker, when the next request arrives.
+//
+// The content of a response can be provided at once with GetContent() or in chunks with
+// OpenContent(), ReadContent() and CloseContent() (e.g. to send large files from FatFs
+// with f_open(), f_read() and f_close() without buffering the whole file).
+
 class CHTTPDaemon : public CTask
 {
 public:
@@ -50,6 +63,23 @@ public:
 				        unsigned    *pLength,	// in: buffer size, out: content length
 				        const char **ppContentType) = 0; // set this if not "text/html"
 
+	// overwrite this to stream your content, default calls GetContent()
+	// ReadContent() and CloseContent() are called only, if HTTPOK is returned
+	virtual THTTPStatus OpenContent (const char  *pPath,	// path of the file to be sent
+					 const char  *pParams,	// parameters to GET ("" for none)
+					 const char  *pFormData, // form data from POST ("" for none)
+					 unsigned    *pLength,	// out: content length or
+								// HTTP_CONTENT_LENGTH_UNKNOWN
+					 const char **ppContentType); // set this if not "text/html"
+
+	// overwrite this together with OpenContent() to provide the next part of your content
+	// returns the number of bytes copied to pBuffer (0 at end of content, < 0 on error)
+	virtual int ReadContent (u8	  *pBuffer,		// copy your content here
+				 unsigned  nBufferSize);	// up to HTTP_CHUNK_SIZE bytes
+
+	// overwrite this to release the resources allocated in OpenContent()
+	virtual void CloseContent (void);
+
 	// overwrite this to implement your own access logging
 	virtual void WriteAccessLog (const CIPAddress	&rRemoteIP,
 				     THTTPRequestMethod	 RequestMethod,
@@ -66,7 +96,18 @@ protected:
 
 private:
 	void Listener (void);			// accepts incoming connections and creates worker task
-	void Worker (void);			// processes a connection
+	void Worker (void);			// processes the requests on a connection
+
+	// starts a worker task for a connection
+	void StartWorker (CSocket *pConnection, unsigned nRequests);
+
+	// called by a worker to pass an idle connection to the listener (TRUE on success)
+	boolean ParkConnection (CSocket *pConnection, unsigned nRequests);
+	void CloseIdleConnections (boolean bAll);
+
+	// processes one request, returns TRUE, if the connection is kept alive
+	boolean ProcessRequest (void);
+	boolean SendContent (unsigned nContentLength, unsigned *pBytesSent);
 
 	THTTPStatus ParseRequest (void);
 	THTTPStatus ParseMethod (char *pLine);
@@ -83,6 +124,28 @@ private:
 	unsigned       m_nMaxMultipartSize;
 	
 	u8 *m_pContentBuffer;
+	boolean m_bContentBuffered;			// content from GetContent() is sent
+
+	// connection
+	CHTTPDaemon *m_pListener;			// the listener, which created this worker
+	unsigned m_nRequests;				// number of requests processed so far
+
+	char *m_pRxBuffer;				// received data (FRAME_BUFFER_SIZE bytes)
+	unsigned m_nRxOffset;				// next byte to be parsed
+	unsigned m_nRxLength;				// valid bytes in m_pRxBuffer
+
+	u8 *m_pChunkBuffer;				// for streamed content
+
+	// listener
+	CSocketPoller *m_pPoller;			// watches listening and idle sockets
+
+	struct TIdleConnection
+	{
+		CSocket	*pSocket;			// 0 if entry is free
+		unsigned nParkTicks;			// when the connection became idle
+		unsigned nRequests;
+	}
+	*m_pIdleConnection;
 
 	// from request
 	THTTPRequestMethod m_RequestMethod;
@@ -91,6 +154,8 @@ private:
 	char m_RequestPath[HTTP_MAX_PATH+1];		// the path without parameters
 	char m_RequestParams[HTTP_MAX_PARAMS+1];	// the parameters from URI
 
+	boolean m_bConnectionClose;			// "Connection: close" requested
+
 	boolean m_bRequestFormDataAvailable;		// form data is available
 	unsigned m_nRequestContentLength;		// length of form data from POST request
 	char m_RequestFormData[HTTP_MAX_FORM_DATA+1];	// form data from POST request
@@ -2,7 +2,7 @@
 // icmphandler.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -93,6 +93,8 @@ public:
 				     const void *pReturnedIPPacket, unsigned nLength);
 
 private:
+	void HandleError (const u8 *pPacket, unsigned nLength, const CIPAddress &rSourceIP);
+
 	void EnqueueNotification (TICMPNotificationType Type, TIPHeader *pIPHeader,
 				  TICMPDataDatagramHeader *pDatagramHeader);
 
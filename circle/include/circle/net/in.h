@@ -10,4 +10,12 @@
 
 #define MSG_DONTWAIT	0x40
 
+// events of CSocketPoller
+#define SOCKET_POLL_READ	0x01		// data can be received
+#define SOCKET_POLL_WRITE	0x02		// data can be sent
+#define SOCKET_POLL_ACCEPT	0x04		// connection can be accepted (listening socket)
+#define SOCKET_POLL_ERROR	0x08		// error occurred (always reported)
+#define SOCKET_POLL_HANGUP	0x10		// connection closed by peer (always reported)
+#define SOCKET_POLL_EDGE	0x80000000	// report changes only (edge-triggered)
+
 #endif
@@ -0,0 +1,85 @@
+//
+// ipreassembler.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_ipreassembler_h
+#define _circle_net_ipreassembler_h
+
+#include <circle/net/netbuffer.h>
+#include <circle/net/ipaddress.h>
+#include <circle/types.h>
+
+#define IP_REASSEMBLY_MAX_DATAGRAMS	8		// datagrams in reassembly at the same time
+#define IP_REASSEMBLY_MAX_MEMORY	0x80000		// bytes of net buffers held by fragments
+
+struct TIPHeader;
+
+class CIPReassembler		// reassembles fragmented IPv4 datagrams (RFC 791, RFC 815)
+{
+public:
+	CIPReassembler (void);
+	~CIPReassembler (void);
+
+	// pFragment contains the IP packet (with header), which has MF set or a fragment
+	// offset, the reference to it is taken over, returns the complete datagram (with
+	// header) or 0, if it is not complete yet (the buffer has to be released by the caller)
+	CNetBuffer *AddFragment (CNetBuffer *pFragment);
+
+	// discards datagrams, which have not been completed in time, call this periodically
+	void Process (void);
+
+	void Flush (void);
+
+private:
+	struct TDatagram
+	{
+		boolean		 bInUse;
+		u8		 SourceAddress[IP_ADDRESS_SIZE];
+		u8		 DestinationAddress[IP_ADDRESS_SIZE];
+		u16		 nIdentification;
+		u8		 nProtocol;
+		unsigned	 nStartTicks;
+		unsigned	 nTotalLength;		// of the payload, 0 until last fragment received
+		unsigned	 nReceivedLength;	// sum of the payload lengths of all fragments
+		unsigned	 nMemory;		// bytes held by the fragments
+		unsigned	 nHeaderLength;		// of the first fragment, 0 until received
+		u8		 Header[6*4];		// of the first fragment (maximum size)
+		CNetBuffer	*pFirstFragment;	// list sorted by fragment offset
+	};
+
+	TDatagram *FindDatagram (const TIPHeader *pHeader);
+	TDatagram *CreateDatagram (const TIPHeader *pHeader);
+
+	// inserts the fragment into the list, returns FALSE if it overlaps another one
+	boolean InsertFragment (TDatagram *pDatagram, CNetBuffer *pFragment,
+				unsigned nOffset, unsigned nLength);
+
+	CNetBuffer *Assemble (TDatagram *pDatagram);
+
+	void DiscardDatagram (TDatagram *pDatagram);
+
+	// discards the oldest datagrams (except pExcept) until nBytes more fit into the limit
+	boolean MakeRoom (unsigned nBytes, const TDatagram *pExcept);
+
+private:
+	TDatagram m_Datagram[IP_REASSEMBLY_MAX_DATAGRAMS];
+
+	unsigned m_nMemoryUsed;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // linklayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -26,6 +26,7 @@
 #include <circle/net/ipaddress.h>
 #include <circle/macaddress.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/macros.h>
 #include <circle/types.h>
 
@@ -54,10 +55,14 @@ public:
 
 	void Process (void);
 
-	boolean Send (const CIPAddress &rReceiver, const void *pIPPacket, unsigned nLength);
+	// the reference to pIPPacket is taken over
+	boolean Send (const CIPAddress &rReceiver, CNetBuffer *pIPPacket);
 
-	// pBuffer must have size FRAME_BUFFER_SIZE
-	boolean Receive (void *pBuffer, unsigned *pResultLength);
+	// returns 0 if nothing has been received, the buffer has to be released by the caller
+	CNetBuffer *Receive (void);
+
+	// returns NET_OFFLOAD_* flags of the net device
+	u32 GetOffloadCapabilities (void) const;
 
 public:
 	boolean SendRaw (const void *pFrame, unsigned nLength);
@@ -70,7 +75,7 @@ public:
 
 private:
 	// return IP packet to the network layer for notification
-	void ResolveFailed (const void *pReturnedFrame, unsigned nLength);
+	void ResolveFailed (CNetBuffer *pReturnedFrame);
 	friend class CARPHandler;
 
 private:
@@ -0,0 +1,63 @@
+//
+// metricsdaemon.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_metricsdaemon_h
+#define _circle_net_metricsdaemon_h
+
+#include <circle/net/httpdaemon.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/socket.h>
+#include <circle/types.h>
+
+#define METRICS_PORT		9100
+#define METRICS_MAX_CONTENT	0x10000
+
+class CMetricsDaemon : public CHTTPDaemon	/// Serves all CMetric objects at "/metrics" for Prometheus
+{
+public:
+	/// \param pNetSubSystem Pointer to the network subsystem
+	/// \param pSocket	 0 for the listener instance (created by the application)
+	/// \param nPort	 TCP port to listen on
+	/// \param nMaxContentSize Buffer size for the metrics text
+	CMetricsDaemon (CNetSubSystem *pNetSubSystem, CSocket *pSocket = 0,
+			u16 nPort = METRICS_PORT, unsigned nMaxContentSize = METRICS_MAX_CONTENT);
+	~CMetricsDaemon (void);
+
+	CHTTPDaemon *CreateWorker (CNetSubSystem *pNetSubSystem, CSocket *pSocket);
+
+	THTTPStatus GetContent (const char  *pPath,
+				const char  *pParams,
+				const char  *pFormData,
+				u8	    *pBuffer,
+				unsigned    *pLength,
+				const char **ppContentType);
+
+	/// \brief Suppress the access log for the periodic scrapes
+	void WriteAccessLog (const CIPAddress	&rRemoteIP,
+			     THTTPRequestMethod	 RequestMethod,
+			     const char		*pRequestURI,
+			     THTTPStatus	 Status,
+			     unsigned		 nContentLength);
+
+private:
+	u16 m_nPort;
+	unsigned m_nMaxContentSize;
+};
+
+#endif
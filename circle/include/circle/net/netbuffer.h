@@ -0,0 +1,141 @@
+//
+// netbuffer.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_netbuffer_h
+#define _circle_net_netbuffer_h
+
+#include <circle/netdevice.h>
+#include <circle/spinlock.h>
+#include <circle/synchronize.h>
+#include <circle/types.h>
+
+#define NET_BUFFER_HEADROOM	128		// room for headers, multiple of the cache line length
+#define NET_BUFFER_SIZE		(NET_BUFFER_HEADROOM + FRAME_BUFFER_SIZE)
+#define NET_BUFFER_PRIVATE_SIZE	16		// per-layer packet information
+#define NET_BUFFER_MAX		1024		// limit of allocated buffers
+
+/// \note A CNetBuffer holds one frame or packet, while it passes the layers of the network\n
+///	  stack. Each layer strips (Pull()) or adds (Push()) its header in place, so that the\n
+///	  payload is not copied. Buffers are reference counted and are allocated from a pool,\n
+///	  which grows on demand up to NET_BUFFER_MAX buffers. Released buffers are kept in\n
+///	  the pool. new returns 0, if no buffer is available. Buffers for packets, which do\n
+///	  not fit into one frame (e.g. reassembled IP datagrams), get their data area from\n
+///	  the heap.
+
+class CNetBuffer	/// Reference counted buffer for a network frame or packet
+{
+public:
+	/// \brief Creates an empty buffer with the data area at NET_BUFFER_HEADROOM
+	/// \note The reference count is 1 afterwards.
+	CNetBuffer (void);
+
+	/// \brief Creates an empty buffer with room for nSize bytes of data
+	/// \param nSize Size of the data area (without headroom), may exceed FRAME_BUFFER_SIZE
+	/// \note The data area is allocated from the heap, if nSize > FRAME_BUFFER_SIZE.
+	CNetBuffer (unsigned nSize);
+
+	/// \return Pointer to the valid data
+	u8 *GetData (void)			{ return m_pData; }
+	/// \return Length of the valid data in bytes
+	unsigned GetLength (void) const		{ return m_nLength; }
+
+	/// \return Number of bytes, which can be added in front of the data
+	unsigned GetHeadroom (void) const	{ return m_pData - m_pBuffer; }
+	/// \return Number of bytes, which can be appended to the data
+	unsigned GetTailroom (void) const	{ return m_pBuffer + m_nBufferSize - (m_pData + m_nLength); }
+
+	/// \brief Add room for a header in front of the data
+	/// \param nBytes Size of the header
+	/// \return Pointer to the header (the new start of the data)
+	u8 *Push (unsigned nBytes);
+
+	/// \brief Remove a header in front of the data
+	/// \param nBytes Size of the header
+	/// \return Pointer to the new start of the data
+	u8 *Pull (unsigned nBytes);
+
+	/// \brief Append room for data
+	/// \param nBytes Number of bytes to be appended
+	/// \return Pointer to the appended room
+	u8 *Put (unsigned nBytes);
+
+	/// \brief Reduce the length of the data (e.g. to remove padding)
+	/// \param nLength New length (must not be greater than the current one)
+	void Trim (unsigned nLength);
+
+	/// \return Pointer to an area of NET_BUFFER_PRIVATE_SIZE bytes, which can be used by\n
+	///	    the layer, which has the buffer queued, to store information about the packet
+	void *GetPrivateData (void)		{ return m_Private; }
+
+	/// \brief Set the offload flags of this frame or packet
+	/// \param nFlags NET_FRAME_* flags (see circle/netdevice.h)
+	void SetOffloadFlags (unsigned nFlags)	{ m_nOffloadFlags = nFlags; }
+	/// \return NET_FRAME_* flags of this frame or packet
+	unsigned GetOffloadFlags (void) const	{ return m_nOffloadFlags; }
+
+	/// \brief Let the net device complete a TCP or UDP checksum on TX
+	/// \param pStart Pointer to the start of the checksummed area (the transport header)
+	/// \param pChecksum Pointer to the checksum field, must be preset with the pseudo header sum
+	/// \param bUDP Is this a UDP checksum?
+	void SetChecksumPartial (const void *pStart, const void *pChecksum, boolean bUDP);
+	/// \brief Calculate the checksum by software, which has been requested with\n
+	///	   SetChecksumPartial() (e.g. if the net device cannot do it)
+	void CompleteChecksum (void);
+	/// \return Offset of the checksummed area from the start of the data
+	unsigned GetChecksumStart (void) const	{ return m_pChecksumStart - m_pData; }
+	/// \return Offset of the checksum field from the start of the checksummed area
+	unsigned GetChecksumOffset (void) const	{ return m_nChecksumOffset; }
+
+	/// \brief Get an additional reference to this buffer
+	/// \return Pointer to this buffer
+	CNetBuffer *AddRef (void);
+
+	/// \brief Release a reference, the buffer is returned to the pool with the last one
+	void Release (void);
+
+	void *operator new (size_t nSize) noexcept;
+	void operator delete (void *pBlock, size_t nSize);
+
+private:
+	~CNetBuffer (void);			// use Release() instead of delete
+
+private:
+	u8 m_Buffer[NET_BUFFER_SIZE] CACHE_ALIGN;	// must be first, frames are received via DMA
+
+	u8	   *m_pBuffer;			// m_Buffer or data area from heap
+	unsigned    m_nBufferSize;
+	u8	   *m_pData;
+	unsigned    m_nLength;
+	unsigned    m_nRefCount;
+
+	unsigned    m_nOffloadFlags;
+	const u8   *m_pChecksumStart;
+	unsigned    m_nChecksumOffset;
+
+	CNetBuffer *m_pNext;			// link in CNetQueue or in the pool
+	friend class CNetQueue;
+
+	u8 m_Private[NET_BUFFER_PRIVATE_SIZE] MAXALIGN;
+
+	static CNetBuffer *s_pFreeList;
+	static unsigned s_nBuffers;
+	static CSpinLock s_SpinLock;
+};
+
+#endif
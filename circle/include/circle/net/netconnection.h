@@ -2,7 +2,7 @@
 // netconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -25,8 +25,13 @@
 #include <circle/net/ipaddress.h>
 #include <circle/net/icmphandler.h>
 #include <circle/net/checksumcalculator.h>
+#include <circle/net/netbuffer.h>
+#include <circle/net/tcpcongestioncontrol.h>
 #include <circle/types.h>
 
+// called on a state change, which may affect the SOCKET_POLL_* events of the connection
+typedef void TNetEventHandler (void *pParam);
+
 class CNetConnection
 {
 public:
@@ -51,20 +56,38 @@ public:
 	virtual int Close (void) = 0;
 	
 	virtual int Send (const void *pData, unsigned nLength, int nFlags) = 0;
-	virtual int Receive (void *pBuffer, int nFlags) = 0;
+	// nLength is the size of pBuffer, a datagram is truncated to it
+	virtual int Receive (void *pBuffer, unsigned nLength, int nFlags) = 0;
 
 	virtual int SendTo (const void *pData, unsigned nLength, int nFlags, CIPAddress	&rForeignIP, u16 nForeignPort) = 0;
-	virtual int ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeignIP, u16 *pForeignPort) = 0;
+	virtual int ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags,
+				 CIPAddress *pForeignIP, u16 *pForeignPort) = 0;
 
 	virtual int SetOptionBroadcast (boolean bAllowed) = 0;
 
+	virtual int SetOptionNoDelay (boolean bNoDelay) = 0;
+	virtual int SetOptionCork (boolean bCork) = 0;
+	virtual int SetOptionCongestionControl (TTCPCongestionControl Algorithm) = 0;
+	virtual int GetConnectionInfo (TTCPConnectionInfo *pInfo) const = 0;
+
 	virtual boolean IsConnected (void) const = 0;
 	virtual boolean IsTerminated (void) const = 0;
+
+	// returns SOCKET_POLL_* events (see: in.h), which are ready now
+	virtual unsigned GetPollEvents (void) const = 0;
+
+	// pHandler may be 0 to remove the handler
+	void SetEventHandler (TNetEventHandler *pHandler, void *pParam);
+
+	// returns TRUE, if packets from the foreign IP address and port only are accepted
+	virtual boolean IsFullySpecified (void) const = 0;
 	
 	virtual void Process (void) = 0;
 
 	// returns: -1: invalid packet, 0: not to me, 1: packet consumed
-	virtual int PacketReceived (const void *pPacket, unsigned nLength,
+	// a consuming connection may keep pBuffer with AddRef() (e.g. to queue the payload),
+	// the caller must not access the packet data afterwards, only release the buffer
+	virtual int PacketReceived (CNetBuffer *pBuffer,
 				    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol) = 0;
 
 	// returns: 0: not to me, 1: notification consumed
@@ -73,6 +96,17 @@ public:
 					  u16 nSendPort, u16 nReceivePort,
 					  int nProtocol) = 0;
 
+protected:
+	// calls the event handler, must be called on each state change, which may
+	// affect the result of GetPollEvents()
+	void SignalEvent (void)
+	{
+		if (m_pEventHandler != 0)
+		{
+			(*m_pEventHandler) (m_pEventParam);
+		}
+	}
+
 protected:
 	CNetConfig    *m_pNetConfig;
 	CNetworkLayer *m_pNetworkLayer;
@@ -83,6 +117,17 @@ protected:
 	int m_nProtocol;
 
 	CChecksumCalculator m_Checksum;
+
+private:
+	TNetEventHandler *m_pEventHandler;
+	void *m_pEventParam;
+
+	friend class CTransportLayer;		// maintains the following members
+
+	boolean m_bHashed;			// entered in the connection map with this key:
+	u32 m_nHashedIP;			//	foreign IP address
+	u16 m_nHashedPort;			//	foreign port
+	CNetConnection *m_pNextOnPort;		// otherwise in the port map
 };
 
 #endif
@@ -2,7 +2,7 @@
 // netdevlayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/net/netconfig.h>
 #include <circle/netdevice.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/bcm54213.h>
 #include <circle/types.h>
 
@@ -39,8 +40,15 @@ public:
 	// returns 0, if net device is not available yet
 	const CMACAddress *GetMACAddress (void) const;
 
+	// returns NET_OFFLOAD_* flags of the net device, 0 if not available yet
+	u32 GetOffloadCapabilities (void) const;
+
+	// the reference to pBuffer is taken over
+	void Send (CNetBuffer *pBuffer);
 	void Send (const void *pBuffer, unsigned nLength);
-	boolean Receive (void *pBuffer, unsigned *pResultLength);
+
+	// returns 0 if nothing has been received, the buffer has to be released by the caller
+	CNetBuffer *Receive (void);
 
 	boolean IsRunning (void) const;			// is net device available?
 
@@ -2,7 +2,7 @@
 // netqueue.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,11 +20,10 @@
 #ifndef _circle_net_netqueue_h
 #define _circle_net_netqueue_h
 
+#include <circle/net/netbuffer.h>
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
-struct TNetQueueEntry;
-
 class CNetQueue
 {
 public:
@@ -35,14 +34,26 @@ public:
 	
 	void Flush (void);
 	
-	void Enqueue (const void *pBuffer, unsigned nLength, void *pParam = 0);
+	// the reference to pBuffer is taken over by the queue
+	void Enqueue (CNetBuffer *pBuffer);
+
+	// returns 0 if queue is empty, the buffer has to be released by the caller
+	CNetBuffer *Dequeue (void);
+
+	// returns the first buffer without removing it (0 if queue is empty),
+	// the buffer remains owned by the queue
+	CNetBuffer *Peek (void) const;
+
+	// copies the data into a new buffer, returns FALSE if no buffer is available
+	boolean Enqueue (const void *pBuffer, unsigned nLength);
 
-	// returns length (0 if queue is empty)
-	unsigned Dequeue (void *pBuffer, void **ppParam = 0);
+	// copies at most nBufferSize bytes, the rest of the entry is discarded,
+	// returns copied length (0 if queue is empty)
+	unsigned Dequeue (void *pBuffer, unsigned nBufferSize);
 
 private:
-	volatile TNetQueueEntry *m_pFirst;
-	volatile TNetQueueEntry *m_pLast;
+	CNetBuffer *volatile m_pFirst;
+	CNetBuffer *volatile m_pLast;
 
 	CSpinLock m_SpinLock;
 };
@@ -2,7 +2,7 @@
 // networklayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,9 +23,11 @@
 #include <circle/net/netconfig.h>
 #include <circle/net/linklayer.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/net/ipaddress.h>
 #include <circle/net/icmphandler.h>
 #include <circle/net/routecache.h>
+#include <circle/net/ipreassembler.h>
 #include <circle/macros.h>
 #include <circle/types.h>
 
@@ -41,7 +43,7 @@ struct TIPHeader
 	u16	nIdentification;
 #define IP_IDENTIFICATION_DEFAULT	0
 	u16	nFlagsFragmentOffset;
-#define IP_FRAGMENT_OFFSET(field)	((field) & 0x1F00)
+#define IP_FRAGMENT_OFFSET(field)	((field) & 0x1FFF)		// in units of 8 bytes
 	#define IP_FRAGMENT_OFFSET_FIRST	0
 #define IP_FLAGS_DF			(1 << 6)	// valid without BE()
 #define IP_FLAGS_MF			(1 << 5)
@@ -56,6 +58,10 @@ struct TIPHeader
 }
 PACKED;
 
+#define IP_PACKET_SIZE_MAX		65535
+#define IP_MTU_DEFAULT			1500		// Ethernet
+#define IP_MTU_MIN			68		// RFC 791
+
 struct TNetworkPrivateData
 {
 	u8	nProtocol;
@@ -73,11 +79,19 @@ public:
 
 	void Process (void);
 
+	// the reference to pPacket is taken over
+	boolean Send (const CIPAddress &rReceiver, CNetBuffer *pPacket, int nProtocol);
 	boolean Send (const CIPAddress &rReceiver, const void *pPacket, unsigned nLength, int nProtocol);
 
-	// pBuffer must have size FRAME_BUFFER_SIZE
-	boolean Receive (void *pBuffer, unsigned *pResultLength,
-			 CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol);
+	// returns 0 if nothing has been received, the buffer has to be released by the caller
+	CNetBuffer *Receive (CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol);
+
+	// returns NET_OFFLOAD_* flags of the net device
+	u32 GetOffloadCapabilities (void) const;
+
+	// returns the maximum size of an IP packet (with header) to rReceiver, which can be
+	// sent without fragmentation (as reported by ICMP or the MTU of the local network)
+	unsigned GetPathMTU (const CIPAddress &rReceiver) const;
 
 	boolean ReceiveNotification (TICMPNotificationType *pType,
 				     CIPAddress *pSender, CIPAddress *pReceiver,
@@ -87,8 +101,12 @@ public:
 private:
 	void AddRoute (const u8 *pDestIP, const u8 *pGatewayIP);
 	const u8 *GetGateway (const u8 *pDestIP) const;
+	void SetPathMTU (const u8 *pDestIP, unsigned nMTU);
 	friend class CICMPHandler;
 
+	// the reference to pPacket (with IP header) is taken over
+	boolean SendFragments (const CIPAddress &rNextHop, CNetBuffer *pPacket, unsigned nMTU);
+
 	// post IP packet to the ICMP handler for notification
 	void SendFailed (unsigned nICMPCode, const void *pReturnedPacket, unsigned nLength);
 	friend class CLinkLayer;
@@ -103,6 +121,9 @@ private:
 	CNetQueue m_ICMPNotificationQueue;
 
 	CRouteCache m_RouteCache;
+
+	CIPReassembler m_Reassembler;
+	u16 m_nIdentification;
 };
 
 #endif
@@ -0,0 +1,69 @@
+//
+// outoforderqueue.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_outoforderqueue_h
+#define _circle_net_outoforderqueue_h
+
+#include <circle/net/netbuffer.h>
+#include <circle/types.h>
+
+#define OOO_QUEUE_SIZE		64		// maximum number of queued segments
+
+class COutOfOrderQueue		// holds TCP segments, which were received ahead of RCV.NXT
+{
+public:
+	COutOfOrderQueue (void);
+	~COutOfOrderQueue (void);
+
+	boolean IsEmpty (void) const;
+
+	// pBuffer contains the segment data only, the reference to it is taken over
+	void Insert (u32 nSequenceNumber, CNetBuffer *pBuffer);
+
+	// returns the next segment, which continues the data at nSequenceNumber (or 0),
+	// data before nSequenceNumber has already been removed from the returned buffer
+	CNetBuffer *Remove (u32 nSequenceNumber);
+
+	// returns the number of SACK blocks (RFC 2018) written to the arrays,
+	// the block, which contains the most recently inserted segment, comes first
+	unsigned GetSACKBlocks (u32 *pLeftEdge, u32 *pRightEdge, unsigned nMaxBlocks) const;
+
+	void Flush (void);
+
+private:
+	// merges contiguous segments, starting at nIndex, into one block,
+	// returns the index of the segment following the block
+	unsigned GetBlock (unsigned nIndex, u32 *pLeftEdge, u32 *pRightEdge) const;
+
+	void Delete (unsigned nIndex);
+
+private:
+	struct TSegment
+	{
+		u32		 nSequenceNumber;
+		CNetBuffer	*pBuffer;
+	};
+
+	TSegment m_Segment[OOO_QUEUE_SIZE];	// sorted by sequence number
+	unsigned m_nSegments;
+
+	u32 m_nLastSequenceNumber;		// of the most recently inserted segment
+};
+
+#endif
@@ -2,7 +2,7 @@
 // retransmissionqueue.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -35,7 +35,13 @@ public:
 
 	unsigned GetBytesAvailable (void) const;
 	void Read (void *pBuffer, unsigned nLength);
+	// like Read(), returns the partial Internet checksum of the data (not complemented)
+	u16 ReadAndSum (void *pBuffer, unsigned nLength);
+	void Skip (unsigned nBytes);				// like Read() without copying
 	void Advance (unsigned nBytes);
+
+	// copy data from nOffset bytes after the first unacknowledged byte
+	void Peek (void *pBuffer, unsigned nOffset, unsigned nLength) const;
 	void Reset (void);
 
 	void Flush (void);
@@ -2,7 +2,7 @@
 // retranstimeoutcalc.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -31,6 +31,8 @@ public:
 	~CRetransmissionTimeoutCalculator (void);
 
 	unsigned GetRTO (void) const;
+	unsigned GetSRTT (void) const;				// 0 if not measured yet
+	unsigned GetRTTVAR (void) const;
 
 	void Initialize (u32 nISN);
 
@@ -2,7 +2,7 @@
 // routecache.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -35,6 +35,16 @@ public:
 
 	const u8 *GetRoute (const u8 *pDestIP) const;
 
+	// path MTU, which has been reported for this destination
+	void SetMTU (const u8 *pDestIP, unsigned nMTU);
+
+	// returns 0 if the path MTU is unknown or has expired
+	unsigned GetMTU (const u8 *pDestIP) const;
+
+private:
+	struct TRouteCacheEntry *FindEntry (const u8 *pDestIP) const;
+	struct TRouteCacheEntry *CreateEntry (const u8 *pDestIP);
+
 public:
 	CPtrArray m_Cache;
 };
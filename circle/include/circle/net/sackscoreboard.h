@@ -0,0 +1,65 @@
+//
+// sackscoreboard.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_sackscoreboard_h
+#define _circle_net_sackscoreboard_h
+
+#include <circle/types.h>
+
+#define SACK_SCOREBOARD_SIZE	16		// maximum number of SACKed ranges
+
+class CSACKScoreboard		// sequence ranges, which have been selectively acknowledged (RFC 2018)
+{
+public:
+	CSACKScoreboard (void);
+	~CSACKScoreboard (void);
+
+	boolean IsEmpty (void) const;
+
+	void Add (u32 nLeftEdge, u32 nRightEdge);
+
+	// removes all ranges before nAcknowledgmentNumber
+	void Advance (u32 nAcknowledgmentNumber);
+
+	// returns TRUE if nSequenceNumber has been SACKed, *pRightEdge is the end of this range
+	boolean IsSACKed (u32 nSequenceNumber, u32 *pRightEdge) const;
+
+	// returns TRUE if a SACKed range starts after nSequenceNumber, *pLeftEdge is its start
+	boolean GetNextRange (u32 nSequenceNumber, u32 *pLeftEdge) const;
+
+	// returns the end of the highest SACKed range, must not be empty
+	u32 GetHighest (void) const;
+
+	// returns the number of SACKed bytes before nSequenceNumber
+	u32 GetSACKedBytes (u32 nSequenceNumber) const;
+
+	void Clear (void);
+
+private:
+	struct TRange
+	{
+		u32	nLeftEdge;
+		u32	nRightEdge;
+	};
+
+	TRange m_Range[SACK_SCOREBOARD_SIZE];	// sorted, not overlapping
+	unsigned m_nRanges;
+};
+
+#endif
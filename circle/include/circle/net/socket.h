@@ -2,7 +2,7 @@
 // socket.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -29,6 +29,7 @@
 #define SOCKET_MAX_LISTEN_BACKLOG	32
 
 class CNetSubSystem;
+class CSocketPoller;
 
 class CSocket : public CNetSocket	/// Application programming interface to the TCP/IP network
 {
@@ -90,7 +91,8 @@ public:
 	/// \brief Receive a message from a remote host, return host/port of remote host
 	/// \param pBuffer Pointer to the message buffer
 	/// \param nLength Size of the message buffer in bytes\n
-	/// Should be at least FRAME_BUFFER_SIZE, otherwise data may get lost
+	/// Should be at least FRAME_BUFFER_SIZE, otherwise data may get lost\n
+	/// (UDP datagrams can be up to 65507 bytes long)
 	/// \param nFlags MSG_DONTWAIT (non-blocking operation) or 0 (blocking operation)
 	/// \param pForeignIP	IP address of host which has sent the message will be returned here
 	/// \param pForeignPort	Number of port from which the message has been sent will be returned here
@@ -104,6 +106,29 @@ public:
 	/// \return Status (0 success, < 0 on error)
 	int SetOptionBroadcast (boolean bAllowed);
 
+	/// \brief Disable the Nagle algorithm on a TCP socket, so that small messages\n
+	/// are sent immediately, even if previously sent data is not acknowledged yet
+	/// \param bNoDelay Send small messages without delay? (default FALSE)
+	/// \return Status (0 success, < 0 on error or not a TCP socket)
+	int SetOptionNoDelay (boolean bNoDelay);
+
+	/// \brief Call this with bCork == TRUE on a TCP socket to send full-sized segments only\n
+	/// (remaining data is sent, when the option is reset or the socket is closed)
+	/// \param bCork Hold back partial segments? (default FALSE)
+	/// \return Status (0 success, < 0 on error or not a TCP socket)
+	int SetOptionCork (boolean bCork);
+
+	/// \brief Select the congestion control algorithm of a TCP socket\n
+	/// (call this after Connect() or on a socket returned by Accept())
+	/// \param Algorithm TCPCongestionControlNewReno or TCPCongestionControlCUBIC
+	/// \return Status (0 success, < 0 on error or not a TCP socket)
+	int SetOptionCongestionControl (TTCPCongestionControl Algorithm);
+
+	/// \brief Get runtime information about a connected TCP socket
+	/// \param pInfo Pointer to the structure to be filled
+	/// \return Status (0 success, < 0 on error or not a TCP socket)
+	int GetConnectionInfo (TTCPConnectionInfo *pInfo) const;
+
 	/// \brief Get IP address of connected remote host
 	/// \return Pointer to IP address (four bytes, 0-pointer if not connected)
 	const u8 *GetForeignIP (void) const;
@@ -111,6 +136,12 @@ public:
 private:
 	CSocket (CSocket &rSocket, int hConnection);
 
+	// for CSocketPoller
+	unsigned GetPollEvents (void) const;
+	void SetEventHandler (TNetEventHandler *pHandler, void *pParam);
+	void SetEventHandler (int hConnection);
+	friend class CSocketPoller;
+
 private:
 	CNetConfig	*m_pNetConfig;
 	CTransportLayer	*m_pTransportLayer;
@@ -121,6 +152,10 @@ private:
 
 	unsigned m_nBackLog;
 	int m_hListenConnection[SOCKET_MAX_LISTEN_BACKLOG];
+
+	CSocketPoller *m_pPoller;		// registered with this poller (or 0)
+	TNetEventHandler *m_pEventHandler;	// set on all connections of this socket
+	void *m_pEventParam;
 };
 
 #endif
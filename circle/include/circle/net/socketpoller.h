@@ -0,0 +1,117 @@
+//
+// socketpoller.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_socketpoller_h
+#define _circle_net_socketpoller_h
+
+#include <circle/net/socket.h>
+#include <circle/net/in.h>
+#include <circle/sched/synchronizationevent.h>
+#include <circle/types.h>
+
+#define SOCKET_POLL_INFINITE	0xFFFFFFFFU	///< Timeout value for Wait() without timeout
+
+struct TSocketPollEvent		/// Event returned by CSocketPoller::Wait()
+{
+	CSocket		*pSocket;
+	unsigned	 nEvents;		///< SOCKET_POLL_* events, which are ready
+	void		*pParam;		///< as given to CSocketPoller::Add()
+};
+
+/// \note Sockets are registered with one or more of the events SOCKET_POLL_READ,\n
+///	  SOCKET_POLL_WRITE and SOCKET_POLL_ACCEPT (see: circle/net/in.h).\n
+///	  SOCKET_POLL_ERROR and SOCKET_POLL_HANGUP are always reported.\n
+///	  By default the events are level-triggered: A socket is reported by each call\n
+///	  of Wait(), as long as one of its events is ready. With SOCKET_POLL_EDGE it is\n
+///	  reported only once after a state change of its connection, so that the\n
+///	  application must call Receive() with MSG_DONTWAIT until it returns 0.
+/// \note Only the sockets, whose connections have changed their state, are checked\n
+///	  by Wait(), so that one task can serve many sockets.
+/// \note A socket can be registered with one poller only. It is removed\n
+///	  automatically, when it is deleted.
+
+class CSocketPoller	/// Waits for readiness events on multiple sockets (like epoll)
+{
+public:
+	CSocketPoller (void);
+
+	/// \brief Destructor (removes all sockets)
+	~CSocketPoller (void);
+
+	/// \brief Register a socket
+	/// \param pSocket Pointer to the socket (after Bind(), Connect() or Listen())
+	/// \param nEvents SOCKET_POLL_* events to wait for, optionally with SOCKET_POLL_EDGE
+	/// \param pParam  User parameter, which is returned with the events of the socket
+	/// \return Status (0 success, < 0 on error)
+	int Add (CSocket *pSocket, unsigned nEvents, void *pParam = 0);
+
+	/// \brief Change the events of a registered socket
+	/// \param pSocket Pointer to the socket
+	/// \param nEvents SOCKET_POLL_* events to wait for, optionally with SOCKET_POLL_EDGE
+	/// \param pParam  User parameter, which is returned with the events of the socket
+	/// \return Status (0 success, < 0 on error)
+	int Modify (CSocket *pSocket, unsigned nEvents, void *pParam = 0);
+
+	/// \brief Unregister a socket
+	/// \param pSocket Pointer to the socket
+	/// \return Status (0 success, < 0 on error)
+	int Remove (CSocket *pSocket);
+
+	/// \brief Wait for events on the registered sockets
+	/// \param pEvents Pointer to an array, which receives the events
+	/// \param nMaxEvents Number of entries in pEvents
+	/// \param nTimeoutMs Timeout in milliseconds (0 to return immediately,\n
+	///	   SOCKET_POLL_INFINITE to wait until an event occurs)
+	/// \return Number of entries in pEvents (0 on timeout)
+	int Wait (TSocketPollEvent *pEvents, unsigned nMaxEvents, unsigned nTimeoutMs);
+
+private:
+	struct TEntry
+	{
+		CSocket		*pSocket;
+		unsigned	 nEvents;
+		void		*pParam;
+		CSocketPoller	*pPoller;
+
+		TEntry		*pPrev;			// list of all entries
+		TEntry		*pNext;
+
+		boolean		 bQueued;		// in the ready list
+		TEntry		*pNextReady;
+	};
+
+	// checks the entries in the ready list, returns the number of events
+	unsigned CollectEvents (TSocketPollEvent *pEvents, unsigned nMaxEvents);
+
+	void Enqueue (TEntry *pEntry);
+	void Dequeue (TEntry *pEntry);
+
+	// called by the connections of a socket on state changes
+	static void EventHandler (void *pParam);
+
+private:
+	TEntry *m_pFirst;
+
+	TEntry *m_pFirstReady;
+	TEntry *m_pLastReady;
+
+	CSynchronizationEvent m_Event;
+};
+
+#endif
@@ -0,0 +1,99 @@
+//
+// tcpcongestioncontrol.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_tcpcongestioncontrol_h
+#define _circle_net_tcpcongestioncontrol_h
+
+#include <circle/types.h>
+
+enum TTCPCongestionControl
+{
+	TCPCongestionControlNewReno,
+	TCPCongestionControlCUBIC,
+	TCPCongestionControlUnknown
+};
+
+#define TCP_CONGESTION_CONTROL_DEFAULT	TCPCongestionControlCUBIC
+
+#define TCP_MAX_CONGESTION_WINDOW	0x1000000	// upper limit of cwnd in bytes
+
+struct TTCPConnectionInfo		// status of a TCP connection
+{
+	TTCPCongestionControl	CongestionControl;
+	u32			nCongestionWindow;	// cwnd in bytes
+	u32			nSlowStartThreshold;	// ssthresh in bytes
+	u32			nSendWindow;		// in bytes, as announced by the peer
+	u32			nReceiveWindow;		// in bytes, as announced to the peer
+	u16			nSendMSS;		// maximum segment size
+	unsigned		nSmoothedRTT;		// in HZ units (0 if not measured yet)
+	unsigned		nRTTVariation;		// in HZ units
+	unsigned		nRTO;			// in HZ units
+	unsigned		nRetransmissionTimeouts;
+	unsigned		nFastRetransmissions;	// segments resent by loss recovery
+};
+
+class CTCPCongestionControl		// base class of TCP congestion control algorithms (RFC 5681)
+{
+public:
+	CTCPCongestionControl (TTCPCongestionControl Algorithm);
+	virtual ~CTCPCongestionControl (void);
+
+	TTCPCongestionControl GetAlgorithm (void) const;
+
+	u32 GetWindow (void) const;			// cwnd in bytes
+	u32 GetSlowStartThreshold (void) const;		// ssthresh in bytes
+
+	// sets the initial window, when the MSS is known (RFC 5681 section 3.1)
+	virtual void Initialize (u16 nMSS);
+
+	// continues with the window of a previously used algorithm
+	void TakeOver (const CTCPCongestionControl *pPrevious);
+
+	// nBytesAcked of new data have been acknowledged outside of loss recovery,
+	// nRTT is the smoothed round-trip time in HZ units (0 if not measured yet)
+	virtual void DataAcknowledged (u32 nBytesAcked, unsigned nRTT) = 0;
+
+	// fast retransmit has detected a loss, nFlightSize is the outstanding data in bytes
+	virtual void LossDetected (u32 nFlightSize) = 0;
+
+	// all data, which was outstanding when the loss was detected, has been acknowledged
+	virtual void RecoveryFinished (void);
+
+	// the retransmission timer has expired
+	virtual void RetransmissionTimeout (u32 nFlightSize);
+
+	// returns 0 for TCPCongestionControlUnknown
+	static CTCPCongestionControl *Create (TTCPCongestionControl Algorithm);
+
+protected:
+	// slow start with appropriate byte counting (RFC 3465, L = 2*SMSS)
+	void SlowStart (u32 nBytesAcked);
+
+	void IncreaseWindow (u32 nIncrement);
+
+protected:
+	u16 m_nMSS;
+	u32 m_nCWND;
+	u32 m_nSSThresh;
+
+private:
+	TTCPCongestionControl m_Algorithm;
+};
+
+#endif
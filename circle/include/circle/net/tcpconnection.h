@@ -2,7 +2,7 @@
 // tcpconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -26,6 +26,9 @@
 #include <circle/net/icmphandler.h>
 #include <circle/net/netqueue.h>
 #include <circle/net/retransmissionqueue.h>
+#include <circle/net/outoforderqueue.h>
+#include <circle/net/sackscoreboard.h>
+#include <circle/net/tcpcongestioncontrol.h>
 #include <circle/net/retranstimeoutcalc.h>
 #include <circle/sched/synchronizationevent.h>
 #include <circle/timer.h>
@@ -52,6 +55,7 @@ enum TTCPTimer
 	TCPTimerUser,
 	TCPTimerRetransmission,
 	TCPTimerTimeWait,
+	TCPTimerDelayedACK,
 	TCPTimerUnknown
 };
 
@@ -75,20 +79,29 @@ public:
 	int Close (void);
 	
 	int Send (const void *pData, unsigned nLength, int nFlags);
-	int Receive (void *pBuffer, int nFlags);
+	int Receive (void *pBuffer, unsigned nLength, int nFlags);
 
 	int SendTo (const void *pData, unsigned nLength, int nFlags, CIPAddress	&rForeignIP, u16 nForeignPort);
-	int ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeignIP, u16 *pForeignPort);
+	int ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags,
+			 CIPAddress *pForeignIP, u16 *pForeignPort);
 
 	int SetOptionBroadcast (boolean bAllowed);
 
+	int SetOptionNoDelay (boolean bNoDelay);
+	int SetOptionCork (boolean bCork);
+	int SetOptionCongestionControl (TTCPCongestionControl Algorithm);
+	int GetConnectionInfo (TTCPConnectionInfo *pInfo) const;
+
 	boolean IsConnected (void) const;
 	boolean IsTerminated (void) const;
+	boolean IsFullySpecified (void) const;
+
+	unsigned GetPollEvents (void) const;
 	
 	void Process (void);
 	
 	// returns: -1: invalid packet, 0: not to me, 1: packet consumed
-	int PacketReceived (const void *pPacket, unsigned nLength,
+	int PacketReceived (CNetBuffer *pBuffer,
 			    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol);
 
 	// returns: 0: not to me, 1: notification consumed
@@ -98,8 +111,26 @@ public:
 				  int nProtocol);
 
 private:
+	// the reference to pData (segment payload) is taken over,
+	// nDataSum is the partial checksum of the payload (-1 if not known)
 	boolean SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber = 0,
-			     const void *pData = 0, unsigned nDataLength = 0);
+			     CNetBuffer *pData = 0, int nDataSum = -1);
+
+	void QueueReceivedData (CNetBuffer *pBuffer, unsigned nDataOffset, unsigned nDataLength);
+
+	// returns TRUE if the receive window has been opened considerably
+	boolean UpdateReceiveWindow (void);
+	void AdjustReceiveBuffer (unsigned nBytesRead);
+
+	// retransmit the next segment, which is considered lost (RFC 6675)
+	boolean RetransmitLostSegment (void);
+
+	// returns the number of bytes, which may be sent now,
+	// limited by the send window and the congestion window
+	u32 GetUsableWindow (void) const;
+
+	// returns the send MSS, limited by the path MTU to the foreign host
+	unsigned GetSegmentSize (void) const;
 
 	void ScanOptions (TTCPHeader *pHeader);
 	
@@ -124,8 +155,10 @@ private:
 
 	CNetQueue m_TxQueue;
 	CNetQueue m_RxQueue;
+	COutOfOrderQueue m_OutOfOrderQueue;
 
 	CRetransmissionQueue m_RetransmissionQueue;
+	CSACKScoreboard m_SACKScoreboard;
 	volatile boolean m_bRetransmit;		// reset m_RetransmissionQueue and send
 	volatile boolean m_bSendSYN;		// send SYN when in TCPStateSynSent or TCPStateSynReceived
 	volatile boolean m_bFINQueued;		// send FIN when TX and retransmission queues are empty
@@ -159,6 +192,35 @@ private:
 	// Other Variables
 	u16 m_nSND_MSS;		// send maximum segment size
 
+	// Window Scale Option (RFC 7323)
+	boolean m_bWindowScale;	// window scale option negotiated
+	u8 m_nSND_SCALE;	// shift count for received windows
+	u8 m_nRCV_SCALE;	// shift count for sent windows
+
+	// Receive Buffer Autotuning
+	u32 m_nRCV_BUF;			// receive buffer size (upper limit of m_nRCV_WND)
+	volatile u32 m_nRxQueued;	// bytes in m_RxQueue, not read by the application yet
+	volatile u32 m_nRxBuffers;	// net buffers in m_RxQueue (limited by TCP_CONFIG_RCV_BUFFERS_MAX)
+	u32 m_nRxBytesRead;		// bytes read by the application in this measurement
+	unsigned m_nRxMeasureStart;	// start of this measurement (in HZ units)
+
+	// Selective Acknowledgment (RFC 2018) and Loss Recovery (RFC 6675)
+	boolean m_bSACKPermitted;	// SACK-permitted option negotiated
+	unsigned m_nDupAcks;		// number of consecutive duplicate ACKs
+	boolean m_bInRecovery;		// loss recovery is active
+	u32 m_nRecoveryPoint;		// recovery ends, when this has been acknowledged
+	u32 m_nHighRxt;			// end of the highest retransmitted segment
+
+	CTCPCongestionControl *m_pCongestionControl;
+	unsigned m_nRetransmissionTimeouts;
+	unsigned m_nFastRetransmissions;
+
+	// Delayed ACK (RFC 1122 section 4.2.3.2) and Nagle Algorithm (RFC 896)
+	unsigned m_nUnackedSegments;		// segments received in order, not acknowledged yet
+	volatile boolean m_bSendDelayedACK;	// delayed ACK timer has expired
+	boolean m_bNoDelay;			// Nagle algorithm disabled
+	boolean m_bCork;			// send full-sized segments only
+
 	CRetransmissionTimeoutCalculator m_RTOCalculator;
 
 	static unsigned s_nConnections;
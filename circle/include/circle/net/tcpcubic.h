@@ -0,0 +1,59 @@
+//
+// tcpcubic.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_tcpcubic_h
+#define _circle_net_tcpcubic_h
+
+#include <circle/net/tcpcongestioncontrol.h>
+#include <circle/types.h>
+
+class CTCPCubic : public CTCPCongestionControl		// RFC 9438
+{
+public:
+	CTCPCubic (void);
+	~CTCPCubic (void);
+
+	void DataAcknowledged (u32 nBytesAcked, unsigned nRTT);
+
+	void LossDetected (u32 nFlightSize);
+
+	void RetransmissionTimeout (u32 nFlightSize);
+
+private:
+	// windows in segments are fixed point values with 10 fractional bits
+	u32 BytesToSegments (u32 nBytes) const;
+	u32 SegmentsToBytes (u32 nSegments) const;
+
+	static u32 CubeRoot (u64 ulValue);
+
+private:
+	u32 m_nWmax;			// window before the last reduction (in segments)
+	u32 m_nWlastMax;		// for fast convergence (in segments)
+
+	boolean m_bEpochStarted;
+	unsigned m_nEpochStart;		// in microseconds
+	u32 m_nK;			// in milliseconds
+	u32 m_nOrigin;			// origin point of the cubic function (in segments)
+
+	u32 m_nCubicAcked;		// bytes acknowledged since the last increase
+	u32 m_nWest;			// Reno-friendly window estimate (in bytes)
+	u32 m_nWestAcked;
+};
+
+#endif
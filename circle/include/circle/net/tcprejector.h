@@ -2,7 +2,7 @@
 // tcprejector.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -34,7 +34,7 @@ public:
 	~CTCPRejector (void);
 
 	// returns: -1: invalid packet, 0: not to me, 1: packet consumed
-	int PacketReceived (const void *pPacket, unsigned nLength,
+	int PacketReceived (CNetBuffer *pBuffer,
 			    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol);
 
 	// unused
@@ -42,14 +42,20 @@ public:
 	int Accept (CIPAddress *pForeignIP, u16 *pForeignPort)		{ return -1; }
 	int Close (void)						{ return -1; }
 	int Send (const void *pData, unsigned nLength, int nFlags)	{ return -1; }
-	int Receive (void *pBuffer, int nFlags)				{ return -1; }
+	int Receive (void *pBuffer, unsigned nLength, int nFlags)	{ return -1; }
 	int SendTo (const void *pData, unsigned nLength, int nFlags,
 		    CIPAddress	&rForeignIP, u16 nForeignPort)		{ return -1; }
-	int ReceiveFrom (void *pBuffer, int nFlags,
+	int ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags,
 			 CIPAddress *pForeignIP, u16 *pForeignPort)	{ return -1; }
 	int SetOptionBroadcast (boolean bAllowed)			{ return -1; }
+	int SetOptionNoDelay (boolean bNoDelay)				{ return -1; }
+	int SetOptionCork (boolean bCork)				{ return -1; }
+	int SetOptionCongestionControl (TTCPCongestionControl Algorithm) { return -1; }
+	int GetConnectionInfo (TTCPConnectionInfo *pInfo) const		{ return -1; }
 	boolean IsConnected (void) const				{ return FALSE; }
 	boolean IsTerminated (void) const				{ return FALSE; }
+	boolean IsFullySpecified (void) const				{ return FALSE; }
+	unsigned GetPollEvents (void) const				{ return 0; }
 	void Process (void)						{ }
 	int NotificationReceived (TICMPNotificationType Type,
 				  CIPAddress &rSenderIP, CIPAddress &rReceiverIP,
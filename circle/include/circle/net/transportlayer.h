@@ -2,7 +2,7 @@
 // transportlayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,9 +27,37 @@
 #include <circle/net/ipaddress.h>
 #include <circle/net/netqueue.h>
 #include <circle/ptrarray.h>
+#include <circle/hashmap.h>
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
+struct TConnectionKey			// identifies a fully specified connection
+{
+	u32	nForeignIP;
+	u16	nForeignPort;
+	u16	nOwnPort;
+	int	nProtocol;
+};
+
+struct TConnectionKeyTraits
+{
+	static u32 Hash (const TConnectionKey &Key)
+	{
+		return THashTraits<u32>::HashWord (  Key.nForeignIP
+						   ^ THashTraits<u32>::HashWord (  (u32) Key.nForeignPort << 16
+										 | Key.nOwnPort)
+						   ^ Key.nProtocol);
+	}
+
+	static boolean Equal (const TConnectionKey &Key1, const TConnectionKey &Key2)
+	{
+		return    Key1.nForeignIP == Key2.nForeignIP
+		       && Key1.nForeignPort == Key2.nForeignPort
+		       && Key1.nOwnPort == Key2.nOwnPort
+		       && Key1.nProtocol == Key2.nProtocol;
+	}
+};
+
 class CTransportLayer
 {
 public:
@@ -53,21 +81,48 @@ public:
 
 	int Send (const void *pData, unsigned nLength, int nFlags, int hConnection);
 
-	// pBuffer must have size FRAME_BUFFER_SIZE
-	int Receive (void *pBuffer, int nFlags, int hConnection);
+	// nLength is the size of pBuffer, a datagram is truncated to it
+	int Receive (void *pBuffer, unsigned nLength, int nFlags, int hConnection);
 
 	int SendTo (const void *pData, unsigned nLength, int nFlags,
 		    CIPAddress &rForeignIP, u16 nForeignPort, int hConnection);
 
-	// pBuffer must have size FRAME_BUFFER_SIZE
-	int ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeignIP,
+	// nLength is the size of pBuffer, a datagram is truncated to it
+	int ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags, CIPAddress *pForeignIP,
 			 u16 *pForeignPort, int hConnection);
 
 	int SetOptionBroadcast (boolean bAllowed, int hConnection);
+	int SetOptionNoDelay (boolean bNoDelay, int hConnection);
+	int SetOptionCork (boolean bCork, int hConnection);
+	int SetOptionCongestionControl (TTCPCongestionControl Algorithm, int hConnection);
+	int GetConnectionInfo (TTCPConnectionInfo *pInfo, int hConnection) const;
 
 	boolean IsConnected (int hConnection) const;
+
+	// returns SOCKET_POLL_* events (see: in.h), which are ready now (0 for invalid handle)
+	unsigned GetPollEvents (int hConnection) const;
+	// the handler is called on state changes of the connection (pHandler = 0 to remove it),
+	// it is removed automatically by Disconnect()
+	int SetEventHandler (int hConnection, TNetEventHandler *pHandler, void *pParam);
 	const u8 *GetForeignIP (int hConnection) const;		// returns 0 if not connected
 
+private:
+	// returns TRUE, if a connection has consumed the packet
+	boolean DeliverPacket (CNetBuffer *pBuffer, CIPAddress &rSenderIP, CIPAddress &rReceiverIP,
+			       int nProtocol);
+
+	// m_SpinLock must be held, when calling the following methods
+	void AddConnection (CNetConnection *pConnection);
+	void RemoveConnection (CNetConnection *pConnection);
+	void UpdateConnection (CNetConnection *pConnection);	// after state change
+	void LinkConnection (CNetConnection *pConnection);
+	void UnlinkConnection (CNetConnection *pConnection);
+
+	static u32 GetPortKey (u16 nOwnPort, int nProtocol)
+	{
+		return (u32) nProtocol << 16 | nOwnPort;
+	}
+
 private:
 	CNetConfig    *m_pNetConfig;
 	CNetworkLayer *m_pNetworkLayer;
@@ -76,6 +131,17 @@ private:
 	u16 m_nOwnPort;
 	CSpinLock m_SpinLock;
 
+	// fully specified connections are found by their address and ports
+	CHashMap<TConnectionKey, CNetConnection *, TConnectionKeyTraits> m_ConnectionMap;
+
+	struct TPortEntry
+	{
+		unsigned	nConnections;	// all connections, which use this own port
+		CNetConnection *pFirst;		// list of connections, which are not in m_ConnectionMap
+	};
+
+	CHashMap<u32, TPortEntry> m_PortMap;	// key is GetPortKey()
+
 	CTCPRejector m_TCPRejector;
 };
 
@@ -2,7 +2,7 @@
 // udpconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -47,20 +47,30 @@ public:
 	int Close (void);
 	
 	int Send (const void *pData, unsigned nLength, int nFlags);
-	int Receive (void *pBuffer, int nFlags);
+	int Receive (void *pBuffer, unsigned nLength, int nFlags);
 
 	int SendTo (const void *pData, unsigned nLength, int nFlags, CIPAddress	&rForeignIP, u16 nForeignPort);
-	int ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeignIP, u16 *pForeignPort);
+	int ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags,
+			 CIPAddress *pForeignIP, u16 *pForeignPort);
 
 	int SetOptionBroadcast (boolean bAllowed);
 
+	// TCP only
+	int SetOptionNoDelay (boolean bNoDelay)				{ return -1; }
+	int SetOptionCork (boolean bCork)				{ return -1; }
+	int SetOptionCongestionControl (TTCPCongestionControl Algorithm)	{ return -1; }
+	int GetConnectionInfo (TTCPConnectionInfo *pInfo) const		{ return -1; }
+
 	boolean IsConnected (void) const;
 	boolean IsTerminated (void) const;
+	boolean IsFullySpecified (void) const;
+
+	unsigned GetPollEvents (void) const;
 	
 	void Process (void);
 
 	// returns: -1: invalid packet, 0: not to me, 1: packet consumed
-	int PacketReceived (const void *pPacket, unsigned nLength,
+	int PacketReceived (CNetBuffer *pBuffer,
 			    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol);
 
 	// returns: 0: not to me, 1: notification consumed
@@ -2,7 +2,7 @@
 // netdevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -46,6 +46,23 @@ enum TNetDeviceSpeed
 	NetDeviceSpeedUnknown
 };
 
+// Offload capabilities of a net device (returned by GetOffloadCapabilities())
+#define NET_OFFLOAD_RX_CHECKSUM		(1 << 0)	///< Verifies TCP/UDP checksums on RX
+#define NET_OFFLOAD_TX_CHECKSUM		(1 << 1)	///< Inserts TCP/UDP checksums on TX
+
+// Per-frame offload flags (TNetFrameInfo::nFlags)
+#define NET_FRAME_TX_CHECKSUM_PARTIAL	(1 << 0)	///< Device has to insert the checksum
+#define NET_FRAME_TX_CHECKSUM_UDP	(1 << 1)	///< Checksum is for UDP (0 becomes 0xFFFF)
+#define NET_FRAME_RX_IP_CHECKSUM_OK	(1 << 2)	///< IPv4 header checksum has been verified
+#define NET_FRAME_RX_L4_CHECKSUM_OK	(1 << 3)	///< TCP/UDP checksum has been verified
+
+struct TNetFrameInfo		/// Offload information, which is passed with a frame
+{
+	unsigned	nFlags;			///< NET_FRAME_* flags
+	unsigned	nChecksumStart;		///< TX: Offset of the checksummed area in the frame
+	unsigned	nChecksumOffset;	///< TX: Offset of the checksum field from nChecksumStart
+};
+
 class CNetDevice	/// Base class (interface) of net devices
 {
 public:
@@ -73,6 +90,33 @@ public:
 	/// \return TRUE if a frame is returned in buffer, FALSE if nothing has been received
 	virtual boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength) = 0;
 
+	/// \return Offload capabilities of this device (NET_OFFLOAD_* flags)
+	virtual u32 GetOffloadCapabilities (void)	{ return 0; }
+
+	/// \brief Send a valid Ethernet frame to the network with offload information
+	/// \param pBuffer Pointer to the frame, does not contain FCS
+	/// \param nLength Frame length in bytes, does not need to be padded
+	/// \param rInfo Offload information for this frame
+	/// \note With NET_FRAME_TX_CHECKSUM_PARTIAL set, the checksum field has to be preset with\n
+	///	  the (not complemented) sum of the pseudo header. This flag may only be set, if the\n
+	///	  device has the capability NET_OFFLOAD_TX_CHECKSUM.
+	virtual boolean SendFrame (const void *pBuffer, unsigned nLength, const TNetFrameInfo &rInfo)
+	{
+		return SendFrame (pBuffer, nLength);
+	}
+
+	/// \brief Poll for a received Ethernet frame with offload information
+	/// \param pBuffer Frame will be placed here, buffer must have size FRAME_BUFFER_SIZE
+	/// \param pResultLength Pointer to variable, which receives the valid frame length
+	/// \param pInfo Pointer to variable, which receives the offload information (nFlags only)
+	/// \return TRUE if a frame is returned in buffer, FALSE if nothing has been received
+	virtual boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength, TNetFrameInfo *pInfo)
+	{
+		pInfo->nFlags = 0;
+
+		return ReceiveFrame (pBuffer, pResultLength);
+	}
+
 	/// \return TRUE if PHY link is up
 	virtual boolean IsLinkUp (void)			{ return TRUE; }
 
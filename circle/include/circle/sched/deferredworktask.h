@@ -0,0 +1,51 @@
+//
+// deferredworktask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sched_deferredworktask_h
+#define _circle_sched_deferredworktask_h
+
+#include <circle/sched/task.h>
+#include <circle/sched/synchronizationevent.h>
+#include <circle/deferredwork.h>
+#include <circle/types.h>
+
+class CDeferredWorkTask : public CTask	/// Worker task, which runs the deferred work items of core 0
+{
+public:
+	/// \param pDeferredWork Pointer to the deferred work object
+	/// \param nMaxBatch Maximum number of items to run, before yielding to other tasks (0 for all)
+	/// \note The scheduler runs on core 0 only, so there is one task for core 0. Secondary
+	///	  cores have to call CDeferredWork::Process() from their own loop (e.g. in
+	///	  CMultiCoreSupport::Run()) or queue their items for core 0 with Queue (0).
+	CDeferredWorkTask (CDeferredWork *pDeferredWork, unsigned nMaxBatch = 16);
+	~CDeferredWorkTask (void);
+
+	void Run (void);
+
+private:
+	static void NotificationHandler (void *pParam);
+
+private:
+	CDeferredWork *m_pDeferredWork;
+	unsigned m_nMaxBatch;
+
+	CSynchronizationEvent m_Event;
+};
+
+#endif
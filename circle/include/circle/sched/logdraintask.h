@@ -0,0 +1,53 @@
+//
+// logdraintask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sched_logdraintask_h
+#define _circle_sched_logdraintask_h
+
+#include <circle/sched/task.h>
+#include <circle/sched/synchronizationevent.h>
+#include <circle/logger.h>
+#include <circle/types.h>
+
+class CLogDrainTask : public CTask	/// Low-priority task, which writes the deferred messages of CLogger
+{
+public:
+	/// \param nIntervalMs Maximum sleep time in milliseconds, while no deferred messages are pending
+	/// \param nMaxBatch Maximum number of messages to write, before yielding to other tasks
+	/// \note Call CLogger::EnableDeferred() before.
+	/// \note The task is woken, when a message is written on core 0 from TASK_LEVEL or
+	///	  IRQ_LEVEL. Messages from secondary cores and FIQ_LEVEL are written after
+	///	  nIntervalMs at the latest, because the scheduler runs on core 0 only and
+	///	  is not protected against FIQs.
+	CLogDrainTask (unsigned nIntervalMs = 10, unsigned nMaxBatch = 8);
+	~CLogDrainTask (void);
+
+	void Run (void);
+
+private:
+	static void DeferredNotificationHandler (void *pParam);
+
+private:
+	unsigned m_nIntervalMs;
+	unsigned m_nMaxBatch;
+
+	CSynchronizationEvent m_Event;
+};
+
+#endif
@@ -2,7 +2,7 @@
 /// \file scheduler.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 
 #include <circle/sched/task.h>
 #include <circle/spinlock.h>
+#include <circle/hashmap.h>
 #include <circle/device.h>
 #include <circle/sysconfig.h>
 #include <circle/types.h>
@@ -99,10 +100,16 @@ private:
 	void RemoveTask (CTask *pTask);
 	unsigned GetNextTask (void); // returns index into m_pTask or MAX_TASKS if no task was found
 
+	void AddTaskName (CTask *pTask);
+	void RemoveTaskName (CTask *pTask);
+
 private:
 	CTask *m_pTask[MAX_TASKS];
 	unsigned m_nTasks;
 
+	CHashMap<const CTask *, unsigned> m_TaskIndex;	// task to index into m_pTask
+	CHashMap<const char *, CTask *> m_TaskByName;	// key is the name buffer of the task
+
 	CTask *m_pCurrent;
 	unsigned m_nCurrent;	// index into m_pTask
 
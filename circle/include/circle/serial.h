@@ -2,7 +2,7 @@
 /// \file serial.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/device.h>
 #include <circle/interrupt.h>
 #include <circle/gpiopin.h>
+#include <circle/deferredwork.h>
 #include <circle/spinlock.h>
 #include <circle/sysconfig.h>
 #include <circle/types.h>
@@ -119,6 +120,8 @@ public:
 	/// (must remain valid after return from this method)
 	/// \param pHandler Handler which is called, when the magic string is found
 	/// \note Does only work with interrupt driver.
+	/// \note If a CDeferredWork object exists, the handler is called on exit from the
+	///	  IRQ handler (with IRQs enabled on AArch64), otherwise from the IRQ handler.
 	void RegisterMagicReceivedHandler (const char *pMagic, TMagicReceivedHandler *pHandler);
 
 protected:
@@ -143,6 +146,8 @@ private:
 	void InterruptHandler (void);
 	static void InterruptStub (void *pParam);
 
+	static void MagicReceivedWork (void *pParam);
+
 private:
 	CInterruptSystem *m_pInterruptSystem;
 	boolean m_bUseFIQ;
@@ -171,6 +176,7 @@ private:
 	const char *m_pMagic;
 	const char *m_pMagicPtr;
 	TMagicReceivedHandler *m_pMagicReceivedHandler;
+	CDeferredWorkItem m_MagicReceivedWork;
 
 	CSpinLock m_SpinLock;
 	CSpinLock m_LineSpinLock;
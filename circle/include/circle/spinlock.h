@@ -24,16 +24,45 @@
 #include <circle/synchronize.h>
 #include <circle/types.h>
 
+enum TSpinLockType
+{
+	SpinLockTestAndSet,	///< Simple test-and-set lock (default, not fair)
+	SpinLockTicket,		///< Ticket lock, cores get the lock in FIFO order
+	SpinLockMCS,		///< MCS queue lock, FIFO order, each core spins locally
+	SpinLockTypeUnknown
+};
+
 #ifdef ARM_ALLOW_MULTI_CORE
 
-class CSpinLock
+struct TSpinLockMCSNode;
+
+#ifdef SPINLOCK_STATISTICS
+
+class CSpinLock;
+
+struct TSpinLockStatistics
+{
+	const char	*pName;
+	unsigned long	 ulAcquisitions;
+	unsigned long	 ulContended;		// acquisitions, which had to wait
+	unsigned long	 ulSpins;		// total number of wait loop iterations
+	unsigned	 nMaxHoldTicks;		// in CLOCKHZ ticks (microseconds)
+	unsigned	 nAcquiredTicks;	// time of last acquisition
+	CSpinLock	*pNext;			// list of all locks with statistics
+	CSpinLock	*pPrev;
+};
+
+#endif
+
+class CSpinLock		/// Encapsulates a spin lock for synchronizing the concurrent access to a resource from multiple cores
 {
 public:
 	// nTargetLevel is the maximum execution level from which the spin lock is used.
 	// This has been a boolean parameter before and valid values were TRUE and FALSE.
 	// These parameters are still working, but are deprecated. Use the *_LEVEL defines
 	// from circle/sysconfig.h instead!
-	CSpinLock (unsigned nTargetLevel = IRQ_LEVEL);
+	/// \param Type Lock algorithm to be used for this instance
+	CSpinLock (unsigned nTargetLevel = IRQ_LEVEL, TSpinLockType Type = SpinLockTestAndSet);
 	~CSpinLock (void);
 
 	void Acquire (void);
@@ -41,10 +70,41 @@ public:
 
 	static void Enable (void);
 
+	/// \brief Collect contention statistics for this lock (SPINLOCK_STATISTICS only)
+	/// \param pName Name of this lock in the report (must remain valid)
+	void EnableStatistics (const char *pName);
+
+	/// \brief Dump statistics of the most contended locks to the logger
+	/// \param nMaxLocks Maximum number of locks to be reported
+	static void DumpStatistics (unsigned nMaxLocks = 10);
+
+private:
+	unsigned AcquireTestAndSet (void);
+	unsigned AcquireTicket (void);
+	unsigned AcquireMCS (void);
+
+	void ReleaseTestAndSet (void);
+	void ReleaseTicket (void);
+	void ReleaseMCS (void);
+
 private:
 	unsigned m_nTargetLevel;
+	TSpinLockType m_Type;
+
+	u32 m_nLocked;					// test-and-set
 
-	u32 m_nLocked;
+	u32 m_nNextTicket;				// ticket
+	volatile u32 m_nOwnerTicket;
+
+	TSpinLockMCSNode * volatile m_pMCSTail;		// MCS
+	TSpinLockMCSNode *m_pMCSOwner;
+
+#ifdef SPINLOCK_STATISTICS
+	TSpinLockStatistics *m_pStatistics;
+
+	static CSpinLock *s_pFirstStatistics;
+	static u32 s_nStatisticsListLock;
+#endif
 
 	static boolean s_bEnabled;
 };
@@ -54,7 +114,7 @@ private:
 class CSpinLock
 {
 public:
-	CSpinLock (unsigned nTargetLevel = IRQ_LEVEL)
+	CSpinLock (unsigned nTargetLevel = IRQ_LEVEL, TSpinLockType Type = SpinLockTestAndSet)
 	:	m_nTargetLevel (nTargetLevel)
 	{
 	}
@@ -75,6 +135,10 @@ public:
 		}
 	}
 
+	// there is no contention on a single core
+	void EnableStatistics (const char *pName)	{}
+	static void DumpStatistics (unsigned nMaxLocks = 10) {}
+
 private:
 	unsigned m_nTargetLevel;
 };
@@ -2,7 +2,7 @@
 // string.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,10 @@
 #include <circle/stdarg.h>
 #include <circle/types.h>
 
+#ifndef STRING_INLINE_SIZE
+#define STRING_INLINE_SIZE	32	// strings shorter than this are not allocated on the heap
+#endif
+
 class CString
 {
 public:
@@ -48,11 +52,21 @@ public:
 	void Format (const char *pFormat, ...);		// supports only a small subset of printf(3)
 	void FormatV (const char *pFormat, va_list Args);
 
+	// formats into a caller provided buffer of nSize bytes without heap allocation,
+	// returns the length of the complete result, which was truncated, if >= nSize
+	static size_t FormatBuffer (char *pBuffer, size_t nSize, const char *pFormat, ...);
+	static size_t FormatBufferV (char *pBuffer, size_t nSize, const char *pFormat, va_list Args);
+
 private:
+	CString (char *pBuffer, size_t nSize);		// uses a fixed external buffer
+
+	void Assign (const char *pString, size_t nLength);
+	void FreeBuffer (void);
+
 	void PutChar (char chChar, size_t nCount = 1);
 	void PutString (const char *pString);
-	void ReserveSpace (size_t nSpace);
-	
+	size_t ReserveSpace (size_t nSpace);		// returns number of characters, which fit
+
 	static char *ntoa (char *pDest, unsigned long ulNumber, unsigned nBase, boolean bUpcase);
 #if STDLIB_SUPPORT >= 1
 	static char *lltoa (char *pDest, unsigned long long ullNumber, unsigned nBase, boolean bUpcase);
@@ -60,9 +74,14 @@ private:
 	static char *ftoa (char *pDest, double fNumber, unsigned nPrecision);
 
 private:
-	char 	 *m_pBuffer;
+	char 	 *m_pBuffer;		// m_InlineBuffer, heap or external buffer
 	unsigned  m_nSize;
 	char	 *m_pInPtr;
+
+	boolean	  m_bExternal;
+	size_t	  m_nOverflow;		// characters, which did not fit into external buffer
+
+	char	  m_InlineBuffer[STRING_INLINE_SIZE];
 };
 
 #endif
@@ -159,6 +159,15 @@
 
 #endif
 
+// SPINLOCK_STATISTICS enables collecting contention statistics (number
+// of acquisitions, contended acquisitions, spins and maximum hold time)
+// for spin locks, for which CSpinLock::EnableStatistics() has been
+// called. CSpinLock::DumpStatistics() writes a report of the most
+// contended locks to the logger. This option has only an effect with
+// ARM_ALLOW_MULTI_CORE defined and slows down spin locks a little.
+
+//#define SPINLOCK_STATISTICS
+
 // USE_PHYSICAL_COUNTER enables the use of the CPU internal physical
 // counter, which is only available on the Raspberry Pi 2, 3 and 4. Reading
 // this counter is much faster than reading the BCM2835 system timer
@@ -188,6 +197,16 @@
 
 //#define USE_XHCI_INTERNAL
 
+// USE_NET_CHECKSUM_OFFLOAD lets the Ethernet controller of the Raspberry
+// Pi 4 verify the TCP and UDP checksums of received frames and insert
+// them into transmitted frames, which saves CPU time in the TCP/IP
+// stack. You can define NO_NET_CHECKSUM_OFFLOAD to calculate all
+// checksums by software instead.
+
+#ifndef NO_NET_CHECKSUM_OFFLOAD
+#define USE_NET_CHECKSUM_OFFLOAD
+#endif
+
 #endif
 
 ///////////////////////////////////////////////////////////////////////
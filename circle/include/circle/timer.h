@@ -2,7 +2,7 @@
 /// \file timer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -95,10 +95,11 @@ public:
 	/// may be FALSE if time was not set and time zone diff is > 0
 	boolean GetUniversalTime (unsigned *pSeconds, unsigned *pMicroSeconds);
 
+	/// \param nTicksAgo Return the time this number of ticks (HZ units) before now
 	/// \return "[MMM dD ]HH:MM:SS.ss" or 0 if Initialize() was not called yet,\n
 	/// resulting CString object must be deleted by caller\n
 	/// Current time according to our time zone
-	CString *GetTimeString (void);
+	CString *GetTimeString (unsigned nTicksAgo = 0);
 
 	/// \brief Starts a kernel timer which elapses after a given delay,\n
 	/// a timer handler gets called then
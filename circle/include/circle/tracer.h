@@ -2,7 +2,7 @@
 // tracer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,42 +20,188 @@
 #ifndef _circle_tracer_h
 #define _circle_tracer_h
 
+#include <circle/device.h>
+#include <circle/sysconfig.h>
 #include <circle/types.h>
 
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/memorymap.h>
+	#define TRACER_CORES	CORES
+#else
+	#define TRACER_CORES	1
+#endif
+
+enum TTraceEventType
+{
+	TraceEventGeneric,		// Event() with ID and four parameters
+	TraceEventBegin,		// start of a span
+	TraceEventEnd,			// end of a span
+	TraceEventInstant,
+	TraceEventCounter,		// value in nParam[0]
+	TraceEventUnknown
+};
+
 struct TTraceEntry
 {
-	unsigned nClockTicks;
-	unsigned nEventID;
+	u64		 nTimestamp;		// see CTracer::GetTimestamp()
+	unsigned	 nType;			// TTraceEventType
+	unsigned	 nEventID;
 #define TRACER_EVENT_STOP	0
-	unsigned nParam[4];
+	const char	*pName;			// 0 for generic events
+	unsigned	 nParam[4];
 };
 
-class CTracer
+class CTracer	/// Collects tracing events in per-core ring buffers for debugging
 {
 public:
+	/// \param nDepth Size of the ring buffer of each core (rounded up to a power of 2)
+	/// \param bStopIfFull Stop recording on a core, if its ring buffer is full
 	CTracer (unsigned nDepth, boolean bStopIfFull);
 	~CTracer (void);
 
 	void Start (void);
 	void Stop (void);
 
-	// not reentrant, use spin lock if required
+	// the following methods are lock-free and can be called from any core and level
+
 	void Event (unsigned nID, unsigned nParam1 = 0, unsigned nParam2 = 0, unsigned nParam3 = 0, unsigned nParam4 = 0);
 
+	/// \param pName Name of the span (must remain valid until the trace is exported)
+	/// \param nParam Optional parameter, shown as argument
+	void SpanBegin (const char *pName, unsigned nParam = 0);
+	/// \param pName Name of the span, must be the same as given to SpanBegin()
+	void SpanEnd (const char *pName);
+
+	void Instant (const char *pName, unsigned nParam = 0);
+
+	/// \param pName Name of the counter
+	/// \param nValue Current value of the counter
+	void Counter (const char *pName, unsigned nValue);
+
+	/// \brief Dump the collected events of all cores to the logger
 	void Dump (void);
 
+	/// \brief Write the collected events in Chrome trace (JSON) format
+	/// \param pTarget Device to be written to (e.g. CQEMUHostFile or CFatFsFile for the SD card)
+	/// \return Operation successful?
+	/// \note The result can be loaded with chrome://tracing or https://ui.perfetto.dev
+	boolean ExportChromeTrace (CDevice *pTarget);
+
+	/// \return Number of events, which have been dropped (ring buffer full)
+	unsigned GetDropped (void) const;
+
 	static CTracer *Get (void);
 
+	/// \return Current value of the system counter (synchronized on all cores)
+	static u64 GetTimestamp (void)
+	{
+#if RASPPI >= 2 && defined (USE_PHYSICAL_COUNTER)
+#if AARCH == 32
+		u32 nCNTPCTLow, nCNTPCTHigh;
+		asm volatile ("mrrc p15, 0, %0, %1, c14" : "=r" (nCNTPCTLow), "=r" (nCNTPCTHigh));
+
+		return (u64) nCNTPCTHigh << 32 | nCNTPCTLow;
+#else
+		u64 nCNTPCT;
+		asm volatile ("mrs %0, CNTPCT_EL0" : "=r" (nCNTPCT));
+
+		return nCNTPCT;
+#endif
+#else
+		return GetClockTicks ();
+#endif
+	}
+
+	/// \return Frequency of the system counter returned by GetTimestamp() in Hz
+	static u32 GetTimestampFrequency (void);
+
+private:
+	void Record (TTraceEventType Type, unsigned nID, const char *pName,
+		     unsigned nParam1 = 0, unsigned nParam2 = 0, unsigned nParam3 = 0, unsigned nParam4 = 0);
+
+	// returns the next entry (in time) of all cores and advances the read index
+	const TTraceEntry *GetNextEntry (unsigned *pCore);
+	void RewindEntries (void);
+
+	double ToMicroSeconds (u64 nTimestamp) const;
+
+	static unsigned GetClockTicks (void);
+
+	static unsigned ThisCore (void);
+
 private:
-	unsigned	 m_nDepth;		// size of ring buffer
+	struct TRing
+	{
+		TTraceEntry	*pEntry;	// array used as ring buffer
+		volatile u32	 nWritten;	// total number of reserved entries
+		volatile u32	 nDropped;
+		unsigned	 nRead;		// used by GetNextEntry()
+	};
+
+	unsigned	 m_nDepth;		// size of ring buffer (power of 2)
 	boolean		 m_bStopIfFull;
-	boolean		 m_bActive;
-	unsigned	 m_nStartTicks;
-	TTraceEntry	*m_pEntry;		// array used as ring buffer
-	unsigned	 m_nEntries;		// valid entries in ring buffer
-	unsigned	 m_nCurrent;		// write index into ring buffer
+	volatile boolean m_bActive;
+	u64		 m_nStartTimestamp;
+	u32		 m_nTimestampFrequency;	// Hz
+	TRing		 m_Ring[TRACER_CORES];
 
 	static CTracer *s_pThis;
 };
 
+class CTraceScope	/// Traces a span for the lifetime of this object
+{
+public:
+	CTraceScope (const char *pName, unsigned nParam = 0)
+	:	m_pName (pName)
+	{
+		CTracer *pTracer = CTracer::Get ();
+		if (pTracer != 0)
+		{
+			pTracer->SpanBegin (m_pName, nParam);
+		}
+	}
+
+	~CTraceScope (void)
+	{
+		CTracer *pTracer = CTracer::Get ();
+		if (pTracer != 0)
+		{
+			pTracer->SpanEnd (m_pName);
+		}
+	}
+
+private:
+	const char *m_pName;
+};
+
+// The following macros generate code only, if TRACING is defined
+// (e.g. "DEFINE += -DTRACING" in Config.mk). They do nothing, if
+// there is no CTracer object in the system.
+
+#ifdef TRACING
+
+#define TRACE_CALL(call)		do { CTracer *pTracer_ = CTracer::Get ();	\
+					     if (pTracer_ != 0) pTracer_->call; } while (0)
+
+#define TRACE_EVENT(id, ...)		TRACE_CALL (Event (id, ##__VA_ARGS__))
+#define TRACE_BEGIN(name, ...)		TRACE_CALL (SpanBegin (name, ##__VA_ARGS__))
+#define TRACE_END(name)			TRACE_CALL (SpanEnd (name))
+#define TRACE_INSTANT(name, ...)	TRACE_CALL (Instant (name, ##__VA_ARGS__))
+#define TRACE_COUNTER(name, value)	TRACE_CALL (Counter (name, value))
+
+#define TRACE_SCOPE_CAT_(name, line)	name##line
+#define TRACE_SCOPE_CAT(name, line)	TRACE_SCOPE_CAT_ (name, line)
+#define TRACE_SCOPE(name, ...)		CTraceScope TRACE_SCOPE_CAT (TraceScope_, __LINE__) (name, ##__VA_ARGS__)
+
+#else
+
+#define TRACE_EVENT(id, ...)		((void) 0)
+#define TRACE_BEGIN(name, ...)		((void) 0)
+#define TRACE_END(name)			((void) 0)
+#define TRACE_INSTANT(name, ...)	((void) 0)
+#define TRACE_COUNTER(name, value)	((void) 0)
+#define TRACE_SCOPE(name, ...)		((void) 0)
+
+#endif
+
 #endif
@@ -2,7 +2,7 @@
 // util.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -38,6 +38,8 @@ int memcmp (const void *pBuffer1, const void *pBuffer2, size_t nLength);
 
 size_t strlen (const char *pString);
 
+void *memchr (const void *pBuffer, int nValue, size_t nLength);
+
 int strcmp (const char *pString1, const char *pString2);
 int strcasecmp (const char *pString1, const char *pString2);
 int strncmp (const char *pString1, const char *pString2, size_t nMaxLen);
@@ -16,7 +16,7 @@
 //	Licensed under GPLv2
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -42,6 +42,7 @@
 #include <circle/string.h>
 #include <circle/util.h>
 #include <circle/macros.h>
+#include <circle/sysconfig.h>
 #include <assert.h>
 
 #define GENET_V5			5	// the only supported GENET version
@@ -95,6 +96,30 @@
 #define ETH_ZLEN			60
 #define ENET_MAX_MTU_SIZE		1536	// with padding
 
+// 64-byte status block in front of Rx/Tx frames (enabled with RBUF_64B_EN)
+struct TGEnetStatus64
+{
+	u32	length_status;		// length and peripheral status
+	u32	ext_status;		// extended status
+	u32	rx_csum;		// partial rx checksum
+	u32	unused1[9];
+	u32	tx_csum_info;		// Tx checksum info
+	u32	unused2[3];
+}
+PACKED;
+
+#define STATUS_TX_CSUM_START_SHIFT	16
+#define STATUS_TX_CSUM_START_MASK	0x7FFF
+#define STATUS_TX_CSUM_PROTO_UDP	0x8000
+#define STATUS_TX_CSUM_OFFSET_MASK	0x7FFF
+#define STATUS_TX_CSUM_LV		0x80000000
+
+#ifdef USE_NET_CHECKSUM_OFFLOAD
+	#define STATUS_BLOCK_SIZE	sizeof (TGEnetStatus64)
+#else
+	#define STATUS_BLOCK_SIZE	0
+#endif
+
 // HW register offset and field definitions
 #define UMAC_HD_BKP_CTRL		0x004
 #define	 HD_FC_EN			(1 << 0)
@@ -281,6 +306,7 @@
 #define GENET_INTRL2_0_OFF		0x0200
 #define GENET_INTRL2_1_OFF		0x0240
 #define GENET_RBUF_OFF			0x0300
+#define GENET_TBUF_OFF			0x0600
 #define GENET_UMAC_OFF			0x0800
 
 // SYS block offsets and register definitions
@@ -545,6 +571,9 @@ GENET_IO_MACRO(hfb_reg, HFB_REG_OFFSET);
 // RBUF register accessors
 GENET_IO_MACRO(rbuf, GENET_RBUF_OFF);
 
+// TBUF register accessors
+GENET_IO_MACRO(tbuf, GENET_TBUF_OFF);
+
 // more I/O helper macros
 #define rbuf_ctrl_get()			sys_readl(SYS_RBUF_FLUSH_CTRL)
 #define rbuf_ctrl_set(val)		sys_writel(val, SYS_RBUF_FLUSH_CTRL)
@@ -645,6 +674,8 @@ boolean CBcm54213Device::Initialize (void)
 	reg = umac_readl(UMAC_CMD);		// make sure we reflect the value of CRC_CMD_FWD
 	m_crc_fwd_en = !!(reg & CMD_CRC_FWD);
 
+	init_offload();
+
 	int ret = set_hw_addr();
 	if (ret)
 	{
@@ -710,6 +741,15 @@ boolean CBcm54213Device::IsSendFrameAdvisable (void)
 }
 
 boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength)
+{
+	TNetFrameInfo Info;
+	Info.nFlags = 0;
+
+	return SendFrame (pBuffer, nLength, Info);
+}
+
+boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength,
+				    const TNetFrameInfo &rInfo)
 {
 	assert (pBuffer != 0);
 	assert (nLength > 0);
@@ -739,14 +779,47 @@ boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength)
 		return FALSE;
 	}
 
-	u8 *pTxBuffer = new u8[ENET_MAX_MTU_SIZE];	// allocate and fill DMA buffer
-	memcpy (pTxBuffer, pBuffer, nLength);
+	// allocate and fill DMA buffer
+	u8 *pTxBuffer = new u8[STATUS_BLOCK_SIZE + ENET_MAX_MTU_SIZE];
+	memcpy (pTxBuffer+STATUS_BLOCK_SIZE, pBuffer, nLength);
 	if (nLength < ETH_ZLEN)				// pad frame if necessary
 	{
-		memset (pTxBuffer+nLength, 0, ETH_ZLEN-nLength);
+		memset (pTxBuffer+STATUS_BLOCK_SIZE+nLength, 0, ETH_ZLEN-nLength);
 		nLength = ETH_ZLEN;
 	}
 
+	u32 len_stat =   (QTAG_MASK << DMA_TX_QTAG_SHIFT)
+		       | DMA_TX_APPEND_CRC | DMA_SOP | DMA_EOP;
+
+#ifdef USE_NET_CHECKSUM_OFFLOAD
+	// prepend status block, which requests the TCP/UDP checksum insertion
+	TGEnetStatus64 *status = (TGEnetStatus64 *) pTxBuffer;
+	memset (status, 0, sizeof *status);
+
+	if (rInfo.nFlags & NET_FRAME_TX_CHECKSUM_PARTIAL)
+	{
+		u32 start = rInfo.nChecksumStart;
+		u32 offset = start + rInfo.nChecksumOffset;
+		assert (start <= STATUS_TX_CSUM_START_MASK);
+		assert (offset <= STATUS_TX_CSUM_OFFSET_MASK);
+
+		u32 tx_csum_info =   (start << STATUS_TX_CSUM_START_SHIFT)
+				   | offset | STATUS_TX_CSUM_LV;
+		if (rInfo.nFlags & NET_FRAME_TX_CHECKSUM_UDP)
+		{
+			tx_csum_info |= STATUS_TX_CSUM_PROTO_UDP;
+		}
+
+		status->tx_csum_info = tx_csum_info;
+
+		len_stat |= DMA_TX_DO_CSUM;
+	}
+
+	nLength += STATUS_BLOCK_SIZE;
+#else
+	assert (!(rInfo.nFlags & NET_FRAME_TX_CHECKSUM_PARTIAL));
+#endif
+
 	TGEnetCB *tx_cb_ptr = get_txcb (ring);		// get Tx control block from ring
 	assert (tx_cb_ptr != 0);
 
@@ -756,9 +829,7 @@ boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength)
 	tx_cb_ptr->buffer = pTxBuffer;			// set DMA buffer in Tx control block
 
 	// set DMA descriptor and start transfer
-	dmadesc_set (tx_cb_ptr->bd_addr, pTxBuffer,   (nLength << DMA_BUFLENGTH_SHIFT)
-						    | (QTAG_MASK << DMA_TX_QTAG_SHIFT)
-						    | DMA_TX_APPEND_CRC | DMA_SOP | DMA_EOP);
+	dmadesc_set (tx_cb_ptr->bd_addr, pTxBuffer, (nLength << DMA_BUFLENGTH_SHIFT) | len_stat);
 
 	// decrement total BD count and advance our write pointer
 	ring->free_bds--;
@@ -774,9 +845,18 @@ boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength)
 }
 
 boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
+{
+	TNetFrameInfo Info;
+
+	return ReceiveFrame (pBuffer, pResultLength, &Info);
+}
+
+boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength,
+				       TNetFrameInfo *pInfo)
 {
 	assert (pBuffer != 0);
 	assert (pResultLength != 0);
+	assert (pInfo != 0);
 
 	TGEnetRxRing *ring = &m_rx_rings[GENET_DESC_INDEX];	// the only supported Rx queue
 
@@ -822,7 +902,11 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 			goto out;
 		}
 
+#ifdef USE_NET_CHECKSUM_OFFLOAD
+		dma_length_status = ((TGEnetStatus64 *) pRxBuffer)->length_status;
+#else
 		dma_length_status = dmadesc_get_length_status (cb->bd_addr);
+#endif
 		dma_flag = dma_length_status & 0xFFFF;
 		nLength = dma_length_status >> DMA_BUFLENGTH_SHIFT;
 
@@ -849,7 +933,8 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 		}
 
 #define LEADING_PAD	2
-		nLength -= LEADING_PAD;		// remove HW 2 bytes added for IP alignment
+		// remove status block and HW 2 bytes added for IP alignment
+		nLength -= STATUS_BLOCK_SIZE + LEADING_PAD;
 
 		if (m_crc_fwd_en)
 		{
@@ -859,10 +944,18 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 
 		assert (nLength > 0);
 		assert (nLength <= FRAME_BUFFER_SIZE);
-		memcpy (pBuffer, pRxBuffer+LEADING_PAD, nLength);
+		memcpy (pBuffer, pRxBuffer+STATUS_BLOCK_SIZE+LEADING_PAD, nLength);
 
 		*pResultLength = nLength;
 
+		pInfo->nFlags = 0;
+#ifdef USE_NET_CHECKSUM_OFFLOAD
+		if (dma_flag & DMA_RX_CHK_V3PLUS)	// TCP/UDP checksum verified by HW
+		{
+			pInfo->nFlags = NET_FRAME_RX_L4_CHECKSUM_OK;
+		}
+#endif
+
 		delete [] pRxBuffer;
 
 		bResult = TRUE;
@@ -884,6 +977,15 @@ out:
 	return bResult;
 }
 
+u32 CBcm54213Device::GetOffloadCapabilities (void)
+{
+#ifdef USE_NET_CHECKSUM_OFFLOAD
+	return NET_OFFLOAD_RX_CHECKSUM | NET_OFFLOAD_TX_CHECKSUM;
+#else
+	return 0;
+#endif
+}
+
 boolean CBcm54213Device::IsLinkUp (void)
 {
 	return m_link ? TRUE : FALSE;
@@ -973,6 +1075,30 @@ void CBcm54213Device::init_umac(void)
 	//intrl2_0_writel(UMAC_IRQ_MDIO_DONE | UMAC_IRQ_MDIO_ERROR, INTRL2_CPU_MASK_CLEAR);
 }
 
+void CBcm54213Device::init_offload(void)
+{
+#ifdef USE_NET_CHECKSUM_OFFLOAD
+	// prepend 64-byte status blocks to Rx and Tx frames
+	u32 reg = rbuf_readl(RBUF_CTRL);
+	reg |= RBUF_64B_EN;
+	rbuf_writel(reg, RBUF_CTRL);
+
+	reg = tbuf_readl(TBUF_CTRL);
+	reg |= RBUF_64B_EN;			// same bit in TBUF_CTRL
+	tbuf_writel(reg, TBUF_CTRL);
+
+	// enable Rx checksum verification, the FCS has to be skipped to get a valid
+	// checksum status, if the UniMAC forwards it
+	reg = rbuf_readl(RBUF_CHK_CTRL);
+	reg |= RBUF_RXCHK_EN;
+	if (m_crc_fwd_en)
+		reg |= RBUF_SKIP_FCS;
+	else
+		reg &= ~RBUF_SKIP_FCS;
+	rbuf_writel(reg, RBUF_CHK_CTRL);
+#endif
+}
+
 void CBcm54213Device::umac_enable_set(u32 mask, bool enable)
 {
 	u32 reg = umac_readl(UMAC_CMD);
@@ -0,0 +1,344 @@
+//
+// checksum.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/checksum.h>
+#include <assert.h>
+
+#define ADLER_BASE		65521
+#define ADLER_NMAX		5552		// max. bytes, before the sums may overflow
+
+#define FLETCHER_BASE		65535
+#define FLETCHER_NMAX		359		// max. words, before the sums may overflow
+
+#if AARCH == 64
+
+// see lib/checksum64.S
+extern "C" u32 crc32_update_arm (u32 nCRC, const void *pBuffer, size_t nLength);
+extern "C" u32 crc32c_update_arm (u32 nCRC, const void *pBuffer, size_t nLength);
+extern "C" void adler32_blocks_neon (u32 Sums[2], const void *pBuffer, size_t nBlocks);
+
+#define CRC32Update(crc, buf, len)	crc32_update_arm (crc, buf, len)
+#define CRC32CUpdate(crc, buf, len)	crc32c_update_arm (crc, buf, len)
+
+#else
+
+// Tables for the slicing-by-4 algorithm, generated at compile time
+
+struct TCRCTable
+{
+	u32 Entry[4][256];
+};
+
+static constexpr TCRCTable MakeCRCTable (u32 nPolynomial)
+{
+	TCRCTable Table {};
+
+	for (unsigned i = 0; i < 256; i++)
+	{
+		u32 nCRC = i;
+		for (unsigned j = 0; j < 8; j++)
+		{
+			nCRC = nCRC & 1 ? (nCRC >> 1) ^ nPolynomial : nCRC >> 1;
+		}
+
+		Table.Entry[0][i] = nCRC;
+	}
+
+	for (unsigned i = 0; i < 256; i++)
+	{
+		for (unsigned k = 1; k < 4; k++)
+		{
+			u32 nCRC = Table.Entry[k-1][i];
+			Table.Entry[k][i] = (nCRC >> 8) ^ Table.Entry[0][nCRC & 0xFF];
+		}
+	}
+
+	return Table;
+}
+
+static constexpr TCRCTable s_CRC32Table = MakeCRCTable (0xEDB88320);	// reflected polynomials
+static constexpr TCRCTable s_CRC32CTable = MakeCRCTable (0x82F63B78);
+
+static u32 CRCUpdateTable (const TCRCTable &rTable, u32 nCRC, const void *pBuffer, size_t nLength)
+{
+	const u8 *p = (const u8 *) pBuffer;
+
+	for (; nLength > 0 && ((uintptr) p & 3); nLength--)
+	{
+		nCRC = rTable.Entry[0][(nCRC ^ *p++) & 0xFF] ^ (nCRC >> 8);
+	}
+
+	for (; nLength >= 4; nLength -= 4)
+	{
+		nCRC ^= *(const u32 *) p;		// aligned, little-endian
+		p += 4;
+
+		nCRC =   rTable.Entry[3][nCRC & 0xFF]
+		       ^ rTable.Entry[2][(nCRC >> 8) & 0xFF]
+		       ^ rTable.Entry[1][(nCRC >> 16) & 0xFF]
+		       ^ rTable.Entry[0][nCRC >> 24];
+	}
+
+	for (; nLength > 0; nLength--)
+	{
+		nCRC = rTable.Entry[0][(nCRC ^ *p++) & 0xFF] ^ (nCRC >> 8);
+	}
+
+	return nCRC;
+}
+
+#define CRC32Update(crc, buf, len)	CRCUpdateTable (s_CRC32Table, crc, buf, len)
+#define CRC32CUpdate(crc, buf, len)	CRCUpdateTable (s_CRC32CTable, crc, buf, len)
+
+#endif
+
+// Modulo operations without division (2^16 = 15 mod 65521 = 1 mod 65535)
+
+static inline u32 AdlerMod (u32 nValue)
+{
+	nValue = (nValue & 0xFFFF) + 15 * (nValue >> 16);
+	nValue = (nValue & 0xFFFF) + 15 * (nValue >> 16);
+
+	return nValue >= ADLER_BASE ? nValue - ADLER_BASE : nValue;
+}
+
+static inline u32 FletcherMod (u32 nValue)
+{
+	nValue = (nValue & 0xFFFF) + (nValue >> 16);
+	nValue = (nValue & 0xFFFF) + (nValue >> 16);
+
+	return nValue == FLETCHER_BASE ? 0 : nValue;
+}
+
+CCRC32::CCRC32 (void)
+{
+	Reset ();
+}
+
+void CCRC32::Reset (void)
+{
+	m_nCRC = 0xFFFFFFFF;
+}
+
+void CCRC32::Update (const void *pBuffer, size_t nLength)
+{
+	assert (pBuffer != 0 || nLength == 0);
+
+	m_nCRC = CRC32Update (m_nCRC, pBuffer, nLength);
+}
+
+u32 CCRC32::Get (void) const
+{
+	return ~m_nCRC;
+}
+
+u32 CCRC32::Calculate (const void *pBuffer, size_t nLength)
+{
+	assert (pBuffer != 0 || nLength == 0);
+
+	return ~CRC32Update (0xFFFFFFFF, pBuffer, nLength);
+}
+
+CCRC32C::CCRC32C (void)
+{
+	Reset ();
+}
+
+void CCRC32C::Reset (void)
+{
+	m_nCRC = 0xFFFFFFFF;
+}
+
+void CCRC32C::Update (const void *pBuffer, size_t nLength)
+{
+	assert (pBuffer != 0 || nLength == 0);
+
+	m_nCRC = CRC32CUpdate (m_nCRC, pBuffer, nLength);
+}
+
+u32 CCRC32C::Get (void) const
+{
+	return ~m_nCRC;
+}
+
+u32 CCRC32C::Calculate (const void *pBuffer, size_t nLength)
+{
+	assert (pBuffer != 0 || nLength == 0);
+
+	return ~CRC32CUpdate (0xFFFFFFFF, pBuffer, nLength);
+}
+
+CAdler32::CAdler32 (void)
+{
+	Reset ();
+}
+
+void CAdler32::Reset (void)
+{
+	m_nSum1 = 1;
+	m_nSum2 = 0;
+}
+
+void CAdler32::Update (const void *pBuffer, size_t nLength)
+{
+	assert (pBuffer != 0 || nLength == 0);
+	const u8 *p = (const u8 *) pBuffer;
+
+	u32 nSum1 = m_nSum1;
+	u32 nSum2 = m_nSum2;
+
+	while (nLength > 0)
+	{
+		// the sums are reduced modulo ADLER_BASE only once per chunk
+		size_t nChunk = nLength < ADLER_NMAX ? nLength : ADLER_NMAX;
+		nLength -= nChunk;
+
+#if AARCH == 64
+		size_t nBlocks = nChunk / 32;
+		if (nBlocks > 0)
+		{
+			u32 Sums[2] = {nSum1, nSum2};
+			adler32_blocks_neon (Sums, p, nBlocks);
+			nSum1 = Sums[0];
+			nSum2 = Sums[1];
+
+			p += nBlocks * 32;
+			nChunk -= nBlocks * 32;
+		}
+#endif
+
+		for (; nChunk >= 4; nChunk -= 4)
+		{
+			nSum1 += p[0]; nSum2 += nSum1;
+			nSum1 += p[1]; nSum2 += nSum1;
+			nSum1 += p[2]; nSum2 += nSum1;
+			nSum1 += p[3]; nSum2 += nSum1;
+			p += 4;
+		}
+
+		for (; nChunk > 0; nChunk--)
+		{
+			nSum1 += *p++;
+			nSum2 += nSum1;
+		}
+
+		nSum1 = AdlerMod (nSum1);
+		nSum2 = AdlerMod (nSum2);
+	}
+
+	m_nSum1 = nSum1;
+	m_nSum2 = nSum2;
+}
+
+u32 CAdler32::Get (void) const
+{
+	return m_nSum2 << 16 | m_nSum1;
+}
+
+u32 CAdler32::Calculate (const void *pBuffer, size_t nLength)
+{
+	CAdler32 Adler32;
+	Adler32.Update (pBuffer, nLength);
+
+	return Adler32.Get ();
+}
+
+CFletcher32::CFletcher32 (void)
+{
+	Reset ();
+}
+
+void CFletcher32::Reset (void)
+{
+	m_nSum1 = 0;
+	m_nSum2 = 0;
+	m_bOddByte = FALSE;
+}
+
+void CFletcher32::Update (const void *pBuffer, size_t nLength)
+{
+	assert (pBuffer != 0 || nLength == 0);
+	const u8 *p = (const u8 *) pBuffer;
+
+	u32 nSum1 = m_nSum1;
+	u32 nSum2 = m_nSum2;
+
+	if (   m_bOddByte
+	    && nLength > 0)
+	{
+		nSum1 = FletcherMod (nSum1 + (m_uchOddByte | *p++ << 8));
+		nSum2 = FletcherMod (nSum2 + nSum1);
+		nLength--;
+
+		m_bOddByte = FALSE;
+	}
+
+	while (nLength >= 2)
+	{
+		size_t nWords = nLength / 2;
+		if (nWords > FLETCHER_NMAX)
+		{
+			nWords = FLETCHER_NMAX;
+		}
+
+		nLength -= nWords * 2;
+
+		for (; nWords > 0; nWords--)
+		{
+			nSum1 += p[0] | p[1] << 8;
+			nSum2 += nSum1;
+			p += 2;
+		}
+
+		nSum1 = FletcherMod (nSum1);
+		nSum2 = FletcherMod (nSum2);
+	}
+
+	if (nLength > 0)
+	{
+		assert (!m_bOddByte);
+		m_bOddByte = TRUE;
+		m_uchOddByte = *p;
+	}
+
+	m_nSum1 = nSum1;
+	m_nSum2 = nSum2;
+}
+
+u32 CFletcher32::Get (void) const
+{
+	u32 nSum1 = m_nSum1;
+	u32 nSum2 = m_nSum2;
+
+	if (m_bOddByte)
+	{
+		nSum1 = FletcherMod (nSum1 + m_uchOddByte);
+		nSum2 = FletcherMod (nSum2 + nSum1);
+	}
+
+	return nSum2 << 16 | nSum1;
+}
+
+u32 CFletcher32::Calculate (const void *pBuffer, size_t nLength)
+{
+	CFletcher32 Fletcher32;
+	Fletcher32.Update (pBuffer, nLength);
+
+	return Fletcher32.Get ();
+}
@@ -0,0 +1,387 @@
+//
+// deferredwork.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/deferredwork.h>
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <assert.h>
+
+LOGMODULE ("deferred");
+
+CDeferredWorkItem *CDeferredWork::s_pFirstItem = 0;
+CSpinLock CDeferredWork::s_ItemListSpinLock (TASK_LEVEL);
+
+CDeferredWork *CDeferredWork::s_pThis = 0;
+
+CDeferredWorkItem::CDeferredWorkItem (TDeferredWorkHandler *pHandler, void *pParam,
+				      const char *pName, TDeferredWorkLevel Level)
+:	m_pHandler (pHandler),
+	m_pParam (pParam),
+	m_pName (pName),
+	m_Level (Level),
+	m_bQueued (FALSE),
+	m_nQueuedTicks (0),
+	m_pNext (0),
+	m_nRuns (0),
+	m_nMaxLatency (0),
+	m_nMaxRunTime (0),
+	m_nLatencyAccu (0),
+	m_nLatencySamples (0),
+	m_pNextItem (0),
+	m_pPrevItem (0)
+{
+	assert (m_pHandler != 0);
+	assert (m_pName != 0);
+	assert (m_Level < DeferredWorkLevels);
+
+	CDeferredWork::AddItem (this);
+}
+
+CDeferredWorkItem::~CDeferredWorkItem (void)
+{
+	assert (!m_bQueued);
+
+	CDeferredWork::RemoveItem (this);
+
+	m_pHandler = 0;
+}
+
+boolean CDeferredWorkItem::Queue (unsigned nCore)
+{
+	CDeferredWork *pDeferredWork = CDeferredWork::Get ();
+	assert (pDeferredWork != 0);
+
+	return pDeferredWork->Enqueue (this, nCore);
+}
+
+unsigned CDeferredWorkItem::GetAvgLatency (void) const
+{
+	unsigned nSamples = __atomic_load_n (&m_nLatencySamples, __ATOMIC_RELAXED);
+	unsigned nAccu = __atomic_load_n (&m_nLatencyAccu, __ATOMIC_RELAXED);
+
+	return nSamples > 0 ? nAccu / nSamples : 0;
+}
+
+CDeferredWork::CDeferredWork (void)
+{
+	assert (s_pThis == 0);
+	s_pThis = this;
+
+	for (unsigned nCore = 0; nCore < DEFERRED_WORK_CORES; nCore++)
+	{
+		for (unsigned nLevel = 0; nLevel < DeferredWorkLevels; nLevel++)
+		{
+			m_Queue[nCore][nLevel].pFirst = 0;
+			m_Queue[nCore][nLevel].pLast = 0;
+
+			m_nBatches[nCore][nLevel] = 0;
+			m_nMaxBatchSize[nCore][nLevel] = 0;
+		}
+
+		m_pNotificationHandler[nCore] = 0;
+		m_pNotificationParam[nCore] = 0;
+
+		m_bInIRQWork[nCore] = FALSE;
+	}
+}
+
+CDeferredWork::~CDeferredWork (void)
+{
+	s_pThis = 0;
+}
+
+unsigned CDeferredWork::Process (unsigned nMaxItems)
+{
+	assert (CurrentExecutionLevel () == TASK_LEVEL);
+
+	return Run (ThisCore (), DeferredWorkTask, nMaxItems);
+}
+
+void CDeferredWork::RegisterNotificationHandler (TDeferredWorkNotificationHandler *pHandler,
+						 void *pParam, unsigned nCore)
+{
+	if (nCore == DEFERRED_WORK_THIS_CORE)
+	{
+		nCore = ThisCore ();
+	}
+	assert (nCore < DEFERRED_WORK_CORES);
+
+	m_SpinLock[nCore].Acquire ();
+
+	m_pNotificationHandler[nCore] = pHandler;
+	m_pNotificationParam[nCore] = pParam;
+
+	m_SpinLock[nCore].Release ();
+}
+
+void CDeferredWork::Dump (void)
+{
+	for (unsigned nCore = 0; nCore < DEFERRED_WORK_CORES; nCore++)
+	{
+		for (unsigned nLevel = 0; nLevel < DeferredWorkLevels; nLevel++)
+		{
+			if (m_nBatches[nCore][nLevel] > 0)
+			{
+				LOGNOTE ("Core %u %s: %u batches, max. %u items",
+					 nCore, nLevel == DeferredWorkTask ? "task" : "IRQ",
+					 m_nBatches[nCore][nLevel], m_nMaxBatchSize[nCore][nLevel]);
+			}
+		}
+	}
+
+	LOGNOTE ("%-16s %10s %10s %10s %10s", "Item", "Runs", "AvgLat", "MaxLat", "MaxRun");
+
+	s_ItemListSpinLock.Acquire ();
+
+	for (CDeferredWorkItem *pItem = s_pFirstItem; pItem != 0; pItem = pItem->m_pNextItem)
+	{
+		LOGNOTE ("%-16s %10u %8uus %8uus %8uus",
+			 pItem->m_pName, pItem->GetRuns (), pItem->GetAvgLatency (),
+			 pItem->GetMaxLatency (), pItem->GetMaxRunTime ());
+	}
+
+	s_ItemListSpinLock.Release ();
+}
+
+void CDeferredWork::InterruptExit (void)
+{
+	CDeferredWork *pThis = s_pThis;
+	if (pThis == 0)
+	{
+		return;
+	}
+
+	unsigned nCore = ThisCore ();
+	if (   pThis->m_Queue[nCore][DeferredWorkIRQ].pFirst == 0
+	    || pThis->m_bInIRQWork[nCore])		// we have interrupted the deferred work
+	{
+		return;
+	}
+
+	pThis->m_bInIRQWork[nCore] = TRUE;
+
+#if AARCH == 64
+	// The IRQ stub has saved ELR_EL1 and SPSR_EL1 on the stack, so that the
+	// deferred work can be interrupted by new IRQs. This is not possible on
+	// AArch32, where the items are run with IRQs disabled.
+	EnableIRQs ();
+#endif
+
+	pThis->Run (nCore, DeferredWorkIRQ, 0);
+
+#if AARCH == 64
+	DisableIRQs ();
+#endif
+
+	pThis->m_bInIRQWork[nCore] = FALSE;
+}
+
+boolean CDeferredWork::IsIRQWorkActive (void)
+{
+	CDeferredWork *pThis = s_pThis;
+
+	return pThis != 0 && pThis->m_bInIRQWork[ThisCore ()];
+}
+
+CDeferredWork *CDeferredWork::Get (void)
+{
+	return s_pThis;
+}
+
+boolean CDeferredWork::Enqueue (CDeferredWorkItem *pItem, unsigned nCore)
+{
+	assert (pItem != 0);
+
+	if (   nCore == DEFERRED_WORK_THIS_CORE
+	    || pItem->m_Level == DeferredWorkIRQ)
+	{
+		nCore = ThisCore ();
+	}
+	assert (nCore < DEFERRED_WORK_CORES);
+
+	if (__atomic_exchange_n (&pItem->m_bQueued, TRUE, __ATOMIC_ACQ_REL))
+	{
+		return FALSE;
+	}
+
+	TDeferredWorkNotificationHandler *pHandler = 0;
+	void *pParam = 0;
+
+	m_SpinLock[nCore].Acquire ();
+
+	pItem->m_nQueuedTicks = CTimer::GetClockTicks ();
+	pItem->m_pNext = 0;
+
+	TQueue *pQueue = &m_Queue[nCore][pItem->m_Level];
+	if (pQueue->pFirst == 0)
+	{
+		pQueue->pFirst = pItem;
+
+		if (pItem->m_Level == DeferredWorkTask)
+		{
+			pHandler = m_pNotificationHandler[nCore];
+			pParam = m_pNotificationParam[nCore];
+		}
+	}
+	else
+	{
+		assert (pQueue->pLast != 0);
+		pQueue->pLast->m_pNext = pItem;
+	}
+
+	pQueue->pLast = pItem;
+
+	m_SpinLock[nCore].Release ();
+
+	if (pHandler != 0)
+	{
+		(*pHandler) (pParam);
+	}
+
+	return TRUE;
+}
+
+unsigned CDeferredWork::Run (unsigned nCore, TDeferredWorkLevel Level, unsigned nMaxItems)
+{
+	assert (nCore < DEFERRED_WORK_CORES);
+	TQueue *pQueue = &m_Queue[nCore][Level];
+
+	unsigned nItems = 0;
+	while (   nMaxItems == 0
+	       || nItems < nMaxItems)
+	{
+		m_SpinLock[nCore].Acquire ();
+
+		CDeferredWorkItem *pItem = pQueue->pFirst;
+		if (pItem == 0)
+		{
+			m_SpinLock[nCore].Release ();
+
+			break;
+		}
+
+		pQueue->pFirst = pItem->m_pNext;
+		if (pQueue->pFirst == 0)
+		{
+			pQueue->pLast = 0;
+		}
+
+		m_SpinLock[nCore].Release ();
+
+		unsigned nStartTicks = CTimer::GetClockTicks ();
+		unsigned nLatency = nStartTicks - pItem->m_nQueuedTicks;
+
+		// the item may be queued again from now on, even by its own handler
+		__atomic_store_n (&pItem->m_bQueued, FALSE, __ATOMIC_RELEASE);
+
+		assert (pItem->m_pHandler != 0);
+		(*pItem->m_pHandler) (pItem->m_pParam);
+
+		unsigned nRunTime = CTimer::GetClockTicks () - nStartTicks;
+
+		__atomic_fetch_add (&pItem->m_nRuns, 1, __ATOMIC_RELAXED);
+
+		if (__atomic_add_fetch (&pItem->m_nLatencyAccu, nLatency, __ATOMIC_RELAXED) < nLatency)
+		{
+			// on overflow restart the average with this sample
+			__atomic_store_n (&pItem->m_nLatencyAccu, nLatency, __ATOMIC_RELAXED);
+			__atomic_store_n (&pItem->m_nLatencySamples, 1, __ATOMIC_RELAXED);
+		}
+		else
+		{
+			__atomic_fetch_add (&pItem->m_nLatencySamples, 1, __ATOMIC_RELAXED);
+		}
+
+		AtomicMax (&pItem->m_nMaxLatency, nLatency);
+		AtomicMax (&pItem->m_nMaxRunTime, nRunTime);
+
+		nItems++;
+	}
+
+	if (nItems > 0)
+	{
+		m_nBatches[nCore][Level]++;
+
+		if (nItems > m_nMaxBatchSize[nCore][Level])
+		{
+			m_nMaxBatchSize[nCore][Level] = nItems;
+		}
+	}
+
+	return nItems;
+}
+
+void CDeferredWork::AddItem (CDeferredWorkItem *pItem)
+{
+	s_ItemListSpinLock.Acquire ();
+
+	pItem->m_pPrevItem = 0;
+	pItem->m_pNextItem = s_pFirstItem;
+	if (s_pFirstItem != 0)
+	{
+		s_pFirstItem->m_pPrevItem = pItem;
+	}
+	s_pFirstItem = pItem;
+
+	s_ItemListSpinLock.Release ();
+}
+
+void CDeferredWork::RemoveItem (CDeferredWorkItem *pItem)
+{
+	s_ItemListSpinLock.Acquire ();
+
+	if (pItem->m_pPrevItem != 0)
+	{
+		pItem->m_pPrevItem->m_pNextItem = pItem->m_pNextItem;
+	}
+	else
+	{
+		assert (s_pFirstItem == pItem);
+		s_pFirstItem = pItem->m_pNextItem;
+	}
+
+	if (pItem->m_pNextItem != 0)
+	{
+		pItem->m_pNextItem->m_pPrevItem = pItem->m_pPrevItem;
+	}
+
+	s_ItemListSpinLock.Release ();
+}
+
+unsigned CDeferredWork::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
+
+void CDeferredWork::AtomicMax (volatile unsigned *pValue, unsigned nValue)
+{
+	unsigned nOld = __atomic_load_n (pValue, __ATOMIC_RELAXED);
+	while (   nValue > nOld
+	       && !__atomic_compare_exchange_n (pValue, &nOld, nValue, TRUE,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+		// nOld has been updated
+	}
+}
@@ -0,0 +1,958 @@
+//
+// deflate.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/deflate.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define MIN_MATCH		3
+#define MAX_MATCH		258
+#define MIN_LOOKAHEAD		(MAX_MATCH + MIN_MATCH + 1)
+#define MAX_DISTANCE		(DEFLATE_WINDOW_SIZE - MIN_LOOKAHEAD)
+#define TOO_FAR			4096		// ignore matches of length 3 with larger distance
+
+#define WINDOW_MASK		(DEFLATE_WINDOW_SIZE - 1)
+#define MAX_BLOCK_BYTES		DEFLATE_WINDOW_SIZE
+
+static const struct
+{
+	u16 nMaxChain;
+	u16 nNiceLength;
+}
+s_LevelConfig[10] =
+{
+	{0, 0},			// 0: store only
+	{4, 8},
+	{8, 16},
+	{16, 32},
+	{32, 64},
+	{64, 128},
+	{128, 128},		// 6: default
+	{256, 258},
+	{1024, 258},
+	{4096, 258}
+};
+
+// Order of the code length code lengths (RFC 1951 3.2.7)
+static const u8 s_CodeLengthOrder[19] =
+	{16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static constexpr unsigned ReverseBits (unsigned nCode, unsigned nLength)
+{
+	unsigned nResult = 0;
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		nResult = nResult << 1 | (nCode >> i & 1);
+	}
+
+	return nResult;
+}
+
+// Fixed Huffman codes (RFC 1951 3.2.6), generated at compile time
+
+static constexpr TDeflateHuffmanCode MakeFixedLitLenCode (void)
+{
+	TDeflateHuffmanCode Code {};
+
+	for (unsigned i = 0; i < 288; i++)
+	{
+		unsigned nCode = 0;
+		unsigned nLength = 0;
+
+		if (i < 144)		{ nCode = 0x30 + i;		nLength = 8; }
+		else if (i < 256)	{ nCode = 0x190 + i - 144;	nLength = 9; }
+		else if (i < 280)	{ nCode = i - 256;		nLength = 7; }
+		else			{ nCode = 0xC0 + i - 280;	nLength = 8; }
+
+		Code.Code[i] = ReverseBits (nCode, nLength);
+		Code.Length[i] = nLength;
+	}
+
+	return Code;
+}
+
+static constexpr TDeflateHuffmanCode MakeFixedDistanceCode (void)
+{
+	TDeflateHuffmanCode Code {};
+
+	for (unsigned i = 0; i < 30; i++)
+	{
+		Code.Code[i] = ReverseBits (i, 5);
+		Code.Length[i] = 5;
+	}
+
+	return Code;
+}
+
+static constexpr TDeflateHuffmanCode s_FixedLitLenCode = MakeFixedLitLenCode ();
+static constexpr TDeflateHuffmanCode s_FixedDistanceCode = MakeFixedDistanceCode ();
+
+// Returns the index of the length code (0..28) and its extra bits
+static inline unsigned GetLengthCode (unsigned nLength, unsigned *pExtraBits, unsigned *pExtraValue)
+{
+	assert (MIN_MATCH <= nLength && nLength <= MAX_MATCH);
+	unsigned nValue = nLength - MIN_MATCH;
+
+	if (nValue < 8)
+	{
+		*pExtraBits = 0;
+		*pExtraValue = 0;
+
+		return nValue;
+	}
+
+	if (nLength == MAX_MATCH)
+	{
+		*pExtraBits = 0;
+		*pExtraValue = 0;
+
+		return 28;
+	}
+
+	unsigned nBits = 31 - __builtin_clz (nValue) - 2;
+	*pExtraBits = nBits;
+	*pExtraValue = nValue & ((1 << nBits) - 1);
+
+	return 4 * (nBits + 1) + ((nValue >> nBits) & 3);
+}
+
+// Returns the distance code (0..29) and its extra bits
+static inline unsigned GetDistanceCode (unsigned nDistance, unsigned *pExtraBits, unsigned *pExtraValue)
+{
+	assert (1 <= nDistance && nDistance <= DEFLATE_WINDOW_SIZE);
+	unsigned nValue = nDistance - 1;
+
+	if (nValue < 4)
+	{
+		*pExtraBits = 0;
+		*pExtraValue = 0;
+
+		return nValue;
+	}
+
+	unsigned nBits = 31 - __builtin_clz (nValue) - 1;
+	*pExtraBits = nBits;
+	*pExtraValue = nValue & ((1 << nBits) - 1);
+
+	return 2 * (nBits + 1) + ((nValue >> nBits) & 1);
+}
+
+CDeflater::CDeflater (TCompressionFormat Format, unsigned nLevel)
+:	m_Format (Format)
+{
+	assert (m_Format != CompressionFormatAuto);
+
+	if (nLevel > 9)
+	{
+		nLevel = 9;
+	}
+
+	m_nLevel = nLevel;
+	m_nMaxChain = s_LevelConfig[nLevel].nMaxChain;
+	m_nNiceLength = s_LevelConfig[nLevel].nNiceLength;
+
+	Reset ();
+}
+
+CDeflater::~CDeflater (void)
+{
+}
+
+void CDeflater::Reset (void)
+{
+	m_State = StateHeader;
+
+	m_nStrStart = 0;
+	m_nLookahead = 0;
+	m_nBlockStart = 0;
+	memset (m_Head, 0, sizeof m_Head);
+
+	m_nSymbols = 0;
+	memset (m_LitLenFrequency, 0, sizeof m_LitLenFrequency);
+	memset (m_DistanceFrequency, 0, sizeof m_DistanceFrequency);
+	m_nExtraBits = 0;
+
+	m_nPendingStart = 0;
+	m_nPendingLength = 0;
+	m_nBitBuffer = 0;
+	m_nBitCount = 0;
+
+	m_nTotalInput = 0;
+
+	m_Adler32.Reset ();
+	m_CRC32.Reset ();
+}
+
+TCompressionStatus CDeflater::Process (const void *pInput, size_t nInputLength, size_t *pInputUsed,
+				       void *pOutput, size_t nOutputSize, size_t *pOutputUsed,
+				       boolean bFinish)
+{
+	assert (pInput != 0 || nInputLength == 0);
+	assert (pInputUsed != 0);
+	assert (pOutput != 0 || nOutputSize == 0);
+	assert (pOutputUsed != 0);
+
+	m_pIn = (const u8 *) pInput;
+	m_pInEnd = m_pIn + nInputLength;
+	m_pOut = (u8 *) pOutput;
+	m_pOutEnd = m_pOut + nOutputSize;
+
+	TCompressionStatus Status = CompressionStatusOK;
+	while (1)
+	{
+		FlushPending ();
+		if (m_nPendingLength > 0)
+		{
+			break;				// output buffer is full
+		}
+
+		if (m_State == StateDone)
+		{
+			Status = CompressionStatusStreamEnd;
+
+			break;
+		}
+
+		if (m_State == StateHeader)
+		{
+			WriteHeader ();
+			m_State = StateData;
+
+			continue;
+		}
+
+		if (!FillWindow ())
+		{
+			EmitBlock (FALSE);		// window cannot slide before
+
+			continue;
+		}
+
+		boolean bFlush = bFinish && m_pIn == m_pInEnd;
+
+		while (   m_nSymbols < DEFLATE_MAX_SYMBOLS
+		       && m_nStrStart - m_nBlockStart < MAX_BLOCK_BYTES
+		       && (   m_nLookahead >= MIN_LOOKAHEAD
+			   || (bFlush && m_nLookahead > 0)))
+		{
+			DeflateStep ();
+		}
+
+		if (   m_nSymbols == DEFLATE_MAX_SYMBOLS
+		    || m_nStrStart - m_nBlockStart >= MAX_BLOCK_BYTES)
+		{
+			EmitBlock (FALSE);
+
+			continue;
+		}
+
+		if (bFlush)
+		{
+			assert (m_nLookahead == 0);
+
+			EmitBlock (TRUE);
+			WriteTrailer ();
+			m_State = StateDone;
+
+			continue;
+		}
+
+		if (m_pIn == m_pInEnd)
+		{
+			break;				// more input needed
+		}
+	}
+
+	*pInputUsed = m_pIn - (const u8 *) pInput;
+	*pOutputUsed = m_pOut - (u8 *) pOutput;
+
+	return Status;
+}
+
+u64 CDeflater::GetTotalInput (void) const
+{
+	return m_nTotalInput;
+}
+
+int CDeflater::Compress (const void *pInput, size_t nInputLength,
+			 void *pOutput, size_t nOutputSize,
+			 TCompressionFormat Format, unsigned nLevel)
+{
+	CDeflater *pDeflater = new CDeflater (Format, nLevel);
+	if (pDeflater == 0)
+	{
+		return -1;
+	}
+
+	size_t nInputUsed, nOutputUsed;
+	TCompressionStatus Status = pDeflater->Process (pInput, nInputLength, &nInputUsed,
+							pOutput, nOutputSize, &nOutputUsed, TRUE);
+
+	delete pDeflater;
+
+	if (Status != CompressionStatusStreamEnd)
+	{
+		return -1;
+	}
+
+	return (int) nOutputUsed;
+}
+
+boolean CDeflater::FillWindow (void)
+{
+	unsigned nEnd = m_nStrStart + m_nLookahead;
+
+	if (   nEnd == 2 * DEFLATE_WINDOW_SIZE
+	    && m_nLookahead < MIN_LOOKAHEAD
+	    && m_pIn < m_pInEnd)
+	{
+		// slide the upper half of the window down, the block must not start before
+		if (m_nBlockStart < DEFLATE_WINDOW_SIZE)
+		{
+			return FALSE;
+		}
+
+		assert (m_nStrStart >= DEFLATE_WINDOW_SIZE);
+		memcpy (m_Window, m_Window + DEFLATE_WINDOW_SIZE, DEFLATE_WINDOW_SIZE);
+		m_nStrStart -= DEFLATE_WINDOW_SIZE;
+		m_nBlockStart -= DEFLATE_WINDOW_SIZE;
+		nEnd -= DEFLATE_WINDOW_SIZE;
+
+		for (unsigned i = 0; i < 1 << DEFLATE_HASH_BITS; i++)
+		{
+			m_Head[i] = m_Head[i] >= DEFLATE_WINDOW_SIZE ? m_Head[i] - DEFLATE_WINDOW_SIZE : 0;
+		}
+
+		for (unsigned i = 0; i < DEFLATE_WINDOW_SIZE; i++)
+		{
+			m_Prev[i] = m_Prev[i] >= DEFLATE_WINDOW_SIZE ? m_Prev[i] - DEFLATE_WINDOW_SIZE : 0;
+		}
+	}
+
+	size_t nLength = 2 * DEFLATE_WINDOW_SIZE - nEnd;
+	if (nLength > (size_t) (m_pInEnd - m_pIn))
+	{
+		nLength = m_pInEnd - m_pIn;
+	}
+
+	if (nLength > 0)
+	{
+		memcpy (m_Window + nEnd, m_pIn, nLength);
+
+		if (m_Format == CompressionFormatZlib)
+		{
+			m_Adler32.Update (m_pIn, nLength);
+		}
+		else if (m_Format == CompressionFormatGzip)
+		{
+			m_CRC32.Update (m_pIn, nLength);
+		}
+
+		m_pIn += nLength;
+		m_nLookahead += nLength;
+		m_nTotalInput += nLength;
+	}
+
+	return TRUE;
+}
+
+void CDeflater::DeflateStep (void)
+{
+	assert (m_nLookahead > 0);
+	assert (m_nSymbols < DEFLATE_MAX_SYMBOLS);
+
+	unsigned nDistance = 0;
+	unsigned nLength = 0;
+
+	if (   m_nMaxChain > 0
+	    && m_nLookahead >= MIN_MATCH)
+	{
+		nLength = FindMatch (&nDistance);
+
+		InsertString (m_nStrStart);
+	}
+
+	if (nLength >= MIN_MATCH)
+	{
+		m_SymbolLitLen[m_nSymbols] = nLength;
+		m_SymbolDistance[m_nSymbols++] = nDistance;
+
+		unsigned nExtraBits, nExtraValue;
+		m_LitLenFrequency[257 + GetLengthCode (nLength, &nExtraBits, &nExtraValue)]++;
+		m_nExtraBits += nExtraBits;
+		m_DistanceFrequency[GetDistanceCode (nDistance, &nExtraBits, &nExtraValue)]++;
+		m_nExtraBits += nExtraBits;
+
+		// insert the strings inside the match too
+		for (unsigned i = 1; i < nLength; i++)
+		{
+			if (m_nLookahead - i >= MIN_MATCH)
+			{
+				InsertString (m_nStrStart + i);
+			}
+		}
+
+		m_nStrStart += nLength;
+		m_nLookahead -= nLength;
+	}
+	else
+	{
+		m_SymbolLitLen[m_nSymbols] = m_Window[m_nStrStart];
+		m_SymbolDistance[m_nSymbols++] = 0;
+
+		m_LitLenFrequency[m_Window[m_nStrStart]]++;
+
+		m_nStrStart++;
+		m_nLookahead--;
+	}
+}
+
+unsigned CDeflater::FindMatch (unsigned *pDistance)
+{
+	unsigned nMaxLength = m_nLookahead < MAX_MATCH ? m_nLookahead : MAX_MATCH;
+	unsigned nLimit = m_nStrStart > MAX_DISTANCE ? m_nStrStart - MAX_DISTANCE : 0;
+	const u8 *pString = m_Window + m_nStrStart;
+
+	unsigned nBestLength = MIN_MATCH - 1;
+	unsigned nChain = m_nMaxChain;
+	unsigned nMatch = m_Head[Hash (pString)];
+
+	while (   nMatch > nLimit
+	       && nChain-- > 0)
+	{
+		assert (nMatch < m_nStrStart);
+		const u8 *pMatch = m_Window + nMatch;
+
+		if (   pMatch[nBestLength] == pString[nBestLength]
+		    && pMatch[0] == pString[0]
+		    && pMatch[1] == pString[1])
+		{
+			unsigned nLength = 2;
+			while (   nLength < nMaxLength
+			       && pMatch[nLength] == pString[nLength])
+			{
+				nLength++;
+			}
+
+			if (nLength > nBestLength)
+			{
+				nBestLength = nLength;
+				*pDistance = m_nStrStart - nMatch;
+
+				if (nLength >= m_nNiceLength || nLength == nMaxLength)
+				{
+					break;
+				}
+			}
+		}
+
+		nMatch = m_Prev[nMatch & WINDOW_MASK];
+	}
+
+	if (   nBestLength == MIN_MATCH
+	    && *pDistance > TOO_FAR)
+	{
+		return 0;
+	}
+
+	return nBestLength >= MIN_MATCH ? nBestLength : 0;
+}
+
+void CDeflater::InsertString (unsigned nPos)
+{
+	unsigned nHash = Hash (m_Window + nPos);
+
+	m_Prev[nPos & WINDOW_MASK] = m_Head[nHash];
+	m_Head[nHash] = nPos;
+}
+
+unsigned CDeflater::Hash (const u8 *pString)
+{
+	u32 nValue = pString[0] << 16 | pString[1] << 8 | pString[2];
+
+	return (nValue * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+}
+
+void CDeflater::EmitBlock (boolean bLast)
+{
+	assert (m_nPendingLength == 0);
+
+	unsigned nBytes = m_nStrStart - m_nBlockStart;
+	unsigned nStoredBits = 3 + 7 + 32 + nBytes * 8;
+
+	if (m_nLevel == 0)
+	{
+		EmitStoredBlock (bLast);
+	}
+	else
+	{
+		m_LitLenFrequency[256] = 1;			// end of block
+
+		// cost of the fixed code
+		unsigned nFixedBits = 3 + m_nExtraBits;
+		for (unsigned i = 0; i < 286; i++)
+		{
+			nFixedBits += m_LitLenFrequency[i] * s_FixedLitLenCode.Length[i];
+		}
+		for (unsigned i = 0; i < 30; i++)
+		{
+			nFixedBits += m_DistanceFrequency[i] * 5;
+		}
+
+		// cost of the dynamic code
+		// (some decoders need at least two distance codes)
+		for (unsigned i = 0; i < 2; i++)
+		{
+			if (m_DistanceFrequency[i] == 0)
+			{
+				m_DistanceFrequency[i] = 1;
+			}
+		}
+
+		BuildCode (m_LitLenFrequency, 286, 15, &m_LitLenCode);
+		BuildCode (m_DistanceFrequency, 30, 15, &m_DistanceCode);
+
+		unsigned nLitLenCodes = 286;
+		while (m_LitLenCode.Length[nLitLenCodes-1] == 0)
+		{
+			nLitLenCodes--;
+		}
+
+		unsigned nDistanceCodes = 30;
+		while (m_DistanceCode.Length[nDistanceCodes-1] == 0)
+		{
+			nDistanceCodes--;
+		}
+
+		EncodeCodeLengths (nLitLenCodes, nDistanceCodes);
+		BuildCode (m_CodeLengthFrequency, 19, 7, &m_CodeLengthCode);
+
+		unsigned nCodeLengthCodes = 19;
+		while (   nCodeLengthCodes > 4
+		       && m_CodeLengthCode.Length[s_CodeLengthOrder[nCodeLengthCodes-1]] == 0)
+		{
+			nCodeLengthCodes--;
+		}
+
+		unsigned nDynamicBits = 3 + 5 + 5 + 4 + 3 * nCodeLengthCodes + m_nExtraBits;
+		for (unsigned i = 0; i < 19; i++)
+		{
+			nDynamicBits += m_CodeLengthFrequency[i] * m_CodeLengthCode.Length[i];
+		}
+		for (unsigned i = 0; i < m_nCodeLengthSymbols; i++)
+		{
+			static const u8 ExtraBits[3] = {2, 3, 7};
+			if (m_CodeLengthSymbol[i] >= 16)
+			{
+				nDynamicBits += ExtraBits[m_CodeLengthSymbol[i] - 16];
+			}
+		}
+		for (unsigned i = 0; i < nLitLenCodes; i++)
+		{
+			nDynamicBits += m_LitLenFrequency[i] * m_LitLenCode.Length[i];
+		}
+		for (unsigned i = 0; i < nDistanceCodes; i++)
+		{
+			// the added dummy frequencies do not matter here
+			nDynamicBits += m_DistanceFrequency[i] * m_DistanceCode.Length[i];
+		}
+
+		if (   nStoredBits <= nFixedBits
+		    && nStoredBits <= nDynamicBits)
+		{
+			EmitStoredBlock (bLast);
+		}
+		else if (nFixedBits <= nDynamicBits)
+		{
+			PutBits (bLast ? 3 : 2, 3);		// BFINAL, BTYPE 01
+			EmitSymbols (s_FixedLitLenCode, s_FixedDistanceCode);
+		}
+		else
+		{
+			PutBits (bLast ? 5 : 4, 3);		// BFINAL, BTYPE 10
+			EmitDynamicHeader (nLitLenCodes, nDistanceCodes, nCodeLengthCodes);
+			EmitSymbols (m_LitLenCode, m_DistanceCode);
+		}
+	}
+
+	m_nBlockStart = m_nStrStart;
+	m_nSymbols = 0;
+	memset (m_LitLenFrequency, 0, sizeof m_LitLenFrequency);
+	memset (m_DistanceFrequency, 0, sizeof m_DistanceFrequency);
+	m_nExtraBits = 0;
+}
+
+void CDeflater::EmitSymbols (const TDeflateHuffmanCode &rLitLenCode,
+			     const TDeflateHuffmanCode &rDistanceCode)
+{
+	for (unsigned i = 0; i < m_nSymbols; i++)
+	{
+		unsigned nDistance = m_SymbolDistance[i];
+		unsigned nSymbol = m_SymbolLitLen[i];
+
+		if (nDistance == 0)
+		{
+			PutBits (rLitLenCode.Code[nSymbol], rLitLenCode.Length[nSymbol]);
+
+			continue;
+		}
+
+		unsigned nExtraBits, nExtraValue;
+		unsigned nCode = 257 + GetLengthCode (nSymbol, &nExtraBits, &nExtraValue);
+		PutBits (rLitLenCode.Code[nCode], rLitLenCode.Length[nCode]);
+		PutBits (nExtraValue, nExtraBits);
+
+		nCode = GetDistanceCode (nDistance, &nExtraBits, &nExtraValue);
+		PutBits (rDistanceCode.Code[nCode], rDistanceCode.Length[nCode]);
+		PutBits (nExtraValue, nExtraBits);
+	}
+
+	PutBits (rLitLenCode.Code[256], rLitLenCode.Length[256]);
+}
+
+void CDeflater::EmitDynamicHeader (unsigned nLitLenCodes, unsigned nDistanceCodes,
+				   unsigned nCodeLengthCodes)
+{
+	PutBits (nLitLenCodes - 257, 5);
+	PutBits (nDistanceCodes - 1, 5);
+	PutBits (nCodeLengthCodes - 4, 4);
+
+	for (unsigned i = 0; i < nCodeLengthCodes; i++)
+	{
+		PutBits (m_CodeLengthCode.Length[s_CodeLengthOrder[i]], 3);
+	}
+
+	for (unsigned i = 0; i < m_nCodeLengthSymbols; i++)
+	{
+		unsigned nSymbol = m_CodeLengthSymbol[i];
+		PutBits (m_CodeLengthCode.Code[nSymbol], m_CodeLengthCode.Length[nSymbol]);
+
+		if (nSymbol >= 16)
+		{
+			static const u8 ExtraBits[3] = {2, 3, 7};
+			PutBits (m_CodeLengthExtra[i], ExtraBits[nSymbol - 16]);
+		}
+	}
+}
+
+// Run-length encodes the code lengths of the literal/length and distance codes
+// (RFC 1951 3.2.7) into m_CodeLengthSymbol/Extra and counts the symbols
+void CDeflater::EncodeCodeLengths (unsigned nLitLenCodes, unsigned nDistanceCodes)
+{
+	memcpy (m_CodeLengths, m_LitLenCode.Length, nLitLenCodes);
+	memcpy (m_CodeLengths + nLitLenCodes, m_DistanceCode.Length, nDistanceCodes);
+	unsigned nCodes = nLitLenCodes + nDistanceCodes;
+
+	memset (m_CodeLengthFrequency, 0, sizeof m_CodeLengthFrequency);
+	m_nCodeLengthSymbols = 0;
+
+	for (unsigned i = 0; i < nCodes;)
+	{
+		u8 uchLength = m_CodeLengths[i];
+
+		unsigned nRun = 1;
+		while (   i + nRun < nCodes
+		       && m_CodeLengths[i + nRun] == uchLength)
+		{
+			nRun++;
+		}
+
+		i += nRun;
+
+		if (uchLength == 0)
+		{
+			while (nRun >= 11)
+			{
+				unsigned nCount = nRun < 138 ? nRun : 138;
+				m_CodeLengthSymbol[m_nCodeLengthSymbols] = 18;
+				m_CodeLengthExtra[m_nCodeLengthSymbols++] = nCount - 11;
+				m_CodeLengthFrequency[18]++;
+				nRun -= nCount;
+			}
+
+			if (nRun >= 3)
+			{
+				m_CodeLengthSymbol[m_nCodeLengthSymbols] = 17;
+				m_CodeLengthExtra[m_nCodeLengthSymbols++] = nRun - 3;
+				m_CodeLengthFrequency[17]++;
+				nRun = 0;
+			}
+		}
+		else
+		{
+			m_CodeLengthSymbol[m_nCodeLengthSymbols++] = uchLength;
+			m_CodeLengthFrequency[uchLength]++;
+			nRun--;
+
+			while (nRun >= 3)
+			{
+				unsigned nCount = nRun < 6 ? nRun : 6;
+				m_CodeLengthSymbol[m_nCodeLengthSymbols] = 16;
+				m_CodeLengthExtra[m_nCodeLengthSymbols++] = nCount - 3;
+				m_CodeLengthFrequency[16]++;
+				nRun -= nCount;
+			}
+		}
+
+		for (; nRun > 0; nRun--)
+		{
+			m_CodeLengthSymbol[m_nCodeLengthSymbols++] = uchLength;
+			m_CodeLengthFrequency[uchLength]++;
+		}
+	}
+}
+
+// Builds a canonical Huffman code with code lengths limited to nMaxLength. If the optimal
+// code is too long, the frequencies are scaled down, until it fits.
+void CDeflater::BuildCode (const u16 *pFrequency, unsigned nSymbols, unsigned nMaxLength,
+			   TDeflateHuffmanCode *pCode)
+{
+	assert (nSymbols <= 288);
+	memset (pCode->Length, 0, sizeof pCode->Length);
+
+	for (unsigned nShift = 0; ; nShift++)
+	{
+		// sort the used symbols by frequency (insertion sort)
+		unsigned nLeaves = 0;
+		for (unsigned nSymbol = 0; nSymbol < nSymbols; nSymbol++)
+		{
+			if (pFrequency[nSymbol] == 0)
+			{
+				continue;
+			}
+
+			u32 nFrequency = ((pFrequency[nSymbol] - 1) >> nShift) + 1;
+
+			unsigned i = nLeaves++;
+			for (; i > 0 && m_TreeFrequency[i-1] > nFrequency; i--)
+			{
+				m_TreeFrequency[i] = m_TreeFrequency[i-1];
+				m_TreeSymbol[i] = m_TreeSymbol[i-1];
+			}
+
+			m_TreeFrequency[i] = nFrequency;
+			m_TreeSymbol[i] = nSymbol;
+		}
+
+		if (nLeaves == 0)
+		{
+			return;
+		}
+
+		if (nLeaves == 1)
+		{
+			pCode->Length[m_TreeSymbol[0]] = 1;
+
+			break;
+		}
+
+		// combine the two least frequent nodes, using a second queue of the inner nodes,
+		// which are created in order of frequency
+		unsigned nNextLeaf = 0;
+		unsigned nNextInner = nLeaves;
+		unsigned nRoot = 2 * nLeaves - 2;
+		for (unsigned nNode = nLeaves; nNode <= nRoot; nNode++)
+		{
+			m_TreeFrequency[nNode] = 0;
+			for (unsigned i = 0; i < 2; i++)
+			{
+				unsigned nChild;
+				if (   nNextLeaf < nLeaves
+				    && (   nNextInner == nNode
+					|| m_TreeFrequency[nNextLeaf] <= m_TreeFrequency[nNextInner]))
+				{
+					nChild = nNextLeaf++;
+				}
+				else
+				{
+					nChild = nNextInner++;
+				}
+
+				m_TreeFrequency[nNode] += m_TreeFrequency[nChild];
+				m_TreeParent[nChild] = nNode;
+			}
+		}
+
+		m_TreeDepth[nRoot] = 0;
+		unsigned nMaxDepth = 0;
+		for (int nNode = nRoot-1; nNode >= 0; nNode--)
+		{
+			m_TreeDepth[nNode] = m_TreeDepth[m_TreeParent[nNode]] + 1;
+
+			if (m_TreeDepth[nNode] > nMaxDepth)
+			{
+				nMaxDepth = m_TreeDepth[nNode];
+			}
+		}
+
+		if (nMaxDepth <= nMaxLength)
+		{
+			for (unsigned i = 0; i < nLeaves; i++)
+			{
+				pCode->Length[m_TreeSymbol[i]] = m_TreeDepth[i];
+			}
+
+			break;
+		}
+	}
+
+	// assign the canonical codes
+	u16 Count[16];
+	memset (Count, 0, sizeof Count);
+	for (unsigned nSymbol = 0; nSymbol < nSymbols; nSymbol++)
+	{
+		Count[pCode->Length[nSymbol]]++;
+	}
+
+	u16 NextCode[16];
+	unsigned nCode = 0;
+	Count[0] = 0;
+	for (unsigned nLength = 1; nLength <= 15; nLength++)
+	{
+		nCode = (nCode + Count[nLength-1]) << 1;
+		NextCode[nLength] = nCode;
+	}
+
+	for (unsigned nSymbol = 0; nSymbol < nSymbols; nSymbol++)
+	{
+		unsigned nLength = pCode->Length[nSymbol];
+		if (nLength != 0)
+		{
+			pCode->Code[nSymbol] = ReverseBits (NextCode[nLength]++, nLength);
+		}
+	}
+}
+
+void CDeflater::EmitStoredBlock (boolean bLast)
+{
+	unsigned nBytes = m_nStrStart - m_nBlockStart;
+	assert (nBytes <= 0xFFFF);
+
+	PutBits (bLast ? 1 : 0, 3);			// BFINAL, BTYPE 00
+	AlignBits ();
+
+	PutByte (nBytes & 0xFF);
+	PutByte (nBytes >> 8);
+	PutByte (~nBytes & 0xFF);
+	PutByte ((~nBytes >> 8) & 0xFF);
+
+	assert (m_nPendingLength + nBytes <= DEFLATE_PENDING_SIZE);
+	memcpy (m_Pending + m_nPendingLength, m_Window + m_nBlockStart, nBytes);
+	m_nPendingLength += nBytes;
+}
+
+void CDeflater::WriteHeader (void)
+{
+	if (m_Format == CompressionFormatZlib)
+	{
+		unsigned nCMF = 0x78;			// deflate, 32K window
+		unsigned nFLG = (m_nLevel < 2 ? 0 : (m_nLevel < 6 ? 1 : (m_nLevel == 6 ? 2 : 3))) << 6;
+		nFLG += 31 - (nCMF << 8 | nFLG) % 31;
+
+		PutByte (nCMF);
+		PutByte (nFLG);
+	}
+	else if (m_Format == CompressionFormatGzip)
+	{
+		static const u8 Header[] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+
+		for (unsigned i = 0; i < sizeof Header; i++)
+		{
+			PutByte (Header[i]);
+		}
+	}
+}
+
+void CDeflater::WriteTrailer (void)
+{
+	AlignBits ();
+
+	if (m_Format == CompressionFormatZlib)
+	{
+		u32 nAdler32 = m_Adler32.Get ();
+		for (int i = 24; i >= 0; i -= 8)
+		{
+			PutByte (nAdler32 >> i);
+		}
+	}
+	else if (m_Format == CompressionFormatGzip)
+	{
+		u32 nCRC32 = m_CRC32.Get ();
+		for (unsigned i = 0; i < 32; i += 8)
+		{
+			PutByte (nCRC32 >> i);
+		}
+
+		u32 nSize = (u32) m_nTotalInput;
+		for (unsigned i = 0; i < 32; i += 8)
+		{
+			PutByte (nSize >> i);
+		}
+	}
+}
+
+void CDeflater::FlushPending (void)
+{
+	size_t nLength = m_nPendingLength - m_nPendingStart;
+	if (nLength > (size_t) (m_pOutEnd - m_pOut))
+	{
+		nLength = m_pOutEnd - m_pOut;
+	}
+
+	memcpy (m_pOut, m_Pending + m_nPendingStart, nLength);
+	m_pOut += nLength;
+	m_nPendingStart += nLength;
+
+	if (m_nPendingStart == m_nPendingLength)
+	{
+		m_nPendingStart = 0;
+		m_nPendingLength = 0;
+	}
+}
+
+void CDeflater::PutBits (u32 nValue, unsigned nBits)
+{
+	assert (nBits <= 16);
+	m_nBitBuffer |= nValue << m_nBitCount;
+	m_nBitCount += nBits;
+
+	while (m_nBitCount >= 8)
+	{
+		PutByte (m_nBitBuffer & 0xFF);
+		m_nBitBuffer >>= 8;
+		m_nBitCount -= 8;
+	}
+}
+
+void CDeflater::AlignBits (void)
+{
+	if (m_nBitCount > 0)
+	{
+		PutByte (m_nBitBuffer & 0xFF);
+	}
+
+	m_nBitBuffer = 0;
+	m_nBitCount = 0;
+}
+
+void CDeflater::PutByte (u8 uchByte)
+{
+	assert (m_nPendingLength < DEFLATE_PENDING_SIZE);
+	m_Pending[m_nPendingLength++] = uchByte;
+}
@@ -2,7 +2,7 @@
 // devicenameservice.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -25,8 +25,7 @@
 CDeviceNameService *CDeviceNameService::s_This = 0;
 
 CDeviceNameService::CDeviceNameService (void)
-:	m_pList (0),
-	m_SpinLock (TASK_LEVEL)
+:	m_SpinLock (TASK_LEVEL)
 {
 	assert (s_This == 0);
 	s_This = this;
@@ -34,25 +33,23 @@ CDeviceNameService::CDeviceNameService (void)
 
 CDeviceNameService::~CDeviceNameService (void)
 {
-	while (m_pList != 0)
+	TDeviceInfo *pInfo;
+	while ((pInfo = m_List.RemoveHead ()) != 0)
 	{
-		TDeviceInfo *pNext = m_pList->pNext;
+		delete [] pInfo->pName;
+		pInfo->pName = 0;
+		pInfo->pDevice = 0;
+		delete pInfo;
+	}
 
-		delete [] m_pList->pName;
-		m_pList->pName = 0;
-		m_pList->pDevice = 0;
-		delete m_pList;
+	m_Map[FALSE].RemoveAll ();
+	m_Map[TRUE].RemoveAll ();
 
-		m_pList = pNext;
-	}
-	
 	s_This = 0;
 }
 
 void CDeviceNameService::AddDevice (const char *pName, CDevice *pDevice, boolean bBlockDevice)
 {
-	m_SpinLock.Acquire ();
-
 	TDeviceInfo *pInfo = new TDeviceInfo;
 	assert (pInfo != 0);
 
@@ -64,10 +61,13 @@ void CDeviceNameService::AddDevice (const char *pName, CDevice *pDevice, boolean
 	assert (pDevice != 0);
 	pInfo->pDevice = pDevice;
 	
-	pInfo->bBlockDevice = bBlockDevice;
+	pInfo->bBlockDevice = bBlockDevice ? TRUE : FALSE;
 
-	pInfo->pNext = m_pList;
-	m_pList = pInfo;
+	m_SpinLock.Acquire ();
+
+	// a device with the same name shadows the older one until it is removed
+	m_List.InsertHead (pInfo);
+	m_Map[pInfo->bBlockDevice].Set (pInfo->pName, pInfo);
 
 	m_SpinLock.Release ();
 }
@@ -85,37 +85,34 @@ void CDeviceNameService::RemoveDevice (const char *pName, boolean bBlockDevice)
 {
 	assert (pName != 0);
 
-	m_SpinLock.Acquire ();
+	bBlockDevice = bBlockDevice ? TRUE : FALSE;
 
-	TDeviceInfo *pInfo = m_pList;
-	TDeviceInfo *pPrev = 0;
-	while (pInfo != 0)
-	{
-		assert (pInfo->pName != 0);
-		if (   strcmp (pName, pInfo->pName) == 0
-		    && pInfo->bBlockDevice == bBlockDevice)
-		{
-			break;
-		}
-
-		pPrev = pInfo;
-		pInfo = pInfo->pNext;
-	}
+	m_SpinLock.Acquire ();
 
-	if (pInfo == 0)
+	TDeviceInfo **ppInfo = m_Map[bBlockDevice].Find (pName);
+	if (ppInfo == 0)
 	{
 		m_SpinLock.Release ();
 
 		return;
 	}
 
-	if (pPrev == 0)
-	{
-		m_pList = pInfo->pNext;
-	}
-	else
+	TDeviceInfo *pInfo = *ppInfo;
+	assert (pInfo != 0);
+
+	m_Map[bBlockDevice].Remove (pName);
+	m_List.Remove (pInfo);
+
+	// make a shadowed older device with the same name visible again
+	for (TDeviceInfo *pOther = m_List.GetFirst (); pOther != 0; pOther = m_List.GetNext (pOther))
 	{
-		pPrev->pNext = pInfo->pNext;
+		if (   pOther->bBlockDevice == bBlockDevice
+		    && strcmp (pOther->pName, pName) == 0)
+		{
+			m_Map[bBlockDevice].Set (pOther->pName, pOther);
+
+			break;
+		}
 	}
 
 	m_SpinLock.Release ();
@@ -140,33 +137,28 @@ CDevice *CDeviceNameService::GetDevice (const char *pName, boolean bBlockDevice)
 
 	m_SpinLock.Acquire ();
 
-	TDeviceInfo *pInfo = m_pList;
-	while (pInfo != 0)
-	{
-		assert (pInfo->pName != 0);
-		if (   strcmp (pName, pInfo->pName) == 0
-		    && pInfo->bBlockDevice == bBlockDevice)
-		{
-			CDevice *pResult = pInfo->pDevice;
-
-			m_SpinLock.Release ();
-
-			assert (pResult != 0);
-			return pResult;
-		}
+	CDevice *pResult = 0;
 
-		pInfo = pInfo->pNext;
+	TDeviceInfo **ppInfo = m_Map[bBlockDevice ? TRUE : FALSE].Find (pName);
+	if (ppInfo != 0)
+	{
+		assert (*ppInfo != 0);
+		pResult = (*ppInfo)->pDevice;
+		assert (pResult != 0);
 	}
 
 	m_SpinLock.Release ();
 
-	return 0;
+	return pResult;
 }
 
 CDevice *CDeviceNameService::GetDevice (const char *pPrefix, unsigned nIndex, boolean bBlockDevice)
 {
-	CString Name;
-	Name.Format ("%s%u", pPrefix, nIndex);
+	char Name[64];
+	if (CString::FormatBuffer (Name, sizeof Name, "%s%u", pPrefix, nIndex) >= sizeof Name)
+	{
+		return 0;
+	}
 
 	return GetDevice (Name, bBlockDevice);
 }
@@ -177,8 +169,7 @@ void CDeviceNameService::ListDevices (CDevice *pTarget)
 
 	unsigned i = 0;
 
-	TDeviceInfo *pInfo = m_pList;
-	while (pInfo != 0)
+	for (TDeviceInfo *pInfo = m_List.GetFirst (); pInfo != 0; pInfo = m_List.GetNext (pInfo))
 	{
 		CString String;
 
@@ -189,8 +180,6 @@ void CDeviceNameService::ListDevices (CDevice *pTarget)
 			       ++i % 4 == 0 ? '\n' : ' ');
 
 		pTarget->Write ((const char *) String, String.GetLength ());
-
-		pInfo = pInfo->pNext;
 	}
 
 	if (i % 4 != 0)
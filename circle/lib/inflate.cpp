@@ -0,0 +1,1175 @@
+//
+// inflate.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/inflate.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define WINDOW_MASK		(INFLATE_WINDOW_SIZE - 1)
+
+#define FAST_MASK		((1U << INFLATE_FAST_BITS) - 1)
+#define FAST_MIN_INPUT		8
+#define FAST_MIN_OUTPUT		(258 + 8)
+
+#define DECODE_MORE_BITS	(-1)		// results of DecodeSymbol()
+#define DECODE_INVALID		(-2)
+
+#define GZIP_FHCRC		0x02
+#define GZIP_FEXTRA		0x04
+#define GZIP_FNAME		0x08
+#define GZIP_FCOMMENT		0x10
+#define GZIP_FRESERVED		0xE0
+
+// Base values and number of extra bits of the length and distance codes (RFC 1951 3.2.5)
+static const u16 s_LengthBase[29] =
+	{3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+	 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const u8 s_LengthExtra[29] =
+	{0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const u16 s_DistanceBase[30] =
+	{1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const u8 s_DistanceExtra[30] =
+	{0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+	 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Order of the code length code lengths (RFC 1951 3.2.7)
+static const u8 s_CodeLengthOrder[19] =
+	{16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+CInflater::CInflater (TCompressionFormat Format)
+:	m_Format (Format)
+{
+	Reset ();
+}
+
+CInflater::~CInflater (void)
+{
+}
+
+void CInflater::Reset (void)
+{
+	m_StreamFormat = m_Format;
+	m_State = StateHeader;
+	m_pErrorMessage = 0;
+
+	m_nBitBuffer = 0;
+	m_nBitCount = 0;
+
+	m_bLastBlock = FALSE;
+	m_nWindowPos = 0;
+	m_nTotalOutput = 0;
+
+	m_Adler32.Reset ();
+	m_CRC32.Reset ();
+}
+
+TCompressionStatus CInflater::Process (const void *pInput, size_t nInputLength, size_t *pInputUsed,
+				       void *pOutput, size_t nOutputSize, size_t *pOutputUsed)
+{
+	assert (pInput != 0 || nInputLength == 0);
+	assert (pInputUsed != 0);
+	assert (pOutput != 0 || nOutputSize == 0);
+	assert (pOutputUsed != 0);
+
+	m_pIn = (const u8 *) pInput;
+	m_pInEnd = m_pIn + nInputLength;
+	m_pOutBegin = (u8 *) pOutput;
+	m_pOut = m_pOutBegin;
+	m_pOutEnd = m_pOut + nOutputSize;
+	m_pOutChecked = m_pOut;
+
+	TCompressionStatus Status = Run ();
+
+	UpdateChecksum ();
+	UpdateWindow ();
+
+	if (   Status == CompressionStatusStreamEnd
+	    || (   Status == CompressionStatusOK
+		&& m_pOut == m_pOutEnd))
+	{
+		// give back whole bytes, which have been read ahead, so that the caller
+		// can find the data following the stream or may pass them again
+		size_t nBytes = m_nBitCount / 8;
+		size_t nConsumed = m_pIn - (const u8 *) pInput;
+		if (nBytes > nConsumed)
+		{
+			nBytes = nConsumed;
+		}
+
+		if (nBytes > 0)
+		{
+			m_pIn -= nBytes;
+			m_nBitCount -= nBytes * 8;
+			m_nBitBuffer &= (1ULL << m_nBitCount) - 1;
+		}
+	}
+
+	*pInputUsed = m_pIn - (const u8 *) pInput;
+	*pOutputUsed = m_pOut - m_pOutBegin;
+
+	m_nTotalOutput += *pOutputUsed;
+
+	return Status;
+}
+
+u64 CInflater::GetTotalOutput (void) const
+{
+	return m_nTotalOutput;
+}
+
+const char *CInflater::GetErrorMessage (void) const
+{
+	return m_pErrorMessage != 0 ? m_pErrorMessage : "No error";
+}
+
+int CInflater::Decompress (const void *pInput, size_t nInputLength,
+			   void *pOutput, size_t nOutputSize, TCompressionFormat Format)
+{
+	CInflater *pInflater = new CInflater (Format);
+	if (pInflater == 0)
+	{
+		return -1;
+	}
+
+	size_t nInputUsed, nOutputUsed;
+	TCompressionStatus Status = pInflater->Process (pInput, nInputLength, &nInputUsed,
+							pOutput, nOutputSize, &nOutputUsed);
+
+	delete pInflater;
+
+	if (Status != CompressionStatusStreamEnd)
+	{
+		return -1;
+	}
+
+	return (int) nOutputUsed;
+}
+
+TCompressionStatus CInflater::Run (void)
+{
+	while (1)
+	{
+		switch (m_State)
+		{
+		case StateHeader:
+			if (m_StreamFormat == CompressionFormatAuto)
+			{
+				if (!NeedBits (8))
+				{
+					return CompressionStatusOK;
+				}
+
+				m_StreamFormat =   PeekBits (8) == 0x1F
+						 ? CompressionFormatGzip : CompressionFormatZlib;
+			}
+
+			if (m_StreamFormat == CompressionFormatRaw)
+			{
+				m_State = StateBlockHeader;
+			}
+			else if (m_StreamFormat == CompressionFormatGzip)
+			{
+				m_State = StateGzipHeader;
+			}
+			else
+			{
+				if (!NeedBits (16))
+				{
+					return CompressionStatusOK;
+				}
+
+				unsigned nCMF = PeekBits (8);
+				unsigned nFLG = PeekBits (16) >> 8;
+				if (   (nCMF & 0x0F) != 8
+				    || (nCMF >> 4) > 7
+				    || (nCMF << 8 | nFLG) % 31 != 0)
+				{
+					Error ("Invalid zlib header");
+					break;
+				}
+
+				if (nFLG & 0x20)
+				{
+					Error ("Preset dictionary not supported");
+					break;
+				}
+
+				DropBits (16);
+
+				m_State = StateBlockHeader;
+			}
+			break;
+
+		case StateGzipHeader:
+			if (!NeedBits (32))
+			{
+				return CompressionStatusOK;
+			}
+
+			if (   PeekBits (24) != 0x088B1F		// ID1, ID2, CM
+			    || (PeekBits (32) >> 24) & GZIP_FRESERVED)
+			{
+				Error ("Invalid gzip header");
+				break;
+			}
+
+			m_nGzipFlags = PeekBits (32) >> 24;
+			DropBits (32);
+
+			m_State = StateGzipTime;
+			break;
+
+		case StateGzipTime:				// MTIME, XFL, OS
+			if (!NeedBits (48))
+			{
+				return CompressionStatusOK;
+			}
+
+			DropBits (48);
+
+			m_State = StateGzipExtraLength;
+			break;
+
+		case StateGzipExtraLength:
+			m_nRemaining = 0;
+			if (m_nGzipFlags & GZIP_FEXTRA)
+			{
+				if (!NeedBits (16))
+				{
+					return CompressionStatusOK;
+				}
+
+				m_nRemaining = PeekBits (16);
+				DropBits (16);
+			}
+
+			m_State = StateGzipExtra;
+			break;
+
+		case StateGzipExtra:
+			for (; m_nRemaining > 0; m_nRemaining--)
+			{
+				if (!NeedBits (8))
+				{
+					return CompressionStatusOK;
+				}
+
+				DropBits (8);
+			}
+
+			m_State = StateGzipName;
+			break;
+
+		case StateGzipName:
+		case StateGzipComment:
+			if (m_nGzipFlags & (m_State == StateGzipName ? GZIP_FNAME : GZIP_FCOMMENT))
+			{
+				unsigned nChar;
+				do
+				{
+					if (!NeedBits (8))
+					{
+						return CompressionStatusOK;
+					}
+
+					nChar = PeekBits (8);
+					DropBits (8);
+				}
+				while (nChar != 0);
+			}
+
+			m_State = m_State == StateGzipName ? StateGzipComment : StateGzipHeaderCRC;
+			break;
+
+		case StateGzipHeaderCRC:
+			if (m_nGzipFlags & GZIP_FHCRC)
+			{
+				if (!NeedBits (16))
+				{
+					return CompressionStatusOK;
+				}
+
+				DropBits (16);			// not checked
+			}
+
+			m_State = StateBlockHeader;
+			break;
+
+		case StateBlockHeader:
+			if (!NeedBits (3))
+			{
+				return CompressionStatusOK;
+			}
+
+			m_bLastBlock = PeekBits (1);
+
+			switch (PeekBits (3) >> 1)
+			{
+			case 0:
+				DropBits (3);
+				DropBits (m_nBitCount & 7);	// go to byte boundary
+				m_State = StateStoredLength;
+				break;
+
+			case 1: {
+				DropBits (3);
+
+				unsigned i = 0;
+				for (; i < 144; i++)	m_Lengths[i] = 8;
+				for (; i < 256; i++)	m_Lengths[i] = 9;
+				for (; i < 280; i++)	m_Lengths[i] = 7;
+				for (; i < 288; i++)	m_Lengths[i] = 8;
+				for (; i < 288+32; i++)	m_Lengths[i] = 5;
+
+				BuildTable (&m_LitLenTable, m_Lengths, 288, FALSE);
+				BuildTable (&m_DistanceTable, m_Lengths + 288, 32, FALSE);
+
+				m_State = StateCodes;
+				} break;
+
+			case 2:
+				DropBits (3);
+				m_State = StateDynamicHeader;
+				break;
+
+			default:
+				Error ("Invalid block type");
+				break;
+			}
+			break;
+
+		case StateStoredLength:
+			if (!NeedBits (32))
+			{
+				return CompressionStatusOK;
+			}
+
+			m_nRemaining = PeekBits (16);
+			if (m_nRemaining != (~PeekBits (32) >> 16 & 0xFFFF))
+			{
+				Error ("Invalid stored block length");
+				break;
+			}
+
+			DropBits (32);
+
+			m_State = StateStored;
+			break;
+
+		case StateStored:
+			while (m_nRemaining > 0)
+			{
+				if (m_pOut == m_pOutEnd)
+				{
+					return CompressionStatusOK;
+				}
+
+				if (m_nBitCount >= 8)		// read ahead bytes first
+				{
+					PutByte (PeekBits (8));
+					DropBits (8);
+					m_nRemaining--;
+
+					continue;
+				}
+
+				size_t nLength = m_nRemaining;
+				if (nLength > (size_t) (m_pInEnd - m_pIn))
+				{
+					nLength = m_pInEnd - m_pIn;
+				}
+				if (nLength > (size_t) (m_pOutEnd - m_pOut))
+				{
+					nLength = m_pOutEnd - m_pOut;
+				}
+
+				if (nLength == 0)
+				{
+					return CompressionStatusOK;
+				}
+
+				PutBytes (m_pIn, nLength);
+				m_pIn += nLength;
+				m_nRemaining -= nLength;
+			}
+
+			m_State = m_bLastBlock ? StateTrailer : StateBlockHeader;
+			break;
+
+		case StateDynamicHeader:
+			if (!NeedBits (14))
+			{
+				return CompressionStatusOK;
+			}
+
+			m_nLitLenCodes = PeekBits (5) + 257;
+			m_nDistanceCodes = (PeekBits (10) >> 5) + 1;
+			m_nCodeLengthCodes = (PeekBits (14) >> 10) + 4;
+			DropBits (14);
+
+			if (   m_nLitLenCodes > 286
+			    || m_nDistanceCodes > 30)
+			{
+				Error ("Too many length or distance codes");
+				break;
+			}
+
+			memset (m_Lengths, 0, 19);
+			m_nIndex = 0;
+
+			m_State = StateCodeLengths;
+			break;
+
+		case StateCodeLengths:
+			for (; m_nIndex < m_nCodeLengthCodes; m_nIndex++)
+			{
+				if (!NeedBits (3))
+				{
+					return CompressionStatusOK;
+				}
+
+				m_Lengths[s_CodeLengthOrder[m_nIndex]] = PeekBits (3);
+				DropBits (3);
+			}
+
+			// the code length code is temporarily held in the literal/length table
+			if (!BuildTable (&m_LitLenTable, m_Lengths, 19, FALSE))
+			{
+				Error ("Invalid code lengths code");
+				break;
+			}
+
+			m_nIndex = 0;
+
+			m_State = StateLengths;
+			break;
+
+		case StateLengths:
+			if (!DecodeLengths ())
+			{
+				return CompressionStatusOK;
+			}
+			break;
+
+		case StateCodes:
+			if (!DecodeCodes ())
+			{
+				return CompressionStatusOK;
+			}
+			break;
+
+		case StateCopy:
+			if (!CopyMatch ())
+			{
+				return CompressionStatusOK;
+			}
+
+			m_State = StateCodes;
+			break;
+
+		case StateTrailer:
+			UpdateChecksum ();
+
+			DropBits (m_nBitCount & 7);
+
+			if (m_StreamFormat == CompressionFormatZlib)
+			{
+				if (!NeedBits (32))
+				{
+					return CompressionStatusOK;
+				}
+
+				if (bswap32 (PeekBits (32)) != m_Adler32.Get ())
+				{
+					Error ("Adler-32 mismatch");
+					break;
+				}
+
+				DropBits (32);
+			}
+			else if (m_StreamFormat == CompressionFormatGzip)
+			{
+				if (!NeedBits (64))
+				{
+					return CompressionStatusOK;
+				}
+
+				if (PeekBits (32) != m_CRC32.Get ())
+				{
+					Error ("CRC-32 mismatch");
+					break;
+				}
+
+				DropBits (32);
+
+				u64 nTotalOutput = m_nTotalOutput + (m_pOut - m_pOutBegin);
+				if (PeekBits (32) != (u32) nTotalOutput)
+				{
+					Error ("Length mismatch");
+					break;
+				}
+
+				DropBits (32);
+			}
+
+			m_State = StateDone;
+			break;
+
+		case StateDone:
+			return CompressionStatusStreamEnd;
+
+		case StateError:
+			return CompressionStatusError;
+		}
+	}
+}
+
+boolean CInflater::DecodeLengths (void)
+{
+	unsigned nTotal = m_nLitLenCodes + m_nDistanceCodes;
+	while (m_nIndex < nTotal)
+	{
+		RefillBits ();
+
+		unsigned nLength;
+		int nSymbol = DecodeSymbol (m_LitLenTable, &nLength);
+		if (nSymbol < 0)
+		{
+			if (nSymbol == DECODE_MORE_BITS)
+			{
+				return FALSE;
+			}
+
+			Error ("Invalid code length");
+
+			return TRUE;
+		}
+
+		if (nSymbol < 16)
+		{
+			DropBits (nLength);
+			m_Lengths[m_nIndex++] = nSymbol;
+
+			continue;
+		}
+
+		unsigned nExtraBits = nSymbol == 16 ? 2 : (nSymbol == 17 ? 3 : 7);
+		if (m_nBitCount < nLength + nExtraBits)
+		{
+			return FALSE;
+		}
+
+		DropBits (nLength);
+
+		u8 uchValue = 0;
+		unsigned nRepeat;
+		if (nSymbol == 16)
+		{
+			if (m_nIndex == 0)
+			{
+				Error ("No code length to repeat");
+
+				return TRUE;
+			}
+
+			uchValue = m_Lengths[m_nIndex-1];
+			nRepeat = 3 + PeekBits (2);
+		}
+		else if (nSymbol == 17)
+		{
+			nRepeat = 3 + PeekBits (3);
+		}
+		else
+		{
+			nRepeat = 11 + PeekBits (7);
+		}
+
+		DropBits (nExtraBits);
+
+		if (m_nIndex + nRepeat > nTotal)
+		{
+			Error ("Too many code lengths");
+
+			return TRUE;
+		}
+
+		while (nRepeat--)
+		{
+			m_Lengths[m_nIndex++] = uchValue;
+		}
+	}
+
+	if (m_Lengths[256] == 0)
+	{
+		Error ("Missing end-of-block code");
+
+		return TRUE;
+	}
+
+	if (!BuildTable (&m_LitLenTable, m_Lengths, m_nLitLenCodes, TRUE))
+	{
+		Error ("Invalid literal/length code lengths");
+
+		return TRUE;
+	}
+
+	if (!BuildTable (&m_DistanceTable, m_Lengths + m_nLitLenCodes, m_nDistanceCodes, TRUE))
+	{
+		Error ("Invalid distance code lengths");
+
+		return TRUE;
+	}
+
+	m_State = StateCodes;
+
+	return TRUE;
+}
+
+boolean CInflater::DecodeCodes (void)
+{
+	while (1)
+	{
+		if (   m_pInEnd - m_pIn >= FAST_MIN_INPUT
+		    && m_pOutEnd - m_pOut >= FAST_MIN_OUTPUT)
+		{
+			DecodeCodesFast ();
+		}
+
+		RefillBits ();
+
+		// a length/distance pair is decoded completely or not at all
+		u64 nSavedBuffer = m_nBitBuffer;
+		unsigned nSavedCount = m_nBitCount;
+
+		unsigned nLength;
+		int nSymbol = DecodeSymbol (m_LitLenTable, &nLength);
+		if (nSymbol < 0)
+		{
+			if (nSymbol == DECODE_MORE_BITS)
+			{
+				return FALSE;
+			}
+
+			Error ("Invalid literal/length code");
+
+			return TRUE;
+		}
+
+		if (   m_pOut == m_pOutEnd
+		    && nSymbol != 256)			// end of block needs no output space
+		{
+			return FALSE;
+		}
+
+		DropBits (nLength);
+
+		if (nSymbol < 256)
+		{
+			PutByte (nSymbol);
+
+			continue;
+		}
+
+		if (nSymbol == 256)
+		{
+			m_State = m_bLastBlock ? StateTrailer : StateBlockHeader;
+
+			return TRUE;
+		}
+
+		nSymbol -= 257;
+		if (nSymbol >= 29)
+		{
+			Error ("Invalid length code");
+
+			return TRUE;
+		}
+
+		unsigned nExtraBits = s_LengthExtra[nSymbol];
+		if (m_nBitCount < nExtraBits)
+		{
+			m_nBitBuffer = nSavedBuffer;
+			m_nBitCount = nSavedCount;
+
+			return FALSE;
+		}
+
+		m_nRemaining = s_LengthBase[nSymbol] + PeekBits (nExtraBits);
+		DropBits (nExtraBits);
+
+		nSymbol = DecodeSymbol (m_DistanceTable, &nLength);
+		if (nSymbol < 0)
+		{
+			if (nSymbol == DECODE_MORE_BITS)
+			{
+				m_nBitBuffer = nSavedBuffer;
+				m_nBitCount = nSavedCount;
+
+				return FALSE;
+			}
+
+			Error ("Invalid distance code");
+
+			return TRUE;
+		}
+
+		DropBits (nLength);
+
+		if (nSymbol >= 30)
+		{
+			Error ("Invalid distance code");
+
+			return TRUE;
+		}
+
+		nExtraBits = s_DistanceExtra[nSymbol];
+		if (m_nBitCount < nExtraBits)
+		{
+			m_nBitBuffer = nSavedBuffer;
+			m_nBitCount = nSavedCount;
+
+			return FALSE;
+		}
+
+		m_nDistance = s_DistanceBase[nSymbol] + PeekBits (nExtraBits);
+		DropBits (nExtraBits);
+
+		if (m_nDistance > m_nTotalOutput + (m_pOut - m_pOutBegin))
+		{
+			Error ("Distance too far back");
+
+			return TRUE;
+		}
+
+		if (!CopyMatch ())
+		{
+			m_State = StateCopy;
+
+			return FALSE;
+		}
+	}
+}
+
+// Decodes symbols, while enough input and output space is available for the longest
+// length/distance pair, without further checks. Returns on end of block, long or invalid
+// codes and back references into the window, which are handled by DecodeCodes().
+void CInflater::DecodeCodesFast (void)
+{
+	const u8 *pIn = m_pIn;
+	const u8 *pInLimit = m_pInEnd - FAST_MIN_INPUT;
+	u8 *pOut = m_pOut;
+	u8 *pOutLimit = m_pOutEnd - FAST_MIN_OUTPUT;
+	u64 nBitBuffer = m_nBitBuffer;
+	unsigned nBitCount = m_nBitCount;
+
+	while (   pIn <= pInLimit
+	       && pOut <= pOutLimit)
+	{
+		if (nBitCount <= 56)
+		{
+			u64 nWord;
+			memcpy (&nWord, pIn, sizeof nWord);
+			nBitBuffer |= nWord << nBitCount;
+			pIn += (63 - nBitCount) / 8;
+			nBitCount |= 56;			// at least 56 bits available now
+		}
+
+		unsigned nEntry = m_LitLenTable.Fast[nBitBuffer & FAST_MASK];
+		if (nEntry == 0)
+		{
+			break;
+		}
+
+		unsigned nSymbol = nEntry >> 4;
+		if (nSymbol < 256)
+		{
+			nBitBuffer >>= nEntry & 0xF;
+			nBitCount -= nEntry & 0xF;
+
+			*pOut++ = nSymbol;
+
+			continue;
+		}
+
+		nSymbol -= 257;
+		if (nSymbol >= 29)				// end of block or invalid
+		{
+			break;
+		}
+
+		unsigned nLengthBits = nEntry & 0xF;
+		unsigned nExtraBits = s_LengthExtra[nSymbol];
+		unsigned nLength =   s_LengthBase[nSymbol]
+				   + ((nBitBuffer >> nLengthBits) & ((1U << nExtraBits) - 1));
+		nLengthBits += nExtraBits;
+
+		nEntry = m_DistanceTable.Fast[(nBitBuffer >> nLengthBits) & FAST_MASK];
+		if (   nEntry == 0
+		    || (nSymbol = nEntry >> 4) >= 30)
+		{
+			break;
+		}
+
+		unsigned nDistanceBits = nLengthBits + (nEntry & 0xF);
+		nExtraBits = s_DistanceExtra[nSymbol];
+		size_t nDistance =   s_DistanceBase[nSymbol]
+				   + ((nBitBuffer >> nDistanceBits) & ((1U << nExtraBits) - 1));
+		nDistanceBits += nExtraBits;
+
+		if (nDistance > (size_t) (pOut - m_pOutBegin))
+		{
+			break;				// into the window or invalid
+		}
+
+		nBitBuffer >>= nDistanceBits;
+		nBitCount -= nDistanceBits;
+
+		const u8 *pFrom = pOut - nDistance;
+		if (nDistance >= 8)
+		{
+			// may write up to 7 bytes more, which are overwritten later
+			for (int i = nLength; i > 0; i -= 8)
+			{
+				memcpy (pOut, pFrom, 8);
+				pOut += 8;
+				pFrom += 8;
+			}
+
+			pOut -= (8 - nLength % 8) % 8;
+		}
+		else
+		{
+			while (nLength--)
+			{
+				*pOut++ = *pFrom++;
+			}
+		}
+	}
+
+	// drop the bytes, which are in the buffer, but not consumed
+	if (nBitCount < 64)
+	{
+		nBitBuffer &= (1ULL << nBitCount) - 1;
+	}
+
+	m_nBitBuffer = nBitBuffer;
+	m_nBitCount = nBitCount;
+	m_pIn = pIn;
+	m_pOut = pOut;
+}
+
+boolean CInflater::CopyMatch (void)
+{
+	size_t nLength = m_nRemaining;
+	if (nLength > (size_t) (m_pOutEnd - m_pOut))
+	{
+		nLength = m_pOutEnd - m_pOut;
+	}
+
+	m_nRemaining -= nLength;
+
+	// the window contains the output of previous calls only, more recent data is
+	// taken from the output buffer
+	size_t nProduced = m_pOut - m_pOutBegin;
+	for (; nLength > 0 && m_nDistance > nProduced; nLength--, nProduced++)
+	{
+		*m_pOut++ = m_Window[(m_nWindowPos - (m_nDistance - nProduced)) & WINDOW_MASK];
+	}
+
+	const u8 *pFrom = m_pOut - m_nDistance;
+	if (m_nDistance >= nLength)
+	{
+		memcpy (m_pOut, pFrom, nLength);
+		m_pOut += nLength;
+	}
+	else
+	{
+		while (nLength--)			// overlapping, repeats a pattern
+		{
+			*m_pOut++ = *pFrom++;
+		}
+	}
+
+	return m_nRemaining == 0;
+}
+
+void CInflater::PutByte (u8 uchByte)
+{
+	assert (m_pOut < m_pOutEnd);
+	*m_pOut++ = uchByte;
+}
+
+void CInflater::PutBytes (const u8 *pBuffer, size_t nLength)
+{
+	assert (m_pOut + nLength <= m_pOutEnd);
+	memcpy (m_pOut, pBuffer, nLength);
+	m_pOut += nLength;
+}
+
+void CInflater::UpdateWindow (void)
+{
+	const u8 *pBuffer = m_pOutBegin;
+	size_t nLength = m_pOut - m_pOutBegin;
+
+	if (nLength > INFLATE_WINDOW_SIZE)
+	{
+		pBuffer += nLength - INFLATE_WINDOW_SIZE;
+		m_nWindowPos += nLength - INFLATE_WINDOW_SIZE;
+		nLength = INFLATE_WINDOW_SIZE;
+	}
+
+	while (nLength > 0)
+	{
+		unsigned nPos = m_nWindowPos & WINDOW_MASK;
+		size_t nChunk = INFLATE_WINDOW_SIZE - nPos;
+		if (nChunk > nLength)
+		{
+			nChunk = nLength;
+		}
+
+		memcpy (m_Window + nPos, pBuffer, nChunk);
+
+		pBuffer += nChunk;
+		m_nWindowPos += nChunk;
+		nLength -= nChunk;
+	}
+}
+
+void CInflater::UpdateChecksum (void)
+{
+	size_t nLength = m_pOut - m_pOutChecked;
+	if (nLength == 0)
+	{
+		return;
+	}
+
+	if (m_StreamFormat == CompressionFormatZlib)
+	{
+		m_Adler32.Update (m_pOutChecked, nLength);
+	}
+	else if (m_StreamFormat == CompressionFormatGzip)
+	{
+		m_CRC32.Update (m_pOutChecked, nLength);
+	}
+
+	m_pOutChecked = m_pOut;
+}
+
+void CInflater::Error (const char *pMessage)
+{
+	m_pErrorMessage = pMessage;
+	m_State = StateError;
+}
+
+boolean CInflater::NeedBits (unsigned nBits)
+{
+	assert (nBits <= 64);
+	while (m_nBitCount < nBits)
+	{
+		if (m_pIn == m_pInEnd)
+		{
+			return FALSE;
+		}
+
+		m_nBitBuffer |= (u64) *m_pIn++ << m_nBitCount;
+		m_nBitCount += 8;
+	}
+
+	return TRUE;
+}
+
+void CInflater::RefillBits (void)
+{
+	if (m_nBitCount > 56)
+	{
+		return;
+	}
+
+	if (m_pInEnd - m_pIn >= 8)
+	{
+		// load 8 bytes at once, but consume only as many, as fit into the buffer
+		u64 nWord;
+		memcpy (&nWord, m_pIn, sizeof nWord);
+		m_nBitBuffer |= nWord << m_nBitCount;
+
+		unsigned nBytes = (63 - m_nBitCount) / 8;
+		m_pIn += nBytes;
+		m_nBitCount += nBytes * 8;
+
+		if (m_nBitCount < 64)
+		{
+			m_nBitBuffer &= (1ULL << m_nBitCount) - 1;
+		}
+
+		return;
+	}
+
+	while (   m_nBitCount <= 56
+	       && m_pIn < m_pInEnd)
+	{
+		m_nBitBuffer |= (u64) *m_pIn++ << m_nBitCount;
+		m_nBitCount += 8;
+	}
+}
+
+u32 CInflater::PeekBits (unsigned nBits) const
+{
+	assert (nBits <= 32);
+	assert (nBits <= m_nBitCount);
+
+	return (u32) m_nBitBuffer & (u32) ((1ULL << nBits) - 1);
+}
+
+void CInflater::DropBits (unsigned nBits)
+{
+	assert (nBits <= m_nBitCount);
+
+	m_nBitBuffer = nBits < 64 ? m_nBitBuffer >> nBits : 0;
+	m_nBitCount -= nBits;
+}
+
+boolean CInflater::BuildTable (THuffmanTable *pTable, const u8 *pLengths, unsigned nCodes,
+			       boolean bAllowIncomplete)
+{
+	assert (pTable != 0);
+	assert (pLengths != 0);
+	assert (nCodes <= 288);
+
+	memset (pTable->Count, 0, sizeof pTable->Count);
+	memset (pTable->Fast, 0, sizeof pTable->Fast);
+
+	for (unsigned nSymbol = 0; nSymbol < nCodes; nSymbol++)
+	{
+		pTable->Count[pLengths[nSymbol]]++;
+	}
+
+	if (pTable->Count[0] == nCodes)		// no codes at all
+	{
+		return bAllowIncomplete;
+	}
+
+	int nLeft = 1;
+	for (unsigned nLength = 1; nLength <= 15; nLength++)
+	{
+		nLeft <<= 1;
+		nLeft -= pTable->Count[nLength];
+		if (nLeft < 0)
+		{
+			return FALSE;			// over-subscribed
+		}
+	}
+
+	u16 Offsets[16];
+	Offsets[1] = 0;
+	for (unsigned nLength = 1; nLength < 15; nLength++)
+	{
+		Offsets[nLength+1] = Offsets[nLength] + pTable->Count[nLength];
+	}
+
+	for (unsigned nSymbol = 0; nSymbol < nCodes; nSymbol++)
+	{
+		if (pLengths[nSymbol] != 0)
+		{
+			pTable->Symbol[Offsets[pLengths[nSymbol]]++] = nSymbol;
+		}
+	}
+
+	// fill the lookup table with the codes, which are not longer than INFLATE_FAST_BITS
+	unsigned nCode = 0;
+	unsigned nIndex = 0;
+	for (unsigned nLength = 1; nLength <= INFLATE_FAST_BITS; nLength++)
+	{
+		for (unsigned i = 0; i < pTable->Count[nLength]; i++)
+		{
+			unsigned nReversed = 0;
+			for (unsigned nBit = 0; nBit < nLength; nBit++)
+			{
+				nReversed |= ((nCode >> nBit) & 1) << (nLength-1 - nBit);
+			}
+
+			u16 usEntry = pTable->Symbol[nIndex++] << 4 | nLength;
+			for (unsigned j = nReversed; j < 1 << INFLATE_FAST_BITS; j += 1 << nLength)
+			{
+				pTable->Fast[j] = usEntry;
+			}
+
+			nCode++;
+		}
+
+		nCode <<= 1;
+	}
+
+	if (nLeft > 0)
+	{
+		// incomplete code only allowed for a single code of length 1
+		return bAllowIncomplete && pTable->Count[0] + pTable->Count[1] == nCodes;
+	}
+
+	return TRUE;
+}
+
+int CInflater::DecodeSymbol (const THuffmanTable &rTable, unsigned *pLength) const
+{
+	u32 nBits = (u32) m_nBitBuffer;
+
+	unsigned nEntry = rTable.Fast[nBits & ((1 << INFLATE_FAST_BITS) - 1)];
+	if (nEntry != 0)
+	{
+		unsigned nLength = nEntry & 0xF;
+		if (nLength > m_nBitCount)
+		{
+			return DECODE_MORE_BITS;
+		}
+
+		*pLength = nLength;
+
+		return nEntry >> 4;
+	}
+
+	// canonical decoding of longer codes bit by bit
+	int nCode = 0;
+	int nFirst = 0;
+	int nIndex = 0;
+	for (unsigned nLength = 1; nLength <= 15; nLength++)
+	{
+		if (nLength > m_nBitCount)
+		{
+			return DECODE_MORE_BITS;
+		}
+
+		nCode |= nBits & 1;
+		nBits >>= 1;
+
+		int nCount = rTable.Count[nLength];
+		if (nCode - nCount < nFirst)
+		{
+			*pLength = nLength;
+
+			return rTable.Symbol[nIndex + (nCode - nFirst)];
+		}
+
+		nIndex += nCount;
+		nFirst += nCount;
+		nFirst <<= 1;
+		nCode <<= 1;
+	}
+
+	return DECODE_INVALID;
+}
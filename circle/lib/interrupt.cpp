@@ -18,6 +18,9 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/interrupt.h>
+#include <circle/deferredwork.h>
+#include <circle/tracer.h>
+#include <circle/latencyhistogram.h>
 #include <circle/synchronize.h>
 #include <circle/multicore.h>
 #include <circle/bcm2835.h>
@@ -46,9 +49,23 @@
 				   : ARM_IC_DISABLE_BASIC_IRQS))
 #define ARM_IRQ_MASK(irq)	(1 << ((irq) & (ARM_IRQS_PER_REG-1)))
 				   
+#if RASPPI >= 2
+
+static inline unsigned ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
+
+#endif
+
 CInterruptSystem *CInterruptSystem::s_pThis = 0;
 
 CInterruptSystem::CInterruptSystem (void)
+:	m_ppLatencyHistogram (0)
 {
 	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
 	{
@@ -135,6 +152,13 @@ void CInterruptSystem::DisconnectIRQ (unsigned nIRQ)
 	m_pParam[nIRQ] = 0;
 }
 
+boolean CInterruptSystem::IsConnected (unsigned nIRQ) const
+{
+	assert (nIRQ < IRQ_LINES);
+
+	return m_apIRQHandler[nIRQ] != 0;
+}
+
 void CInterruptSystem::ConnectFIQ (unsigned nFIQ, TFIQHandler *pHandler, void *pParam)
 {
 #ifdef USE_RPI_STUB_AT
@@ -173,9 +197,21 @@ void CInterruptSystem::EnableIRQ (unsigned nIRQ)
 	else
 	{
 #if RASPPI >= 2
-		assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);	// the only implemented local IRQ so far
-		write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
-			 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) | (1 << 1));
+		if (nIRQ == ARM_IRQLOCAL0_PMU)		// the PMU IRQ is handled on the calling core
+		{
+			write32 (ARM_LOCAL_PM_ROUTING_SET, 1 << ThisCore ());
+		}
+		else if (nIRQ == ARM_IRQLOCAL0_CNTV)	// the virtual timer IRQ too
+		{
+			uintptr nControl = ARM_LOCAL_TIMER_INT_CONTROL0 + 4*ThisCore ();
+			write32 (nControl, read32 (nControl) | (1 << 3));
+		}
+		else
+		{
+			assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);
+			write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
+				 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) | (1 << 1));
+		}
 #else
 		assert (0);
 #endif
@@ -197,9 +233,21 @@ void CInterruptSystem::DisableIRQ (unsigned nIRQ)
 	else
 	{
 #if RASPPI >= 2
-		assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);	// the only implemented local IRQ so far
-		write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
-			 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) & ~(1 << 1));
+		if (nIRQ == ARM_IRQLOCAL0_PMU)		// the PMU IRQ is handled on the calling core
+		{
+			write32 (ARM_LOCAL_PM_ROUTING_CLR, 1 << ThisCore ());
+		}
+		else if (nIRQ == ARM_IRQLOCAL0_CNTV)	// the virtual timer IRQ too
+		{
+			uintptr nControl = ARM_LOCAL_TIMER_INT_CONTROL0 + 4*ThisCore ();
+			write32 (nControl, read32 (nControl) & ~(1 << 3));
+		}
+		else
+		{
+			assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);
+			write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
+				 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) & ~(1 << 1));
+		}
 #else
 		assert (0);
 #endif
@@ -228,20 +276,41 @@ void CInterruptSystem::DisableFIQ (void)
 	PeripheralExit ();
 }
 
+void CInterruptSystem::SetLatencyHistograms (CLatencyHistogram **ppHistogram)
+{
+	m_ppLatencyHistogram = ppHistogram;
+
+	DataSyncBarrier ();
+}
+
 CInterruptSystem *CInterruptSystem::Get (void)
 {
 	assert (s_pThis != 0);
 	return s_pThis;
 }
 
-boolean CInterruptSystem::CallIRQHandler (unsigned nIRQ)
+boolean CInterruptSystem::CallIRQHandler (unsigned nIRQ, u32 nEntryTime)
 {
 	assert (nIRQ < IRQ_LINES);
 	TIRQHandler *pHandler = m_apIRQHandler[nIRQ];
 
 	if (pHandler != 0)
 	{
+		CLatencyHistogram **ppHistogram = m_ppLatencyHistogram;
+		if (ppHistogram != 0)
+		{
+			CLatencyHistogram *pHistogram = ppHistogram[nIRQ];
+			if (pHistogram != 0)
+			{
+				pHistogram->Add ((u32) CTracer::GetTimestamp () - nEntryTime);
+			}
+		}
+
+		TRACE_BEGIN ("IRQ", nIRQ);
+
 		(*pHandler) (m_pParam[nIRQ]);
+
+		TRACE_END ("IRQ");
 		
 		return TRUE;
 	}
@@ -257,12 +326,28 @@ void CInterruptSystem::InterruptHandler (void)
 {
 	assert (s_pThis != 0);
 
+	u32 nEntryTime = s_pThis->m_ppLatencyHistogram != 0 ? (u32) CTracer::GetTimestamp () : 0;
+
 #if RASPPI >= 2
-	u32 nLocalPending = read32 (ARM_LOCAL_IRQ_PENDING0);
-	assert (!(nLocalPending & ~(1 << 1 | 0xF << 4 | 1 << 8)));
-	if (nLocalPending & (1 << 1))		// the only implemented local IRQ so far
+	u32 nLocalPending = read32 (ARM_LOCAL_IRQ_PENDING0 + 4*ThisCore ());
+	assert (!(nLocalPending & ~(1 << 1 | 1 << 3 | 0xF << 4 | 1 << 8 | 1 << 9)));
+	if (nLocalPending & (1 << 1))
+	{
+		s_pThis->CallIRQHandler (ARM_IRQLOCAL0_CNTPNS, nEntryTime);
+
+		return;
+	}
+
+	if (nLocalPending & (1 << 3))
 	{
-		s_pThis->CallIRQHandler (ARM_IRQLOCAL0_CNTPNS);
+		s_pThis->CallIRQHandler (ARM_IRQLOCAL0_CNTV, nEntryTime);
+
+		return;
+	}
+
+	if (nLocalPending & (1 << 9))
+	{
+		s_pThis->CallIRQHandler (ARM_IRQLOCAL0_PMU, nEntryTime);
 
 		return;
 	}
@@ -294,7 +379,7 @@ void CInterruptSystem::InterruptHandler (void)
 			do
 			{
 				if (   (nPending & 1)
-				    && s_pThis->CallIRQHandler (nIRQ))
+				    && s_pThis->CallIRQHandler (nIRQ, nEntryTime))
 				{
 					return;
 				}
@@ -313,5 +398,7 @@ void InterruptHandler (void)
 	
 	CInterruptSystem::InterruptHandler ();
 
+	CDeferredWork::InterruptExit ();
+
 	PeripheralEntry ();	// continuing with interrupted peripheral
 }
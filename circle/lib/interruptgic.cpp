@@ -20,6 +20,9 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/interrupt.h>
+#include <circle/deferredwork.h>
+#include <circle/tracer.h>
+#include <circle/latencyhistogram.h>
 #include <circle/synchronize.h>
 #include <circle/multicore.h>
 #include <circle/bcm2711.h>
@@ -87,6 +90,7 @@ enum TSMCFunction
 CInterruptSystem *CInterruptSystem::s_pThis = 0;
 
 CInterruptSystem::CInterruptSystem (void)
+:	m_ppLatencyHistogram (0)
 {
 	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
 	{
@@ -155,6 +159,12 @@ boolean CInterruptSystem::Initialize (void)
 						| GICD_ITARGETSR_CORE0 << 24);
 	}
 
+	// direct the PMU interrupt of each core to this core
+	write32 (GICD_ITARGETSR0 + ARM_IRQ_PMU0,   GICD_ITARGETSR_CORE0
+						 | GICD_ITARGETSR_CORE0 << (8+1)
+						 | GICD_ITARGETSR_CORE0 << (16+2)
+						 | GICD_ITARGETSR_CORE0 << (24+3));
+
 	// set all interrupts to level triggered
 	for (unsigned n = 0; n < IRQ_LINES/16; n++)
 	{
@@ -195,6 +205,13 @@ void CInterruptSystem::DisconnectIRQ (unsigned nIRQ)
 	m_pParam[nIRQ] = 0;
 }
 
+boolean CInterruptSystem::IsConnected (unsigned nIRQ) const
+{
+	assert (nIRQ < IRQ_LINES);
+
+	return m_apIRQHandler[nIRQ] != 0;
+}
+
 void CInterruptSystem::ConnectFIQ (unsigned nFIQ, TFIQHandler *pHandler, void *pParam)
 {
 	assert (nFIQ <= ARM_MAX_FIQ);
@@ -266,20 +283,41 @@ void CInterruptSystem::DisableFIQ (void)	// may be called, when FIQ is not enabl
 	}
 }
 
+void CInterruptSystem::SetLatencyHistograms (CLatencyHistogram **ppHistogram)
+{
+	m_ppLatencyHistogram = ppHistogram;
+
+	DataSyncBarrier ();
+}
+
 CInterruptSystem *CInterruptSystem::Get (void)
 {
 	assert (s_pThis != 0);
 	return s_pThis;
 }
 
-boolean CInterruptSystem::CallIRQHandler (unsigned nIRQ)
+boolean CInterruptSystem::CallIRQHandler (unsigned nIRQ, u32 nEntryTime)
 {
 	assert (nIRQ < IRQ_LINES);
 	TIRQHandler *pHandler = m_apIRQHandler[nIRQ];
 
 	if (pHandler != 0)
 	{
+		CLatencyHistogram **ppHistogram = m_ppLatencyHistogram;
+		if (ppHistogram != 0)
+		{
+			CLatencyHistogram *pHistogram = ppHistogram[nIRQ];
+			if (pHistogram != 0)
+			{
+				pHistogram->Add ((u32) CTracer::GetTimestamp () - nEntryTime);
+			}
+		}
+
+		TRACE_BEGIN ("IRQ", nIRQ);
+
 		(*pHandler) (m_pParam[nIRQ]);
+
+		TRACE_END ("IRQ");
 		
 		return TRUE;
 	}
@@ -293,6 +331,9 @@ boolean CInterruptSystem::CallIRQHandler (unsigned nIRQ)
 
 void CInterruptSystem::InterruptHandler (void)
 {
+	assert (s_pThis != 0);
+	u32 nEntryTime = s_pThis->m_ppLatencyHistogram != 0 ? (u32) CTracer::GetTimestamp () : 0;
+
 	u32 nIAR = read32 (GICC_IAR);
 
 	unsigned nIRQ = nIAR & GICC_IAR_INTERRUPT_ID__MASK;
@@ -301,8 +342,7 @@ void CInterruptSystem::InterruptHandler (void)
 		if (nIRQ > 15)
 		{
 			// peripheral interrupts (PPI and SPI)
-			assert (s_pThis != 0);
-			s_pThis->CallIRQHandler (nIRQ);
+			s_pThis->CallIRQHandler (nIRQ, nEntryTime);
 		}
 #ifdef ARM_ALLOW_MULTI_CORE
 		else
@@ -327,6 +367,8 @@ void CInterruptSystem::InterruptHandler (void)
 void InterruptHandler (void)
 {
 	CInterruptSystem::InterruptHandler ();
+
+	CDeferredWork::InterruptExit ();
 }
 
 void CInterruptSystem::InitializeSecondary (void)
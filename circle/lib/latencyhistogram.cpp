@@ -0,0 +1,163 @@
+//
+// latencyhistogram.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/latencyhistogram.h>
+#include <circle/util.h>
+#include <assert.h>
+
+CLatencyHistogram::CLatencyHistogram (void)
+{
+	Reset ();
+}
+
+void CLatencyHistogram::Reset (void)
+{
+	m_nCount = 0;
+	m_nMin = (unsigned) -1;
+	m_nMax = 0;
+
+	for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		m_nBucket[i] = 0;
+	}
+}
+
+void CLatencyHistogram::Add (unsigned nValue)
+{
+	__atomic_fetch_add (&m_nBucket[GetBucket (nValue)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add (&m_nCount, 1, __ATOMIC_RELAXED);
+
+	unsigned nMin = m_nMin;
+	while (   nValue < nMin
+	       && !__atomic_compare_exchange_n (&m_nMin, &nMin, nValue, TRUE,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+		// nMin has been updated, retry
+	}
+
+	unsigned nMax = m_nMax;
+	while (   nValue > nMax
+	       && !__atomic_compare_exchange_n (&m_nMax, &nMax, nValue, TRUE,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+		// nMax has been updated, retry
+	}
+}
+
+void CLatencyHistogram::Add (const CLatencyHistogram &rHistogram)
+{
+	if (rHistogram.m_nCount == 0)
+	{
+		return;
+	}
+
+	for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		m_nBucket[i] += rHistogram.m_nBucket[i];
+	}
+
+	m_nCount += rHistogram.m_nCount;
+
+	if (rHistogram.m_nMin < m_nMin)
+	{
+		m_nMin = rHistogram.m_nMin;
+	}
+
+	if (rHistogram.m_nMax > m_nMax)
+	{
+		m_nMax = rHistogram.m_nMax;
+	}
+}
+
+unsigned CLatencyHistogram::GetCount (void) const
+{
+	return m_nCount;
+}
+
+unsigned CLatencyHistogram::GetMin (void) const
+{
+	return m_nCount != 0 ? m_nMin : 0;
+}
+
+unsigned CLatencyHistogram::GetMax (void) const
+{
+	return m_nMax;
+}
+
+unsigned CLatencyHistogram::GetPercentile (unsigned nPermille) const
+{
+	assert (nPermille <= 1000);
+
+	unsigned nCount = m_nCount;
+	if (nCount == 0)
+	{
+		return 0;
+	}
+
+	// rank of the wanted value, avoids overflow of nCount * nPermille
+	unsigned nRank = nCount / 1000 * nPermille + (nCount % 1000 * nPermille + 999) / 1000;
+	if (nRank == 0)
+	{
+		nRank = 1;
+	}
+
+	unsigned nSum = 0;
+	for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		nSum += m_nBucket[i];
+		if (nSum >= nRank)
+		{
+			unsigned nLimit = GetBucketLimit (i);
+
+			return nLimit < m_nMax ? nLimit : m_nMax;
+		}
+	}
+
+	return m_nMax;
+}
+
+unsigned CLatencyHistogram::GetBucket (unsigned nValue)
+{
+	if (nValue < 16)
+	{
+		return nValue;
+	}
+
+	unsigned nExponent = 31 - __builtin_clz (nValue);	// 4..31
+	unsigned nSubBucket = (nValue >> (nExponent-3)) & 7;
+
+	return 16 + (nExponent-4)*8 + nSubBucket;
+}
+
+unsigned CLatencyHistogram::GetBucketLimit (unsigned nBucket)
+{
+	assert (nBucket < LATENCY_HISTOGRAM_BUCKETS);
+
+	if (nBucket < 16)
+	{
+		return nBucket;
+	}
+
+	unsigned nExponent = 4 + (nBucket-16) / 8;
+	unsigned nSubBucket = (nBucket-16) % 8;
+
+	u32 nLower = (8 + nSubBucket) << (nExponent-3);
+
+	return nLower + ((1U << (nExponent-3)) - 1);
+}
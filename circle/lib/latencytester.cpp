@@ -2,7 +2,7 @@
 // latencytester.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,16 +19,46 @@
 //
 #include <circle/latencytester.h>
 #include <circle/bcm2835.h>
+#include <circle/bcm2835int.h>
 #include <circle/memio.h>
+#include <circle/multicore.h>
 #include <circle/synchronize.h>
+#include <circle/tracer.h>
 #include <circle/logger.h>
+#include <circle/string.h>
 #include <circle/debug.h>
 #include <assert.h>
 
+LOGMODULE ("latency");
+
+#if RASPPI == 1
+	#define LATENCY_IRQ	ARM_IRQ_TIMER1
+#else
+	#define LATENCY_IRQ	ARM_IRQLOCAL0_CNTV
+#endif
+
+static double ToDouble (u64 nValue)	// without u64 conversion helpers on AArch32
+{
+	return (double) (u32) (nValue >> 32) * 4294967296.0 + (double) (u32) nValue;
+}
+
 CLatencyTester::CLatencyTester (CInterruptSystem *pInterruptSystem)
 :	m_pInterruptSystem (pInterruptSystem),
-	m_bRunning (FALSE)
+	m_bRunning (FALSE),
+	m_nTimerFrequency (1000000),
+	m_nWantedDelay (0),
+	m_bIRQStatistics (FALSE)
 {
+	for (unsigned nCore = 0; nCore < LATENCY_CORES; nCore++)
+	{
+		m_CoreStatistics[nCore].nDelaySum = 0;
+		m_bTimerActive[nCore] = FALSE;
+	}
+
+	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
+	{
+		m_pIRQHistogram[nIRQ] = 0;
+	}
 }
 
 CLatencyTester::~CLatencyTester (void)
@@ -37,124 +67,352 @@ CLatencyTester::~CLatencyTester (void)
 	{
 		Stop ();
 	}
+
+	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
+	{
+		delete m_pIRQHistogram[nIRQ];
+		m_pIRQHistogram[nIRQ] = 0;
+	}
 }
 
-void CLatencyTester::Start (unsigned nSampleRateHZ)
+void CLatencyTester::Start (unsigned nSampleRateHZ, boolean bIRQStatistics)
 {
 	assert (!m_bRunning);
+	assert (ThisCore () == 0);
+	assert (nSampleRateHZ > 0);
 
-	m_nWantedDelay = (1000000 + nSampleRateHZ/2) / nSampleRateHZ;
+#if RASPPI >= 2
+	m_nTimerFrequency = GetTimerFrequency ();
+#endif
+	m_nWantedDelay = (m_nTimerFrequency + nSampleRateHZ/2) / nSampleRateHZ;
+	assert (m_nWantedDelay > 0);
 
-	m_nMinDelay = (unsigned) -1;
-	m_nMaxDelay = 0;
-	m_nDelayAccu = 0;
-	m_nSamples = 0;
-	m_bOverflow = FALSE;
+	for (unsigned nCore = 0; nCore < LATENCY_CORES; nCore++)
+	{
+		m_CoreStatistics[nCore].Histogram.Reset ();
+		m_CoreStatistics[nCore].nDelaySum = 0;
+	}
 
 	m_bRunning = TRUE;
 
-	PeripheralEntry ();
+	m_pInterruptSystem->ConnectIRQ (LATENCY_IRQ, InterruptStub, this);
 
-	write32 (ARM_SYSTIMER_C1, read32 (ARM_SYSTIMER_CLO) + m_nWantedDelay);
-	
-	PeripheralExit ();
+	m_bIRQStatistics = bIRQStatistics;
+	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
+	{
+		delete m_pIRQHistogram[nIRQ];
+		m_pIRQHistogram[nIRQ] = 0;
+
+		if (   m_bIRQStatistics
+		    && m_pInterruptSystem->IsConnected (nIRQ))
+		{
+			m_pIRQHistogram[nIRQ] = new CLatencyHistogram;
+			assert (m_pIRQHistogram[nIRQ] != 0);
+		}
+	}
+
+	if (m_bIRQStatistics)
+	{
+		m_pInterruptSystem->SetLatencyHistograms (m_pIRQHistogram);
+	}
 
-	m_pInterruptSystem->ConnectIRQ (ARM_IRQ_TIMER1, InterruptStub, this);
+	StartTimer ();
 }
 
-void CLatencyTester::Stop (void)
+#if RASPPI >= 2
+
+void CLatencyTester::StartSecondary (void)
 {
 	assert (m_bRunning);
+	assert (ThisCore () != 0);
 
-	m_pInterruptSystem->DisconnectIRQ (ARM_IRQ_TIMER1);
+	// the virtual timer IRQ is enabled on the calling core only
+	CInterruptSystem::EnableIRQ (ARM_IRQLOCAL0_CNTV);
+
+	StartTimer ();
+}
 
+#endif
+
+void CLatencyTester::Stop (void)
+{
+	assert (m_bRunning);
+
+	// timers on secondary cores are stopped with their next IRQ
 	m_bRunning = FALSE;
+	DataSyncBarrier ();
+
+	if (m_bIRQStatistics)
+	{
+		m_pInterruptSystem->SetLatencyHistograms (0);
+	}
+
+	StopTimer ();
+
+	// the IRQ must not occur on any core, after the handler has been disconnected
+	for (unsigned nCore = 0; nCore < LATENCY_CORES; nCore++)
+	{
+		while (m_bTimerActive[nCore])
+		{
+			DataMemBarrier ();
+		}
+	}
+
+	m_pInterruptSystem->DisconnectIRQ (LATENCY_IRQ);
 }
 
 unsigned CLatencyTester::GetMin (void) const
 {
-	return m_nMinDelay;
+	CLatencyHistogram Total;
+	GetTotal (&Total);
+
+	return ToNanoSeconds (Total.GetMin (), m_nTimerFrequency) / 1000;
 }
 
 unsigned CLatencyTester::GetMax (void) const
 {
-	return m_nMaxDelay;
+	CLatencyHistogram Total;
+	GetTotal (&Total);
+
+	return ToNanoSeconds (Total.GetMax (), m_nTimerFrequency) / 1000;
 }
 
 unsigned CLatencyTester::GetAvg (void)
 {
-	m_SpinLock.Acquire ();
-
-	if (m_bOverflow)
+	double fSum = 0.0;
+	unsigned nSamples = 0;
+	for (unsigned nCore = 0; nCore < LATENCY_CORES; nCore++)
 	{
-		m_SpinLock.Release ();
+		fSum += ToDouble (m_CoreStatistics[nCore].nDelaySum);
+		nSamples += m_CoreStatistics[nCore].Histogram.GetCount ();
+	}
 
-		return (unsigned) -1;
+	if (nSamples == 0)
+	{
+		return 0;
 	}
 
-	unsigned nDelayAccu = m_nDelayAccu;
-	unsigned nSamples = m_nSamples;
+	return (unsigned) (fSum * 1000000.0 / m_nTimerFrequency / nSamples + 0.5);
+}
 
-	m_SpinLock.Release ();
+unsigned CLatencyTester::GetPercentile (unsigned nPermille) const
+{
+	CLatencyHistogram Total;
+	GetTotal (&Total);
 
-	return nSamples > 0 ? nDelayAccu / nSamples : 0;
+	return ToNanoSeconds (Total.GetPercentile (nPermille), m_nTimerFrequency);
 }
 
 void CLatencyTester::Dump (void)
 {
-	CLogger::Get ()->Write ("latency", LogNotice, "IRQ latency: Min %u Max %u Avg %u (us)",
-				GetMin (), GetMax (), GetAvg ());
+	LOGNOTE ("IRQ latency: Min %u Max %u Avg %u (us)", GetMin (), GetMax (), GetAvg ());
+
+	LOGNOTE ("Source        Count      Min      p50      p99    p99.9      Max (ns)");
+
+	CLatencyHistogram Total;
+	for (unsigned nCore = 0; nCore < LATENCY_CORES; nCore++)
+	{
+		const CLatencyHistogram &rHistogram = m_CoreStatistics[nCore].Histogram;
+		if (rHistogram.GetCount () == 0)
+		{
+			continue;
+		}
+
+		Total.Add (rHistogram);
+
+		CString Source;
+		Source.Format ("Core %u", nCore);
+
+		LOGNOTE ("%-8s %10u %8u %8u %8u %8u %8u", (const char *) Source,
+			 rHistogram.GetCount (),
+			 ToNanoSeconds (rHistogram.GetMin (), m_nTimerFrequency),
+			 ToNanoSeconds (rHistogram.GetPercentile (500), m_nTimerFrequency),
+			 ToNanoSeconds (rHistogram.GetPercentile (990), m_nTimerFrequency),
+			 ToNanoSeconds (rHistogram.GetPercentile (999), m_nTimerFrequency),
+			 ToNanoSeconds (rHistogram.GetMax (), m_nTimerFrequency));
+	}
+
+	LOGNOTE ("%-8s %10u %8u %8u %8u %8u %8u", "Total",
+		 Total.GetCount (),
+		 ToNanoSeconds (Total.GetMin (), m_nTimerFrequency),
+		 ToNanoSeconds (Total.GetPercentile (500), m_nTimerFrequency),
+		 ToNanoSeconds (Total.GetPercentile (990), m_nTimerFrequency),
+		 ToNanoSeconds (Total.GetPercentile (999), m_nTimerFrequency),
+		 ToNanoSeconds (Total.GetMax (), m_nTimerFrequency));
+
+	if (!m_bIRQStatistics)
+	{
+		return;
+	}
+
+	// latency from IRQ entry to handler call
+	unsigned nFrequency = CTracer::GetTimestampFrequency ();
+	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
+	{
+		const CLatencyHistogram *pHistogram = m_pIRQHistogram[nIRQ];
+		if (   pHistogram == 0
+		    || pHistogram->GetCount () == 0)
+		{
+			continue;
+		}
+
+		CString Source;
+		Source.Format ("IRQ %u", nIRQ);
+
+		LOGNOTE ("%-8s %10u %8u %8u %8u %8u %8u", (const char *) Source,
+			 pHistogram->GetCount (),
+			 ToNanoSeconds (pHistogram->GetMin (), nFrequency),
+			 ToNanoSeconds (pHistogram->GetPercentile (500), nFrequency),
+			 ToNanoSeconds (pHistogram->GetPercentile (990), nFrequency),
+			 ToNanoSeconds (pHistogram->GetPercentile (999), nFrequency),
+			 ToNanoSeconds (pHistogram->GetMax (), nFrequency));
+	}
+}
+
+void CLatencyTester::GetTotal (CLatencyHistogram *pHistogram) const
+{
+	assert (pHistogram != 0);
+
+	for (unsigned nCore = 0; nCore < LATENCY_CORES; nCore++)
+	{
+		pHistogram->Add (m_CoreStatistics[nCore].Histogram);
+	}
 }
 
 void CLatencyTester::InterruptHandler (void)
 {
+#if RASPPI == 1
 	PeripheralEntry ();
 
 	u32 nClock = read32 (ARM_SYSTIMER_CLO);
 	u32 nCompare = read32 (ARM_SYSTIMER_C1);
 	u32 nDelay = nClock - nCompare;
+#else
+	// the timer value counts down below 0 after the timer condition has been met
+	u32 nDelay = (u32) -ReadTimerValue ();
+#endif
 
 #ifndef NDEBUG
 	//debug_click ();
 #endif
 
-	m_SpinLock.Acquire ();
+	TCoreStatistics *pStatistics = &m_CoreStatistics[ThisCore ()];
 
-	if (nDelay < m_nMinDelay)
-	{
-		m_nMinDelay = nDelay;
-	}
+	pStatistics->Histogram.Add (nDelay);
+	pStatistics->nDelaySum += nDelay;
 
-	if (nDelay > m_nMaxDelay)
+#if RASPPI == 1
+	write32 (ARM_SYSTIMER_C1, read32 (ARM_SYSTIMER_CLO) + m_nWantedDelay);
+	write32 (ARM_SYSTIMER_CS, 1 << 1);
+
+	PeripheralExit ();
+#else
+	if (m_bRunning)
 	{
-		m_nMaxDelay = nDelay;
+		WriteTimerValue (m_nWantedDelay);
 	}
-
-	if (!m_bOverflow)
+	else
 	{
-		if (   m_nDelayAccu + nDelay >= m_nDelayAccu
-		    && m_nSamples + 1 != 0)
-		{
-			m_nDelayAccu += nDelay;
-			m_nSamples++;
-		}
-		else
-		{
-			m_bOverflow = TRUE;
-		}
+		StopTimer ();
 	}
+#endif
+}
 
-	m_SpinLock.Release ();
+void CLatencyTester::InterruptStub (void *pParam)
+{
+	CLatencyTester *pTimer = (CLatencyTester *) pParam;
+
+	pTimer->InterruptHandler ();
+}
+
+void CLatencyTester::StartTimer (void)
+{
+#if RASPPI == 1
+	PeripheralEntry ();
 
 	write32 (ARM_SYSTIMER_C1, read32 (ARM_SYSTIMER_CLO) + m_nWantedDelay);
-	write32 (ARM_SYSTIMER_CS, 1 << 1);
 
 	PeripheralExit ();
+#else
+	WriteTimerValue (m_nWantedDelay);
+	WriteTimerControl (CNTV_CTL_ENABLE);
+#endif
+
+	m_bTimerActive[ThisCore ()] = TRUE;
 }
 
-void CLatencyTester::InterruptStub (void *pParam)
+void CLatencyTester::StopTimer (void)
 {
-	CLatencyTester *pTimer = (CLatencyTester *) pParam;
+#if RASPPI >= 2
+	WriteTimerControl (0);
+	InstructionSyncBarrier ();
+#endif
 
-	pTimer->InterruptHandler ();
+	DataMemBarrier ();
+	m_bTimerActive[ThisCore ()] = FALSE;
+}
+
+unsigned CLatencyTester::ToNanoSeconds (unsigned nTicks, unsigned nFrequency)
+{
+	assert (nFrequency > 0);
+	double fNanoSeconds = (double) nTicks * 1000000000.0 / nFrequency + 0.5;
+
+	return fNanoSeconds < 4294967295.0 ? (unsigned) fNanoSeconds : (unsigned) -1;
+}
+
+unsigned CLatencyTester::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
 }
+
+#if RASPPI >= 2
+
+u32 CLatencyTester::GetTimerFrequency (void)
+{
+#if AARCH == 32
+	u32 nCNTFRQ;
+	asm volatile ("mrc p15, 0, %0, c14, c0, 0" : "=r" (nCNTFRQ));
+#else
+	u64 nCNTFRQ;
+	asm volatile ("mrs %0, CNTFRQ_EL0" : "=r" (nCNTFRQ));
+#endif
+
+	return (u32) nCNTFRQ;
+}
+
+s32 CLatencyTester::ReadTimerValue (void)
+{
+#if AARCH == 32
+	u32 nCNTV_TVAL;
+	asm volatile ("mrc p15, 0, %0, c14, c3, 0" : "=r" (nCNTV_TVAL));
+#else
+	u64 nCNTV_TVAL;
+	asm volatile ("mrs %0, CNTV_TVAL_EL0" : "=r" (nCNTV_TVAL));
+#endif
+
+	return (s32) nCNTV_TVAL;
+}
+
+void CLatencyTester::WriteTimerValue (u32 nValue)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c14, c3, 0" :: "r" (nValue));
+#else
+	asm volatile ("msr CNTV_TVAL_EL0, %0" :: "r" ((u64) nValue));
+#endif
+}
+
+void CLatencyTester::WriteTimerControl (u32 nValue)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c14, c3, 1" :: "r" (nValue));
+#else
+	asm volatile ("msr CNTV_CTL_EL0, %0" :: "r" ((u64) nValue));
+#endif
+}
+
+#endif
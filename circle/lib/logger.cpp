@@ -2,7 +2,7 @@
 // logger.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #include <circle/machineinfo.h>
 #include <circle/version.h>
 #include <circle/debug.h>
+#include <assert.h>
 
 struct TLogEvent
 {
@@ -38,6 +39,291 @@ struct TLogEvent
 	int		nTimeZone;			// minutes diff to UTC
 };
 
+struct TLogRecord				// deferred message
+{
+	volatile unsigned nSequence;		// slot state of the lock-free ring
+	unsigned	nTimestamp;		// CTimer::GetClockTicks()
+	u8		Severity;
+	u8		nArgs;
+	boolean		bTruncated;		// more arguments, than could be stored
+	const char	*pSource;
+	const char	*pMessage;
+	u64		Arg[LOG_DEFERRED_MAX_ARGS];	// raw value or offset in Strings[]
+	char		Strings[LOG_DEFERRED_STRINGS];
+};
+
+enum TLogArgType
+{
+	LogArgNone,				// "%%"
+	LogArgInt,
+	LogArgLong,
+	LogArgLongLong,
+	LogArgDouble,
+	LogArgString,
+	LogArgInvalid
+};
+
+// parses a conversion specification like CString::FormatV() does,
+// pFormat points behind the '%', returns pointer behind the specification
+static const char *ParseConversion (const char *pFormat, TLogArgType *pType)
+{
+	if (*pFormat == '%')
+	{
+		*pType = LogArgNone;
+
+		return pFormat+1;
+	}
+
+	while (   *pFormat == '#'
+	       || *pFormat == '-'
+	       || *pFormat == '0')
+	{
+		pFormat++;
+	}
+
+	while ('0' <= *pFormat && *pFormat <= '9')
+	{
+		pFormat++;
+	}
+
+	if (*pFormat == '.')
+	{
+		pFormat++;
+
+		while ('0' <= *pFormat && *pFormat <= '9')
+		{
+			pFormat++;
+		}
+	}
+
+	TLogArgType IntType = LogArgInt;
+	if (*pFormat == 'l')
+	{
+		IntType = LogArgLong;
+		pFormat++;
+#if STDLIB_SUPPORT >= 1
+		if (*pFormat == 'l')
+		{
+			IntType = LogArgLongLong;
+			pFormat++;
+		}
+#endif
+	}
+
+	switch (*pFormat)
+	{
+	case 'c':
+		*pType = LogArgInt;
+		break;
+
+	case 'd':
+	case 'i':
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'p':
+		*pType = IntType;
+		break;
+
+	case 'f':
+		*pType = LogArgDouble;
+		break;
+
+	case 's':
+		*pType = LogArgString;
+		break;
+
+	default:
+		*pType = LogArgInvalid;
+		return pFormat;
+	}
+
+	return pFormat+1;
+}
+
+// stores the arguments of a deferred message into the record
+static void CaptureArgs (TLogRecord *pRecord, va_list Args)
+{
+	pRecord->nArgs = 0;
+	pRecord->bTruncated = FALSE;
+
+	unsigned nStringOffset = 0;
+
+	const char *pFormat = pRecord->pMessage;
+	while ((pFormat = strchr (pFormat, '%')) != 0)
+	{
+		TLogArgType Type;
+		pFormat = ParseConversion (pFormat+1, &Type);
+		if (Type == LogArgNone)
+		{
+			continue;
+		}
+
+		if (   Type == LogArgInvalid
+		    || pRecord->nArgs == LOG_DEFERRED_MAX_ARGS)
+		{
+			pRecord->bTruncated = TRUE;
+
+			break;
+		}
+
+		u64 *pArg = &pRecord->Arg[pRecord->nArgs++];
+
+		switch (Type)
+		{
+		case LogArgInt:
+			*pArg = va_arg (Args, unsigned);
+			break;
+
+		case LogArgLong:
+			*pArg = va_arg (Args, unsigned long);
+			break;
+
+		case LogArgLongLong:
+			*pArg = va_arg (Args, unsigned long long);
+			break;
+
+		case LogArgDouble: {
+			double fArg = va_arg (Args, double);
+			memcpy (pArg, &fArg, sizeof fArg);
+			} break;
+
+		case LogArgString: {
+			const char *pString = va_arg (Args, const char *);
+			if (pString == 0)
+			{
+				pString = "(null)";
+			}
+
+			// the last byte of Strings[] is always an empty string
+			if (nStringOffset >= LOG_DEFERRED_STRINGS-1)
+			{
+				nStringOffset = LOG_DEFERRED_STRINGS-1;
+			}
+
+			*pArg = nStringOffset;
+
+			while (   *pString != '\0'
+			       && nStringOffset < LOG_DEFERRED_STRINGS-1)
+			{
+				pRecord->Strings[nStringOffset++] = *pString++;
+			}
+
+			pRecord->Strings[nStringOffset++] = '\0';
+			} break;
+
+		default:
+			assert (0);
+			break;
+		}
+	}
+
+	pRecord->Strings[LOG_DEFERRED_STRINGS-1] = '\0';
+}
+
+// appends nLength characters from pText to pResult
+static void AppendText (CString *pResult, const char *pText, size_t nLength)
+{
+	char Buffer[64];
+
+	while (nLength > 0)
+	{
+		size_t nChunk = nLength < sizeof Buffer - 1 ? nLength : sizeof Buffer - 1;
+
+		memcpy (Buffer, pText, nChunk);
+		Buffer[nChunk] = '\0';
+
+		pResult->Append (Buffer);
+
+		pText += nChunk;
+		nLength -= nChunk;
+	}
+}
+
+// formats a deferred message from the format string and the stored arguments
+static void FormatRecord (CString *pResult, const TLogRecord *pRecord)
+{
+	unsigned nArg = 0;
+
+	const char *pFormat = pRecord->pMessage;
+	while (*pFormat != '\0')
+	{
+		const char *pPercent = strchr (pFormat, '%');
+		if (pPercent == 0)
+		{
+			pResult->Append (pFormat);
+
+			break;
+		}
+
+		AppendText (pResult, pFormat, pPercent - pFormat);
+
+		TLogArgType Type;
+		pFormat = ParseConversion (pPercent+1, &Type);
+		if (Type == LogArgNone)
+		{
+			pResult->Append ("%");
+
+			continue;
+		}
+
+		char Spec[16];
+		size_t nSpecLength = pFormat - pPercent;
+		if (   Type == LogArgInvalid
+		    || nArg >= pRecord->nArgs
+		    || nSpecLength >= sizeof Spec)
+		{
+			pResult->Append (pPercent);
+
+			break;
+		}
+
+		memcpy (Spec, pPercent, nSpecLength);
+		Spec[nSpecLength] = '\0';
+
+		u64 nArgValue = pRecord->Arg[nArg++];
+
+		CString Conversion;
+		switch (Type)
+		{
+		case LogArgInt:
+			Conversion.Format (Spec, (unsigned) nArgValue);
+			break;
+
+		case LogArgLong:
+			Conversion.Format (Spec, (unsigned long) nArgValue);
+			break;
+
+		case LogArgLongLong:
+			Conversion.Format (Spec, (unsigned long long) nArgValue);
+			break;
+
+		case LogArgDouble: {
+			double fArg;
+			memcpy (&fArg, &nArgValue, sizeof fArg);
+			Conversion.Format (Spec, fArg);
+			} break;
+
+		case LogArgString:
+			assert (nArgValue < LOG_DEFERRED_STRINGS);
+			Conversion.Format (Spec, &pRecord->Strings[nArgValue]);
+			break;
+
+		default:
+			assert (0);
+			break;
+		}
+
+		pResult->Append (Conversion);
+	}
+
+	if (pRecord->bTruncated)
+	{
+		pResult->Append (" [truncated]");
+	}
+}
+
 CLogger *CLogger::s_pThis = 0;
 
 CLogger::CLogger (unsigned nLogLevel, CTimer *pTimer, boolean bOverwriteOldest)
@@ -51,8 +337,19 @@ CLogger::CLogger (unsigned nLogLevel, CTimer *pTimer, boolean bOverwriteOldest)
 	m_nEventInPtr (0),
 	m_nEventOutPtr (0),
 	m_pEventNotificationHandler (0),
-	m_pPanicHandler (0)
+	m_pPanicHandler (0),
+	m_nDeferredSlots (0),
+	m_nDeferredDropped (0),
+	m_pDeferredNotificationHandler (0),
+	m_pDeferredNotificationParam (0)
 {
+	for (unsigned nCore = 0; nCore < LOGGER_CORES; nCore++)
+	{
+		m_pDeferredRing[nCore] = 0;
+		m_nDeferredIn[nCore] = 0;
+		m_nDeferredOut[nCore] = 0;
+	}
+
 	m_pBuffer = new char[LOGGER_BUFSIZE];
 
 	s_pThis = this;
@@ -72,6 +369,13 @@ CLogger::~CLogger (void)
 		}
 	}
 
+	m_nDeferredSlots = 0;
+	for (unsigned nCore = 0; nCore < LOGGER_CORES; nCore++)
+	{
+		delete [] m_pDeferredRing[nCore];
+		m_pDeferredRing[nCore] = 0;
+	}
+
 	delete [] m_pBuffer;
 	m_pBuffer = 0;
 
@@ -109,65 +413,85 @@ void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMe
 
 void CLogger::WriteV (const char *pSource, TLogSeverity Severity, const char *pMessage, va_list Args)
 {
-	CString Message;
-	Message.FormatV (pMessage, Args);
+	// format into a stack buffer first and use the heap for long messages only
+	va_list ArgsCopy;
+	va_copy (ArgsCopy, Args);
 
-	WriteEvent (pSource, Severity, Message);
+	char Buffer[LOG_MAX_MESSAGE];
+	if (CString::FormatBufferV (Buffer, sizeof Buffer, pMessage, ArgsCopy) < sizeof Buffer)
+	{
+		WriteMessage (pSource, Severity, Buffer);
+	}
+	else
+	{
+		CString Message;
+		Message.FormatV (pMessage, Args);
+
+		WriteMessage (pSource, Severity, Message);
+	}
+
+	va_end (ArgsCopy);
+}
+
+void CLogger::WriteMessage (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			    unsigned nAge)
+{
+	WriteEvent (pSource, Severity, pMessage, nAge);
 
 	if (Severity > m_nLogLevel)
 	{
 		return;
 	}
 
-	CString Buffer;
+	const char *pPrefix = "";
+	const char *pSuffix = "";
 
 #ifdef USE_LOG_COLORS
 	switch (Severity)
 	{
-	case LogPanic:		Buffer = "\x1b[91m";	break;
-	case LogError:		Buffer = "\x1b[95m";	break;
-	case LogWarning:	Buffer = "\x1b[93m";	break;
-	default:		Buffer = "\x1b[97m";	break;
+	case LogPanic:		pPrefix = "\x1b[91m";	break;
+	case LogError:		pPrefix = "\x1b[95m";	break;
+	case LogWarning:	pPrefix = "\x1b[93m";	break;
+	default:		pPrefix = "\x1b[97m";	break;
+	}
+
+	if (Severity <= LogWarning)
+	{
+		pSuffix = "\x1b[97m";
 	}
 #else
 	if (Severity == LogPanic)
 	{
-		Buffer = "\x1b[1m";
+		pPrefix = "\x1b[1m";
+		pSuffix = "\x1b[0m";
 	}
 #endif
 
+	CString *pTimeString = 0;
 	if (m_pTimer != 0)
 	{
-		CString *pTimeString = m_pTimer->GetTimeString ();
-		if (pTimeString != 0)
-		{
-			Buffer.Append (*pTimeString);
-			Buffer.Append (" ");
-
-			delete pTimeString;
-		}
+		pTimeString = m_pTimer->GetTimeString (nAge / (CLOCKHZ / HZ));
 	}
 
-	Buffer.Append (pSource);
-	Buffer.Append (": ");
-
-	Buffer.Append (Message);
+	const char *pTime = pTimeString != 0 ? (const char *) *pTimeString : "";
+	const char *pTimeSeparator = pTimeString != 0 ? " " : "";
 
-#ifdef USE_LOG_COLORS
-	if (Severity <= LogWarning)
+	char Buffer[LOG_MAX_SOURCE + LOG_MAX_MESSAGE + 64];
+	if (CString::FormatBuffer (Buffer, sizeof Buffer, "%s%s%s%s: %s%s\n", pPrefix, pTime,
+				   pTimeSeparator, pSource, pMessage, pSuffix) < sizeof Buffer)
 	{
-		Buffer.Append ("\x1b[97m");
+		Write (Buffer);
 	}
-#else
-	if (Severity == LogPanic)
+	else
 	{
-		Buffer.Append ("\x1b[0m");
-	}
-#endif
+		CString Line;
+		Line.Format ("%s%s%s%s: %s%s\n", pPrefix, pTime, pTimeSeparator, pSource, pMessage,
+			     pSuffix);
 
-	Buffer.Append ("\n");
+		Write (Line);
+	}
 
-	Write (Buffer);
+	delete pTimeString;
 
 	if (Severity == LogPanic)
 	{
@@ -234,6 +558,178 @@ void CLogger::WriteNoAlloc (const char *pSource, TLogSeverity Severity, const ch
 	}
 }
 
+boolean CLogger::EnableDeferred (unsigned nSlotsPerCore)
+{
+	assert (m_nDeferredSlots == 0);
+	assert (nSlotsPerCore >= 2);
+	assert ((nSlotsPerCore & (nSlotsPerCore-1)) == 0);
+
+	for (unsigned nCore = 0; nCore < LOGGER_CORES; nCore++)
+	{
+		m_pDeferredRing[nCore] = new TLogRecord[nSlotsPerCore];
+		if (m_pDeferredRing[nCore] == 0)
+		{
+			return FALSE;
+		}
+
+		for (unsigned i = 0; i < nSlotsPerCore; i++)
+		{
+			m_pDeferredRing[nCore][i].nSequence = i;
+		}
+	}
+
+	DataSyncBarrier ();
+
+	m_nDeferredSlots = nSlotsPerCore;
+
+	return TRUE;
+}
+
+void CLogger::WriteDeferred (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	va_list var;
+	va_start (var, pMessage);
+
+	if (   m_nDeferredSlots == 0
+	    || Severity == LogPanic)
+	{
+		WriteV (pSource, Severity, pMessage, var);
+
+		va_end (var);
+
+		return;
+	}
+
+	if (Severity > m_nLogLevel)
+	{
+		va_end (var);
+
+		return;
+	}
+
+	// reserve a slot in the ring of this core (bounded MPMC queue), may be interrupted
+	// by a message written from a higher execution level on this core
+	unsigned nCore = ThisCore ();
+	TLogRecord *pRing = m_pDeferredRing[nCore];
+	unsigned nMask = m_nDeferredSlots-1;
+
+	TLogRecord *pRecord;
+	unsigned nPos = __atomic_load_n (&m_nDeferredIn[nCore], __ATOMIC_RELAXED);
+	while (1)
+	{
+		pRecord = &pRing[nPos & nMask];
+		unsigned nSequence = __atomic_load_n (&pRecord->nSequence, __ATOMIC_ACQUIRE);
+
+		int nDiff = (int) (nSequence - nPos);
+		if (nDiff == 0)
+		{
+			if (__atomic_compare_exchange_n (&m_nDeferredIn[nCore], &nPos, nPos+1, TRUE,
+							 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (nDiff < 0)
+		{
+			// ring is full
+			__atomic_fetch_add (&m_nDeferredDropped, 1, __ATOMIC_RELAXED);
+
+			va_end (var);
+
+			return;
+		}
+		else
+		{
+			nPos = __atomic_load_n (&m_nDeferredIn[nCore], __ATOMIC_RELAXED);
+		}
+	}
+
+	pRecord->nTimestamp = CTimer::GetClockTicks ();
+	pRecord->Severity = (u8) Severity;
+	pRecord->pSource = pSource;
+	pRecord->pMessage = pMessage;
+
+	CaptureArgs (pRecord, var);
+
+	va_end (var);
+
+	// publish the record
+	__atomic_store_n (&pRecord->nSequence, nPos+1, __ATOMIC_RELEASE);
+
+	TLogDeferredNotificationHandler *pHandler = m_pDeferredNotificationHandler;
+	if (pHandler != 0)
+	{
+		(*pHandler) (m_pDeferredNotificationParam);
+	}
+}
+
+unsigned CLogger::ProcessDeferred (unsigned nMaxMessages)
+{
+	if (m_nDeferredSlots == 0)
+	{
+		return 0;
+	}
+
+	unsigned nMask = m_nDeferredSlots-1;
+
+	unsigned nProcessed = 0;
+	while (   nMaxMessages == 0
+	       || nProcessed < nMaxMessages)
+	{
+		// find the oldest published record of all cores
+		TLogRecord *pOldest = 0;
+		unsigned nOldestCore = 0;
+		for (unsigned nCore = 0; nCore < LOGGER_CORES; nCore++)
+		{
+			unsigned nPos = m_nDeferredOut[nCore];
+			TLogRecord *pRecord = &m_pDeferredRing[nCore][nPos & nMask];
+
+			if (__atomic_load_n (&pRecord->nSequence, __ATOMIC_ACQUIRE) != nPos+1)
+			{
+				continue;
+			}
+
+			if (   pOldest == 0
+			    || (int) (pRecord->nTimestamp - pOldest->nTimestamp) < 0)
+			{
+				pOldest = pRecord;
+				nOldestCore = nCore;
+			}
+		}
+
+		if (pOldest == 0)
+		{
+			break;
+		}
+
+		CString Message;
+		FormatRecord (&Message, pOldest);
+
+		const char *pSource = pOldest->pSource;
+		TLogSeverity Severity = (TLogSeverity) pOldest->Severity;
+		unsigned nAge = CTimer::GetClockTicks () - pOldest->nTimestamp;
+
+		// release the slot for the producers
+		unsigned nPos = m_nDeferredOut[nOldestCore]++;
+		__atomic_store_n (&pOldest->nSequence, nPos + m_nDeferredSlots, __ATOMIC_RELEASE);
+
+		WriteMessage (pSource, Severity, Message, nAge);
+
+		nProcessed++;
+	}
+
+	unsigned nDropped = __atomic_exchange_n (&m_nDeferredDropped, 0, __ATOMIC_RELAXED);
+	if (nDropped != 0)
+	{
+		CString Message;
+		Message.Format ("%u deferred message(s) dropped", nDropped);
+
+		WriteMessage ("logger", LogWarning, Message);
+	}
+
+	return nProcessed;
+}
+
 CLogger *CLogger::Get (void)
 {
 	if (s_pThis == 0)
@@ -324,7 +820,8 @@ int CLogger::Read (void *pBuffer, unsigned nCount, boolean bClear)
 	return nResult;
 }
 
-void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage)
+void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			  unsigned nAge)
 {
 	TLogEvent *pEvent = new TLogEvent;
 	if (pEvent == 0)
@@ -344,6 +841,18 @@ void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char
 	if (   m_pTimer != 0
 	    && m_pTimer->GetLocalTime (&nSeconds, &nMicroSeconds))
 	{
+		// deferred messages get the time, when they have been written
+		unsigned nSecondsAgo = nAge / 1000000;
+		nAge %= 1000000;
+		if (nAge > nMicroSeconds)
+		{
+			nMicroSeconds += 1000000;
+			nSecondsAgo++;
+		}
+
+		nMicroSeconds -= nAge;
+		nSeconds = nSeconds > nSecondsAgo ? nSeconds-nSecondsAgo : 0;
+
 		pEvent->Time = nSeconds;
 		pEvent->nHundredthTime = nMicroSeconds / 10000;
 		pEvent->nTimeZone = m_pTimer->GetTimeZone ();
@@ -431,3 +940,24 @@ void CLogger::RegisterPanicHandler (TLogPanicHandler *pHandler)
 {
 	m_pPanicHandler = pHandler;
 }
+
+void CLogger::RegisterDeferredNotificationHandler (TLogDeferredNotificationHandler *pHandler,
+						   void *pParam)
+{
+	m_pDeferredNotificationHandler = 0;
+	DataSyncBarrier ();
+
+	m_pDeferredNotificationParam = pParam;
+	DataSyncBarrier ();
+
+	m_pDeferredNotificationHandler = pHandler;
+}
+
+unsigned CLogger::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
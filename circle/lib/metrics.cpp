@@ -0,0 +1,405 @@
+//
+// metrics.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/metrics.h>
+#include <circle/multicore.h>
+#include <circle/logger.h>
+#include <circle/util.h>
+#include <assert.h>
+
+LOGMODULE ("metrics");
+
+CMetric *CMetric::s_pFirst = 0;
+u32 CMetric::s_nListLock = 0;
+
+CMetric::CMetric (const char *pName, const char *pHelp, TMetricType Type)
+:	m_pName (pName),
+	m_pHelp (pHelp),
+	m_Type (Type),
+	m_pPrev (0)
+{
+	assert (m_pName != 0);
+	assert (m_pHelp != 0);
+	assert (m_Type < MetricTypeUnknown);
+
+	EnterCritical (FIQ_LEVEL);
+	while (__atomic_exchange_n (&s_nListLock, 1, __ATOMIC_ACQUIRE))
+	{
+		// just wait
+	}
+
+	m_pNext = s_pFirst;
+	if (s_pFirst != 0)
+	{
+		s_pFirst->m_pPrev = this;
+	}
+	s_pFirst = this;
+
+	__atomic_store_n (&s_nListLock, 0, __ATOMIC_RELEASE);
+	LeaveCritical ();
+}
+
+CMetric::~CMetric (void)
+{
+	EnterCritical (FIQ_LEVEL);
+	while (__atomic_exchange_n (&s_nListLock, 1, __ATOMIC_ACQUIRE))
+	{
+		// just wait
+	}
+
+	if (m_pPrev != 0)
+	{
+		m_pPrev->m_pNext = m_pNext;
+	}
+	else
+	{
+		assert (s_pFirst == this);
+		s_pFirst = m_pNext;
+	}
+
+	if (m_pNext != 0)
+	{
+		m_pNext->m_pPrev = m_pPrev;
+	}
+
+	__atomic_store_n (&s_nListLock, 0, __ATOMIC_RELEASE);
+	LeaveCritical ();
+
+	m_pName = 0;
+	m_pHelp = 0;
+}
+
+const char *CMetric::GetName (void) const
+{
+	return m_pName;
+}
+
+const char *CMetric::GetHelp (void) const
+{
+	return m_pHelp;
+}
+
+TMetricType CMetric::GetType (void) const
+{
+	return m_Type;
+}
+
+void CMetric::DumpAll (void)
+{
+	// metrics are normally static objects, which are never removed, so the list is walked
+	// without lock, a metric must not be destroyed while the metrics are dumped
+	for (const CMetric *pMetric = s_pFirst; pMetric != 0; pMetric = pMetric->m_pNext)
+	{
+		CString Value;
+		pMetric->Format (&Value);
+
+		LOGNOTE ("%s: %s", pMetric->m_pName, (const char *) Value);
+	}
+}
+
+unsigned CMetric::FormatPrometheusAll (char *pBuffer, unsigned nBufferSize)
+{
+	assert (pBuffer != 0);
+
+	static const char *TypeName[MetricTypeUnknown] = {"counter", "gauge", "histogram"};
+
+	// see DumpAll() for walking the list
+	unsigned nLength = 0;
+	for (const CMetric *pMetric = s_pFirst; pMetric != 0; pMetric = pMetric->m_pNext)
+	{
+		CString Text;
+		Text.Format ("# HELP %s %s\n# TYPE %s %s\n", pMetric->m_pName, pMetric->m_pHelp,
+			     pMetric->m_pName, TypeName[pMetric->m_Type]);
+
+		pMetric->FormatPrometheus (&Text);
+
+		unsigned nTextLength = Text.GetLength ();
+		if (nLength + nTextLength > nBufferSize)
+		{
+			LOGWARN ("Buffer too small (%u bytes)", nBufferSize);
+
+			return 0;
+		}
+
+		memcpy (pBuffer + nLength, (const char *) Text, nTextLength);
+		nLength += nTextLength;
+	}
+
+	return nLength;
+}
+
+void CMetric::AppendValue (CString *pResult, u64 nValue)
+{
+	assert (pResult != 0);
+
+	// without 64-bit division on AArch32
+	static const u64 Powers[] =
+	{
+		10000000000000000000ULL, 1000000000000000000ULL, 100000000000000000ULL,
+		10000000000000000ULL, 1000000000000000ULL, 100000000000000ULL,
+		10000000000000ULL, 1000000000000ULL, 100000000000ULL, 10000000000ULL,
+		1000000000ULL, 100000000ULL, 10000000ULL, 1000000ULL, 100000ULL,
+		10000ULL, 1000ULL, 100ULL, 10ULL, 1ULL
+	};
+
+	char Buffer[24];
+	unsigned nPos = 0;
+	for (unsigned i = 0; i < sizeof Powers / sizeof Powers[0]; i++)
+	{
+		char chDigit = '0';
+		while (nValue >= Powers[i])
+		{
+			nValue -= Powers[i];
+			chDigit++;
+		}
+
+		if (   chDigit != '0'
+		    || nPos > 0
+		    || Powers[i] == 1)
+		{
+			Buffer[nPos++] = chDigit;
+		}
+	}
+	Buffer[nPos] = '\0';
+
+	pResult->Append (Buffer);
+}
+
+unsigned CMetric::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
+
+CMetricCounter::CMetricCounter (const char *pName, const char *pHelp)
+:	CMetric (pName, pHelp, MetricTypeCounter)
+{
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		m_Core[nCore].nValue = 0;
+	}
+}
+
+CMetricCounter::~CMetricCounter (void)
+{
+}
+
+u64 CMetricCounter::Get (void) const
+{
+	u64 nValue = 0;
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		nValue += __atomic_load_n (&m_Core[nCore].nValue, __ATOMIC_RELAXED);
+	}
+
+	return nValue;
+}
+
+void CMetricCounter::Format (CString *pResult) const
+{
+	AppendValue (pResult, Get ());
+
+#if METRICS_CORES > 1
+	pResult->Append (" (");
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		if (nCore > 0)
+		{
+			pResult->Append (" ");
+		}
+
+		AppendValue (pResult, __atomic_load_n (&m_Core[nCore].nValue, __ATOMIC_RELAXED));
+	}
+	pResult->Append (")");
+#endif
+}
+
+void CMetricCounter::FormatPrometheus (CString *pResult) const
+{
+	pResult->Append (GetName ());
+	pResult->Append (" ");
+	AppendValue (pResult, Get ());
+	pResult->Append ("\n");
+}
+
+CMetricGauge::CMetricGauge (const char *pName, const char *pHelp)
+:	CMetric (pName, pHelp, MetricTypeGauge),
+	m_nValue (0)
+{
+}
+
+CMetricGauge::~CMetricGauge (void)
+{
+}
+
+void CMetricGauge::Format (CString *pResult) const
+{
+	s64 nValue = Get ();
+	if (nValue < 0)
+	{
+		pResult->Append ("-");
+		nValue = -nValue;
+	}
+
+	AppendValue (pResult, (u64) nValue);
+}
+
+void CMetricGauge::FormatPrometheus (CString *pResult) const
+{
+	pResult->Append (GetName ());
+	pResult->Append (" ");
+	Format (pResult);
+	pResult->Append ("\n");
+}
+
+CMetricHistogram::CMetricHistogram (const char *pName, const char *pHelp,
+				    const unsigned *pUpperBounds, unsigned nBuckets)
+:	CMetric (pName, pHelp, MetricTypeHistogram),
+	m_pUpperBounds (pUpperBounds),
+	m_nBuckets (nBuckets)
+{
+	assert (m_pUpperBounds != 0);
+	assert (0 < m_nBuckets && m_nBuckets <= METRICS_MAX_BUCKETS);
+
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		for (unsigned i = 0; i <= METRICS_MAX_BUCKETS; i++)
+		{
+			m_Core[nCore].nBucket[i] = 0;
+		}
+
+		m_Core[nCore].nSum = 0;
+	}
+}
+
+CMetricHistogram::~CMetricHistogram (void)
+{
+	m_pUpperBounds = 0;
+}
+
+void CMetricHistogram::Observe (unsigned nValue)
+{
+	unsigned nBucket = 0;
+	while (   nBucket < m_nBuckets
+	       && nValue > m_pUpperBounds[nBucket])
+	{
+		nBucket++;
+	}
+
+	TCoreValues *pCore = &m_Core[ThisCore ()];
+
+	__atomic_fetch_add (&pCore->nBucket[nBucket], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add (&pCore->nSum, nValue, __ATOMIC_RELAXED);
+}
+
+u64 CMetricHistogram::GetCount (void) const
+{
+	u64 nCount = 0;
+	for (unsigned i = 0; i <= m_nBuckets; i++)
+	{
+		nCount += GetBucketCount (i);
+	}
+
+	return nCount;
+}
+
+u64 CMetricHistogram::GetSum (void) const
+{
+	u64 nSum = 0;
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		nSum += __atomic_load_n (&m_Core[nCore].nSum, __ATOMIC_RELAXED);
+	}
+
+	return nSum;
+}
+
+u64 CMetricHistogram::GetBucketCount (unsigned nBucket) const
+{
+	assert (nBucket <= m_nBuckets);
+
+	u64 nCount = 0;
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		nCount += __atomic_load_n (&m_Core[nCore].nBucket[nBucket], __ATOMIC_RELAXED);
+	}
+
+	return nCount;
+}
+
+void CMetricHistogram::Format (CString *pResult) const
+{
+	pResult->Append ("count ");
+	AppendValue (pResult, GetCount ());
+	pResult->Append (" sum ");
+	AppendValue (pResult, GetSum ());
+
+	for (unsigned i = 0; i <= m_nBuckets; i++)
+	{
+		CString Bucket;
+		if (i < m_nBuckets)
+		{
+			Bucket.Format (" <=%u:", m_pUpperBounds[i]);
+		}
+		else
+		{
+			Bucket = " inf:";
+		}
+
+		pResult->Append (Bucket);
+		AppendValue (pResult, GetBucketCount (i));
+	}
+}
+
+void CMetricHistogram::FormatPrometheus (CString *pResult) const
+{
+	// buckets are cumulative in Prometheus
+	u64 nCount = 0;
+	for (unsigned i = 0; i <= m_nBuckets; i++)
+	{
+		nCount += GetBucketCount (i);
+
+		CString Line;
+		if (i < m_nBuckets)
+		{
+			Line.Format ("%s_bucket{le=\"%u\"} ", GetName (), m_pUpperBounds[i]);
+		}
+		else
+		{
+			Line.Format ("%s_bucket{le=\"+Inf\"} ", GetName ());
+		}
+
+		pResult->Append (Line);
+		AppendValue (pResult, nCount);
+		pResult->Append ("\n");
+	}
+
+	pResult->Append (GetName ());
+	pResult->Append ("_sum ");
+	AppendValue (pResult, GetSum ());
+	pResult->Append ("\n");
+
+	pResult->Append (GetName ());
+	pResult->Append ("_count ");
+	AppendValue (pResult, nCount);
+	pResult->Append ("\n");
+}
@@ -2,7 +2,7 @@
 // arphandler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -61,12 +61,15 @@ CARPHandler::CARPHandler (CNetConfig *pNetConfig, CNetDeviceLayer *pNetDevLayer,
 	m_pLinkLayer (pLinkLayer),
 	m_pRxQueue (pRxQueue),
 	m_nEntries (0),
+	m_EntryIndex (ARP_MAX_ENTRIES * 4),
 	m_nTicksLastCleanup (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetDevLayer != 0);
 	assert (m_pLinkLayer != 0);
 	assert (m_pRxQueue != 0);
+
+	m_EntryIndex.Reserve ();	// no allocation with m_SpinLock acquired later
 }
 
 CARPHandler::~CARPHandler (void)
@@ -88,18 +91,24 @@ void CARPHandler::Process (void)
 	const CIPAddress *pOwnIPAddress = m_pNetConfig->GetIPAddress ();
 	assert (pOwnIPAddress != 0);
 
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	TARPPacket *pPacket = (TARPPacket *) Buffer;
-
-	u32 nResultLength;
+	CNetBuffer *pBuffer;
 	assert (m_pRxQueue != 0);
-	while ((nResultLength = m_pRxQueue->Dequeue (pPacket)) != 0)
+	while ((pBuffer = m_pRxQueue->Dequeue ()) != 0)
 	{
-		if (nResultLength <  sizeof (TARPPacket))
+		if (pBuffer->GetLength () < sizeof (TARPPacket))
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
+		// the packet is small, so copy it and release the buffer early
+		TARPPacket Packet;
+		TARPPacket *pPacket = &Packet;
+		memcpy (pPacket, pBuffer->GetData (), sizeof (TARPPacket));
+
+		pBuffer->Release ();
+
 		if (   pPacket->nHWAddressSpace        != BE (HW_ADDR_ETHER)
 		    || pPacket->nProtocolAddressSpace  != BE (PROT_ADDR_IP)
 		    || pPacket->nHWAddressLength       != MAC_ADDRESS_SIZE
@@ -157,24 +166,28 @@ void CARPHandler::Process (void)
 			else
 			{
 				assert (pEntry->pTxQueue != 0);
-				while ((nResultLength = pEntry->pTxQueue->Dequeue (Buffer)) != 0)
+				while ((pBuffer = pEntry->pTxQueue->Dequeue ()) != 0)
 				{
-					m_pLinkLayer->ResolveFailed (Buffer, nResultLength);
+					m_pLinkLayer->ResolveFailed (pBuffer);
 				}
 
-				pEntry->State = ARPStateFreeSlot;
+				m_SpinLock.Acquire ();
+
+				FreeEntry (nEntry);
+
+				m_SpinLock.Release ();
 			}
 			break;
 
 		case  ARPStateSendTxQueue:
 			assert (pEntry->pTxQueue != 0);
-			while ((nResultLength = pEntry->pTxQueue->Dequeue (Buffer)) != 0)
+			while ((pBuffer = pEntry->pTxQueue->Dequeue ()) != 0)
 			{
-				TEthernetHeader *pHeader = (TEthernetHeader *) Buffer;
+				TEthernetHeader *pHeader = (TEthernetHeader *) pBuffer->GetData ();
 				memcpy (pHeader->MACReceiver, pEntry->MACAddress,
 					MAC_ADDRESS_SIZE);
 
-				m_pNetDevLayer->Send (Buffer, nResultLength);
+				m_pNetDevLayer->Send (pBuffer);
 			}
 
 			pEntry->State = ARPStateValid;
@@ -197,7 +210,7 @@ void CARPHandler::Process (void)
 			if (   m_Entry[nEntry].State == ARPStateValid
 			    && m_Entry[nEntry].nTicksLastUsed + ARP_LIFETIME_HZ < nTicks)
 			{
-				m_Entry[nEntry].State = ARPStateFreeSlot;
+				FreeEntry (nEntry);
 			}
 		}
 
@@ -206,7 +219,7 @@ void CARPHandler::Process (void)
 }
 
 boolean CARPHandler::Resolve (const CIPAddress &rIPAddress, CMACAddress *pMACAddress,
-			      const void *pFrame, unsigned nFrameLength)
+			      CNetBuffer *pFrame)
 {
 	unsigned nFreeSlot = ARP_MAX_ENTRIES;
 
@@ -215,6 +228,42 @@ boolean CARPHandler::Resolve (const CIPAddress &rIPAddress, CMACAddress *pMACAdd
 
 	m_SpinLock.Acquire ();
 
+	unsigned *pIndex = m_EntryIndex.Find (rIPAddress);
+	if (pIndex != 0)
+	{
+		assert (*pIndex < m_nEntries);
+		TARPEntry *pEntry = &m_Entry[*pIndex];
+		assert (rIPAddress == pEntry->IPAddress);
+
+		pEntry->nTicksLastUsed = CTimer::Get ()->GetTicks ();
+
+		switch (pEntry->State)
+		{
+		case ARPStateRequestSent:
+		case ARPStateRetryRequest:
+		case ARPStateSendTxQueue:
+			assert (pEntry->pTxQueue != 0);
+			pEntry->pTxQueue->Enqueue (pFrame);
+
+			m_SpinLock.Release ();
+
+			return FALSE;
+
+		case ARPStateValid:
+			assert (pMACAddress != 0);
+			pMACAddress->Set (pEntry->MACAddress);
+
+			m_SpinLock.Release ();
+
+			return TRUE;
+
+		default:
+			assert (0);
+			break;
+		}
+	}
+
+	// not found, get a free slot or the least recently used valid entry
 	unsigned nEntry;
 	for (nEntry = 0; nEntry < m_nEntries; nEntry++)
 	{
@@ -227,43 +276,15 @@ boolean CARPHandler::Resolve (const CIPAddress &rIPAddress, CMACAddress *pMACAdd
 			}
 			break;
 
-		case ARPStateRequestSent:
-		case ARPStateRetryRequest:
-		case ARPStateSendTxQueue:
-			if (rIPAddress == m_Entry[nEntry].IPAddress)
-			{
-				assert (m_Entry[nEntry].pTxQueue != 0);
-				m_Entry[nEntry].pTxQueue->Enqueue (pFrame, nFrameLength);
-
-				m_Entry[nEntry].nTicksLastUsed = CTimer::Get ()->GetTicks ();
-
-				m_SpinLock.Release ();
-
-				return FALSE;
-			}
-			break;
-
 		case ARPStateValid:
 			if (m_Entry[nEntry].nTicksLastUsed < nMinTicks)
 			{
 				nOldestEntry = nEntry;
 				nMinTicks = m_Entry[nEntry].nTicksLastUsed;
 			}
-
-			if (rIPAddress == m_Entry[nEntry].IPAddress)
-			{
-				assert (pMACAddress != 0);
-				pMACAddress->Set (m_Entry[nEntry].MACAddress);
-				m_Entry[nEntry].nTicksLastUsed = CTimer::Get ()->GetTicks ();
-
-				m_SpinLock.Release ();
-
-				return TRUE;
-			}
 			break;
 
 		default:
-			assert (0);
 			break;
 		}
 	}
@@ -283,7 +304,7 @@ boolean CARPHandler::Resolve (const CIPAddress &rIPAddress, CMACAddress *pMACAdd
 		else
 		{
 			assert (nOldestEntry < m_nEntries);
-			m_Entry[nOldestEntry].State = ARPStateFreeSlot;
+			FreeEntry (nOldestEntry);
 
 			nFreeSlot = nOldestEntry;
 		}
@@ -293,9 +314,10 @@ boolean CARPHandler::Resolve (const CIPAddress &rIPAddress, CMACAddress *pMACAdd
 
 	pEntry->State = ARPStateRequestSent;
 	rIPAddress.CopyTo (pEntry->IPAddress);
+	m_EntryIndex.Set (rIPAddress, nEntry);
 
 	assert (pEntry->pTxQueue != 0);
-	pEntry->pTxQueue->Enqueue (pFrame, nFrameLength);
+	pEntry->pTxQueue->Enqueue (pFrame);
 
 	pEntry->nTicksLastUsed = CTimer::Get ()->GetTicks ();
 
@@ -317,22 +339,19 @@ void CARPHandler::ReplyReceived (const CIPAddress &rForeignIP, const CMACAddress
 {
 	m_SpinLock.Acquire ();
 
-	for (unsigned nEntry = 0; nEntry < m_nEntries; nEntry++)
+	unsigned *pIndex = m_EntryIndex.Find (rForeignIP);
+	if (pIndex != 0)
 	{
-		if (   m_Entry[nEntry].State != ARPStateRequestSent
-		    && m_Entry[nEntry].State != ARPStateRetryRequest)
-		{
-			continue;
-		}
-			
-		if (rForeignIP == m_Entry[nEntry].IPAddress)
-		{
-			CTimer::Get ()->CancelKernelTimer (m_Entry[nEntry].hTimer);
+		assert (*pIndex < m_nEntries);
+		TARPEntry *pEntry = &m_Entry[*pIndex];
 
-			rForeignMAC.CopyTo (m_Entry[nEntry].MACAddress);
-			m_Entry[nEntry].State = ARPStateSendTxQueue;
+		if (   pEntry->State == ARPStateRequestSent
+		    || pEntry->State == ARPStateRetryRequest)
+		{
+			CTimer::Get ()->CancelKernelTimer (pEntry->hTimer);
 
-			break;
+			rForeignMAC.CopyTo (pEntry->MACAddress);
+			pEntry->State = ARPStateSendTxQueue;
 		}
 	}
 
@@ -343,22 +362,22 @@ void CARPHandler::RequestReceived (const CIPAddress &rForeignIP, const CMACAddre
 {
 	m_SpinLock.Acquire ();
 
+	if (m_EntryIndex.Find (rForeignIP) != 0)
+	{
+		m_SpinLock.Release ();
+
+		return;
+	}
+
 	unsigned nFreeSlot = ARP_MAX_ENTRIES;
 	unsigned nEntry;
 	for (nEntry = 0; nEntry < m_nEntries; nEntry++)
 	{
 		if (m_Entry[nEntry].State == ARPStateFreeSlot)
 		{
-			if (nFreeSlot == ARP_MAX_ENTRIES)
-			{
-				nFreeSlot = nEntry;
-			}
-		}
-		else if (rForeignIP == m_Entry[nEntry].IPAddress)
-		{
-			m_SpinLock.Release ();
+			nFreeSlot = nEntry;
 
-			return;
+			break;
 		}
 	}
 
@@ -382,6 +401,8 @@ void CARPHandler::RequestReceived (const CIPAddress &rForeignIP, const CMACAddre
 		m_Entry[nFreeSlot].nTicksLastUsed = CTimer::Get ()->GetTicks ();
 
 		m_Entry[nFreeSlot].State = ARPStateValid;
+
+		m_EntryIndex.Set (rForeignIP, nFreeSlot);
 	}
 
 	m_SpinLock.Release ();
@@ -419,6 +440,17 @@ void CARPHandler::SendPacket (boolean		 bRequest,
 	m_pNetDevLayer->Send (&ARPFrame, sizeof ARPFrame);
 }
 
+void CARPHandler::FreeEntry (unsigned nEntry)
+{
+	assert (nEntry < m_nEntries);
+	TARPEntry *pEntry = &m_Entry[nEntry];
+	assert (pEntry->State != ARPStateFreeSlot);
+
+	m_EntryIndex.Remove (CIPAddress (pEntry->IPAddress));
+
+	pEntry->State = ARPStateFreeSlot;
+}
+
 void CARPHandler::TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext)
 {
 	CARPHandler *pThis = (CARPHandler *) pContext;
@@ -2,7 +2,7 @@
 // checksumcalculator.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,16 @@
 #include <circle/util.h>
 #include <assert.h>
 
+#if AARCH == 64
+
+// see lib/checksum64.S
+extern "C" u64 inet_checksum_blocks_neon (const void *pBuffer, size_t nBlocks);
+
+#define NEON_BLOCK_SIZE		64
+#define NEON_MAX_BLOCKS		16384	// the 32-bit lanes in the NEON code may not overflow
+
+#endif
+
 CChecksumCalculator::CChecksumCalculator (const CIPAddress &rSourceIP, int nProtocol)
 :	m_bDestAddressSet (FALSE)
 {
@@ -60,7 +70,7 @@ u16 CChecksumCalculator::Calculate (const void *pBuffer, unsigned nLength)
 	assert (m_bDestAddressSet);
 
 	m_Header.nTCPLength = le2be16 (nLength);
-	u32 nChecksum = CalculateChunk (&m_Header, sizeof m_Header, 0);
+	u64 nChecksum = CalculateChunk (&m_Header, sizeof m_Header, 0);
 
 	assert (pBuffer != 0);
 	assert (nLength > 0);
@@ -69,46 +79,251 @@ u16 CChecksumCalculator::Calculate (const void *pBuffer, unsigned nLength)
 	return ~FoldResult (nChecksum);
 }
 
+u16 CChecksumCalculator::Calculate (const void *pHeader, unsigned nHeaderLength,
+				    u16 nPayloadSum, unsigned nPayloadLength)
+{
+	assert (m_bDestAddressSet);
+
+	m_Header.nTCPLength = le2be16 (nHeaderLength + nPayloadLength);
+	u64 nChecksum = CalculateChunk (&m_Header, sizeof m_Header, 0);
+
+	assert (pHeader != 0);
+	assert (nHeaderLength > 0);
+	assert (!(nHeaderLength & 1));
+	nChecksum = CalculateChunk (pHeader, nHeaderLength, nChecksum);
+
+	nChecksum += nPayloadSum;
+
+	return ~FoldResult (nChecksum);
+}
+
+u16 CChecksumCalculator::PseudoHeaderSum (unsigned nLength)
+{
+	assert (m_bDestAddressSet);
+
+	m_Header.nTCPLength = le2be16 (nLength);
+
+	return FoldResult (CalculateChunk (&m_Header, sizeof m_Header, 0));
+}
+
 u16 CChecksumCalculator::SimpleCalculate (const void *pBuffer, unsigned nLength)
 {
 	assert (pBuffer != 0);
 	assert (nLength > 0);
-	u32 nChecksum = CalculateChunk (pBuffer, nLength, 0);
+	u64 nChecksum = CalculateChunk (pBuffer, nLength, 0);
 
 	return ~FoldResult (nChecksum);
 }
 
-u32 CChecksumCalculator::CalculateChunk (const void *pBuffer, unsigned nLength, u32 nChecksum)
+u16 CChecksumCalculator::Sum (const void *pBuffer, unsigned nLength)
 {
-	u16 *pBuffer16 = (u16 *) pBuffer;
-	assert (pBuffer16 != 0);
-	assert (nLength > 0);
+	if (nLength == 0)
+	{
+		return 0;
+	}
+
+	return FoldResult (CalculateChunk (pBuffer, nLength, 0));
+}
+
+u16 CChecksumCalculator::CopyAndSum (void *pDest, const void *pSource, unsigned nLength)
+{
+	u8 *pTo = (u8 *) pDest;
+	const u8 *pFrom = (const u8 *) pSource;
+	assert (pTo != 0);
+	assert (pFrom != 0);
+
+	if (   nLength < 16
+	    || (((uintptr) pTo ^ (uintptr) pFrom) & 3))
+	{
+		// the data is in the cache after copying
+		memcpy (pTo, pFrom, nLength);
+
+		return Sum (pTo, nLength);
+	}
+
+	u64 nChecksum = 0;
+
+	// see CalculateChunk() for odd addresses
+	boolean bOdd = (uintptr) pFrom & 1;
+	if (bOdd)
+	{
+		nChecksum = (u32) (*pTo++ = *pFrom++) << 8;
+		nLength--;
+	}
 
-	while (nLength >= 2)
+	while (((uintptr) pFrom & 3) && nLength >= 2)
 	{
-		nChecksum += *pBuffer16++;
+		u16 nWord = *(const u16 *) pFrom;
+		*(u16 *) pTo = nWord;
+		nChecksum += nWord;
+
+		pFrom += 2;
+		pTo += 2;
 		nLength -= 2;
 	}
 
-	assert (nLength <= 1);
+	const u32 *pFrom32 = (const u32 *) pFrom;
+	u32 *pTo32 = (u32 *) pTo;
+	for (; nLength >= 16; nLength -= 16)
+	{
+		u32 nWord0 = pFrom32[0];
+		u32 nWord1 = pFrom32[1];
+		u32 nWord2 = pFrom32[2];
+		u32 nWord3 = pFrom32[3];
+		pFrom32 += 4;
+
+		pTo32[0] = nWord0;
+		pTo32[1] = nWord1;
+		pTo32[2] = nWord2;
+		pTo32[3] = nWord3;
+		pTo32 += 4;
+
+		nChecksum += nWord0;
+		nChecksum += nWord1;
+		nChecksum += nWord2;
+		nChecksum += nWord3;
+	}
+
+	pFrom = (const u8 *) pFrom32;
+	pTo = (u8 *) pTo32;
+	for (; nLength >= 2; nLength -= 2)
+	{
+		u16 nWord = *(const u16 *) pFrom;
+		*(u16 *) pTo = nWord;
+		nChecksum += nWord;
+
+		pFrom += 2;
+		pTo += 2;
+	}
+
 	if (nLength != 0)
 	{
-		nChecksum += *(u8 *) pBuffer16;
+		nChecksum += *pTo = *pFrom;
+	}
+
+	u16 nSum = FoldResult (nChecksum);
+
+	return bOdd ? bswap16 (nSum) : nSum;
+}
+
+u16 CChecksumCalculator::CombineSums (u16 nSum1, u16 nSum2, unsigned nLength1)
+{
+	// block 2 starts in the middle of a 16-bit word
+	if (nLength1 & 1)
+	{
+		nSum2 = bswap16 (nSum2);
 	}
-	
-	return nChecksum;
+
+	return FoldResult ((u32) nSum1 + nSum2);
+}
+
+u16 CChecksumCalculator::Update (u16 nChecksum, u16 nOldValue, u16 nNewValue)
+{
+	// HC' = ~(~HC + ~m + m') (RFC 1624 equation 3)
+	u32 nSum = (u16) ~nChecksum;
+	nSum += (u16) ~nOldValue;
+	nSum += nNewValue;
+
+	return ~FoldResult (nSum);
+}
+
+u16 CChecksumCalculator::Update32 (u16 nChecksum, u32 nOldValue, u32 nNewValue)
+{
+	u32 nSum = (u16) ~nChecksum;
+	nSum += (u16) ~nOldValue;
+	nSum += (u16) ~(nOldValue >> 16);
+	nSum += nNewValue & 0xFFFF;
+	nSum += nNewValue >> 16;
+
+	return ~FoldResult (nSum);
 }
 
-u16 CChecksumCalculator::FoldResult (u32 nChecksum)
+u64 CChecksumCalculator::CalculateChunk (const void *pBuffer, unsigned nLength, u64 nChecksum)
 {
-	u16 nHigh = nChecksum >> 16;
-	while (nHigh != 0)
+	const u8 *p = (const u8 *) pBuffer;
+	assert (p != 0);
+	assert (nLength > 0);
+
+	// The words are loaded aligned. On an odd address the first byte is summed as
+	// the upper byte of a word. This swaps the bytes of the result, which is swapped
+	// back at the end (RFC 1071 section 2 (B)).
+	u64 nSum = 0;
+	boolean bOdd = (uintptr) p & 1;
+	if (bOdd)
+	{
+		nSum = (u32) *p++ << 8;
+		nLength--;
+	}
+
+	while (((uintptr) p & 7) && nLength >= 2)
+	{
+		nSum += *(const u16 *) p;
+		p += 2;
+		nLength -= 2;
+	}
+
+#if AARCH == 64
+	while (nLength >= NEON_BLOCK_SIZE)
+	{
+		unsigned nBlocks = nLength / NEON_BLOCK_SIZE;
+		if (nBlocks > NEON_MAX_BLOCKS)
+		{
+			nBlocks = NEON_MAX_BLOCKS;
+		}
+
+		nSum += inet_checksum_blocks_neon (p, nBlocks);
+
+		p += nBlocks * NEON_BLOCK_SIZE;
+		nLength -= nBlocks * NEON_BLOCK_SIZE;
+	}
+#endif
+
+	// 32-bit words are summed in a 64-bit accumulator, the carries are
+	// added back by FoldResult(), because 2^16 = 1 in ones' complement
+	const u32 *p32 = (const u32 *) p;
+	for (; nLength >= 16; nLength -= 16)
+	{
+		nSum += p32[0];
+		nSum += p32[1];
+		nSum += p32[2];
+		nSum += p32[3];
+		p32 += 4;
+	}
+
+	for (; nLength >= 4; nLength -= 4)
+	{
+		nSum += *p32++;
+	}
+
+	p = (const u8 *) p32;
+	if (nLength >= 2)
+	{
+		nSum += *(const u16 *) p;
+		p += 2;
+		nLength -= 2;
+	}
+
+	assert (nLength <= 1);
+	if (nLength != 0)
 	{
-		nChecksum &= 0xFFFF;
-		nChecksum += nHigh;
+		nSum += *p;
+	}
 
-		nHigh = nChecksum >> 16;
+	if (bOdd)
+	{
+		nSum = bswap16 (FoldResult (nSum));
 	}
-	
-	return (u16) nChecksum;
+
+	return nChecksum + nSum;
+}
+
+u16 CChecksumCalculator::FoldResult (u64 nChecksum)
+{
+	nChecksum = (nChecksum & 0xFFFFFFFF) + (nChecksum >> 32);
+
+	u32 nChecksum32 = (u32) nChecksum + (u32) (nChecksum >> 32);	// cannot overflow again
+	nChecksum32 = (nChecksum32 & 0xFFFF) + (nChecksum32 >> 16);
+	nChecksum32 = (nChecksum32 & 0xFFFF) + (nChecksum32 >> 16);
+
+	return (u16) nChecksum32;
 }
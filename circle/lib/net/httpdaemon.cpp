@@ -4,7 +4,7 @@
 // A simple HTTP webserver
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,17 +21,29 @@
 //
 #include <circle/net/httpdaemon.h>
 #include <circle/net/in.h>
+#include <circle/sched/scheduler.h>
 #include <circle/netdevice.h>
 #include <circle/sysconfig.h>
 #include <circle/logger.h>
 #include <circle/string.h>
+#include <circle/timer.h>
 #include <circle/util.h>
 #include <assert.h>
 
-#define HTTPD_VERSION		"0.02"
+#define HTTPD_VERSION		"0.03"
 #define SERVER			"CHTTPDaemon/" HTTPD_VERSION " (Circle)"
 
-#define MAX_CLIENTS		10
+#define MAX_CLIENTS		10		// worker tasks
+#define MAX_IDLE_CONNECTIONS	20		// kept alive connections, waiting for requests
+
+#define KEEP_ALIVE_TIMEOUT	15		// seconds
+#define MAX_KEEP_ALIVE_REQUESTS	100		// per connection
+
+#define POLL_TIMEOUT_MS		1000		// for checking the idle connections
+#define WORKER_WAIT_MS		10		// wait for a worker to terminate
+
+#define CHUNK_HEADER_SIZE	10		// "XXXXXXXX\r\n"
+#define CHUNK_TRAILER_SIZE	2		// "\r\n"
 
 #define HTTPD_STACK_SIZE	TASK_STACK_SIZE
 
@@ -47,7 +59,17 @@ CHTTPDaemon::CHTTPDaemon (CNetSubSystem *pNetSubSystem, CSocket *pSocket,
 	m_nMaxContentSize (nMaxContentSize),
 	m_nPort (nPort),
 	m_nMaxMultipartSize (nMaxMultipartSize),
-	m_pContentBuffer (0)
+	m_pContentBuffer (0),
+	m_bContentBuffered (FALSE),
+	m_pListener (0),
+	m_nRequests (0),
+	m_pRxBuffer (0),
+	m_nRxOffset (0),
+	m_nRxLength (0),
+	m_pChunkBuffer (0),
+	m_pPoller (0),
+	m_pIdleConnection (0),
+	m_pMultipartBuffer (0)
 {
 	s_nInstanceCount++;
 
@@ -74,9 +96,30 @@ CHTTPDaemon::~CHTTPDaemon (void)
 {
 	assert (m_pSocket == 0);
 
+	if (m_pPoller != 0)
+	{
+		CloseIdleConnections (TRUE);
+
+		delete m_pPoller;
+		m_pPoller = 0;
+	}
+
+	delete [] m_pIdleConnection;
+	m_pIdleConnection = 0;
+
+	delete [] m_pMultipartBuffer;
+	m_pMultipartBuffer = 0;
+
+	delete [] m_pChunkBuffer;
+	m_pChunkBuffer = 0;
+
+	delete [] m_pRxBuffer;
+	m_pRxBuffer = 0;
+
 	delete m_pContentBuffer;
 	m_pContentBuffer = 0;
 
+	m_pListener = 0;
 	m_pNetSubSystem = 0;
 
 	s_nInstanceCount--;
@@ -94,6 +137,36 @@ void CHTTPDaemon::Run (void)
 	}
 }
 
+THTTPStatus CHTTPDaemon::OpenContent (const char *pPath, const char *pParams,
+				      const char *pFormData, unsigned *pLength,
+				      const char **ppContentType)
+{
+	if (m_pContentBuffer == 0)
+	{
+		return HTTPInternalServerError;
+	}
+
+	assert (pLength != 0);
+	*pLength = m_nMaxContentSize;
+
+	THTTPStatus Status = GetContent (pPath, pParams, pFormData,
+					 m_pContentBuffer, pLength, ppContentType);
+	assert (*pLength <= m_nMaxContentSize);
+
+	m_bContentBuffered = TRUE;		// sent at once by SendContent()
+
+	return Status;
+}
+
+int CHTTPDaemon::ReadContent (u8 *pBuffer, unsigned nBufferSize)
+{
+	return -1;				// not used for the content from GetContent()
+}
+
+void CHTTPDaemon::CloseContent (void)
+{
+}
+
 void CHTTPDaemon::WriteAccessLog (const CIPAddress &rRemoteIP, THTTPRequestMethod RequestMethod,
 				  const char *pRequestURI, THTTPStatus Status,
 				  unsigned nContentLength)
@@ -142,28 +215,141 @@ void CHTTPDaemon::Listener (void)
 		return;
 	}
 
+	m_pIdleConnection = new TIdleConnection[MAX_IDLE_CONNECTIONS];
+	assert (m_pIdleConnection != 0);
+
+	for (unsigned i = 0; i < MAX_IDLE_CONNECTIONS; i++)
+	{
+		m_pIdleConnection[i].pSocket = 0;
+	}
+
+	m_pPoller = new CSocketPoller;
+	assert (m_pPoller != 0);
+
+	m_pPoller->Add (m_pSocket, SOCKET_POLL_ACCEPT);		// parameter 0 for this socket
+
 	while (1)
 	{
-		CIPAddress ForeignIP;
-		u16 nForeignPort;
-		CSocket *pConnection = m_pSocket->Accept (&ForeignIP, &nForeignPort);
-		if (pConnection == 0)
+		CloseIdleConnections (FALSE);
+
+		if (s_nInstanceCount >= MAX_CLIENTS+1)
 		{
-			CLogger::Get ()->Write (FromHTTPDaemon, LogWarning, "Cannot accept connection");
+			// new connections and requests wait in the meantime
+			CScheduler::Get ()->MsSleep (WORKER_WAIT_MS);
 
 			continue;
 		}
 
-		if (s_nInstanceCount >= MAX_CLIENTS+1)
+		TSocketPollEvent Event;
+		if (m_pPoller->Wait (&Event, 1, POLL_TIMEOUT_MS) <= 0)
 		{
-			CLogger::Get ()->Write (FromHTTPDaemon, LogWarning, "Too many clients");
+			continue;
+		}
+
+		if (Event.pParam == 0)
+		{
+			assert (Event.nEvents & SOCKET_POLL_ACCEPT);
+
+			CIPAddress ForeignIP;
+			u16 nForeignPort;
+			CSocket *pConnection = m_pSocket->Accept (&ForeignIP, &nForeignPort);
+			if (pConnection == 0)
+			{
+				CLogger::Get ()->Write (FromHTTPDaemon, LogWarning, "Cannot accept connection");
+
+				continue;
+			}
+
+			StartWorker (pConnection, 0);
 
+			continue;
+		}
+
+		// next request on an idle connection or connection closed by client
+		TIdleConnection *pIdle = (TIdleConnection *) Event.pParam;
+		CSocket *pConnection = pIdle->pSocket;
+		assert (pConnection != 0);
+
+		m_pPoller->Remove (pConnection);
+		pIdle->pSocket = 0;
+
+		// a pipelined request may be pending before the client has closed its side,
+		// the worker reads it and sees the end of the connection afterwards
+		if (   (Event.nEvents & SOCKET_POLL_ERROR)
+		    || (   (Event.nEvents & SOCKET_POLL_HANGUP)
+			&& !(Event.nEvents & SOCKET_POLL_READ)))
+		{
 			delete pConnection;
 
 			continue;
 		}
 
-		CreateWorker (m_pNetSubSystem, pConnection);
+		StartWorker (pConnection, pIdle->nRequests);
+	}
+}
+
+void CHTTPDaemon::StartWorker (CSocket *pConnection, unsigned nRequests)
+{
+	assert (m_pNetSubSystem != 0);
+	assert (pConnection != 0);
+	CHTTPDaemon *pWorker = CreateWorker (m_pNetSubSystem, pConnection);
+	assert (pWorker != 0);
+
+	// the new task does not run before this task blocks
+	pWorker->m_pListener = this;
+	pWorker->m_nRequests = nRequests;
+}
+
+boolean CHTTPDaemon::ParkConnection (CSocket *pConnection, unsigned nRequests)
+{
+	if (m_pPoller == 0)
+	{
+		return FALSE;
+	}
+
+	assert (m_pIdleConnection != 0);
+	for (unsigned i = 0; i < MAX_IDLE_CONNECTIONS; i++)
+	{
+		TIdleConnection *pIdle = &m_pIdleConnection[i];
+		if (pIdle->pSocket == 0)
+		{
+			assert (pConnection != 0);
+			pIdle->pSocket = pConnection;
+			pIdle->nParkTicks = CTimer::Get ()->GetTicks ();
+			pIdle->nRequests = nRequests;
+
+			if (m_pPoller->Add (pConnection, SOCKET_POLL_READ, pIdle) < 0)
+			{
+				pIdle->pSocket = 0;
+
+				return FALSE;
+			}
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void CHTTPDaemon::CloseIdleConnections (boolean bAll)
+{
+	unsigned nTicks = CTimer::Get ()->GetTicks ();
+
+	assert (m_pIdleConnection != 0);
+	for (unsigned i = 0; i < MAX_IDLE_CONNECTIONS; i++)
+	{
+		TIdleConnection *pIdle = &m_pIdleConnection[i];
+		if (   pIdle->pSocket != 0
+		    && (   bAll
+			|| nTicks - pIdle->nParkTicks >= KEEP_ALIVE_TIMEOUT * HZ))
+		{
+			assert (m_pPoller != 0);
+			m_pPoller->Remove (pIdle->pSocket);
+
+			delete pIdle->pSocket;		// closes connection
+			pIdle->pSocket = 0;
+		}
 	}
 }
 
@@ -171,35 +357,87 @@ void CHTTPDaemon::Worker (void)
 {
 	assert (m_pSocket != 0);
 
+	assert (m_pRxBuffer == 0);
+	m_pRxBuffer = new char[FRAME_BUFFER_SIZE];
+	assert (m_pRxBuffer != 0);
+
+	m_nRxOffset = 0;
+	m_nRxLength = 0;
+
+	while (ProcessRequest ())
+	{
+		if (m_nRxOffset < m_nRxLength)
+		{
+			continue;		// pipelined request has been received already
+		}
+
+		int nResult = m_pSocket->Receive (m_pRxBuffer, FRAME_BUFFER_SIZE, MSG_DONTWAIT);
+		if (nResult > 0)
+		{
+			m_nRxOffset = 0;
+			m_nRxLength = nResult;
+
+			continue;
+		}
+
+		// connection is idle, the listener waits for the next request
+		if (   nResult == 0
+		    && m_pListener != 0
+		    && m_pListener->ParkConnection (m_pSocket, m_nRequests))
+		{
+			m_pSocket = 0;
+		}
+
+		break;
+	}
+
+	delete m_pSocket;		// closes connection
+	m_pSocket = 0;
+}
+
+boolean CHTTPDaemon::ProcessRequest (void)
+{
+	assert (m_pSocket != 0);
+
 	// parse HTTP request
 	THTTPStatus Status = ParseRequest ();
 	if (Status == HTTPUnknownError)		// unknown error cannot be reported to client
 	{
-		delete m_pSocket;
-		m_pSocket = 0;
+		delete [] m_pMultipartBuffer;
+		m_pMultipartBuffer = 0;
 
-		return;
+		return FALSE;
+	}
+
+	// on error the request may not have been received completely
+	boolean bKeepAlive = Status == HTTPOK && !m_bConnectionClose;
+	if (++m_nRequests >= MAX_KEEP_ALIVE_REQUESTS)
+	{
+		bKeepAlive = FALSE;
 	}
 
 	// process HTTP request
-	unsigned nContentLength = m_nMaxContentSize;
+	unsigned nContentLength = 0;
 	const char *pContentType = "text/html";
 
 	const char *pStatusMsg = "OK";
 
+	m_bContentBuffered = FALSE;
+
 	if (Status == HTTPOK)
 	{
 		// get content
-		assert (m_pContentBuffer != 0);
-		Status = GetContent (m_RequestPath, m_RequestParams, m_RequestFormData,
-				     m_pContentBuffer, &nContentLength, &pContentType);
-		assert (nContentLength <= m_nMaxContentSize);
+		Status = OpenContent (m_RequestPath, m_RequestParams, m_RequestFormData,
+				      &nContentLength, &pContentType);
 		assert (pContentType != 0);
-
-		delete [] m_pMultipartBuffer;
-		m_pMultipartBuffer = 0;
 	}
 
+	delete [] m_pMultipartBuffer;
+	m_pMultipartBuffer = 0;
+
+	boolean bContentOpen = Status == HTTPOK;
+
+	CString ErrorPage;
 	if (Status != HTTPOK)
 	{
 		switch (Status)
@@ -214,7 +452,6 @@ void CHTTPDaemon::Worker (void)
 		default:			pStatusMsg = "Unknown Error";			break;
 		}
 
-		CString ErrorPage;
 		ErrorPage.Format ("<!DOCTYPE html>\n"
 				  "<html>\n"
 				  "<head><title>%u %s</title></head>\n"
@@ -222,66 +459,187 @@ void CHTTPDaemon::Worker (void)
 				  "</html>\n", Status, pStatusMsg, pStatusMsg);
 
 		nContentLength = ErrorPage.GetLength ();
-		if (nContentLength > m_nMaxContentSize)
-		{
-			nContentLength = m_nMaxContentSize;
-		}
-
-		assert (m_pContentBuffer != 0);
-		memcpy (m_pContentBuffer, (const char *) ErrorPage, nContentLength);
-		pContentType = "text/html";	// may has been changed by GetContent()
+		pContentType = "text/html";	// may has been changed by OpenContent()
 	}
 
-	// write access log
 	const u8 *pClientIP = m_pSocket->GetForeignIP ();
 	if (pClientIP == 0)			// connection closed in the meantime?
 	{
-		delete m_pSocket;
-		m_pSocket = 0;
+		if (bContentOpen)
+		{
+			CloseContent ();
+		}
 
-		return;
+		return FALSE;
 	}
 	CIPAddress ClientIP (pClientIP);
 
-	WriteAccessLog (ClientIP, m_RequestMethod, m_RequestURI, Status, nContentLength);
-
 	// send HTTP response header
+	boolean bChunked = nContentLength == HTTP_CONTENT_LENGTH_UNKNOWN;
+
 	CString Header;
 	Header.Format ("HTTP/1.1 %u %s\r\n"
 		       "Server: " SERVER "\r\n"
-		       "Content-Type: %s\r\n"
-		       "Content-Length: %u\r\n"
-		       "Connection: close\r\n"
-		       "\r\n", Status, pStatusMsg, pContentType, nContentLength);
+		       "Content-Type: %s\r\n", Status, pStatusMsg, pContentType);
+
+	if (bChunked)
+	{
+		Header.Append ("Transfer-Encoding: chunked\r\n");
+	}
+	else
+	{
+		CString ContentLength;
+		ContentLength.Format ("Content-Length: %u\r\n", nContentLength);
+
+		Header.Append (ContentLength);
+	}
+
+	Header.Append (bKeepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
 
+	unsigned nBytesSent = 0;
+	boolean bSent = TRUE;
 	if (m_pSocket->Send ((const char *) Header, Header.GetLength (), MSG_DONTWAIT) < 0)
 	{
 		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response header");
 
-		delete m_pSocket;
-		m_pSocket = 0;
+		bSent = FALSE;
+	}
+	else if (m_RequestMethod != HTTPRequestMethodHead)
+	{
+		// send response
+		if (bContentOpen)
+		{
+			bSent = SendContent (nContentLength, &nBytesSent);
+		}
+		else
+		{
+			assert (nContentLength > 0);
+			bSent = m_pSocket->Send ((const char *) ErrorPage, nContentLength,
+						 MSG_DONTWAIT) >= 0;
+		}
 
-		return;
+		if (!bSent)
+		{
+			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response");
+		}
 	}
 
-	// send response
-	if (   m_RequestMethod != HTTPRequestMethodHead
-	    && nContentLength > 0)
+	if (bContentOpen)
 	{
-		assert (m_pContentBuffer != 0);
-		if (m_pSocket->Send (m_pContentBuffer, nContentLength, MSG_DONTWAIT) < 0)
+		CloseContent ();
+	}
+
+	// write access log
+	WriteAccessLog (ClientIP, m_RequestMethod, m_RequestURI, Status,
+			bChunked ? nBytesSent : nContentLength);
+
+	return bSent && bKeepAlive;
+}
+
+boolean CHTTPDaemon::SendContent (unsigned nContentLength, unsigned *pBytesSent)
+{
+	assert (m_pSocket != 0);
+	assert (pBytesSent != 0);
+	*pBytesSent = 0;
+
+	if (m_bContentBuffered)			// from GetContent(), send at once
+	{
+		assert (nContentLength <= m_nMaxContentSize);
+		if (nContentLength > 0)
 		{
-			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response");
+			assert (m_pContentBuffer != 0);
+			if (m_pSocket->Send (m_pContentBuffer, nContentLength, MSG_DONTWAIT) < 0)
+			{
+				return FALSE;
+			}
+		}
 
-			delete m_pSocket;
-			m_pSocket = 0;
+		*pBytesSent = nContentLength;
+
+		return TRUE;
+	}
 
-			return;
+	if (m_pChunkBuffer == 0)
+	{
+		m_pChunkBuffer = new u8[CHUNK_HEADER_SIZE + HTTP_CHUNK_SIZE + CHUNK_TRAILER_SIZE];
+		assert (m_pChunkBuffer != 0);
+	}
+
+	// the chunk header is placed in front of the data, so that a chunk is sent at once
+	u8 *pData = m_pChunkBuffer + CHUNK_HEADER_SIZE;
+
+	boolean bChunked = nContentLength == HTTP_CONTENT_LENGTH_UNKNOWN;
+	while (1)
+	{
+		unsigned nSize = HTTP_CHUNK_SIZE;
+		if (!bChunked)
+		{
+			if (*pBytesSent >= nContentLength)
+			{
+				break;
+			}
+
+			if (nSize > nContentLength - *pBytesSent)
+			{
+				nSize = nContentLength - *pBytesSent;
+			}
+		}
+
+		int nResult = ReadContent (pData, nSize);
+		if (   nResult == 0
+		    && bChunked)
+		{
+			break;
+		}
+
+		if (nResult <= 0)		// error or content shorter than announced
+		{
+			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot read content");
+
+			return FALSE;
+		}
+
+		assert ((unsigned) nResult <= nSize);
+
+		u8 *pChunk = pData;
+		unsigned nChunkLength = nResult;
+
+		if (bChunked)
+		{
+			char ChunkHeader[CHUNK_HEADER_SIZE+1];
+			unsigned nHeaderLength = CString::FormatBuffer (ChunkHeader, sizeof ChunkHeader,
+									"%X\r\n", (unsigned) nResult);
+			assert (nHeaderLength <= CHUNK_HEADER_SIZE);
+
+			pChunk -= nHeaderLength;
+			memcpy (pChunk, ChunkHeader, nHeaderLength);
+
+			pData[nResult] = '\r';
+			pData[nResult+1] = '\n';
+
+			nChunkLength += nHeaderLength + CHUNK_TRAILER_SIZE;
 		}
+
+		// blocks until the data has been taken over by the connection (flow control)
+		if (m_pSocket->Send (pChunk, nChunkLength, 0) < 0)
+		{
+			return FALSE;
+		}
+
+		*pBytesSent += nResult;
 	}
 
-	delete m_pSocket;		// closes connection
-	m_pSocket = 0;
+	if (bChunked)
+	{
+		// last chunk without trailer fields
+		static const char LastChunk[] = "0\r\n\r\n";
+		if (m_pSocket->Send (LastChunk, sizeof LastChunk-1, MSG_DONTWAIT) < 0)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
 }
 
 THTTPStatus CHTTPDaemon::ParseRequest (void)
@@ -292,156 +650,189 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 	m_RequestURI[0] = '\0';
 	m_RequestPath[0] = '\0';
 	m_RequestParams[0] = '\0';
+	m_bConnectionClose = FALSE;
 	m_bRequestFormDataAvailable = FALSE;
 	m_nRequestContentLength = 0;
 	m_RequestFormData[0] = '\0';
 	m_bMultipartFormDataAvailable = FALSE;
 	m_MultipartBoundary[0] = '\0';
 	m_nMultipartContentLength = 0;
-	m_pMultipartBuffer = 0;
+	assert (m_pMultipartBuffer == 0);
+	m_pMultipartPointer = 0;
 
-	char Buffer[FRAME_BUFFER_SIZE];
 	char Line[HTTP_MAX_REQUEST_LINE+1];
-#if HTTP_MAX_REQUEST_LINE+FRAME_BUFFER_SIZE+2000 > HTTPD_STACK_SIZE
+#if HTTP_MAX_REQUEST_LINE+2000 > HTTPD_STACK_SIZE
 	#error Increase HTTPD_STACK_SIZE!
 #endif
 
-	unsigned nState = 0; // 0: parse header, 1: parse form data, 2: parse multipart data, 3: leave
+	// 0: parse header, 1: parse form data, 2: parse multipart data, 3: skip content, 4: leave
+	unsigned nState = 0;
 	unsigned nLine = 0;
 	unsigned nChar = 0;
 
-	int nResult;
-
 	assert (m_pSocket != 0);
-	while (   nState < 3
-	       && (nResult = m_pSocket->Receive (Buffer, sizeof Buffer, 0)) > 0)
+	assert (m_pRxBuffer != 0);
+	while (nState < 4)
 	{
-		for (unsigned i = 0; i < (unsigned) nResult; i++)
+		// data following this request remains in the buffer (pipelining)
+		if (m_nRxOffset >= m_nRxLength)
 		{
-			char chChar = Buffer[i];
-
-			if (nState == 0)
+			int nResult = m_pSocket->Receive (m_pRxBuffer, FRAME_BUFFER_SIZE, 0);
+			if (nResult <= 0)
 			{
-				if (chChar == '\r')
+				// the client may close the connection between requests
+				if (   nLine > 0
+				    || nChar > 0)
 				{
-					continue;
+					CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Receive failed");
 				}
 
-				if (chChar == '\n')		// end of line
+				return HTTPUnknownError;
+			}
+
+			m_nRxOffset = 0;
+			m_nRxLength = nResult;
+		}
+
+		if (nState == 0)
+		{
+			char chChar = m_pRxBuffer[m_nRxOffset++];
+
+			if (chChar == '\r')
+			{
+				continue;
+			}
+
+			if (chChar == '\n')		// end of line
+			{
+				if (nChar == 0)		// empty line is end of header
 				{
-					if (nChar == 0)		// empty line is end of header
+					if (nLine == 0)	// ignore empty lines before request line
 					{
-						if (   m_bRequestFormDataAvailable
-						    && m_nRequestContentLength > 0)
+						continue;
+					}
+
+					if (   m_bRequestFormDataAvailable
+					    && m_nRequestContentLength > 0)
+					{
+						if (m_nRequestContentLength <= HTTP_MAX_FORM_DATA)
 						{
-							if (m_nRequestContentLength <= HTTP_MAX_FORM_DATA)
-							{
-								nChar = 0;
-								nState = 1;
-							}
-							else
-							{
-								Status = HTTPRequestEntityTooLarge;
-								nState = 3;
-							}
+							nChar = 0;
+							nState = 1;
 						}
-						else if (   m_bMultipartFormDataAvailable
-							 && m_nRequestContentLength > 0)
+						else
 						{
-							m_nMultipartContentLength = m_nRequestContentLength;
-							m_nRequestContentLength = 0;
+							Status = HTTPRequestEntityTooLarge;
+							nState = 4;
+						}
+					}
+					else if (   m_bMultipartFormDataAvailable
+						 && m_nRequestContentLength > 0)
+					{
+						m_nMultipartContentLength = m_nRequestContentLength;
+						m_nRequestContentLength = 0;
 
-							if (m_nMultipartContentLength <= m_nMaxMultipartSize)
+						if (m_nMultipartContentLength <= m_nMaxMultipartSize)
+						{
+							assert (m_pMultipartBuffer == 0);
+							m_pMultipartBuffer = new char[m_nMultipartContentLength];
+							if (m_pMultipartBuffer == 0)
 							{
-								assert (m_pMultipartBuffer == 0);
-								m_pMultipartBuffer = new char[m_nMultipartContentLength];
-								if (m_pMultipartBuffer == 0)
-								{
-									Status = HTTPInternalServerError;
-									nState = 3;
-								}
-								else
-								{
-									nChar = 0;
-									nState = 2;
-								}
+								Status = HTTPInternalServerError;
+								nState = 4;
 							}
 							else
 							{
-								Status = HTTPRequestEntityTooLarge;
-								nState = 3;
+								nChar = 0;
+								nState = 2;
 							}
 						}
 						else
 						{
-							nState = 3;
+							Status = HTTPRequestEntityTooLarge;
+							nState = 4;
 						}
 					}
-					else
+					else if (m_nRequestContentLength > 0)
 					{
-						if (nLine++ == 0)	// first line?
-						{
-							if (Status == HTTPOK)
-							{						
-								Status = ParseMethod (Line);
-							}
-						}
-						else
-						{
-							if (Status == HTTPOK)
-							{						
-								Status = ParseHeaderField (Line);
-							}
-						}
-
 						nChar = 0;
+						nState = 3;
+					}
+					else
+					{
+						nState = 4;
 					}
 				}
 				else
 				{
-					// accumulate option line
-					if (nChar < sizeof Line-1)
+					if (nLine++ == 0)	// first line?
 					{
-						Line[nChar++] = chChar;
-						Line[nChar] = '\0';
+						if (Status == HTTPOK)
+						{
+							Status = ParseMethod (Line);
+						}
 					}
 					else
 					{
-						Status = HTTPRequestEntityTooLarge;
+						if (Status == HTTPOK)
+						{
+							Status = ParseHeaderField (Line);
+						}
 					}
+
+					nChar = 0;
 				}
 			}
-			else if (nState == 1)
+			else
 			{
-				m_RequestFormData[nChar++] = chChar;
-				m_RequestFormData[nChar] = '\0';
-
-				if (nChar >= m_nRequestContentLength)
+				// accumulate option line
+				if (nChar < sizeof Line-1)
+				{
+					Line[nChar++] = chChar;
+					Line[nChar] = '\0';
+				}
+				else
 				{
-					nState = 3;
+					Status = HTTPRequestEntityTooLarge;
 				}
 			}
+		}
+		else
+		{
+			// copy or skip the content of the request
+			unsigned nContentLength =   nState == 2
+						  ? m_nMultipartContentLength
+						  : m_nRequestContentLength;
+			assert (nChar < nContentLength);
+
+			unsigned nLength = m_nRxLength - m_nRxOffset;
+			if (nLength > nContentLength - nChar)
+			{
+				nLength = nContentLength - nChar;
+			}
+
+			if (nState == 1)
+			{
+				memcpy (m_RequestFormData + nChar, m_pRxBuffer + m_nRxOffset, nLength);
+				m_RequestFormData[nChar + nLength] = '\0';
+			}
 			else if (nState == 2)
 			{
-				m_pMultipartBuffer[nChar++] = chChar;
+				memcpy (m_pMultipartBuffer + nChar, m_pRxBuffer + m_nRxOffset, nLength);
+			}
 
-				if (nChar >= m_nMultipartContentLength)
-				{
-					m_pMultipartPointer = m_pMultipartBuffer;
+			m_nRxOffset += nLength;
+			nChar += nLength;
 
-					nState = 3;
-				}
+			if (nChar >= nContentLength)
+			{
+				m_pMultipartPointer = m_pMultipartBuffer;
+
+				nState = 4;
 			}
 		}
 	}
 
-	if (nResult < 0)
-	{
-		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Receive failed");
-
-		return HTTPUnknownError;
-	}
-	
 	if (Status != HTTPOK)
 	{
 		return Status;
@@ -468,7 +859,6 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 
 	return HTTPOK;
 }
-
 THTTPStatus CHTTPDaemon::ParseMethod (char *pLine)
 {
 	// "METHOD uri HTTP/1.1" expected
@@ -541,7 +931,7 @@ THTTPStatus CHTTPDaemon::ParseHeaderField (char *pLine)
 		return HTTPBadRequest;
 	}
 
-	if (strcmp (pToken, "Content-Type") == 0)
+	if (strcasecmp (pToken, "Content-Type") == 0)
 	{
 		if ((pToken = strtok_r (0, " ;", &pSavePtr)) == 0)
 		{
@@ -567,7 +957,7 @@ THTTPStatus CHTTPDaemon::ParseHeaderField (char *pLine)
 			strcpy (m_MultipartBoundary, pToken);
 		}
 	}
-	else if (strcmp (pToken, "Content-Length") == 0)
+	else if (strcasecmp (pToken, "Content-Length") == 0)
 	{
 		if ((pToken = strtok_r (0, " ", &pSavePtr)) == 0)
 		{
@@ -594,6 +984,20 @@ THTTPStatus CHTTPDaemon::ParseHeaderField (char *pLine)
 
 		m_nRequestContentLength = nAccu;
 	}
+	else if (strcasecmp (pToken, "Connection") == 0)
+	{
+		while ((pToken = strtok_r (0, " ,", &pSavePtr)) != 0)
+		{
+			if (strcasecmp (pToken, "close") == 0)
+			{
+				m_bConnectionClose = TRUE;
+			}
+		}
+	}
+	else if (strcasecmp (pToken, "Transfer-Encoding") == 0)
+	{
+		return HTTPMethodNotImplemented;	// chunked request content is not supported
+	}
 
 	return HTTPOK;
 }
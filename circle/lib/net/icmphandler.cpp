@@ -2,7 +2,7 @@
 // icmphandler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -35,6 +35,7 @@ struct TICMPHeader
 	u8	Parameter[4];		// ICMP_TYPE_REDIRECT: Gateway IP address
 					// ICMP_CODE_POINTER: Pointer (in first byte)
 					// ICMP_TYPE_ECHO: Identifier and Sequence Number
+					// ICMP_CODE_FRAG_REQUIRED: Next-Hop MTU (in last two bytes)
 					// otherwise: unused
 }
 PACKED;
@@ -49,6 +50,9 @@ PACKED;
 
 static const char FromICMP[] = "icmp";
 
+// MTU plateaus for routers, which do not report the next-hop MTU (RFC 1191 section 7)
+static const u16 s_MTUPlateau[] = {65535, 32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, 68};
+
 CICMPHandler::CICMPHandler (CNetConfig *pNetConfig, CNetworkLayer *pNetworkLayer,
 			    CNetQueue *pRxQueue, CNetQueue *pNotificationQueue)
 :	m_pNetConfig (pNetConfig),
@@ -72,37 +76,39 @@ CICMPHandler::~CICMPHandler (void)
 
 void CICMPHandler::Process (void)
 {
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	unsigned nLength;
-	void *pParam;
+	CNetBuffer *pBuffer;
 	assert (m_pRxQueue != 0);
-	while ((nLength = m_pRxQueue->Dequeue (Buffer, &pParam)) != 0)
+	while ((pBuffer = m_pRxQueue->Dequeue ()) != 0)
 	{
-		TNetworkPrivateData *pData = (TNetworkPrivateData *) pParam;
-		assert (pData != 0);
+		TNetworkPrivateData *pData = (TNetworkPrivateData *) pBuffer->GetPrivateData ();
 		assert (pData->nProtocol == IPPROTO_ICMP);
 
 		CIPAddress SourceIP (pData->SourceAddress);
 		CIPAddress DestIP (pData->DestinationAddress);
 
-		delete pData;
-		pData = 0;
-
 		assert (m_pNetConfig != 0);
 		if (   DestIP.IsBroadcast ()
 		    || DestIP == *m_pNetConfig->GetBroadcastAddress ())
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
+		unsigned nLength = pBuffer->GetLength ();
 		if (nLength < sizeof (TICMPHeader))
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
-		TICMPHeader *pICMPHeader = (TICMPHeader *) Buffer;
+		u8 *pPacket = pBuffer->GetData ();
+		TICMPHeader *pICMPHeader = (TICMPHeader *) pPacket;
 
-		if (CChecksumCalculator::SimpleCalculate (Buffer, nLength) != CHECKSUM_OK)
+		if (CChecksumCalculator::SimpleCalculate (pPacket, nLength) != CHECKSUM_OK)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
@@ -111,87 +117,130 @@ void CICMPHandler::Process (void)
 		{
 			if (pICMPHeader->nCode == ICMP_CODE_ECHO)
 			{
-				// packet will be used in place to send it back
+				// packet will be used in place to send it back,
+				// only the type changes, so the checksum is updated
 				pICMPHeader->nType     = ICMP_TYPE_ECHO_REPLY;
 				pICMPHeader->nCode     = ICMP_CODE_ECHO;
-				pICMPHeader->nChecksum = 0;
-				pICMPHeader->nChecksum = CChecksumCalculator::SimpleCalculate (Buffer, nLength);
+				pICMPHeader->nChecksum = CChecksumCalculator::Update (pICMPHeader->nChecksum,
+					ICMP_TYPE_ECHO | ICMP_CODE_ECHO << 8,		// as in memory
+					ICMP_TYPE_ECHO_REPLY | ICMP_CODE_ECHO << 8);
 
 				assert (m_pNetworkLayer != 0);
-				m_pNetworkLayer->Send (SourceIP, Buffer, nLength, IPPROTO_ICMP);
+				m_pNetworkLayer->Send (SourceIP, pBuffer, IPPROTO_ICMP);
+			}
+			else
+			{
+				pBuffer->Release ();
 			}
 
 			continue;
 		}
 
 		// handle ERROR messages next
-		if (nLength <= sizeof (TICMPHeader) + sizeof (TIPHeader))
-		{
-			continue;
-		}
-		TIPHeader *pIPHeader = (TIPHeader *) (Buffer + sizeof (TICMPHeader));
+		HandleError (pPacket, nLength, SourceIP);
 
-		unsigned nIPHeaderLength = pIPHeader->nVersionIHL & 0xF;
-		if (   nIPHeaderLength < IP_HEADER_LENGTH_DWORD_MIN
-		    || nIPHeaderLength > IP_HEADER_LENGTH_DWORD_MAX)
-		{
-			continue;
-		}
-		nIPHeaderLength *= 4;
+		pBuffer->Release ();
+	}
+}
 
-		if (   (pIPHeader->nVersionIHL >> 4) != IP_VERSION
-		    || *m_pNetConfig->GetIPAddress () != pIPHeader->SourceAddress)
-		{
-			continue;
-		}
+void CICMPHandler::HandleError (const u8 *pPacket, unsigned nLength, const CIPAddress &rSourceIP)
+{
+	assert (pPacket != 0);
+	TICMPHeader *pICMPHeader = (TICMPHeader *) pPacket;
 
-		if (nLength < sizeof (TICMPHeader) + nIPHeaderLength + sizeof (TICMPDataDatagramHeader))
-		{
-			continue;
-		}
-		TICMPDataDatagramHeader *pDatagramHeader =
-			(TICMPDataDatagramHeader *) ((u8 *) pIPHeader + nIPHeaderLength);
+	if (nLength <= sizeof (TICMPHeader) + sizeof (TIPHeader))
+	{
+		return;
+	}
+	TIPHeader *pIPHeader = (TIPHeader *) (pPacket + sizeof (TICMPHeader));
 
-		switch (pICMPHeader->nType)
-		{
-		case ICMP_TYPE_DEST_UNREACH:
-			CLogger::Get ()->Write (FromICMP, LogDebug, "Destination unreachable (%u)",
-						pICMPHeader->nCode);
-			EnqueueNotification (ICMPNotificationDestUnreach, pIPHeader, pDatagramHeader);
-			break;
+	unsigned nIPHeaderLength = pIPHeader->nVersionIHL & 0xF;
+	if (   nIPHeaderLength < IP_HEADER_LENGTH_DWORD_MIN
+	    || nIPHeaderLength > IP_HEADER_LENGTH_DWORD_MAX)
+	{
+		return;
+	}
+	nIPHeaderLength *= 4;
 
-		case ICMP_TYPE_REDIRECT: {
-			CIPAddress GatewayIP (pICMPHeader->Parameter);
+	if (   (pIPHeader->nVersionIHL >> 4) != IP_VERSION
+	    || *m_pNetConfig->GetIPAddress () != pIPHeader->SourceAddress)
+	{
+		return;
+	}
 
-			// See: RFC 1122 3.2.2.2
-			assert (m_pNetworkLayer != 0);
-			if (   !GatewayIP.OnSameNetwork (*m_pNetConfig->GetIPAddress (),
-							 m_pNetConfig->GetNetMask ())
-			    || SourceIP != m_pNetworkLayer->GetGateway (pIPHeader->DestinationAddress))
+	if (nLength < sizeof (TICMPHeader) + nIPHeaderLength + sizeof (TICMPDataDatagramHeader))
+	{
+		return;
+	}
+	TICMPDataDatagramHeader *pDatagramHeader =
+		(TICMPDataDatagramHeader *) ((u8 *) pIPHeader + nIPHeaderLength);
+
+	switch (pICMPHeader->nType)
+	{
+	case ICMP_TYPE_DEST_UNREACH:
+		if (pICMPHeader->nCode == ICMP_CODE_FRAG_REQUIRED)
+		{
+			// path MTU discovery (RFC 1191), the connection is not affected
+			unsigned nMTU =   (unsigned) pICMPHeader->Parameter[2] << 8
+					| pICMPHeader->Parameter[3];
+			if (nMTU == 0)
 			{
-				break;
+				unsigned nTotalLength = le2be16 (pIPHeader->nTotalLength);
+				for (unsigned i = 0; i < sizeof s_MTUPlateau / sizeof s_MTUPlateau[0]; i++)
+				{
+					nMTU = s_MTUPlateau[i];
+					if (nMTU < nTotalLength)
+					{
+						break;
+					}
+				}
 			}
 
-			CLogger::Get ()->Write (FromICMP, LogDebug, "Redirect (%u)", pICMPHeader->nCode);
+			CLogger::Get ()->Write (FromICMP, LogDebug, "Fragmentation needed (MTU %u)",
+						nMTU);
 
-			m_pNetworkLayer->AddRoute (pIPHeader->DestinationAddress, GatewayIP.Get ());
-			} break;
+			assert (m_pNetworkLayer != 0);
+			m_pNetworkLayer->SetPathMTU (pIPHeader->DestinationAddress, nMTU);
 
-		case ICMP_TYPE_TIME_EXCEED:
-			CLogger::Get ()->Write (FromICMP, LogWarning, "Time exceeded (%u)",
-						pICMPHeader->nCode);
-			EnqueueNotification (ICMPNotificationTimeExceed, pIPHeader, pDatagramHeader);
 			break;
+		}
 
-		case ICMP_TYPE_PARAM_PROBLEM:
-			CLogger::Get ()->Write (FromICMP, LogWarning, "Parameter problem (%u)",
-						pICMPHeader->nCode);
-			EnqueueNotification (ICMPNotificationParamProblem, pIPHeader, pDatagramHeader);
-			break;
+		CLogger::Get ()->Write (FromICMP, LogDebug, "Destination unreachable (%u)",
+					pICMPHeader->nCode);
+		EnqueueNotification (ICMPNotificationDestUnreach, pIPHeader, pDatagramHeader);
+		break;
+
+	case ICMP_TYPE_REDIRECT: {
+		CIPAddress GatewayIP (pICMPHeader->Parameter);
 
-		default:
+		// See: RFC 1122 3.2.2.2
+		assert (m_pNetworkLayer != 0);
+		if (   !GatewayIP.OnSameNetwork (*m_pNetConfig->GetIPAddress (),
+						 m_pNetConfig->GetNetMask ())
+		    || rSourceIP != m_pNetworkLayer->GetGateway (pIPHeader->DestinationAddress))
+		{
 			break;
 		}
+
+		CLogger::Get ()->Write (FromICMP, LogDebug, "Redirect (%u)", pICMPHeader->nCode);
+
+		m_pNetworkLayer->AddRoute (pIPHeader->DestinationAddress, GatewayIP.Get ());
+		} break;
+
+	case ICMP_TYPE_TIME_EXCEED:
+		CLogger::Get ()->Write (FromICMP, LogWarning, "Time exceeded (%u)",
+					pICMPHeader->nCode);
+		EnqueueNotification (ICMPNotificationTimeExceed, pIPHeader, pDatagramHeader);
+		break;
+
+	case ICMP_TYPE_PARAM_PROBLEM:
+		CLogger::Get ()->Write (FromICMP, LogWarning, "Parameter problem (%u)",
+					pICMPHeader->nCode);
+		EnqueueNotification (ICMPNotificationParamProblem, pIPHeader, pDatagramHeader);
+		break;
+
+	default:
+		break;
 	}
 }
 
@@ -0,0 +1,404 @@
+//
+// ipreassembler.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/ipreassembler.h>
+#include <circle/net/networklayer.h>
+#include <circle/net/checksumcalculator.h>
+#include <circle/metrics.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define REASSEMBLY_TIMEOUT_HZ	(15 * HZ)	// RFC 791 recommends 15 seconds
+
+#define IP_PAYLOAD_SIZE_MAX	(IP_PACKET_SIZE_MAX - sizeof (TIPHeader))
+
+struct TFragmentPrivateData
+{
+	CNetBuffer	*pNext;
+	unsigned	 nOffset;		// of the payload in the datagram
+};
+
+static CMetricCounter s_FragmentsReceived ("circle_net_ip_fragments_received_total",
+					   "IP fragments received");
+static CMetricCounter s_DatagramsReassembled ("circle_net_ip_datagrams_reassembled_total",
+					      "IP datagrams successfully reassembled from fragments");
+static CMetricCounter s_ReassemblyFailures ("circle_net_ip_reassembly_failures_total",
+					    "IP datagrams discarded during reassembly (timeout, "
+					    "overlap or limit)");
+
+CIPReassembler::CIPReassembler (void)
+:	m_nMemoryUsed (0)
+{
+	for (unsigned i = 0; i < IP_REASSEMBLY_MAX_DATAGRAMS; i++)
+	{
+		m_Datagram[i].bInUse = FALSE;
+		m_Datagram[i].pFirstFragment = 0;
+	}
+}
+
+CIPReassembler::~CIPReassembler (void)
+{
+	Flush ();
+}
+
+CNetBuffer *CIPReassembler::AddFragment (CNetBuffer *pFragment)
+{
+	assert (pFragment != 0);
+	assert (sizeof (TFragmentPrivateData) <= NET_BUFFER_PRIVATE_SIZE);
+
+	s_FragmentsReceived.Inc ();
+
+	// the header has been validated by the network layer and the buffer has been trimmed
+	const TIPHeader *pHeader = (const TIPHeader *) pFragment->GetData ();
+	unsigned nHeaderLength = (pHeader->nVersionIHL & 0xF) * 4;
+	assert (nHeaderLength <= sizeof m_Datagram[0].Header);
+	assert (pFragment->GetLength () > nHeaderLength);
+	unsigned nLength = pFragment->GetLength () - nHeaderLength;
+
+	u16 nFlagsFragmentOffset = pHeader->nFlagsFragmentOffset;
+	boolean bMoreFragments = nFlagsFragmentOffset & IP_FLAGS_MF ? TRUE : FALSE;
+	unsigned nOffset = IP_FRAGMENT_OFFSET (le2be16 (nFlagsFragmentOffset)) * 8;
+
+	// all fragments but the last must contain a multiple of 8 bytes
+	if (   (bMoreFragments && (nLength & 7))
+	    || nOffset + nLength > IP_PAYLOAD_SIZE_MAX)
+	{
+		pFragment->Release ();
+
+		return 0;
+	}
+
+	TDatagram *pDatagram = FindDatagram (pHeader);
+	if (pDatagram == 0)
+	{
+		pDatagram = CreateDatagram (pHeader);
+		assert (pDatagram != 0);
+	}
+
+	if (   pDatagram->nTotalLength != 0
+	    && (   nOffset + nLength > pDatagram->nTotalLength
+		|| (   !bMoreFragments
+		    && nOffset + nLength != pDatagram->nTotalLength)))
+	{
+		// inconsistent with the last fragment received before
+		DiscardDatagram (pDatagram);
+		pFragment->Release ();
+
+		return 0;
+	}
+
+	if (!MakeRoom (sizeof (CNetBuffer), pDatagram))
+	{
+		DiscardDatagram (pDatagram);
+		pFragment->Release ();
+
+		return 0;
+	}
+
+	if (nOffset == 0)
+	{
+		memcpy (pDatagram->Header, pHeader, nHeaderLength);
+		pDatagram->nHeaderLength = nHeaderLength;
+	}
+
+	// the payload of the fragment remains
+	pFragment->Pull (nHeaderLength);
+
+	if (!InsertFragment (pDatagram, pFragment, nOffset, nLength))
+	{
+		// overlapping fragments are not accepted (see RFC 5722 for the reason)
+		DiscardDatagram (pDatagram);
+		pFragment->Release ();
+
+		return 0;
+	}
+
+	if (!bMoreFragments)
+	{
+		// the queued fragments do not overlap, so no fragment may follow the last one
+		if (((TFragmentPrivateData *) pFragment->GetPrivateData ())->pNext != 0)
+		{
+			DiscardDatagram (pDatagram);
+
+			return 0;
+		}
+
+		pDatagram->nTotalLength = nOffset + nLength;
+	}
+
+	if (   pDatagram->nTotalLength == 0
+	    || pDatagram->nReceivedLength != pDatagram->nTotalLength)
+	{
+		return 0;
+	}
+
+	// the fragments do not overlap, so the datagram is complete now
+	assert (pDatagram->nReceivedLength == pDatagram->nTotalLength);
+	assert (pDatagram->nHeaderLength != 0);
+
+	return Assemble (pDatagram);
+}
+
+void CIPReassembler::Process (void)
+{
+	unsigned nTicks = CTimer::Get ()->GetTicks ();
+
+	for (unsigned i = 0; i < IP_REASSEMBLY_MAX_DATAGRAMS; i++)
+	{
+		TDatagram *pDatagram = &m_Datagram[i];
+		if (   pDatagram->bInUse
+		    && nTicks - pDatagram->nStartTicks >= REASSEMBLY_TIMEOUT_HZ)
+		{
+			DiscardDatagram (pDatagram);
+		}
+	}
+}
+
+void CIPReassembler::Flush (void)
+{
+	for (unsigned i = 0; i < IP_REASSEMBLY_MAX_DATAGRAMS; i++)
+	{
+		if (m_Datagram[i].bInUse)
+		{
+			DiscardDatagram (&m_Datagram[i]);
+		}
+	}
+
+	assert (m_nMemoryUsed == 0);
+}
+
+CIPReassembler::TDatagram *CIPReassembler::FindDatagram (const TIPHeader *pHeader)
+{
+	assert (pHeader != 0);
+
+	for (unsigned i = 0; i < IP_REASSEMBLY_MAX_DATAGRAMS; i++)
+	{
+		TDatagram *pDatagram = &m_Datagram[i];
+		if (   pDatagram->bInUse
+		    && pDatagram->nIdentification == pHeader->nIdentification
+		    && pDatagram->nProtocol == pHeader->nProtocol
+		    && memcmp (pDatagram->SourceAddress, pHeader->SourceAddress,
+			       IP_ADDRESS_SIZE) == 0
+		    && memcmp (pDatagram->DestinationAddress, pHeader->DestinationAddress,
+			       IP_ADDRESS_SIZE) == 0)
+		{
+			return pDatagram;
+		}
+	}
+
+	return 0;
+}
+
+CIPReassembler::TDatagram *CIPReassembler::CreateDatagram (const TIPHeader *pHeader)
+{
+	// use a free entry, or the oldest one, if all are in use
+	TDatagram *pDatagram = 0;
+	unsigned nTicks = CTimer::Get ()->GetTicks ();
+	for (unsigned i = 0; i < IP_REASSEMBLY_MAX_DATAGRAMS; i++)
+	{
+		if (!m_Datagram[i].bInUse)
+		{
+			pDatagram = &m_Datagram[i];
+
+			break;
+		}
+
+		if (   pDatagram == 0
+		    || nTicks - m_Datagram[i].nStartTicks > nTicks - pDatagram->nStartTicks)
+		{
+			pDatagram = &m_Datagram[i];
+		}
+	}
+
+	assert (pDatagram != 0);
+	if (pDatagram->bInUse)
+	{
+		DiscardDatagram (pDatagram);
+	}
+
+	assert (pHeader != 0);
+	memcpy (pDatagram->SourceAddress, pHeader->SourceAddress, IP_ADDRESS_SIZE);
+	memcpy (pDatagram->DestinationAddress, pHeader->DestinationAddress, IP_ADDRESS_SIZE);
+	pDatagram->nIdentification = pHeader->nIdentification;
+	pDatagram->nProtocol = pHeader->nProtocol;
+	pDatagram->nStartTicks = nTicks;
+	pDatagram->nTotalLength = 0;
+	pDatagram->nReceivedLength = 0;
+	pDatagram->nMemory = 0;
+	pDatagram->nHeaderLength = 0;
+	pDatagram->pFirstFragment = 0;
+	pDatagram->bInUse = TRUE;
+
+	return pDatagram;
+}
+
+boolean CIPReassembler::InsertFragment (TDatagram *pDatagram, CNetBuffer *pFragment,
+					unsigned nOffset, unsigned nLength)
+{
+	assert (pDatagram != 0);
+	assert (pFragment != 0);
+
+	CNetBuffer *pPrev = 0;
+	CNetBuffer *pNext = pDatagram->pFirstFragment;
+	while (pNext != 0)
+	{
+		TFragmentPrivateData *pData = (TFragmentPrivateData *) pNext->GetPrivateData ();
+		if (pData->nOffset >= nOffset)
+		{
+			break;
+		}
+
+		pPrev = pNext;
+		pNext = pData->pNext;
+	}
+
+	if (pPrev != 0)
+	{
+		TFragmentPrivateData *pData = (TFragmentPrivateData *) pPrev->GetPrivateData ();
+		if (pData->nOffset + pPrev->GetLength () > nOffset)
+		{
+			return FALSE;
+		}
+	}
+
+	if (pNext != 0)
+	{
+		TFragmentPrivateData *pData = (TFragmentPrivateData *) pNext->GetPrivateData ();
+		if (nOffset + nLength > pData->nOffset)
+		{
+			return FALSE;
+		}
+	}
+
+	TFragmentPrivateData *pData = (TFragmentPrivateData *) pFragment->GetPrivateData ();
+	pData->nOffset = nOffset;
+	pData->pNext = pNext;
+
+	if (pPrev != 0)
+	{
+		((TFragmentPrivateData *) pPrev->GetPrivateData ())->pNext = pFragment;
+	}
+	else
+	{
+		pDatagram->pFirstFragment = pFragment;
+	}
+
+	pDatagram->nReceivedLength += nLength;
+	pDatagram->nMemory += sizeof (CNetBuffer);
+	m_nMemoryUsed += sizeof (CNetBuffer);
+
+	return TRUE;
+}
+
+CNetBuffer *CIPReassembler::Assemble (TDatagram *pDatagram)
+{
+	assert (pDatagram != 0);
+	unsigned nHeaderLength = pDatagram->nHeaderLength;
+
+	CNetBuffer *pBuffer = new CNetBuffer (nHeaderLength + pDatagram->nTotalLength);
+	if (pBuffer == 0)
+	{
+		DiscardDatagram (pDatagram);
+
+		return 0;
+	}
+
+	TIPHeader *pHeader = (TIPHeader *) pBuffer->Put (nHeaderLength + pDatagram->nTotalLength);
+	memcpy (pHeader, pDatagram->Header, nHeaderLength);
+	pHeader->nTotalLength = le2be16 (nHeaderLength + pDatagram->nTotalLength);
+	pHeader->nFlagsFragmentOffset = 0;
+	pHeader->nHeaderChecksum = 0;
+	pHeader->nHeaderChecksum = CChecksumCalculator::SimpleCalculate (pHeader, nHeaderLength);
+
+	u8 *pPayload = (u8 *) pHeader + nHeaderLength;
+	for (CNetBuffer *pFragment = pDatagram->pFirstFragment; pFragment != 0;)
+	{
+		TFragmentPrivateData *pData = (TFragmentPrivateData *) pFragment->GetPrivateData ();
+		assert (pData->nOffset + pFragment->GetLength () <= pDatagram->nTotalLength);
+		memcpy (pPayload + pData->nOffset, pFragment->GetData (), pFragment->GetLength ());
+
+		pFragment = pData->pNext;
+	}
+
+	DiscardDatagram (pDatagram);
+
+	s_DatagramsReassembled.Inc ();
+
+	return pBuffer;
+}
+
+void CIPReassembler::DiscardDatagram (TDatagram *pDatagram)
+{
+	assert (pDatagram != 0);
+	assert (pDatagram->bInUse);
+
+	CNetBuffer *pFragment = pDatagram->pFirstFragment;
+	while (pFragment != 0)
+	{
+		CNetBuffer *pNext = ((TFragmentPrivateData *) pFragment->GetPrivateData ())->pNext;
+
+		pFragment->Release ();
+
+		pFragment = pNext;
+	}
+
+	pDatagram->pFirstFragment = 0;
+
+	if (   pDatagram->nTotalLength == 0
+	    || pDatagram->nReceivedLength != pDatagram->nTotalLength)
+	{
+		s_ReassemblyFailures.Inc ();
+	}
+
+	assert (m_nMemoryUsed >= pDatagram->nMemory);
+	m_nMemoryUsed -= pDatagram->nMemory;
+	pDatagram->nMemory = 0;
+
+	pDatagram->bInUse = FALSE;
+}
+
+boolean CIPReassembler::MakeRoom (unsigned nBytes, const TDatagram *pExcept)
+{
+	while (m_nMemoryUsed + nBytes > IP_REASSEMBLY_MAX_MEMORY)
+	{
+		TDatagram *pOldest = 0;
+		unsigned nTicks = CTimer::Get ()->GetTicks ();
+		for (unsigned i = 0; i < IP_REASSEMBLY_MAX_DATAGRAMS; i++)
+		{
+			TDatagram *pDatagram = &m_Datagram[i];
+			if (   pDatagram->bInUse
+			    && pDatagram != pExcept
+			    && (   pOldest == 0
+				|| nTicks - pDatagram->nStartTicks > nTicks - pOldest->nStartTicks))
+			{
+				pOldest = pDatagram;
+			}
+		}
+
+		if (pOldest == 0)
+		{
+			return FALSE;
+		}
+
+		DiscardDatagram (pOldest);
+	}
+
+	return TRUE;
+}
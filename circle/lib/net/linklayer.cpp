@@ -2,7 +2,7 @@
 // linklayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -74,46 +74,54 @@ void CLinkLayer::Process (void)
 	}
 
 	assert (m_pNetDevLayer != 0);
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	unsigned nLength;
-	while (m_pNetDevLayer->Receive (Buffer, &nLength))
+	CNetBuffer *pBuffer;
+	while ((pBuffer = m_pNetDevLayer->Receive ()) != 0)
 	{
-		assert (nLength <= FRAME_BUFFER_SIZE);
-		if (nLength <= sizeof (TEthernetHeader))
+		assert (pBuffer->GetLength () <= FRAME_BUFFER_SIZE);
+		if (pBuffer->GetLength () <= sizeof (TEthernetHeader))
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
-		TEthernetHeader *pHeader = (TEthernetHeader *) Buffer;
+		TEthernetHeader *pHeader = (TEthernetHeader *) pBuffer->GetData ();
 
 		CMACAddress MACAddressReceiver (pHeader->MACReceiver);
 		if (    MACAddressReceiver != *pOwnMACAddress
 		    && !MACAddressReceiver.IsBroadcast ())
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
-		nLength -= sizeof (TEthernetHeader);
-		assert (nLength > 0);
+		// the header remains valid in the headroom
+		pBuffer->Pull (sizeof (TEthernetHeader));
+		assert (pBuffer->GetLength () > 0);
 		
 		switch (pHeader->nProtocolType)
 		{
 		case BE (ETH_PROT_IP):
-			m_IPRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader), nLength);
+			m_IPRxQueue.Enqueue (pBuffer);
 			break;
 
 		case BE (ETH_PROT_ARP):
-			m_ARPRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader), nLength);
+			m_ARPRxQueue.Enqueue (pBuffer);
 			break;
 
 		default:
 			if (pHeader->nProtocolType == m_nRawProtocolType)
 			{
-				TRawPrivateData *pParam = new TRawPrivateData;
-				assert (pParam != 0);
-				memcpy (pParam->MACSender, pHeader->MACSender, MAC_ADDRESS_SIZE);
+				assert (sizeof (TRawPrivateData) <= NET_BUFFER_PRIVATE_SIZE);
+				TRawPrivateData *pData =
+					(TRawPrivateData *) pBuffer->GetPrivateData ();
+				memcpy (pData->MACSender, pHeader->MACSender, MAC_ADDRESS_SIZE);
 
-				m_RawRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader),
-						      nLength, pParam);
+				m_RawRxQueue.Enqueue (pBuffer);
+			}
+			else
+			{
+				pBuffer->Release ();
 			}
 			break;
 		}
@@ -123,17 +131,18 @@ void CLinkLayer::Process (void)
 	m_pARPHandler->Process ();
 }
 
-boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, unsigned nLength)
+boolean CLinkLayer::Send (const CIPAddress &rReceiver, CNetBuffer *pIPPacket)
 {
-	unsigned nFrameLength = sizeof (TEthernetHeader) + nLength;	// may wrap
-	if (   nFrameLength <= sizeof (TEthernetHeader)
-	    || nFrameLength > FRAME_BUFFER_SIZE)
+	assert (pIPPacket != 0);
+	if (   pIPPacket->GetLength () == 0
+	    || pIPPacket->GetLength () > FRAME_BUFFER_SIZE - sizeof (TEthernetHeader))
 	{
+		pIPPacket->Release ();
+
 		return FALSE;
 	}
 
-	u8 FrameBuffer[nFrameLength];
-	TEthernetHeader *pHeader = (TEthernetHeader *) FrameBuffer;
+	TEthernetHeader *pHeader = (TEthernetHeader *) pIPPacket->Push (sizeof (TEthernetHeader));
 
 	assert (m_pNetDevLayer != 0);
 	const CMACAddress *pOwnMACAddress = m_pNetDevLayer->GetMACAddress ();
@@ -142,10 +151,6 @@ boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, un
 
 	pHeader->nProtocolType = BE (ETH_PROT_IP);
 
-	assert (pIPPacket != 0);
-	assert (nLength > 0);
-	memcpy (FrameBuffer+sizeof (TEthernetHeader), pIPPacket, nLength);
-
 	assert (m_pNetConfig != 0);
 	assert (m_pARPHandler != 0);
 	CMACAddress MACAddressReceiver;
@@ -154,26 +159,27 @@ boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, un
 	{
 		MACAddressReceiver.SetBroadcast ();
 	}
-	else if (!m_pARPHandler->Resolve (rReceiver, &MACAddressReceiver,
-					  FrameBuffer, nFrameLength))
+	else if (!m_pARPHandler->Resolve (rReceiver, &MACAddressReceiver, pIPPacket))
 	{
-		return TRUE;		// packet will be retransmitted by ARP handler
+		return TRUE;		// frame will be sent or returned by ARP handler
 	}
 
 	MACAddressReceiver.CopyTo (pHeader->MACReceiver);
 
-	m_pNetDevLayer->Send (FrameBuffer, nFrameLength);
+	m_pNetDevLayer->Send (pIPPacket);
 
 	return TRUE;
 }
 
-boolean CLinkLayer::Receive (void *pBuffer, unsigned *pResultLength)
+CNetBuffer *CLinkLayer::Receive (void)
 {
-	assert (pBuffer != 0);
-	assert (pResultLength != 0);
-	*pResultLength = m_IPRxQueue.Dequeue (pBuffer);
+	return m_IPRxQueue.Dequeue ();
+}
 
-	return *pResultLength != 0 ? TRUE : FALSE;
+u32 CLinkLayer::GetOffloadCapabilities (void) const
+{
+	assert (m_pNetDevLayer != 0);
+	return m_pNetDevLayer->GetOffloadCapabilities ();
 }
 
 boolean CLinkLayer::SendRaw (const void *pFrame, unsigned nLength)
@@ -188,24 +194,24 @@ boolean CLinkLayer::SendRaw (const void *pFrame, unsigned nLength)
 
 boolean CLinkLayer::ReceiveRaw (void *pBuffer, unsigned *pResultLength, CMACAddress *pSender)
 {
-	void *pParam;
-	assert (pBuffer != 0);
-	assert (pResultLength != 0);
-	*pResultLength = m_RawRxQueue.Dequeue (pBuffer, &pParam);
-	if (*pResultLength == 0)
+	CNetBuffer *pNetBuffer = m_RawRxQueue.Dequeue ();
+	if (pNetBuffer == 0)
 	{
 		return FALSE;
 	}
 
-	TRawPrivateData *pData = (TRawPrivateData *) pParam;
+	assert (pBuffer != 0);
+	assert (pResultLength != 0);
+	*pResultLength = pNetBuffer->GetLength ();
+	memcpy (pBuffer, pNetBuffer->GetData (), *pResultLength);
 
 	if (pSender != 0)
 	{
-		assert (pData != 0);
+		TRawPrivateData *pData = (TRawPrivateData *) pNetBuffer->GetPrivateData ();
 		pSender->Set (pData->MACSender);
 	}
 
-	delete pData;
+	pNetBuffer->Release ();
 
 	return TRUE;
 }
@@ -223,13 +229,16 @@ boolean CLinkLayer::EnableReceiveRaw (u16 nProtocolType)
 	return TRUE;
 }
 
-void CLinkLayer::ResolveFailed (const void *pReturnedFrame, unsigned nLength)
+void CLinkLayer::ResolveFailed (CNetBuffer *pReturnedFrame)
 {
 	assert (pReturnedFrame != 0);
-	assert (nLength > sizeof (TEthernetHeader));
+	assert (pReturnedFrame->GetLength () > sizeof (TEthernetHeader));
 	assert (m_pNetworkLayer != 0);
 
+	pReturnedFrame->Pull (sizeof (TEthernetHeader));
+
 	m_pNetworkLayer->SendFailed (ICMP_CODE_DEST_HOST_UNREACH,
-				     (const u8 *) pReturnedFrame + sizeof (TEthernetHeader),
-				     nLength - sizeof (TEthernetHeader));
+				     pReturnedFrame->GetData (), pReturnedFrame->GetLength ());
+
+	pReturnedFrame->Release ();
 }
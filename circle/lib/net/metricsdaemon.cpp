@@ -0,0 +1,78 @@
+//
+// metricsdaemon.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/metricsdaemon.h>
+#include <circle/metrics.h>
+#include <circle/util.h>
+#include <assert.h>
+
+CMetricsDaemon::CMetricsDaemon (CNetSubSystem *pNetSubSystem, CSocket *pSocket,
+				u16 nPort, unsigned nMaxContentSize)
+:	CHTTPDaemon (pNetSubSystem, pSocket, pSocket != 0 ? nMaxContentSize : 0, nPort),
+	m_nPort (nPort),
+	m_nMaxContentSize (nMaxContentSize)
+{
+}
+
+CMetricsDaemon::~CMetricsDaemon (void)
+{
+}
+
+CHTTPDaemon *CMetricsDaemon::CreateWorker (CNetSubSystem *pNetSubSystem, CSocket *pSocket)
+{
+	return new CMetricsDaemon (pNetSubSystem, pSocket, m_nPort, m_nMaxContentSize);
+}
+
+THTTPStatus CMetricsDaemon::GetContent (const char  *pPath,
+					const char  *pParams,
+					const char  *pFormData,
+					u8	    *pBuffer,
+					unsigned    *pLength,
+					const char **ppContentType)
+{
+	assert (pPath != 0);
+	assert (ppContentType != 0);
+
+	if (   strcmp (pPath, "/metrics") != 0
+	    && strcmp (pPath, "/") != 0)
+	{
+		return HTTPNotFound;
+	}
+
+	assert (pBuffer != 0);
+	assert (pLength != 0);
+	unsigned nLength = CMetric::FormatPrometheusAll ((char *) pBuffer, *pLength);
+	if (nLength == 0)
+	{
+		return HTTPInternalServerError;
+	}
+
+	*pLength = nLength;
+	*ppContentType = "text/plain; version=0.0.4";
+
+	return HTTPOK;
+}
+
+void CMetricsDaemon::WriteAccessLog (const CIPAddress	&rRemoteIP,
+				     THTTPRequestMethod	 RequestMethod,
+				     const char		*pRequestURI,
+				     THTTPStatus	 Status,
+				     unsigned		 nContentLength)
+{
+}
@@ -0,0 +1,233 @@
+//
+// netbuffer.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/netbuffer.h>
+#include <circle/net/checksumcalculator.h>
+#include <circle/alloc.h>
+#include <circle/metrics.h>
+#include <circle/macros.h>
+#include <assert.h>
+
+CNetBuffer *CNetBuffer::s_pFreeList = 0;
+unsigned CNetBuffer::s_nBuffers = 0;
+CSpinLock CNetBuffer::s_SpinLock (TASK_LEVEL);
+
+static CMetricGauge s_BuffersAllocated ("circle_net_buffers_allocated",
+					"Net buffers allocated from the heap for the pool");
+static CMetricGauge s_BuffersInUse ("circle_net_buffers_in_use",
+				    "Net buffers currently in use");
+static CMetricCounter s_AllocFailures ("circle_net_buffer_alloc_failures_total",
+				       "Net buffer allocations failed, because the pool limit was reached");
+
+CNetBuffer::CNetBuffer (void)
+:	m_pBuffer (m_Buffer),
+	m_nBufferSize (NET_BUFFER_SIZE),
+	m_pData (m_Buffer + NET_BUFFER_HEADROOM),
+	m_nLength (0),
+	m_nRefCount (1),
+	m_nOffloadFlags (0),
+	m_pChecksumStart (0),
+	m_nChecksumOffset (0),
+	m_pNext (0)
+{
+	assert (((uintptr) m_Buffer & (DATA_CACHE_LINE_LENGTH_MAX-1)) == 0);
+	assert (NET_BUFFER_HEADROOM % DATA_CACHE_LINE_LENGTH_MAX == 0);
+}
+
+CNetBuffer::CNetBuffer (unsigned nSize)
+:	m_pBuffer (m_Buffer),
+	m_nBufferSize (NET_BUFFER_SIZE),
+	m_nLength (0),
+	m_nRefCount (1),
+	m_nOffloadFlags (0),
+	m_pChecksumStart (0),
+	m_nChecksumOffset (0),
+	m_pNext (0)
+{
+	if (nSize > FRAME_BUFFER_SIZE)
+	{
+		m_nBufferSize = NET_BUFFER_HEADROOM + nSize;
+		m_pBuffer = new u8[m_nBufferSize];
+		assert (m_pBuffer != 0);
+	}
+
+	m_pData = m_pBuffer + NET_BUFFER_HEADROOM;
+}
+
+CNetBuffer::~CNetBuffer (void)
+{
+	if (m_pBuffer != m_Buffer)
+	{
+		delete [] m_pBuffer;
+	}
+
+	m_pBuffer = 0;
+}
+
+u8 *CNetBuffer::Push (unsigned nBytes)
+{
+	assert (nBytes <= GetHeadroom ());
+	m_pData -= nBytes;
+	m_nLength += nBytes;
+
+	return m_pData;
+}
+
+u8 *CNetBuffer::Pull (unsigned nBytes)
+{
+	assert (nBytes <= m_nLength);
+	m_pData += nBytes;
+	m_nLength -= nBytes;
+
+	return m_pData;
+}
+
+u8 *CNetBuffer::Put (unsigned nBytes)
+{
+	assert (nBytes <= GetTailroom ());
+	u8 *pTail = m_pData + m_nLength;
+	m_nLength += nBytes;
+
+	return pTail;
+}
+
+void CNetBuffer::Trim (unsigned nLength)
+{
+	assert (nLength <= m_nLength);
+	m_nLength = nLength;
+}
+
+void CNetBuffer::SetChecksumPartial (const void *pStart, const void *pChecksum, boolean bUDP)
+{
+	m_pChecksumStart = (const u8 *) pStart;
+	assert (m_pData <= m_pChecksumStart);
+	assert (m_pChecksumStart < m_pData + m_nLength);
+
+	m_nChecksumOffset = (const u8 *) pChecksum - m_pChecksumStart;
+	assert (m_pChecksumStart + m_nChecksumOffset + sizeof (u16) <= m_pData + m_nLength);
+
+	m_nOffloadFlags |= NET_FRAME_TX_CHECKSUM_PARTIAL;
+	if (bUDP)
+	{
+		m_nOffloadFlags |= NET_FRAME_TX_CHECKSUM_UDP;
+	}
+}
+
+void CNetBuffer::CompleteChecksum (void)
+{
+	assert (m_nOffloadFlags & NET_FRAME_TX_CHECKSUM_PARTIAL);
+
+	// the checksum field contains the pseudo header sum, which is included here
+	unsigned nStart = GetChecksumStart ();
+	assert (nStart < m_nLength);
+	u8 *pStart = m_pData + nStart;
+
+	u16 nChecksum = ~CChecksumCalculator::Sum (pStart, m_nLength - nStart);
+	if (   nChecksum == 0
+	    && (m_nOffloadFlags & NET_FRAME_TX_CHECKSUM_UDP))
+	{
+		nChecksum = 0xFFFF;		// 0 means "no checksum" for UDP
+	}
+
+	u16 *pChecksum = (u16 *) (pStart + m_nChecksumOffset);
+	*pChecksum = nChecksum;
+
+	m_nOffloadFlags &= ~(NET_FRAME_TX_CHECKSUM_PARTIAL | NET_FRAME_TX_CHECKSUM_UDP);
+}
+
+CNetBuffer *CNetBuffer::AddRef (void)
+{
+	assert (m_nRefCount > 0);
+	m_nRefCount++;
+
+	return this;
+}
+
+void CNetBuffer::Release (void)
+{
+	assert (m_nRefCount > 0);
+	if (--m_nRefCount == 0)
+	{
+		delete this;
+	}
+}
+
+void *CNetBuffer::operator new (size_t nSize) noexcept
+{
+	assert (nSize == sizeof (CNetBuffer));
+
+	s_SpinLock.Acquire ();
+
+	CNetBuffer *pBuffer = s_pFreeList;
+	if (pBuffer != 0)
+	{
+		s_pFreeList = pBuffer->m_pNext;
+
+		s_SpinLock.Release ();
+	}
+	else
+	{
+		if (s_nBuffers >= NET_BUFFER_MAX)
+		{
+			s_SpinLock.Release ();
+
+			s_AllocFailures.Inc ();
+
+			return 0;
+		}
+
+		s_nBuffers++;
+
+		s_SpinLock.Release ();
+
+		pBuffer = (CNetBuffer *) memalign (DATA_CACHE_LINE_LENGTH_MAX, sizeof (CNetBuffer));
+		if (pBuffer == 0)
+		{
+			s_SpinLock.Acquire ();
+			s_nBuffers--;
+			s_SpinLock.Release ();
+
+			s_AllocFailures.Inc ();
+
+			return 0;
+		}
+
+		s_BuffersAllocated.Add (1);
+	}
+
+	s_BuffersInUse.Add (1);
+
+	return pBuffer;
+}
+
+void CNetBuffer::operator delete (void *pBlock, size_t nSize)
+{
+	assert (pBlock != 0);
+	assert (nSize == sizeof (CNetBuffer));
+	CNetBuffer *pBuffer = (CNetBuffer *) pBlock;
+
+	s_BuffersInUse.Sub (1);
+
+	s_SpinLock.Acquire ();
+
+	pBuffer->m_pNext = s_pFreeList;
+	s_pFreeList = pBuffer;
+
+	s_SpinLock.Release ();
+}
@@ -2,7 +2,7 @@
 // netconnection.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -32,7 +32,13 @@ CNetConnection::CNetConnection (CNetConfig	*pNetConfig,
 	m_nForeignPort (nForeignPort),
 	m_nOwnPort (nOwnPort),
 	m_nProtocol (nProtocol),
-	m_Checksum (*pNetConfig->GetIPAddress (), rForeignIP, nProtocol)
+	m_Checksum (*pNetConfig->GetIPAddress (), rForeignIP, nProtocol),
+	m_pEventHandler (0),
+	m_pEventParam (0),
+	m_bHashed (FALSE),
+	m_nHashedIP (0),
+	m_nHashedPort (0),
+	m_pNextOnPort (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
@@ -46,7 +52,14 @@ CNetConnection::CNetConnection (CNetConfig	*pNetConfig,
 	m_pNetworkLayer (pNetworkLayer),
 	m_nForeignPort (0),
 	m_nOwnPort (nOwnPort),
-	m_Checksum (*pNetConfig->GetIPAddress (), nProtocol)
+	m_nProtocol (nProtocol),
+	m_Checksum (*pNetConfig->GetIPAddress (), nProtocol),
+	m_pEventHandler (0),
+	m_pEventParam (0),
+	m_bHashed (FALSE),
+	m_nHashedIP (0),
+	m_nHashedPort (0),
+	m_pNextOnPort (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
@@ -73,3 +86,9 @@ int CNetConnection::GetProtocol (void) const
 {
 	return m_nProtocol;
 }
+
+void CNetConnection::SetEventHandler (TNetEventHandler *pHandler, void *pParam)
+{
+	m_pEventHandler = pHandler;
+	m_pEventParam = pParam;
+}
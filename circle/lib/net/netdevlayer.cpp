@@ -2,7 +2,7 @@
 // netdevlayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/timer.h>
 #include <circle/synchronize.h>
 #include <circle/macros.h>
+#include <circle/util.h>
 #include <assert.h>
 
 const char FromNetDev[] = "netdev";
@@ -101,12 +102,46 @@ void CNetDeviceLayer::Process (void)
 		new CPHYTask (m_pDevice);
 	}
 
-	DMA_BUFFER (u8, Buffer, FRAME_BUFFER_SIZE);
-	unsigned nLength;
+	CNetBuffer *pBuffer;
 	while (   m_pDevice->IsSendFrameAdvisable ()
-	       && (nLength = m_TxQueue.Dequeue (Buffer)) > 0)
+	       && (pBuffer = m_TxQueue.Dequeue ()) != 0)
 	{
-		if (!m_pDevice->SendFrame (Buffer, nLength))
+		TNetFrameInfo Info;
+		Info.nFlags = pBuffer->GetOffloadFlags ()
+			      & (NET_FRAME_TX_CHECKSUM_PARTIAL | NET_FRAME_TX_CHECKSUM_UDP);
+		if (Info.nFlags & NET_FRAME_TX_CHECKSUM_PARTIAL)
+		{
+			if (m_pDevice->GetOffloadCapabilities () & NET_OFFLOAD_TX_CHECKSUM)
+			{
+				Info.nChecksumStart = pBuffer->GetChecksumStart ();
+				Info.nChecksumOffset = pBuffer->GetChecksumOffset ();
+			}
+			else
+			{
+				pBuffer->CompleteChecksum ();
+
+				Info.nFlags = 0;
+			}
+		}
+
+		boolean bOK;
+		if (((uintptr) pBuffer->GetData () & (DATA_CACHE_LINE_LENGTH_MAX-1)) == 0)
+		{
+			bOK = m_pDevice->SendFrame (pBuffer->GetData (), pBuffer->GetLength (), Info);
+		}
+		else
+		{
+			// some devices use the frame for DMA directly
+			DMA_BUFFER (u8, Buffer, FRAME_BUFFER_SIZE);
+			assert (pBuffer->GetLength () <= FRAME_BUFFER_SIZE);
+			memcpy (Buffer, pBuffer->GetData (), pBuffer->GetLength ());
+
+			bOK = m_pDevice->SendFrame (Buffer, pBuffer->GetLength (), Info);
+		}
+
+		pBuffer->Release ();
+
+		if (!bOK)
 		{
 			CLogger::Get ()->Write (FromNetDev, LogWarning, "Frame dropped");
 
@@ -114,10 +149,29 @@ void CNetDeviceLayer::Process (void)
 		}
 	}
 
-	while (m_pDevice->ReceiveFrame (Buffer, &nLength))
+	// frames are received directly into the data area of a net buffer,
+	// which is DMA aligned and has room for FRAME_BUFFER_SIZE bytes
+	while ((pBuffer = new CNetBuffer) != 0)
 	{
+		assert (pBuffer->GetTailroom () >= FRAME_BUFFER_SIZE);
+
+		unsigned nLength;
+		TNetFrameInfo Info;
+		if (!m_pDevice->ReceiveFrame (pBuffer->GetData (), &nLength, &Info))
+		{
+			pBuffer->Release ();
+
+			break;
+		}
+
 		assert (nLength > 0);
-		m_RxQueue.Enqueue (Buffer, nLength);
+		assert (nLength <= FRAME_BUFFER_SIZE);
+		pBuffer->Put (nLength);
+
+		pBuffer->SetOffloadFlags (Info.nFlags & (  NET_FRAME_RX_IP_CHECKSUM_OK
+							 | NET_FRAME_RX_L4_CHECKSUM_OK));
+
+		m_RxQueue.Enqueue (pBuffer);
 	}
 }
 
@@ -131,23 +185,29 @@ const CMACAddress *CNetDeviceLayer::GetMACAddress (void) const
 	return m_pDevice->GetMACAddress ();
 }
 
-void CNetDeviceLayer::Send (const void *pBuffer, unsigned nLength)
+u32 CNetDeviceLayer::GetOffloadCapabilities (void) const
 {
-	m_TxQueue.Enqueue (pBuffer, nLength);
+	if (m_pDevice == 0)
+	{
+		return 0;
+	}
+
+	return m_pDevice->GetOffloadCapabilities ();
 }
 
-boolean CNetDeviceLayer::Receive (void *pBuffer, unsigned *pResultLength)
+void CNetDeviceLayer::Send (CNetBuffer *pBuffer)
 {
-	unsigned nLength = m_RxQueue.Dequeue (pBuffer);
-	if (nLength == 0)
-	{
-		return FALSE;
-	}
+	m_TxQueue.Enqueue (pBuffer);
+}
 
-	assert (pResultLength != 0);
-	*pResultLength = nLength;
+void CNetDeviceLayer::Send (const void *pBuffer, unsigned nLength)
+{
+	m_TxQueue.Enqueue (pBuffer, nLength);
+}
 
-	return TRUE;
+CNetBuffer *CNetDeviceLayer::Receive (void)
+{
+	return m_RxQueue.Dequeue ();
 }
 
 boolean CNetDeviceLayer::IsRunning (void) const
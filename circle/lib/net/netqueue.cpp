@@ -2,7 +2,7 @@
 // netqueue.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,19 +18,9 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/netqueue.h>
-#include <circle/netdevice.h>
 #include <circle/util.h>
 #include <assert.h>
 
-struct TNetQueueEntry
-{
-	volatile TNetQueueEntry *pPrev;
-	volatile TNetQueueEntry *pNext;
-	unsigned		 nLength;
-	unsigned char		 Buffer[FRAME_BUFFER_SIZE];
-	void			*pParam;
-};
-
 CNetQueue::CNetQueue (void)
 :	m_pFirst (0),
 	m_pLast (0),
@@ -50,101 +40,110 @@ boolean CNetQueue::IsEmpty (void) const
 
 void CNetQueue::Flush (void)
 {
-	while (m_pFirst != 0)
+	CNetBuffer *pBuffer;
+	while ((pBuffer = Dequeue ()) != 0)
 	{
-		m_SpinLock.Acquire ();
-
-		volatile TNetQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
-
-		m_pFirst = pEntry->pNext;
-		if (m_pFirst != 0)
-		{
-			m_pFirst->pPrev = 0;
-		}
-		else
-		{
-			assert (m_pLast == pEntry);
-			m_pLast = 0;
-		}
-
-		m_SpinLock.Release ();
-
-		delete pEntry;
+		pBuffer->Release ();
 	}
 }
-	
-void CNetQueue::Enqueue (const void *pBuffer, unsigned nLength, void *pParam)
-{
-	TNetQueueEntry *pEntry = new TNetQueueEntry;
-	assert (pEntry != 0);
-
-	assert (nLength > 0);
-	assert (nLength <= FRAME_BUFFER_SIZE);
-	pEntry->nLength = nLength;
 
+void CNetQueue::Enqueue (CNetBuffer *pBuffer)
+{
 	assert (pBuffer != 0);
-	memcpy (pEntry->Buffer, pBuffer, nLength);
-
-	pEntry->pParam = pParam;
+	assert (pBuffer->GetLength () > 0);
+	pBuffer->m_pNext = 0;
 
 	m_SpinLock.Acquire ();
 
-	pEntry->pPrev = m_pLast;
-	pEntry->pNext = 0;
-
 	if (m_pFirst == 0)
 	{
-		m_pFirst = pEntry;
+		m_pFirst = pBuffer;
 	}
 	else
 	{
 		assert (m_pLast != 0);
-		assert (m_pLast->pNext == 0);
-		m_pLast->pNext = pEntry;
+		assert (m_pLast->m_pNext == 0);
+		m_pLast->m_pNext = pBuffer;
 	}
-	m_pLast = pEntry;
+	m_pLast = pBuffer;
 
 	m_SpinLock.Release ();
 }
 
-unsigned CNetQueue::Dequeue (void *pBuffer, void **ppParam)
+CNetBuffer *CNetQueue::Dequeue (void)
 {
-	unsigned nResult = 0;
-	
-	if (m_pFirst != 0)
+	if (m_pFirst == 0)
 	{
-		m_SpinLock.Acquire ();
+		return 0;
+	}
 
-		volatile TNetQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
+	m_SpinLock.Acquire ();
 
-		m_pFirst = pEntry->pNext;
-		if (m_pFirst != 0)
-		{
-			m_pFirst->pPrev = 0;
-		}
-		else
+	CNetBuffer *pBuffer = m_pFirst;
+	if (pBuffer != 0)
+	{
+		m_pFirst = pBuffer->m_pNext;
+		if (m_pFirst == 0)
 		{
-			assert (m_pLast == pEntry);
+			assert (m_pLast == pBuffer);
 			m_pLast = 0;
 		}
 
-		m_SpinLock.Release ();
+		pBuffer->m_pNext = 0;
+	}
 
-		nResult = pEntry->nLength;
-		assert (nResult > 0);
-		assert (nResult <= FRAME_BUFFER_SIZE);
+	m_SpinLock.Release ();
 
-		memcpy (pBuffer, (const void *) pEntry->Buffer, nResult);
+	return pBuffer;
+}
 
-		if (ppParam != 0)
-		{
-			*ppParam = pEntry->pParam;
-		}
+CNetBuffer *CNetQueue::Peek (void) const
+{
+	return m_pFirst;
+}
 
-		delete pEntry;
+boolean CNetQueue::Enqueue (const void *pBuffer, unsigned nLength)
+{
+	assert (nLength > 0);
+	if (nLength > FRAME_BUFFER_SIZE)
+	{
+		return FALSE;
 	}
 
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	if (pNetBuffer == 0)
+	{
+		return FALSE;
+	}
+
+	assert (pBuffer != 0);
+	memcpy (pNetBuffer->Put (nLength), pBuffer, nLength);
+
+	Enqueue (pNetBuffer);
+
+	return TRUE;
+}
+
+unsigned CNetQueue::Dequeue (void *pBuffer, unsigned nBufferSize)
+{
+	CNetBuffer *pNetBuffer = Dequeue ();
+	if (pNetBuffer == 0)
+	{
+		return 0;
+	}
+
+	// zero-copy entries may be larger than one frame
+	unsigned nResult = pNetBuffer->GetLength ();
+	assert (nResult > 0);
+	if (nResult > nBufferSize)
+	{
+		nResult = nBufferSize;
+	}
+
+	assert (pBuffer != 0);
+	memcpy (pBuffer, pNetBuffer->GetData (), nResult);
+
+	pNetBuffer->Release ();
+
 	return nResult;
 }
@@ -2,7 +2,7 @@
 // networklayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -26,7 +26,8 @@
 CNetworkLayer::CNetworkLayer (CNetConfig *pNetConfig, CLinkLayer *pLinkLayer)
 :	m_pNetConfig (pNetConfig),
 	m_pLinkLayer (pLinkLayer),
-	m_pICMPHandler (0)
+	m_pICMPHandler (0),
+	m_nIdentification (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pLinkLayer != 0);
@@ -56,32 +57,41 @@ void CNetworkLayer::Process (void)
 	const CIPAddress *pOwnIPAddress = m_pNetConfig->GetIPAddress ();
 	assert (pOwnIPAddress != 0);
 
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	unsigned nResultLength;
+	CNetBuffer *pBuffer;
 	assert (m_pLinkLayer != 0);
-	while (m_pLinkLayer->Receive (Buffer, &nResultLength))
+	while ((pBuffer = m_pLinkLayer->Receive ()) != 0)
 	{
+		unsigned nResultLength = pBuffer->GetLength ();
 		if (nResultLength <= sizeof (TIPHeader))
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
-		TIPHeader *pHeader = (TIPHeader *) Buffer;
+		TIPHeader *pHeader = (TIPHeader *) pBuffer->GetData ();
 
 		unsigned nHeaderLength = pHeader->nVersionIHL & 0xF;
 		if (   nHeaderLength < IP_HEADER_LENGTH_DWORD_MIN
 		    || nHeaderLength > IP_HEADER_LENGTH_DWORD_MAX)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 		nHeaderLength *= 4;
 		if (nResultLength <= nHeaderLength)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
-		if (   CChecksumCalculator::SimpleCalculate (pHeader, nHeaderLength) != CHECKSUM_OK
+		if (   (   !(pBuffer->GetOffloadFlags () & NET_FRAME_RX_IP_CHECKSUM_OK)
+			&& CChecksumCalculator::SimpleCalculate (pHeader, nHeaderLength) != CHECKSUM_OK)
 		    || (pHeader->nVersionIHL >> 4) != IP_VERSION)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
 
@@ -92,6 +102,8 @@ void CNetworkLayer::Process (void)
 			    && !IPAddressDestination.IsBroadcast ()
 			    && *m_pNetConfig->GetBroadcastAddress () != IPAddressDestination)
 			{
+				pBuffer->Release ();
+
 				continue;
 			}
 		}
@@ -99,63 +111,80 @@ void CNetworkLayer::Process (void)
 		{
 			if (!IPAddressDestination.IsBroadcast ())
 			{
+				pBuffer->Release ();
+
 				continue;
 			}
 		}
 
-		if (   (pHeader->nFlagsFragmentOffset & IP_FLAGS_MF)
-		    ||    IP_FRAGMENT_OFFSET (le2be16 (pHeader->nFlagsFragmentOffset))
-		       != IP_FRAGMENT_OFFSET_FIRST)
+		unsigned nTotalLength = le2be16 (pHeader->nTotalLength);
+		if (   nResultLength < nTotalLength
+		    || nTotalLength <= nHeaderLength)
 		{
+			pBuffer->Release ();
+
 			continue;
 		}
-		
-		unsigned nTotalLength = le2be16 (pHeader->nTotalLength);
-		if (nResultLength < nTotalLength)
+		pBuffer->Trim (nTotalLength);		// ignore padding
+
+		if (   (pHeader->nFlagsFragmentOffset & IP_FLAGS_MF)
+		    ||    IP_FRAGMENT_OFFSET (le2be16 (pHeader->nFlagsFragmentOffset))
+		       != IP_FRAGMENT_OFFSET_FIRST)
 		{
-			continue;
+			pBuffer = m_Reassembler.AddFragment (pBuffer);
+			if (pBuffer == 0)
+			{
+				continue;		// datagram not complete yet
+			}
+
+			pHeader = (TIPHeader *) pBuffer->GetData ();
+			nHeaderLength = (pHeader->nVersionIHL & 0xF) * 4;
 		}
-		nResultLength = nTotalLength;		// ignore padding
 
-		TNetworkPrivateData *pParam = new TNetworkPrivateData;
-		assert (pParam != 0);
-		pParam->nProtocol = pHeader->nProtocol;
-		memcpy (pParam->SourceAddress, pHeader->SourceAddress, IP_ADDRESS_SIZE);
-		memcpy (pParam->DestinationAddress, pHeader->DestinationAddress, IP_ADDRESS_SIZE);
+		assert (sizeof (TNetworkPrivateData) <= NET_BUFFER_PRIVATE_SIZE);
+		TNetworkPrivateData *pData = (TNetworkPrivateData *) pBuffer->GetPrivateData ();
+		pData->nProtocol = pHeader->nProtocol;
+		memcpy (pData->SourceAddress, pHeader->SourceAddress, IP_ADDRESS_SIZE);
+		memcpy (pData->DestinationAddress, pHeader->DestinationAddress, IP_ADDRESS_SIZE);
 
-		nResultLength -= nHeaderLength;
+		// the header remains valid in the headroom
+		pBuffer->Pull (nHeaderLength);
 
 		if (pHeader->nProtocol == IPPROTO_ICMP)
 		{
-			m_ICMPRxQueue.Enqueue (Buffer+nHeaderLength, nResultLength, pParam);
+			m_ICMPRxQueue.Enqueue (pBuffer);
 		}
 		else
 		{
-			m_RxQueue.Enqueue (Buffer+nHeaderLength, nResultLength, pParam);
+			m_RxQueue.Enqueue (pBuffer);
 		}
 	}
 
+	m_Reassembler.Process ();
+
 	assert (m_pICMPHandler != 0);
 	m_pICMPHandler->Process ();
 }
 
-boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, unsigned nLength, int nProtocol)
+boolean CNetworkLayer::Send (const CIPAddress &rReceiver, CNetBuffer *pPacket, int nProtocol)
 {
-	unsigned nPacketLength = sizeof (TIPHeader) + nLength;		// may wrap
+	assert (pPacket != 0);
+	unsigned nPacketLength = sizeof (TIPHeader) + pPacket->GetLength ();
 	if (   nPacketLength <= sizeof (TIPHeader)
-	    || nPacketLength > FRAME_BUFFER_SIZE)
+	    || nPacketLength > IP_PACKET_SIZE_MAX)
 	{
+		pPacket->Release ();
+
 		return FALSE;
 	}
 
-	u8 PacketBuffer[nPacketLength];
-	TIPHeader *pHeader = (TIPHeader *) PacketBuffer;
+	TIPHeader *pHeader = (TIPHeader *) pPacket->Push (sizeof (TIPHeader));
 
 	pHeader->nVersionIHL          = IP_VERSION << 4 | IP_HEADER_LENGTH_DWORD_MIN;
 	pHeader->nTypeOfService       = IP_TOS_ROUTINE;
 	pHeader->nTotalLength         = le2be16 ((u16) nPacketLength);
-	pHeader->nIdentification      = BE (IP_IDENTIFICATION_DEFAULT);
-	pHeader->nFlagsFragmentOffset = IP_FLAGS_DF | BE (IP_FRAGMENT_OFFSET_FIRST);
+	pHeader->nIdentification      = le2be16 (m_nIdentification++);
+	pHeader->nFlagsFragmentOffset = BE (IP_FRAGMENT_OFFSET_FIRST);
 	pHeader->nTTL                 = IP_TTL_DEFAULT;
 	pHeader->nProtocol            = (u8) nProtocol;
 
@@ -167,17 +196,24 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 
 	rReceiver.CopyTo (pHeader->DestinationAddress);
 
+	// TCP segments are sized to the path MTU and can use path MTU discovery (RFC 1191),
+	// all other packets may be fragmented by routers on the way
+	unsigned nMTU = GetPathMTU (rReceiver);
+	if (   nProtocol == IPPROTO_TCP
+	    && nPacketLength <= nMTU)
+	{
+		pHeader->nFlagsFragmentOffset |= IP_FLAGS_DF;
+	}
+
 	pHeader->nHeaderChecksum = 0;
 	pHeader->nHeaderChecksum = CChecksumCalculator::SimpleCalculate (pHeader, sizeof (TIPHeader));
 
-	assert (pPacket != 0);
-	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TIPHeader), pPacket, nLength);
-
 	if (   pOwnIPAddress->IsNull ()
 	    && !rReceiver.IsBroadcast ())
 	{
-		SendFailed (ICMP_CODE_DEST_NET_UNREACH, PacketBuffer, nPacketLength);
+		SendFailed (ICMP_CODE_DEST_NET_UNREACH, pHeader, nPacketLength);
+
+		pPacket->Release ();
 
 		return FALSE;
 	}
@@ -198,32 +234,54 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 			pNextHop = m_pNetConfig->GetDefaultGateway ();
 			if (pNextHop->IsNull ())
 			{
-				SendFailed (ICMP_CODE_DEST_NET_UNREACH, PacketBuffer, nPacketLength);
+				SendFailed (ICMP_CODE_DEST_NET_UNREACH, pHeader, nPacketLength);
+
+				pPacket->Release ();
 
 				return FALSE;
 			}
 		}
 	}
 	
-	assert (m_pLinkLayer != 0);
 	assert (pNextHop != 0);
-	return m_pLinkLayer->Send (*pNextHop, PacketBuffer, nPacketLength);
+	if (nPacketLength > nMTU)
+	{
+		return SendFragments (*pNextHop, pPacket, nMTU);
+	}
+
+	assert (m_pLinkLayer != 0);
+	return m_pLinkLayer->Send (*pNextHop, pPacket);
 }
 
-boolean CNetworkLayer::Receive (void *pBuffer, unsigned *pResultLength,
-				CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol)
+boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, unsigned nLength, int nProtocol)
 {
-	void *pParam;
-	assert (pBuffer != 0);
-	assert (pResultLength != 0);
-	*pResultLength = m_RxQueue.Dequeue (pBuffer, &pParam);
-	if (*pResultLength == 0)
+	if (   nLength == 0
+	    || nLength > IP_PACKET_SIZE_MAX - sizeof (TIPHeader))
+	{
+		return FALSE;
+	}
+
+	CNetBuffer *pBuffer = new CNetBuffer (nLength);
+	if (pBuffer == 0)
 	{
 		return FALSE;
 	}
+
+	assert (pPacket != 0);
+	memcpy (pBuffer->Put (nLength), pPacket, nLength);
+
+	return Send (rReceiver, pBuffer, nProtocol);
+}
+
+CNetBuffer *CNetworkLayer::Receive (CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol)
+{
+	CNetBuffer *pBuffer = m_RxQueue.Dequeue ();
+	if (pBuffer == 0)
+	{
+		return 0;
+	}
 	
-	TNetworkPrivateData *pData = (TNetworkPrivateData *) pParam;
-	assert (pData != 0);
+	TNetworkPrivateData *pData = (TNetworkPrivateData *) pBuffer->GetPrivateData ();
 
 	assert (pProtocol != 0);
 	*pProtocol = pData->nProtocol;
@@ -234,10 +292,25 @@ boolean CNetworkLayer::Receive (void *pBuffer, unsigned *pResultLength,
 	assert (pReceiver != 0);
 	pReceiver->Set (pData->DestinationAddress);
 
-	delete pData;
-	pData = 0;
-	
-	return TRUE;
+	return pBuffer;
+}
+
+u32 CNetworkLayer::GetOffloadCapabilities (void) const
+{
+	assert (m_pLinkLayer != 0);
+	return m_pLinkLayer->GetOffloadCapabilities ();
+}
+
+unsigned CNetworkLayer::GetPathMTU (const CIPAddress &rReceiver) const
+{
+	unsigned nMTU = m_RouteCache.GetMTU (rReceiver.Get ());
+	if (   nMTU == 0
+	    || nMTU > IP_MTU_DEFAULT)
+	{
+		nMTU = IP_MTU_DEFAULT;
+	}
+
+	return nMTU;
 }
 
 boolean CNetworkLayer::ReceiveNotification (TICMPNotificationType *pType,
@@ -246,7 +319,7 @@ boolean CNetworkLayer::ReceiveNotification (TICMPNotificationType *pType,
 					    int *pProtocol)
 {
 	TICMPNotification Notification;
-	unsigned nLength = m_ICMPNotificationQueue.Dequeue (&Notification);
+	unsigned nLength = m_ICMPNotificationQueue.Dequeue (&Notification, sizeof Notification);
 	if (nLength == 0)
 	{
 		return FALSE;
@@ -279,6 +352,22 @@ void CNetworkLayer::AddRoute (const u8 *pDestIP, const u8 *pGatewayIP)
 	m_RouteCache.AddRoute (pDestIP, pGatewayIP);
 }
 
+void CNetworkLayer::SetPathMTU (const u8 *pDestIP, unsigned nMTU)
+{
+	if (nMTU < IP_MTU_MIN)
+	{
+		nMTU = IP_MTU_MIN;
+	}
+
+	// the path MTU can only be reduced here, it is increased again, when the entry expires
+	unsigned nOldMTU = m_RouteCache.GetMTU (pDestIP);
+	if (   nOldMTU == 0
+	    || nMTU < nOldMTU)
+	{
+		m_RouteCache.SetMTU (pDestIP, nMTU);
+	}
+}
+
 const u8 *CNetworkLayer::GetGateway (const u8 *pDestIP) const
 {
 	const u8 *pGateway = m_RouteCache.GetRoute (pDestIP);
@@ -299,3 +388,65 @@ void CNetworkLayer::SendFailed (unsigned nICMPCode, const void *pReturnedPacket,
 	assert (m_pICMPHandler != 0);
 	m_pICMPHandler->DestinationUnreachable (nICMPCode, pReturnedPacket, nLength);
 }
+
+boolean CNetworkLayer::SendFragments (const CIPAddress &rNextHop, CNetBuffer *pPacket, unsigned nMTU)
+{
+	assert (pPacket != 0);
+	if (pPacket->GetOffloadFlags () & NET_FRAME_TX_CHECKSUM_PARTIAL)
+	{
+		pPacket->CompleteChecksum ();	// the device cannot calculate it over fragments
+	}
+
+	const TIPHeader *pHeader = (const TIPHeader *) pPacket->GetData ();
+	assert (pHeader->nVersionIHL == (IP_VERSION << 4 | IP_HEADER_LENGTH_DWORD_MIN));
+	assert (!(pHeader->nFlagsFragmentOffset & IP_FLAGS_DF));
+	const u8 *pPayload = (const u8 *) pHeader + sizeof (TIPHeader);
+	unsigned nPayloadLength = pPacket->GetLength () - sizeof (TIPHeader);
+
+	// all fragments but the last must contain a multiple of 8 bytes
+	assert (nMTU >= IP_MTU_MIN);
+	unsigned nFragmentSize = (nMTU - sizeof (TIPHeader)) & ~7;
+
+	boolean bResult = TRUE;
+	for (unsigned nOffset = 0; nOffset < nPayloadLength; nOffset += nFragmentSize)
+	{
+		unsigned nLength = nPayloadLength - nOffset;
+		u16 nFlagsFragmentOffset = le2be16 (nOffset / 8);
+		if (nLength > nFragmentSize)
+		{
+			nLength = nFragmentSize;
+			nFlagsFragmentOffset |= IP_FLAGS_MF;
+		}
+
+		CNetBuffer *pFragment = new CNetBuffer;
+		if (pFragment == 0)
+		{
+			bResult = FALSE;
+
+			break;
+		}
+
+		TIPHeader *pFragmentHeader =
+			(TIPHeader *) pFragment->Put (sizeof (TIPHeader) + nLength);
+		memcpy (pFragmentHeader, pHeader, sizeof (TIPHeader));
+		memcpy ((u8 *) pFragmentHeader + sizeof (TIPHeader), pPayload + nOffset, nLength);
+
+		pFragmentHeader->nTotalLength = le2be16 ((u16) (sizeof (TIPHeader) + nLength));
+		pFragmentHeader->nFlagsFragmentOffset = nFlagsFragmentOffset;
+		pFragmentHeader->nHeaderChecksum = 0;
+		pFragmentHeader->nHeaderChecksum =
+			CChecksumCalculator::SimpleCalculate (pFragmentHeader, sizeof (TIPHeader));
+
+		assert (m_pLinkLayer != 0);
+		if (!m_pLinkLayer->Send (rNextHop, pFragment))
+		{
+			bResult = FALSE;
+
+			break;
+		}
+	}
+
+	pPacket->Release ();
+
+	return bResult;
+}
@@ -0,0 +1,242 @@
+//
+// outoforderqueue.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/outoforderqueue.h>
+#include <assert.h>
+
+// Modulo 32 sequence number arithmetic
+#define lt(x, y)		((int) ((u32) (x) - (u32) (y)) < 0)
+#define le(x, y)		((int) ((u32) (x) - (u32) (y)) <= 0)
+#define gt(x, y) 		lt (y, x)
+
+COutOfOrderQueue::COutOfOrderQueue (void)
+:	m_nSegments (0),
+	m_nLastSequenceNumber (0)
+{
+}
+
+COutOfOrderQueue::~COutOfOrderQueue (void)
+{
+	Flush ();
+}
+
+boolean COutOfOrderQueue::IsEmpty (void) const
+{
+	return m_nSegments == 0 ? TRUE : FALSE;
+}
+
+void COutOfOrderQueue::Insert (u32 nSequenceNumber, CNetBuffer *pBuffer)
+{
+	assert (pBuffer != 0);
+	u32 nEnd = nSequenceNumber + pBuffer->GetLength ();
+
+	unsigned nIndex = 0;
+	while (   nIndex < m_nSegments
+	       && le (m_Segment[nIndex].nSequenceNumber, nSequenceNumber))
+	{
+		nIndex++;
+	}
+
+	// ignore duplicate, which is completely covered by its predecessor
+	if (nIndex > 0)
+	{
+		const TSegment *pPrev = &m_Segment[nIndex-1];
+		if (le (nEnd, pPrev->nSequenceNumber + pPrev->pBuffer->GetLength ()))
+		{
+			pBuffer->Release ();
+
+			return;
+		}
+	}
+
+	if (m_nSegments == OOO_QUEUE_SIZE)
+	{
+		// segments with lower sequence numbers are more valuable
+		if (nIndex == OOO_QUEUE_SIZE)
+		{
+			pBuffer->Release ();
+
+			return;
+		}
+
+		Delete (m_nSegments-1);
+	}
+
+	for (unsigned i = m_nSegments; i > nIndex; i--)
+	{
+		m_Segment[i] = m_Segment[i-1];
+	}
+
+	m_Segment[nIndex].nSequenceNumber = nSequenceNumber;
+	m_Segment[nIndex].pBuffer = pBuffer;
+	m_nSegments++;
+
+	m_nLastSequenceNumber = nSequenceNumber;
+}
+
+CNetBuffer *COutOfOrderQueue::Remove (u32 nSequenceNumber)
+{
+	while (m_nSegments > 0)
+	{
+		TSegment *pFirst = &m_Segment[0];
+		if (gt (pFirst->nSequenceNumber, nSequenceNumber))
+		{
+			break;
+		}
+
+		CNetBuffer *pBuffer = pFirst->pBuffer;
+		assert (pBuffer != 0);
+
+		u32 nEnd = pFirst->nSequenceNumber + pBuffer->GetLength ();
+		if (le (nEnd, nSequenceNumber))
+		{
+			Delete (0);		// data has been received already
+
+			continue;
+		}
+
+		pBuffer->Pull (nSequenceNumber - pFirst->nSequenceNumber);
+
+		for (unsigned i = 1; i < m_nSegments; i++)
+		{
+			m_Segment[i-1] = m_Segment[i];
+		}
+		m_nSegments--;
+
+		return pBuffer;
+	}
+
+	return 0;
+}
+
+unsigned COutOfOrderQueue::GetSACKBlocks (u32 *pLeftEdge, u32 *pRightEdge,
+					  unsigned nMaxBlocks) const
+{
+	assert (pLeftEdge != 0);
+	assert (pRightEdge != 0);
+
+	if (nMaxBlocks == 0)
+	{
+		return 0;
+	}
+
+	// find the first block
+	unsigned nFirstIndex = 0;
+	unsigned nIndex = 0;
+	while (nIndex < m_nSegments)
+	{
+		u32 nLeftEdge, nRightEdge;
+		unsigned nNextIndex = GetBlock (nIndex, &nLeftEdge, &nRightEdge);
+
+		if (   le (nLeftEdge, m_nLastSequenceNumber)
+		    && lt (m_nLastSequenceNumber, nRightEdge))
+		{
+			pLeftEdge[0] = nLeftEdge;
+			pRightEdge[0] = nRightEdge;
+			nFirstIndex = nIndex;
+
+			break;
+		}
+
+		nIndex = nNextIndex;
+	}
+
+	if (nIndex >= m_nSegments)
+	{
+		if (m_nSegments == 0)
+		{
+			return 0;
+		}
+
+		// the block with the last received segment has been removed already,
+		// the lowest block is reported first then
+		GetBlock (0, &pLeftEdge[0], &pRightEdge[0]);
+		nFirstIndex = 0;
+	}
+
+	// append the other blocks
+	unsigned nBlocks = 1;
+	for (nIndex = 0; nIndex < m_nSegments && nBlocks < nMaxBlocks; )
+	{
+		u32 nLeftEdge, nRightEdge;
+		unsigned nNextIndex = GetBlock (nIndex, &nLeftEdge, &nRightEdge);
+
+		if (nIndex != nFirstIndex)
+		{
+			pLeftEdge[nBlocks] = nLeftEdge;
+			pRightEdge[nBlocks] = nRightEdge;
+			nBlocks++;
+		}
+
+		nIndex = nNextIndex;
+	}
+
+	return nBlocks;
+}
+
+void COutOfOrderQueue::Flush (void)
+{
+	while (m_nSegments > 0)
+	{
+		Delete (m_nSegments-1);
+	}
+}
+
+unsigned COutOfOrderQueue::GetBlock (unsigned nIndex, u32 *pLeftEdge, u32 *pRightEdge) const
+{
+	assert (nIndex < m_nSegments);
+	u32 nLeftEdge = m_Segment[nIndex].nSequenceNumber;
+	u32 nRightEdge = nLeftEdge + m_Segment[nIndex].pBuffer->GetLength ();
+
+	for (nIndex++; nIndex < m_nSegments; nIndex++)
+	{
+		const TSegment *pSegment = &m_Segment[nIndex];
+		if (gt (pSegment->nSequenceNumber, nRightEdge))
+		{
+			break;
+		}
+
+		u32 nEnd = pSegment->nSequenceNumber + pSegment->pBuffer->GetLength ();
+		if (gt (nEnd, nRightEdge))
+		{
+			nRightEdge = nEnd;
+		}
+	}
+
+	assert (pLeftEdge != 0);
+	*pLeftEdge = nLeftEdge;
+	assert (pRightEdge != 0);
+	*pRightEdge = nRightEdge;
+
+	return nIndex;
+}
+
+void COutOfOrderQueue::Delete (unsigned nIndex)
+{
+	assert (nIndex < m_nSegments);
+	assert (m_Segment[nIndex].pBuffer != 0);
+	m_Segment[nIndex].pBuffer->Release ();
+
+	for (unsigned i = nIndex+1; i < m_nSegments; i++)
+	{
+		m_Segment[i-1] = m_Segment[i];
+	}
+
+	m_nSegments--;
+}
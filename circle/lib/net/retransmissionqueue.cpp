@@ -2,7 +2,7 @@
 // retransmissionqueue.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,6 +18,8 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/retransmissionqueue.h>
+#include <circle/net/checksumcalculator.h>
+#include <circle/util.h>
 #include <assert.h>
 
 CRetransmissionQueue::CRetransmissionQueue (unsigned nSize)
@@ -35,7 +37,7 @@ CRetransmissionQueue::CRetransmissionQueue (unsigned nSize)
 
 CRetransmissionQueue::~CRetransmissionQueue (void)
 {
-	delete m_pBuffer;
+	delete [] m_pBuffer;
 	m_pBuffer = 0;
 	
 	m_nSize = 0;
@@ -65,14 +67,29 @@ void CRetransmissionQueue::Write (const void *pBuffer, unsigned nLength)
 	assert (nLength > 0);
 	assert (GetFreeSpace () >= nLength);
 
-	unsigned char *p = (unsigned char *) pBuffer;
+	const u8 *p = (const u8 *) pBuffer;
 	assert (p != 0);
 	assert (m_pBuffer != 0);
 
-	while (nLength--)
+	// copy in up to two parts, if the data wraps around
+	while (nLength > 0)
 	{
-		m_pBuffer[m_nInPtr++] = *p++;
-		m_nInPtr %= m_nSize;
+		unsigned nPart = m_nSize-m_nInPtr;
+		if (nPart > nLength)
+		{
+			nPart = nLength;
+		}
+
+		memcpy (m_pBuffer+m_nInPtr, p, nPart);
+
+		p += nPart;
+		nLength -= nPart;
+
+		m_nInPtr += nPart;
+		if (m_nInPtr == m_nSize)
+		{
+			m_nInPtr = 0;
+		}
 	}
 }
 
@@ -95,14 +112,89 @@ void CRetransmissionQueue::Read (void *pBuffer, unsigned nLength)
 	assert (nLength > 0);
 	assert (GetBytesAvailable () >= nLength);
 
+	u8 *p = (u8 *) pBuffer;
+	assert (p != 0);
+	assert (m_pBuffer != 0);
+
+	while (nLength > 0)
+	{
+		unsigned nPart = m_nSize-m_nPreOutPtr;
+		if (nPart > nLength)
+		{
+			nPart = nLength;
+		}
+
+		memcpy (p, m_pBuffer+m_nPreOutPtr, nPart);
+
+		p += nPart;
+		nLength -= nPart;
+
+		m_nPreOutPtr += nPart;
+		if (m_nPreOutPtr == m_nSize)
+		{
+			m_nPreOutPtr = 0;
+		}
+	}
+}
+
+u16 CRetransmissionQueue::ReadAndSum (void *pBuffer, unsigned nLength)
+{
+	assert (nLength > 0);
+	assert (GetBytesAvailable () >= nLength);
+
+	u8 *p = (u8 *) pBuffer;
+	assert (p != 0);
+	assert (m_pBuffer != 0);
+
+	u16 nSum = 0;
+	unsigned nOffset = 0;
+	while (nLength > 0)
+	{
+		unsigned nPart = m_nSize-m_nPreOutPtr;
+		if (nPart > nLength)
+		{
+			nPart = nLength;
+		}
+
+		u16 nPartSum = CChecksumCalculator::CopyAndSum (p, m_pBuffer+m_nPreOutPtr, nPart);
+		nSum = CChecksumCalculator::CombineSums (nSum, nPartSum, nOffset);
+
+		p += nPart;
+		nOffset += nPart;
+		nLength -= nPart;
+
+		m_nPreOutPtr += nPart;
+		if (m_nPreOutPtr == m_nSize)
+		{
+			m_nPreOutPtr = 0;
+		}
+	}
+
+	return nSum;
+}
+
+void CRetransmissionQueue::Skip (unsigned nBytes)
+{
+	assert (GetBytesAvailable () >= nBytes);
+
+	m_nPreOutPtr += nBytes;
+	m_nPreOutPtr %= m_nSize;
+}
+
+void CRetransmissionQueue::Peek (void *pBuffer, unsigned nOffset, unsigned nLength) const
+{
+	assert (nLength > 0);
+	assert (nOffset < m_nSize);
+
 	unsigned char *p = (unsigned char *) pBuffer;
 	assert (p != 0);
 	assert (m_pBuffer != 0);
 
+	unsigned nPtr = (m_nOutPtr + nOffset) % m_nSize;
 	while (nLength--)
 	{
-		*p++ = m_pBuffer[m_nPreOutPtr++];
-		m_nPreOutPtr %= m_nSize;
+		*p++ = m_pBuffer[nPtr++];
+		nPtr %= m_nSize;
 	}
 }
 
@@ -4,7 +4,7 @@
 // Calculating TCP retransmission timeout according to RFC 6298
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -61,6 +61,16 @@ unsigned CRetransmissionTimeoutCalculator::GetRTO (void) const
 	return m_nRTO;
 }
 
+unsigned CRetransmissionTimeoutCalculator::GetSRTT (void) const
+{
+	return m_bFirstMeasurement ? 0 : m_nSRTT;
+}
+
+unsigned CRetransmissionTimeoutCalculator::GetRTTVAR (void) const
+{
+	return m_bFirstMeasurement ? 0 : m_nRTTVAR;
+}
+
 void CRetransmissionTimeoutCalculator::Initialize (u32 nISN)
 {
 	m_SpinLock.Acquire ();
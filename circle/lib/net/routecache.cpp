@@ -2,7 +2,7 @@
 // routecache.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,13 +19,19 @@
 //
 #include <circle/net/routecache.h>
 #include <circle/net/ipaddress.h>
+#include <circle/timer.h>
 #include <circle/util.h>
 #include <assert.h>
 
+#define MTU_LIFETIME_HZ		(600 * HZ)	// RFC 1191 section 6.3
+
 struct TRouteCacheEntry
 {
-	u8	DestIP[IP_ADDRESS_SIZE];
-	u8	GatewayIP[IP_ADDRESS_SIZE];
+	u8		DestIP[IP_ADDRESS_SIZE];
+	boolean		bHasGateway;
+	u8		GatewayIP[IP_ADDRESS_SIZE];
+	unsigned	nMTU;				// 0 if unknown
+	unsigned	nMTUTicks;			// when nMTU has been set
 };
 
 CRouteCache::CRouteCache (void)
@@ -53,50 +59,91 @@ void CRouteCache::AddRoute (const u8 *pDestIP, const u8 *pGatewayIP)
 	assert (pDestIP != 0);
 	assert (pGatewayIP != 0);
 
-	TRouteCacheEntry *pDestEntry = 0;
-
-	unsigned nCount = m_Cache.GetCount ();
-	for (unsigned i = 0; i < nCount; i++)
+	TRouteCacheEntry *pDestEntry = FindEntry (pDestIP);
+	if (pDestEntry == 0)
 	{
-		TRouteCacheEntry *pEntry = (TRouteCacheEntry *) m_Cache[i];
-		assert (pEntry != 0);
+		pDestEntry = CreateEntry (pDestIP);
+	}
 
-		if (memcmp (pEntry->DestIP, pDestIP, IP_ADDRESS_SIZE) == 0)
-		{
-			pDestEntry = pEntry;
+	memcpy (pDestEntry->GatewayIP, pGatewayIP, IP_ADDRESS_SIZE);
+	pDestEntry->bHasGateway = TRUE;
+}
 
-			break;
-		}
+const u8 *CRouteCache::GetRoute (const u8 *pDestIP) const
+{
+	const TRouteCacheEntry *pEntry = FindEntry (pDestIP);
+	if (   pEntry == 0
+	    || !pEntry->bHasGateway)
+	{
+		return 0;
 	}
 
+	return pEntry->GatewayIP;
+}
+
+void CRouteCache::SetMTU (const u8 *pDestIP, unsigned nMTU)
+{
+	assert (nMTU > 0);
+
+	TRouteCacheEntry *pDestEntry = FindEntry (pDestIP);
 	if (pDestEntry == 0)
 	{
-		pDestEntry = new TRouteCacheEntry;
-		assert (pDestEntry != 0);
+		pDestEntry = CreateEntry (pDestIP);
+	}
 
-		memcpy (pDestEntry->DestIP, pDestIP, IP_ADDRESS_SIZE);
+	pDestEntry->nMTU = nMTU;
+	pDestEntry->nMTUTicks = CTimer::Get ()->GetTicks ();
+}
 
-		m_Cache.Append (pDestEntry);
+unsigned CRouteCache::GetMTU (const u8 *pDestIP) const
+{
+	const TRouteCacheEntry *pEntry = FindEntry (pDestIP);
+	if (   pEntry == 0
+	    || pEntry->nMTU == 0)
+	{
+		return 0;
 	}
 
-	memcpy (pDestEntry->GatewayIP, pGatewayIP, IP_ADDRESS_SIZE);
+	// try a larger MTU again after some time
+	if (CTimer::Get ()->GetTicks () - pEntry->nMTUTicks >= MTU_LIFETIME_HZ)
+	{
+		return 0;
+	}
+
+	return pEntry->nMTU;
 }
 
-const u8 *CRouteCache::GetRoute (const u8 *pDestIP) const
+TRouteCacheEntry *CRouteCache::FindEntry (const u8 *pDestIP) const
 {
 	assert (pDestIP != 0);
 
 	unsigned nCount = m_Cache.GetCount ();
 	for (unsigned i = 0; i < nCount; i++)
 	{
-		const TRouteCacheEntry *pEntry = (const TRouteCacheEntry *) m_Cache[i];
+		TRouteCacheEntry *pEntry = (TRouteCacheEntry *) m_Cache[i];
 		assert (pEntry != 0);
 
 		if (memcmp (pEntry->DestIP, pDestIP, IP_ADDRESS_SIZE) == 0)
 		{
-			return pEntry->GatewayIP;
+			return pEntry;
 		}
 	}
 
 	return 0;
 }
+
+TRouteCacheEntry *CRouteCache::CreateEntry (const u8 *pDestIP)
+{
+	TRouteCacheEntry *pEntry = new TRouteCacheEntry;
+	assert (pEntry != 0);
+
+	assert (pDestIP != 0);
+	memcpy (pEntry->DestIP, pDestIP, IP_ADDRESS_SIZE);
+	pEntry->bHasGateway = FALSE;
+	pEntry->nMTU = 0;
+	pEntry->nMTUTicks = 0;
+
+	m_Cache.Append (pEntry);
+
+	return pEntry;
+}
@@ -0,0 +1,189 @@
+//
+// sackscoreboard.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/sackscoreboard.h>
+#include <assert.h>
+
+// Modulo 32 sequence number arithmetic
+#define lt(x, y)		((int) ((u32) (x) - (u32) (y)) < 0)
+#define le(x, y)		((int) ((u32) (x) - (u32) (y)) <= 0)
+#define gt(x, y) 		lt (y, x)
+
+CSACKScoreboard::CSACKScoreboard (void)
+:	m_nRanges (0)
+{
+}
+
+CSACKScoreboard::~CSACKScoreboard (void)
+{
+}
+
+boolean CSACKScoreboard::IsEmpty (void) const
+{
+	return m_nRanges == 0 ? TRUE : FALSE;
+}
+
+void CSACKScoreboard::Add (u32 nLeftEdge, u32 nRightEdge)
+{
+	if (!lt (nLeftEdge, nRightEdge))
+	{
+		return;
+	}
+
+	// merge with overlapping or adjacent ranges, which are removed
+	unsigned nIndex = 0;
+	unsigned nRanges = 0;
+	for (unsigned i = 0; i < m_nRanges; i++)
+	{
+		TRange *pRange = &m_Range[i];
+
+		if (   le (pRange->nLeftEdge, nRightEdge)
+		    && le (nLeftEdge, pRange->nRightEdge))
+		{
+			if (lt (pRange->nLeftEdge, nLeftEdge))
+			{
+				nLeftEdge = pRange->nLeftEdge;
+			}
+
+			if (gt (pRange->nRightEdge, nRightEdge))
+			{
+				nRightEdge = pRange->nRightEdge;
+			}
+
+			continue;
+		}
+
+		if (lt (pRange->nLeftEdge, nLeftEdge))
+		{
+			nIndex = nRanges+1;
+		}
+
+		m_Range[nRanges++] = *pRange;
+	}
+	m_nRanges = nRanges;
+
+	if (m_nRanges == SACK_SCOREBOARD_SIZE)
+	{
+		// lower ranges are more important for retransmission
+		if (nIndex == SACK_SCOREBOARD_SIZE)
+		{
+			return;
+		}
+
+		m_nRanges--;
+	}
+
+	for (unsigned i = m_nRanges; i > nIndex; i--)
+	{
+		m_Range[i] = m_Range[i-1];
+	}
+
+	m_Range[nIndex].nLeftEdge = nLeftEdge;
+	m_Range[nIndex].nRightEdge = nRightEdge;
+	m_nRanges++;
+}
+
+void CSACKScoreboard::Advance (u32 nAcknowledgmentNumber)
+{
+	unsigned nRanges = 0;
+	for (unsigned i = 0; i < m_nRanges; i++)
+	{
+		TRange *pRange = &m_Range[i];
+
+		if (le (pRange->nRightEdge, nAcknowledgmentNumber))
+		{
+			continue;
+		}
+
+		if (lt (pRange->nLeftEdge, nAcknowledgmentNumber))
+		{
+			pRange->nLeftEdge = nAcknowledgmentNumber;
+		}
+
+		m_Range[nRanges++] = *pRange;
+	}
+
+	m_nRanges = nRanges;
+}
+
+boolean CSACKScoreboard::IsSACKed (u32 nSequenceNumber, u32 *pRightEdge) const
+{
+	for (unsigned i = 0; i < m_nRanges; i++)
+	{
+		const TRange *pRange = &m_Range[i];
+
+		if (   le (pRange->nLeftEdge, nSequenceNumber)
+		    && lt (nSequenceNumber, pRange->nRightEdge))
+		{
+			assert (pRightEdge != 0);
+			*pRightEdge = pRange->nRightEdge;
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+boolean CSACKScoreboard::GetNextRange (u32 nSequenceNumber, u32 *pLeftEdge) const
+{
+	for (unsigned i = 0; i < m_nRanges; i++)
+	{
+		if (gt (m_Range[i].nLeftEdge, nSequenceNumber))
+		{
+			assert (pLeftEdge != 0);
+			*pLeftEdge = m_Range[i].nLeftEdge;
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+u32 CSACKScoreboard::GetHighest (void) const
+{
+	assert (m_nRanges > 0);
+
+	return m_Range[m_nRanges-1].nRightEdge;
+}
+
+u32 CSACKScoreboard::GetSACKedBytes (u32 nSequenceNumber) const
+{
+	u32 nBytes = 0;
+	for (unsigned i = 0; i < m_nRanges; i++)
+	{
+		const TRange *pRange = &m_Range[i];
+
+		if (le (nSequenceNumber, pRange->nLeftEdge))
+		{
+			break;
+		}
+
+		nBytes +=   (lt (pRange->nRightEdge, nSequenceNumber) ? pRange->nRightEdge : nSequenceNumber)
+			  - pRange->nLeftEdge;
+	}
+
+	return nBytes;
+}
+
+void CSACKScoreboard::Clear (void)
+{
+	m_nRanges = 0;
+}
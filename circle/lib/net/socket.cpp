@@ -2,7 +2,7 @@
 // socket.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 //
 #include <circle/net/socket.h>
 #include <circle/net/netsubsystem.h>
+#include <circle/net/socketpoller.h>
 #include <circle/net/in.h>
 #include <circle/util.h>
 #include <assert.h>
@@ -30,7 +31,10 @@ CSocket::CSocket (CNetSubSystem *pNetSubSystem, int nProtocol)
 	m_nProtocol (nProtocol),
 	m_nOwnPort (0),
 	m_hConnection (-1),
-	m_nBackLog (0)
+	m_nBackLog (0),
+	m_pPoller (0),
+	m_pEventHandler (0),
+	m_pEventParam (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pTransportLayer != 0);
@@ -43,7 +47,10 @@ CSocket::CSocket (CSocket &rSocket, int hConnection)
 	m_nProtocol (rSocket.m_nProtocol),
 	m_nOwnPort (rSocket.m_nOwnPort),
 	m_hConnection (hConnection),
-	m_nBackLog (0)
+	m_nBackLog (0),
+	m_pPoller (0),
+	m_pEventHandler (0),
+	m_pEventParam (0)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pTransportLayer != 0);
@@ -53,6 +60,12 @@ CSocket::~CSocket (void)
 {
 	assert (m_pTransportLayer != 0);
 
+	if (m_pPoller != 0)
+	{
+		m_pPoller->Remove (this);
+		assert (m_pPoller == 0);
+	}
+
 	if (m_hConnection >= 0)
 	{
 		assert (m_nBackLog == 0);
@@ -97,6 +110,8 @@ int CSocket::Bind (u16 nOwnPort)
 		{
 			return m_hConnection;		// return error code
 		}
+
+		SetEventHandler (m_hConnection);
 	}
 
 	return 0;
@@ -131,8 +146,14 @@ int CSocket::Connect (CIPAddress &rForeignIP, u16 nForeignPort)
 	}
 
 	m_hConnection = m_pTransportLayer->Connect (rForeignIP, nForeignPort, m_nOwnPort, m_nProtocol);
+	if (m_hConnection < 0)
+	{
+		return m_hConnection;
+	}
+
+	SetEventHandler (m_hConnection);
 
-	return m_hConnection >= 0 ? 0 : m_hConnection;
+	return 0;
 }
 
 int CSocket::Listen (unsigned nBackLog)
@@ -163,6 +184,8 @@ int CSocket::Listen (unsigned nBackLog)
 	{
 		m_hListenConnection[i] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol);
 		assert (m_hListenConnection[i] >= 0);
+
+		SetEventHandler (m_hListenConnection[i]);
 	}
 
 	return 0;
@@ -208,6 +231,9 @@ CSocket *CSocket::Accept (CIPAddress *pForeignIP, u16 *pForeignPort)
 	assert (pForeignIP != 0);
 	assert (pForeignPort != 0);
 
+	// the connection does not belong to this socket any more
+	m_pTransportLayer->SetEventHandler (hConnection, 0, 0);
+
 	// blocks until connection is active
 	if (m_pTransportLayer->Accept (pForeignIP, pForeignPort, hConnection) >= 0)
 	{
@@ -219,6 +245,8 @@ CSocket *CSocket::Accept (CIPAddress *pForeignIP, u16 *pForeignPort)
 	m_hListenConnection[nIndex] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol);
 	assert (m_hListenConnection[nIndex] >= 0);
 
+	SetEventHandler (m_hListenConnection[nIndex]);
+
 	return pNewSocket;
 }
 
@@ -252,22 +280,8 @@ int CSocket::Receive (void *pBuffer, unsigned nLength, int nFlags)
 	}
 	
 	assert (m_pTransportLayer != 0);
-	u8 TempBuffer[FRAME_BUFFER_SIZE];
-	int nResult = m_pTransportLayer->Receive (TempBuffer, nFlags, m_hConnection);
-	if (nResult < 0)
-	{
-		return nResult;
-	}
-
-	if (nLength < (unsigned) nResult)
-	{
-		nResult = nLength;
-	}
-
 	assert (pBuffer != 0);
-	memcpy (pBuffer, TempBuffer, nResult);
-
-	return nResult;
+	return m_pTransportLayer->Receive (pBuffer, nLength, nFlags, m_hConnection);
 }
 
 int CSocket::SendTo (const void *pBuffer, unsigned nLength, int nFlags,
@@ -313,39 +327,73 @@ int CSocket::ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags,
 	}
 	
 	assert (m_pTransportLayer != 0);
-	u8 TempBuffer[FRAME_BUFFER_SIZE];
-	int nResult = m_pTransportLayer->ReceiveFrom (TempBuffer, nFlags,
-						      pForeignIP, pForeignPort, m_hConnection);
-	if (nResult < 0)
+	assert (pBuffer != 0);
+	return m_pTransportLayer->ReceiveFrom (pBuffer, nLength, nFlags,
+					       pForeignIP, pForeignPort, m_hConnection);
+}
+
+int CSocket::SetOptionBroadcast (boolean bAllowed)
+{
+	if (m_hConnection < 0)
 	{
-		return nResult;
+		return -1;
 	}
 
-	if (nLength < (unsigned) nResult)
+	if (m_nProtocol != IPPROTO_UDP)
 	{
-		nResult = nLength;
+		return 0;
 	}
 
-	assert (pBuffer != 0);
-	memcpy (pBuffer, TempBuffer, nResult);
+	assert (m_pTransportLayer != 0);
+	return m_pTransportLayer->SetOptionBroadcast (bAllowed, m_hConnection);
+}
+
+int CSocket::SetOptionNoDelay (boolean bNoDelay)
+{
+	if (   m_hConnection < 0
+	    || m_nProtocol != IPPROTO_TCP)
+	{
+		return -1;
+	}
 
-	return nResult;
+	assert (m_pTransportLayer != 0);
+	return m_pTransportLayer->SetOptionNoDelay (bNoDelay, m_hConnection);
 }
 
-int CSocket::SetOptionBroadcast (boolean bAllowed)
+int CSocket::SetOptionCork (boolean bCork)
 {
-	if (m_hConnection < 0)
+	if (   m_hConnection < 0
+	    || m_nProtocol != IPPROTO_TCP)
 	{
 		return -1;
 	}
 
-	if (m_nProtocol != IPPROTO_UDP)
+	assert (m_pTransportLayer != 0);
+	return m_pTransportLayer->SetOptionCork (bCork, m_hConnection);
+}
+
+int CSocket::SetOptionCongestionControl (TTCPCongestionControl Algorithm)
+{
+	if (   m_hConnection < 0
+	    || m_nProtocol != IPPROTO_TCP)
 	{
-		return 0;
+		return -1;
 	}
 
 	assert (m_pTransportLayer != 0);
-	return m_pTransportLayer->SetOptionBroadcast (bAllowed, m_hConnection);
+	return m_pTransportLayer->SetOptionCongestionControl (Algorithm, m_hConnection);
+}
+
+int CSocket::GetConnectionInfo (TTCPConnectionInfo *pInfo) const
+{
+	if (   m_hConnection < 0
+	    || m_nProtocol != IPPROTO_TCP)
+	{
+		return -1;
+	}
+
+	assert (m_pTransportLayer != 0);
+	return m_pTransportLayer->GetConnectionInfo (pInfo, m_hConnection);
 }
 
 const u8 *CSocket::GetForeignIP (void) const
@@ -358,3 +406,51 @@ const u8 *CSocket::GetForeignIP (void) const
 	assert (m_pTransportLayer != 0);
 	return m_pTransportLayer->GetForeignIP (m_hConnection);
 }
+
+unsigned CSocket::GetPollEvents (void) const
+{
+	assert (m_pTransportLayer != 0);
+
+	if (m_nBackLog > 0)
+	{
+		for (unsigned i = 0; i < m_nBackLog; i++)
+		{
+			if (m_pTransportLayer->IsConnected (m_hListenConnection[i]))
+			{
+				return SOCKET_POLL_ACCEPT;
+			}
+		}
+
+		return 0;
+	}
+
+	if (m_hConnection < 0)
+	{
+		return 0;
+	}
+
+	return m_pTransportLayer->GetPollEvents (m_hConnection);
+}
+
+void CSocket::SetEventHandler (TNetEventHandler *pHandler, void *pParam)
+{
+	m_pEventHandler = pHandler;
+	m_pEventParam = pParam;
+
+	if (m_hConnection >= 0)
+	{
+		SetEventHandler (m_hConnection);
+	}
+
+	for (unsigned i = 0; i < m_nBackLog; i++)
+	{
+		SetEventHandler (m_hListenConnection[i]);
+	}
+}
+
+void CSocket::SetEventHandler (int hConnection)
+{
+	assert (hConnection >= 0);
+	assert (m_pTransportLayer != 0);
+	m_pTransportLayer->SetEventHandler (hConnection, m_pEventHandler, m_pEventParam);
+}
@@ -0,0 +1,314 @@
+//
+// socketpoller.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/socketpoller.h>
+#include <circle/timer.h>
+#include <assert.h>
+
+#define MAX_WAIT_MS	1000000		// prevents overflow of the timeout in microseconds
+
+CSocketPoller::CSocketPoller (void)
+:	m_pFirst (0),
+	m_pFirstReady (0),
+	m_pLastReady (0)
+{
+}
+
+CSocketPoller::~CSocketPoller (void)
+{
+	while (m_pFirst != 0)
+	{
+		Remove (m_pFirst->pSocket);
+	}
+
+	assert (m_pFirstReady == 0);
+}
+
+int CSocketPoller::Add (CSocket *pSocket, unsigned nEvents, void *pParam)
+{
+	assert (pSocket != 0);
+	if (pSocket->m_pPoller != 0)
+	{
+		return -1;
+	}
+
+	TEntry *pEntry = new TEntry;
+	assert (pEntry != 0);
+
+	pEntry->pSocket = pSocket;
+	pEntry->nEvents = nEvents;
+	pEntry->pParam = pParam;
+	pEntry->pPoller = this;
+	pEntry->bQueued = FALSE;
+	pEntry->pNextReady = 0;
+
+	pEntry->pPrev = 0;
+	pEntry->pNext = m_pFirst;
+	if (m_pFirst != 0)
+	{
+		m_pFirst->pPrev = pEntry;
+	}
+	m_pFirst = pEntry;
+
+	pSocket->m_pPoller = this;
+	pSocket->SetEventHandler (EventHandler, pEntry);
+
+	// report the events, which are ready already
+	Enqueue (pEntry);
+
+	return 0;
+}
+
+int CSocketPoller::Modify (CSocket *pSocket, unsigned nEvents, void *pParam)
+{
+	assert (pSocket != 0);
+	if (pSocket->m_pPoller != this)
+	{
+		return -1;
+	}
+
+	TEntry *pEntry = (TEntry *) pSocket->m_pEventParam;
+	assert (pEntry != 0);
+	assert (pEntry->pSocket == pSocket);
+
+	pEntry->nEvents = nEvents;
+	pEntry->pParam = pParam;
+
+	Enqueue (pEntry);
+
+	return 0;
+}
+
+int CSocketPoller::Remove (CSocket *pSocket)
+{
+	assert (pSocket != 0);
+	if (pSocket->m_pPoller != this)
+	{
+		return -1;
+	}
+
+	TEntry *pEntry = (TEntry *) pSocket->m_pEventParam;
+	assert (pEntry != 0);
+	assert (pEntry->pSocket == pSocket);
+
+	pSocket->SetEventHandler (0, 0);
+	pSocket->m_pPoller = 0;
+
+	Dequeue (pEntry);
+
+	if (pEntry->pPrev != 0)
+	{
+		pEntry->pPrev->pNext = pEntry->pNext;
+	}
+	else
+	{
+		assert (m_pFirst == pEntry);
+		m_pFirst = pEntry->pNext;
+	}
+
+	if (pEntry->pNext != 0)
+	{
+		pEntry->pNext->pPrev = pEntry->pPrev;
+	}
+
+	delete pEntry;
+
+	return 0;
+}
+
+int CSocketPoller::Wait (TSocketPollEvent *pEvents, unsigned nMaxEvents, unsigned nTimeoutMs)
+{
+	assert (pEvents != 0);
+	assert (nMaxEvents > 0);
+
+	CTimer *pTimer = CTimer::Get ();
+	assert (pTimer != 0);
+	unsigned nStartTicks = pTimer->GetTicks ();
+
+	// the timeout in ticks is rounded up, the calculation does not overflow
+	unsigned nTimeoutTicks =   nTimeoutMs / 1000 * HZ
+				 + ((nTimeoutMs % 1000) * HZ + 999) / 1000;
+
+	while (TRUE)
+	{
+		m_Event.Clear ();
+
+		unsigned nResult = CollectEvents (pEvents, nMaxEvents);
+		if (   nResult > 0
+		    || nTimeoutMs == 0)
+		{
+			return nResult;
+		}
+
+		if (nTimeoutMs == SOCKET_POLL_INFINITE)
+		{
+			m_Event.Wait ();
+
+			continue;
+		}
+
+		unsigned nElapsedTicks = pTimer->GetTicks () - nStartTicks;
+		if (nElapsedTicks >= nTimeoutTicks)
+		{
+			return 0;
+		}
+
+		unsigned nWaitTicks = nTimeoutTicks - nElapsedTicks;
+		if (nWaitTicks > MSEC2HZ (MAX_WAIT_MS))
+		{
+			nWaitTicks = MSEC2HZ (MAX_WAIT_MS);
+		}
+
+		m_Event.WaitWithTimeout (nWaitTicks * (1000000 / HZ));
+	}
+}
+
+unsigned CSocketPoller::CollectEvents (TSocketPollEvent *pEvents, unsigned nMaxEvents)
+{
+	unsigned nResult = 0;
+
+	// level-triggered entries, which are still ready, are queued again at the end
+	TEntry *pFirstAgain = 0;
+	TEntry *pLastAgain = 0;
+
+	while (   m_pFirstReady != 0
+	       && nResult < nMaxEvents)
+	{
+		TEntry *pEntry = m_pFirstReady;
+		m_pFirstReady = pEntry->pNextReady;
+		if (m_pFirstReady == 0)
+		{
+			m_pLastReady = 0;
+		}
+		pEntry->pNextReady = 0;
+
+		assert (pEntry->pSocket != 0);
+		unsigned nEvents =   pEntry->pSocket->GetPollEvents ()
+				   & (pEntry->nEvents | SOCKET_POLL_ERROR | SOCKET_POLL_HANGUP);
+		if (nEvents == 0)
+		{
+			pEntry->bQueued = FALSE;
+
+			continue;
+		}
+
+		pEvents[nResult].pSocket = pEntry->pSocket;
+		pEvents[nResult].nEvents = nEvents;
+		pEvents[nResult].pParam = pEntry->pParam;
+		nResult++;
+
+		if (pEntry->nEvents & SOCKET_POLL_EDGE)
+		{
+			pEntry->bQueued = FALSE;
+
+			continue;
+		}
+
+		if (pLastAgain != 0)
+		{
+			pLastAgain->pNextReady = pEntry;
+		}
+		else
+		{
+			pFirstAgain = pEntry;
+		}
+		pLastAgain = pEntry;
+	}
+
+	if (pFirstAgain != 0)
+	{
+		if (m_pLastReady != 0)
+		{
+			m_pLastReady->pNextReady = pFirstAgain;
+		}
+		else
+		{
+			m_pFirstReady = pFirstAgain;
+		}
+		m_pLastReady = pLastAgain;
+	}
+
+	return nResult;
+}
+
+void CSocketPoller::Enqueue (TEntry *pEntry)
+{
+	assert (pEntry != 0);
+	if (!pEntry->bQueued)
+	{
+		pEntry->bQueued = TRUE;
+		pEntry->pNextReady = 0;
+
+		if (m_pLastReady != 0)
+		{
+			m_pLastReady->pNextReady = pEntry;
+		}
+		else
+		{
+			m_pFirstReady = pEntry;
+		}
+		m_pLastReady = pEntry;
+	}
+
+	m_Event.Set ();
+}
+
+void CSocketPoller::Dequeue (TEntry *pEntry)
+{
+	assert (pEntry != 0);
+	if (!pEntry->bQueued)
+	{
+		return;
+	}
+
+	TEntry *pPrev = 0;
+	for (TEntry *p = m_pFirstReady; p != 0; pPrev = p, p = p->pNextReady)
+	{
+		if (p == pEntry)
+		{
+			if (pPrev != 0)
+			{
+				pPrev->pNextReady = p->pNextReady;
+			}
+			else
+			{
+				m_pFirstReady = p->pNextReady;
+			}
+
+			if (m_pLastReady == p)
+			{
+				m_pLastReady = pPrev;
+			}
+
+			break;
+		}
+	}
+
+	pEntry->bQueued = FALSE;
+	pEntry->pNextReady = 0;
+}
+
+void CSocketPoller::EventHandler (void *pParam)
+{
+	TEntry *pEntry = (TEntry *) pParam;
+	assert (pEntry != 0);
+	assert (pEntry->pPoller != 0);
+
+	pEntry->pPoller->Enqueue (pEntry);
+}
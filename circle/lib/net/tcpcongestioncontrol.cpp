@@ -0,0 +1,130 @@
+//
+// tcpcongestioncontrol.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/tcpcongestioncontrol.h>
+#include <circle/net/tcpnewreno.h>
+#include <circle/net/tcpcubic.h>
+#include <assert.h>
+
+#define INITIAL_MSS		536		// RFC 1122 section 4.2.2.6
+
+CTCPCongestionControl::CTCPCongestionControl (TTCPCongestionControl Algorithm)
+:	m_nSSThresh ((u32) -1),			// arbitrarily high (RFC 5681 section 3.1)
+	m_Algorithm (Algorithm)
+{
+	CTCPCongestionControl::Initialize (INITIAL_MSS);
+}
+
+CTCPCongestionControl::~CTCPCongestionControl (void)
+{
+}
+
+TTCPCongestionControl CTCPCongestionControl::GetAlgorithm (void) const
+{
+	return m_Algorithm;
+}
+
+u32 CTCPCongestionControl::GetWindow (void) const
+{
+	return m_nCWND;
+}
+
+u32 CTCPCongestionControl::GetSlowStartThreshold (void) const
+{
+	return m_nSSThresh;
+}
+
+void CTCPCongestionControl::Initialize (u16 nMSS)
+{
+	assert (nMSS > 0);
+	m_nMSS = nMSS;
+
+	// initial window (RFC 5681 section 3.1)
+	if (m_nMSS > 2190)
+	{
+		m_nCWND = 2 * m_nMSS;
+	}
+	else if (m_nMSS > 1095)
+	{
+		m_nCWND = 3 * m_nMSS;
+	}
+	else
+	{
+		m_nCWND = 4 * m_nMSS;
+	}
+}
+
+void CTCPCongestionControl::TakeOver (const CTCPCongestionControl *pPrevious)
+{
+	assert (pPrevious != 0);
+	m_nMSS = pPrevious->m_nMSS;
+	m_nCWND = pPrevious->m_nCWND;
+	m_nSSThresh = pPrevious->m_nSSThresh;
+}
+
+void CTCPCongestionControl::RecoveryFinished (void)
+{
+	m_nCWND = m_nSSThresh;			// deflate the window (RFC 6582 section 3.2)
+}
+
+void CTCPCongestionControl::RetransmissionTimeout (u32 nFlightSize)
+{
+	// RFC 5681 section 3.1
+	m_nSSThresh = nFlightSize / 2;
+	if (m_nSSThresh < 2U * m_nMSS)
+	{
+		m_nSSThresh = 2 * m_nMSS;
+	}
+
+	m_nCWND = m_nMSS;			// loss window
+}
+
+CTCPCongestionControl *CTCPCongestionControl::Create (TTCPCongestionControl Algorithm)
+{
+	switch (Algorithm)
+	{
+	case TCPCongestionControlNewReno:
+		return new CTCPNewReno;
+
+	case TCPCongestionControlCUBIC:
+		return new CTCPCubic;
+
+	default:
+		return 0;
+	}
+}
+
+void CTCPCongestionControl::SlowStart (u32 nBytesAcked)
+{
+	if (nBytesAcked > 2U * m_nMSS)
+	{
+		nBytesAcked = 2 * m_nMSS;
+	}
+
+	IncreaseWindow (nBytesAcked);
+}
+
+void CTCPCongestionControl::IncreaseWindow (u32 nIncrement)
+{
+	m_nCWND += nIncrement;
+	if (m_nCWND > TCP_MAX_CONGESTION_WINDOW)
+	{
+		m_nCWND = TCP_MAX_CONGESTION_WINDOW;
+	}
+}
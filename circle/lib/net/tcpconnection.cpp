@@ -1,19 +1,20 @@
 //
 // tcpconnection.cpp
 //
-// This implements RFC 793 with some changes in RFC 1122 and RFC 6298.
+// This implements RFC 793 with some changes in RFC 1122 and RFC 6298,
+// the Window Scale option from RFC 7323, and Selective Acknowledgment
+// (RFC 2018) with a simplified loss recovery according to RFC 6675.
+// Congestion control (RFC 5681) is implemented in CTCPCongestionControl.
+// Small segments are coalesced using delayed ACKs and the Nagle algorithm.
 //
 // Non-implemented features:
-//	dynamic receive window
 //	URG flag and urgent pointer
-//	delayed ACK
-//	queueing out-of-order TCP segments
 //	security/compartment
 //	precedence
 //	user timeout
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -29,9 +30,11 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/tcpconnection.h>
+#include <circle/net/netbuffer.h>
 #include <circle/macros.h>
 #include <circle/util.h>
 #include <circle/logger.h>
+#include <circle/metrics.h>
 #include <circle/net/in.h>
 #include <assert.h>
 
@@ -43,15 +46,23 @@
 #define MSS_S				1480	// maximum segment size to be send to network layer
 
 #define TCP_CONFIG_MSS			(MSS_R - 20)
-#define TCP_CONFIG_WINDOW		(TCP_CONFIG_MSS * 10)
-
-#define TCP_CONFIG_RETRANS_BUFFER_SIZE	0x10000	// should be greater than maximum send window size
-
-#define TCP_MAX_WINDOW			((u16) -1)	// without Window extension option
+#define TCP_CONFIG_WINDOW		(TCP_CONFIG_MSS * 10)	// initial receive buffer size
+#define TCP_CONFIG_RCV_BUFFER_MAX	0x40000	// maximum size of autotuned receive buffer
+#define TCP_CONFIG_WINDOW_SCALE		3	// shift count, TCP_CONFIG_RCV_BUFFER_MAX must fit
+#define TCP_CONFIG_RCV_BUFFERS_MAX	(NET_BUFFER_MAX / 8)	// maximum number of queued net buffers
+
+#define TCP_CONFIG_RETRANS_BUFFER_SIZE	0x40000	// should be greater than maximum send window size
+
+#define TCP_MAX_WINDOW			((u16) -1)	// without Window Scale option
+#define TCP_MAX_WINDOW_SCALE		14	// RFC 7323 section 2.3
+#define TCP_MAX_SACK_BLOCKS		4	// without Timestamps option (RFC 2018 section 3)
+#define TCP_DUP_ACK_THRESHOLD		3	// RFC 6675 section 2
+#define TCP_DELAYED_ACK_SEGMENTS	2	// ACK at least every second segment (RFC 5681 4.2)
 #define TCP_QUIET_TIME			30	// seconds after crash before another connection starts
 
 #define HZ_TIMEWAIT			(60 * HZ)
 #define HZ_FIN_TIMEOUT			(60 * HZ)	// timeout in FIN-WAIT-2 state
+#define HZ_DELAYED_ACK			(HZ / 5)	// must be less than 0.5 seconds (RFC 1122)
 
 #define MAX_RETRANSMISSIONS		5
 
@@ -90,6 +101,7 @@ struct TTCPOption
 #define TCP_OPTION_MSS		2	//	Maximum segment size (2 byte)
 #define TCP_OPTION_WINDOW_SCALE	3	//	Shift count (1 byte)
 #define TCP_OPTION_SACK_PERM	4	//	None
+#define TCP_OPTION_SACK		5	//	Left edge, right edge of blocks (n*2*4 byte)
 #define TCP_OPTION_TIMESTAMP	8	//	Timestamp value, Timestamp echo reply (2*4 byte)
 	u8	nLength;
 	u8	Data[];
@@ -126,6 +138,13 @@ unsigned CTCPConnection::s_nConnections = 0;
 
 static const char FromTCP[] = "tcp";
 
+static CMetricCounter s_SegmentsSent ("circle_net_tcp_segments_sent_total",
+				      "TCP segments sent");
+static CMetricCounter s_SegmentsReceived ("circle_net_tcp_segments_received_total",
+					  "TCP segments received for an existing connection");
+static CMetricCounter s_Retransmissions ("circle_net_tcp_retransmissions_total",
+					 "TCP retransmissions of unacknowledged data");
+
 CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 				CNetworkLayer	*pNetworkLayer,
 				CIPAddress	&rForeignIP,
@@ -147,8 +166,30 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 	m_nRCV_NXT (0),
 	m_nRCV_WND (TCP_CONFIG_WINDOW),
 	m_nIRS (0),
-	m_nSND_MSS (536)	// RFC 1122 section 4.2.2.6
+	m_nSND_MSS (536),	// RFC 1122 section 4.2.2.6
+	m_bWindowScale (FALSE),
+	m_nSND_SCALE (0),
+	m_nRCV_SCALE (0),
+	m_nRCV_BUF (TCP_CONFIG_WINDOW),
+	m_nRxQueued (0),
+	m_nRxBuffers (0),
+	m_nRxBytesRead (0),
+	m_nRxMeasureStart (0),
+	m_bSACKPermitted (FALSE),
+	m_nDupAcks (0),
+	m_bInRecovery (FALSE),
+	m_nRecoveryPoint (0),
+	m_nHighRxt (0),
+	m_pCongestionControl (CTCPCongestionControl::Create (TCP_CONGESTION_CONTROL_DEFAULT)),
+	m_nRetransmissionTimeouts (0),
+	m_nFastRetransmissions (0),
+	m_nUnackedSegments (0),
+	m_bSendDelayedACK (FALSE),
+	m_bNoDelay (FALSE),
+	m_bCork (FALSE)
 {
+	assert (m_pCongestionControl != 0);
+
 	s_nConnections++;
 
 	for (unsigned nTimer = TCPTimerUser; nTimer < TCPTimerUnknown; nTimer++)
@@ -190,8 +231,30 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 	m_nRCV_NXT (0),
 	m_nRCV_WND (TCP_CONFIG_WINDOW),
 	m_nIRS (0),
-	m_nSND_MSS (536)	// RFC 1122 section 4.2.2.6
+	m_nSND_MSS (536),	// RFC 1122 section 4.2.2.6
+	m_bWindowScale (FALSE),
+	m_nSND_SCALE (0),
+	m_nRCV_SCALE (0),
+	m_nRCV_BUF (TCP_CONFIG_WINDOW),
+	m_nRxQueued (0),
+	m_nRxBuffers (0),
+	m_nRxBytesRead (0),
+	m_nRxMeasureStart (0),
+	m_bSACKPermitted (FALSE),
+	m_nDupAcks (0),
+	m_bInRecovery (FALSE),
+	m_nRecoveryPoint (0),
+	m_nHighRxt (0),
+	m_pCongestionControl (CTCPCongestionControl::Create (TCP_CONGESTION_CONTROL_DEFAULT)),
+	m_nRetransmissionTimeouts (0),
+	m_nFastRetransmissions (0),
+	m_nUnackedSegments (0),
+	m_bSendDelayedACK (FALSE),
+	m_bNoDelay (FALSE),
+	m_bCork (FALSE)
 {
+	assert (m_pCongestionControl != 0);
+
 	s_nConnections++;
 
 	for (unsigned nTimer = TCPTimerUser; nTimer < TCPTimerUnknown; nTimer++)
@@ -217,6 +280,9 @@ CTCPConnection::~CTCPConnection (void)
 	m_Event.Set ();
 	m_TxEvent.Set ();
 
+	delete m_pCongestionControl;
+	m_pCongestionControl = 0;
+
 	assert (s_nConnections > 0);
 	s_nConnections--;
 }
@@ -384,17 +450,23 @@ int CTCPConnection::Send (const void *pData, unsigned nLength, int nFlags)
 	assert (pData != 0);
 	u8 *pBuffer = (u8 *) pData;
 
-	while (nLength > FRAME_BUFFER_SIZE)
+	while (nLength > 0)
 	{
-		m_TxQueue.Enqueue (pBuffer, FRAME_BUFFER_SIZE);
+		unsigned nChunk = min (nLength, (unsigned) FRAME_BUFFER_SIZE);
+		if (!m_TxQueue.Enqueue (pBuffer, nChunk))
+		{
+			nResult -= nLength;		// out of net buffers
 
-		pBuffer += FRAME_BUFFER_SIZE;
-		nLength -= FRAME_BUFFER_SIZE;
+			break;
+		}
+
+		pBuffer += nChunk;
+		nLength -= nChunk;
 	}
 
-	if (nLength > 0)
+	if (nResult == 0)
 	{
-		m_TxQueue.Enqueue (pBuffer, nLength);
+		return -1;
 	}
 
 	if (!(nFlags & MSG_DONTWAIT))
@@ -411,7 +483,7 @@ int CTCPConnection::Send (const void *pData, unsigned nLength, int nFlags)
 	return nResult;
 }
 
-int CTCPConnection::Receive (void *pBuffer, int nFlags)
+int CTCPConnection::Receive (void *pBuffer, unsigned nBufferSize, int nFlags)
 {
 	if (   nFlags != 0
 	    && nFlags != MSG_DONTWAIT)
@@ -424,8 +496,9 @@ int CTCPConnection::Receive (void *pBuffer, int nFlags)
 		return m_nErrno;
 	}
 	
-	unsigned nLength;
-	while ((nLength = m_RxQueue.Dequeue (pBuffer)) == 0)
+	// the queue entries can be larger than one frame (reassembled segments)
+	CNetBuffer *pEntry;
+	while ((pEntry = m_RxQueue.Peek ()) == 0)
 	{
 		switch (m_State)
 		{
@@ -459,6 +532,29 @@ int CTCPConnection::Receive (void *pBuffer, int nFlags)
 		}
 	}
 
+	// the network task cannot flush the queue in between (cooperative scheduling),
+	// so pEntry remains at the head of the queue
+	unsigned nLength = min (pEntry->GetLength (), nBufferSize);
+	assert (pBuffer != 0 || nLength == 0);
+	memcpy (pBuffer, pEntry->GetData (), nLength);
+	pEntry->Pull (nLength);
+
+	if (pEntry->GetLength () == 0)
+	{
+		// the rest of a partially read entry remains queued otherwise
+		CNetBuffer *pDequeued = m_RxQueue.Dequeue ();
+		assert (pDequeued == pEntry);
+		pDequeued->Release ();
+
+		assert (m_nRxBuffers > 0);
+		m_nRxBuffers--;
+	}
+
+	assert (m_nRxQueued >= nLength);
+	m_nRxQueued -= nLength;
+
+	AdjustReceiveBuffer (nLength);
+
 	return nLength;
 }
 
@@ -469,9 +565,10 @@ int CTCPConnection::SendTo (const void *pData, unsigned nLength, int nFlags,
 	return Send (pData, nLength, nFlags);
 }
 
-int CTCPConnection::ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeignIP, u16 *pForeignPort)
+int CTCPConnection::ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags,
+				 CIPAddress *pForeignIP, u16 *pForeignPort)
 {
-	int nResult = Receive (pBuffer, nFlags);
+	int nResult = Receive (pBuffer, nLength, nFlags);
 	if (nResult <= 0)
 	{
 		return nResult;
@@ -492,6 +589,62 @@ int CTCPConnection::SetOptionBroadcast (boolean bAllowed)
 	return 0;
 }
 
+int CTCPConnection::SetOptionNoDelay (boolean bNoDelay)
+{
+	m_bNoDelay = bNoDelay;
+
+	return 0;
+}
+
+int CTCPConnection::SetOptionCork (boolean bCork)
+{
+	m_bCork = bCork;			// pending data will be sent in Process()
+
+	return 0;
+}
+
+int CTCPConnection::SetOptionCongestionControl (TTCPCongestionControl Algorithm)
+{
+	assert (m_pCongestionControl != 0);
+	if (m_pCongestionControl->GetAlgorithm () == Algorithm)
+	{
+		return 0;
+	}
+
+	CTCPCongestionControl *pCongestionControl = CTCPCongestionControl::Create (Algorithm);
+	if (pCongestionControl == 0)
+	{
+		return -1;
+	}
+
+	pCongestionControl->TakeOver (m_pCongestionControl);
+
+	delete m_pCongestionControl;
+	m_pCongestionControl = pCongestionControl;
+
+	return 0;
+}
+
+int CTCPConnection::GetConnectionInfo (TTCPConnectionInfo *pInfo) const
+{
+	assert (pInfo != 0);
+	assert (m_pCongestionControl != 0);
+
+	pInfo->CongestionControl	= m_pCongestionControl->GetAlgorithm ();
+	pInfo->nCongestionWindow	= m_pCongestionControl->GetWindow ();
+	pInfo->nSlowStartThreshold	= m_pCongestionControl->GetSlowStartThreshold ();
+	pInfo->nSendWindow		= m_nSND_WND;
+	pInfo->nReceiveWindow		= m_nRCV_WND;
+	pInfo->nSendMSS			= m_nSND_MSS;
+	pInfo->nSmoothedRTT		= m_RTOCalculator.GetSRTT ();
+	pInfo->nRTTVariation		= m_RTOCalculator.GetRTTVAR ();
+	pInfo->nRTO			= m_RTOCalculator.GetRTO ();
+	pInfo->nRetransmissionTimeouts	= m_nRetransmissionTimeouts;
+	pInfo->nFastRetransmissions	= m_nFastRetransmissions;
+
+	return 0;
+}
+
 boolean CTCPConnection::IsConnected (void) const
 {
 	return     m_State > TCPStateSynSent
@@ -503,6 +656,62 @@ boolean CTCPConnection::IsTerminated (void) const
 	return m_State == TCPStateClosed;
 }
 
+boolean CTCPConnection::IsFullySpecified (void) const
+{
+	return m_State != TCPStateListen;
+}
+
+unsigned CTCPConnection::GetPollEvents (void) const
+{
+	unsigned nEvents = 0;
+
+	if (m_nErrno < 0)
+	{
+		nEvents |= SOCKET_POLL_ERROR;
+	}
+
+	if (!m_RxQueue.IsEmpty ())
+	{
+		nEvents |= SOCKET_POLL_READ;
+	}
+
+	switch (m_State)
+	{
+	case TCPStateListen:
+	case TCPStateSynSent:
+	case TCPStateSynReceived:
+		break;
+
+	case TCPStateEstablished:
+		if (m_TxQueue.IsEmpty ())
+		{
+			nEvents |= SOCKET_POLL_WRITE;
+		}
+		break;
+
+	case TCPStateCloseWait:
+		if (m_TxQueue.IsEmpty ())
+		{
+			nEvents |= SOCKET_POLL_WRITE;
+		}
+		// fall through
+
+	case TCPStateClosing:
+	case TCPStateLastAck:
+	case TCPStateTimeWait:
+	case TCPStateClosed:
+		// Receive() returns -1, when the received data has been read
+		nEvents |= SOCKET_POLL_READ | SOCKET_POLL_HANGUP;
+		break;
+
+	case TCPStateFinWait1:
+	case TCPStateFinWait2:
+		break;
+	}
+
+	return nEvents;
+}
+
 void CTCPConnection::Process (void)
 {
 	if (m_bTimedOut)
@@ -510,9 +719,21 @@ void CTCPConnection::Process (void)
 		m_nErrno = -1;
 		NEW_STATE (TCPStateClosed);
 		m_Event.Set ();
+		SignalEvent ();
 		return;
 	}
 
+	// window update, if the application has read enough data meanwhile,
+	// or delayed ACK, if no data has been sent in the meantime
+	if (   (   m_State == TCPStateEstablished
+		|| m_State == TCPStateFinWait1
+		|| m_State == TCPStateFinWait2)
+	    && (   UpdateReceiveWindow ()
+		|| m_bSendDelayedACK))
+	{
+		SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
+	}
+
 	switch (m_State)
 	{
 	case TCPStateClosed:
@@ -558,16 +779,20 @@ void CTCPConnection::Process (void)
 		break;
 	}
 
-	u8 TempBuffer[FRAME_BUFFER_SIZE];
-	unsigned nLength;
+	boolean bTxQueued = !m_TxQueue.IsEmpty ();
+
+	CNetBuffer *pBuffer;
 	while (    m_RetransmissionQueue.GetFreeSpace () >= FRAME_BUFFER_SIZE
-		&& (nLength = m_TxQueue.Dequeue (TempBuffer)) > 0)
+		&& (pBuffer = m_TxQueue.Dequeue ()) != 0)
 	{
 #ifdef TCP_DEBUG
-		CLogger::Get ()->Write (FromTCP, LogDebug, "Transfering %u bytes into RT buffer", nLength);
+		CLogger::Get ()->Write (FromTCP, LogDebug, "Transfering %u bytes into RT buffer",
+					pBuffer->GetLength ());
 #endif
 
-		m_RetransmissionQueue.Write (TempBuffer, nLength);
+		m_RetransmissionQueue.Write (pBuffer->GetData (), pBuffer->GetLength ());
+
+		pBuffer->Release ();
 	}
 
 	// pacing transmit
@@ -576,6 +801,11 @@ void CTCPConnection::Process (void)
 	    && m_TxQueue.IsEmpty ())
 	{
 		m_TxEvent.Set ();
+
+		if (bTxQueued)
+		{
+			SignalEvent ();		// has become writable
+		}
 	}
 
 	if (m_bRetransmit)
@@ -584,24 +814,81 @@ void CTCPConnection::Process (void)
 		CLogger::Get ()->Write (FromTCP, LogDebug, "Retransmission (nxt %u, una %u)", m_nSND_NXT-m_nISS, m_nSND_UNA-m_nISS);
 #endif
 		m_bRetransmit = FALSE;
+
+		assert (m_pCongestionControl != 0);
+		m_pCongestionControl->RetransmissionTimeout (m_nSND_NXT-m_nSND_UNA);
+		m_nRetransmissionTimeouts++;
+
 		m_RetransmissionQueue.Reset ();
+		m_SACKScoreboard.Clear ();	// the receiver may have reneged (RFC 2018 section 8)
+		s_Retransmissions.Inc ();
 		m_nSND_NXT = m_nSND_UNA;
+
+		m_bInRecovery = FALSE;
+		m_nDupAcks = 0;
 	}
 
 	u32 nBytesAvail;
 	u32 nWindowLeft;
 	while (   (nBytesAvail = m_RetransmissionQueue.GetBytesAvailable ()) > 0
-	       && (nWindowLeft = m_nSND_UNA+m_nSND_WND-m_nSND_NXT) > 0)
+	       && (nWindowLeft = GetUsableWindow ()) > 0)
 	{
-		nLength = min (nBytesAvail, nWindowLeft);
-		nLength = min (nLength, m_nSND_MSS);
+		// do not send data again, which has been SACKed already
+		u32 nRightEdge;
+		if (m_SACKScoreboard.IsSACKed (m_nSND_NXT, &nRightEdge))
+		{
+			unsigned nSkip = min (nRightEdge-m_nSND_NXT, nBytesAvail);
+			m_RetransmissionQueue.Skip (nSkip);
+			m_nSND_NXT += nSkip;
+
+			continue;
+		}
+
+		unsigned nSegmentSize = GetSegmentSize ();
+		unsigned nLength = min (nBytesAvail, nWindowLeft);
+		nLength = min (nLength, nSegmentSize);
+
+		// Nagle algorithm (RFC 1122 section 4.2.3.4): hold back a small segment,
+		// while data is unacknowledged (or until uncorked), but not on close
+		if (   nBytesAvail < nSegmentSize
+		    && !m_bFINQueued
+		    && (   m_bCork
+			|| (   !m_bNoDelay
+			    && m_nSND_NXT != m_nSND_UNA)))
+		{
+			break;
+		}
+
+		u32 nLeftEdge;
+		if (m_SACKScoreboard.GetNextRange (m_nSND_NXT, &nLeftEdge))
+		{
+			nLength = min (nLength, nLeftEdge-m_nSND_NXT);
+		}
+
+		pBuffer = new CNetBuffer;
+		if (pBuffer == 0)
+		{
+			break;
+		}
 
 #ifdef TCP_DEBUG
 		CLogger::Get ()->Write (FromTCP, LogDebug, "Transfering %u bytes into TX buffer", nLength);
 #endif
 
+		// the segment is built around the data in place, the payload
+		// is summed for the checksum while copying it, if the net
+		// device cannot calculate the checksum
 		assert (nLength <= FRAME_BUFFER_SIZE);
-		m_RetransmissionQueue.Read (TempBuffer, nLength);
+		int nDataSum = -1;
+		assert (m_pNetworkLayer != 0);
+		if (m_pNetworkLayer->GetOffloadCapabilities () & NET_OFFLOAD_TX_CHECKSUM)
+		{
+			m_RetransmissionQueue.Read (pBuffer->Put (nLength), nLength);
+		}
+		else
+		{
+			nDataSum = m_RetransmissionQueue.ReadAndSum (pBuffer->Put (nLength), nLength);
+		}
 
 		unsigned nFlags = TCP_FLAG_ACK;
 		if (m_TxQueue.IsEmpty ())
@@ -609,19 +896,22 @@ void CTCPConnection::Process (void)
 			nFlags |= TCP_FLAG_PUSH;
 		}
 
-		SendSegment (nFlags, m_nSND_NXT, m_nRCV_NXT, TempBuffer, nLength);
+		SendSegment (nFlags, m_nSND_NXT, m_nRCV_NXT, pBuffer, nDataSum);
 		m_RTOCalculator.SegmentSent (m_nSND_NXT, nLength);
 		m_nSND_NXT += nLength;
 		StartTimer (TCPTimerRetransmission, m_RTOCalculator.GetRTO ());
 	}
 }
 
-int CTCPConnection::PacketReceived (const void	*pPacket,
-				    unsigned	 nLength,
+int CTCPConnection::PacketReceived (CNetBuffer	*pBuffer,
 				    CIPAddress	&rSenderIP,
 				    CIPAddress	&rReceiverIP,
 				    int		 nProtocol)
 {
+	assert (pBuffer != 0);
+	const void *pPacket = pBuffer->GetData ();
+	unsigned nLength = pBuffer->GetLength ();
+
 	if (nProtocol != IPPROTO_TCP)
 	{
 		return 0;
@@ -658,11 +948,14 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		m_Checksum.SetDestinationAddress (rSenderIP);
 	}
 
-	if (m_Checksum.Calculate (pPacket, nLength) != CHECKSUM_OK)
+	if (   !(pBuffer->GetOffloadFlags () & NET_FRAME_RX_L4_CHECKSUM_OK)
+	    && m_Checksum.Calculate (pPacket, nLength) != CHECKSUM_OK)
 	{
 		return 0;
 	}
 
+	s_SegmentsReceived.Inc ();
+
 	u16 nFlags = pHeader->nDataOffsetFlags;
 	u32 nDataOffset = TCP_DATA_OFFSET (pHeader->nDataOffsetFlags)*4;
 	u32 nDataLength = nLength-nDataOffset;
@@ -687,6 +980,11 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 
 	ScanOptions (pHeader);
 
+	if (!(nFlags & TCP_FLAG_SYN))
+	{
+		nSEG_WND <<= m_nSND_SCALE;	// RFC 7323 section 2.2
+	}
+
 #ifdef TCP_DEBUG
 	CLogger::Get ()->Write (FromTCP, LogDebug,
 				"rx %c%c%c%c%c%c, seq %u, ack %u, win %u, len %u",
@@ -764,12 +1062,15 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_nSND_WND = nSEG_WND;
 			m_nSND_WL1 = nSEG_SEQ;
 			m_nSND_WL2 = nSEG_ACK;
+
+			assert (m_pCongestionControl != 0);
+			m_pCongestionControl->Initialize (m_nSND_MSS);
 	
 			assert (nSEG_LEN > 0);
 
 			if (nDataLength > 0)
 			{
-				m_RxQueue.Enqueue ((u8 *) pPacket+nDataOffset, nDataLength);
+				QueueReceivedData (pBuffer, nDataOffset, nDataLength);
 			}
 
 			m_nISS = CalculateISN ();
@@ -788,6 +1089,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			NEW_STATE (TCPStateSynReceived);
 
 			m_Event.Set ();
+			SignalEvent ();
 		}
 		break;
 
@@ -818,6 +1120,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_nErrno = -1;
 
 				m_Event.Set ();
+				SignalEvent ();
 			}
 			
 			break;
@@ -834,6 +1137,9 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_nRCV_NXT = nSEG_SEQ+1;
 			m_nIRS = nSEG_SEQ;
 
+			assert (m_pCongestionControl != 0);
+			m_pCongestionControl->Initialize (m_nSND_MSS);
+
 			if (nFlags & TCP_FLAG_ACK)
 			{
 				m_RTOCalculator.SegmentAcknowledged (nSEG_ACK);
@@ -857,6 +1163,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_nRetransmissionCount = MAX_RETRANSMISSIONS;
 
 				m_Event.Set ();
+				SignalEvent ();
 
 				// RFC 1122 section 4.2.2.20 (c)
 				m_nSND_WND = nSEG_WND;
@@ -891,11 +1198,12 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 						NEW_STATE (TCPStateClosed);
 						m_nErrno = -1;
 						m_Event.Set ();
+						SignalEvent ();
 					}
 
 					if (nDataLength > 0)
 					{
-						m_RxQueue.Enqueue ((u8 *) pPacket+nDataOffset, nDataLength);
+						QueueReceivedData (pBuffer, nDataOffset, nDataLength);
 					}
 
 					break;
@@ -966,6 +1274,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					m_nErrno = -1;
 					NEW_STATE (TCPStateClosed);
 					m_Event.Set ();
+					SignalEvent ();
 					return 1;
 					
 				}
@@ -979,8 +1288,13 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_RetransmissionQueue.Flush ();
 				m_TxQueue.Flush ();
 				m_RxQueue.Flush ();
+				m_nRxQueued = 0;
+				m_nRxBuffers = 0;
+				m_OutOfOrderQueue.Flush ();
+				m_SACKScoreboard.Clear ();
 				NEW_STATE (TCPStateClosed);
 				m_Event.Set ();
+				SignalEvent ();
 				return 1;
 
 			case TCPStateClosing:
@@ -988,6 +1302,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			case TCPStateTimeWait:
 				NEW_STATE (TCPStateClosed);
 				m_Event.Set ();
+				SignalEvent ();
 				return 1;
 
 			default:
@@ -1014,8 +1329,13 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_RetransmissionQueue.Flush ();
 			m_TxQueue.Flush ();
 			m_RxQueue.Flush ();
+			m_nRxQueued = 0;
+			m_nRxBuffers = 0;
+			m_OutOfOrderQueue.Flush ();
+			m_SACKScoreboard.Clear ();
 			NEW_STATE (TCPStateClosed);
 			m_Event.Set ();
+			SignalEvent ();
 			return 1;
 		}
 
@@ -1043,6 +1363,8 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 
 				// next transmission starts with this count
 				m_nRetransmissionCount = MAX_RETRANSMISSIONS;
+
+				SignalEvent ();		// has become writable
 			}
 			else
 			{
@@ -1062,6 +1384,9 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				unsigned nBytesAck = nSEG_ACK-m_nSND_UNA;
 				m_nSND_UNA = nSEG_ACK;
 
+				m_SACKScoreboard.Advance (m_nSND_UNA);
+				m_nDupAcks = 0;
+
 				if (nSEG_ACK == m_nSND_NXT)	// all segments are acknowledged
 				{
 					StopTimer (TCPTimerRetransmission);
@@ -1097,11 +1422,55 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					m_nSND_WL1 = nSEG_SEQ;
 					m_nSND_WL2 = nSEG_ACK;
 				}
+
+				assert (m_pCongestionControl != 0);
+				if (m_bInRecovery)
+				{
+					if (ge (m_nSND_UNA, m_nRecoveryPoint))
+					{
+						m_bInRecovery = FALSE;
+						m_pCongestionControl->RecoveryFinished ();
+					}
+					else
+					{
+						RetransmitLostSegment ();	// partial ACK
+					}
+				}
+				else if (nBytesAck > 0)
+				{
+					m_pCongestionControl->DataAcknowledged (nBytesAck,
+										m_RTOCalculator.GetSRTT ());
+				}
 			}
 			else if (le (nSEG_ACK, m_nSND_UNA))	// RFC 1122 section 4.2.2.20 (g)
 			{
-				// ignore duplicate ACK ...
-				
+				// duplicate ACKs trigger the loss recovery (RFC 5681 section 2)
+				if (   nSEG_ACK == m_nSND_UNA
+				    && m_nSND_NXT != m_nSND_UNA
+				    && nDataLength == 0
+				    && nSEG_WND == m_nSND_WND
+				    && !(nFlags & (TCP_FLAG_SYN | TCP_FLAG_FIN)))
+				{
+					m_nDupAcks++;
+
+					if (m_bInRecovery)
+					{
+						RetransmitLostSegment ();
+					}
+					else if (m_nDupAcks == TCP_DUP_ACK_THRESHOLD)
+					{
+						// fast retransmit (RFC 5681 section 3.2)
+						m_bInRecovery = TRUE;
+						m_nRecoveryPoint = m_nSND_NXT;
+						m_nHighRxt = m_nSND_UNA;
+
+						assert (m_pCongestionControl != 0);
+						m_pCongestionControl->LossDetected (m_nSND_NXT-m_nSND_UNA);
+
+						RetransmitLostSegment ();
+					}
+				}
+
 				// RFC 1122 section 4.2.2.20 (g)
 				if (bwlh (m_nSND_UNA, nSEG_ACK, m_nSND_NXT))
 				{
@@ -1148,6 +1517,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				if (m_RetransmissionQueue.IsEmpty ())
 				{
 					m_Event.Set ();
+					SignalEvent ();
 				}
 				break;
 				
@@ -1175,6 +1545,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_bFINQueued = FALSE;
 				NEW_STATE (TCPStateClosed);
 				m_Event.Set ();
+				SignalEvent ();
 				return 1;
 			}
 			break;
@@ -1207,27 +1578,90 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		case TCPStateEstablished:
 		case TCPStateFinWait1:
 		case TCPStateFinWait2:
+			// remove data at the front, which has been received before
+			if (   lt (nSEG_SEQ, m_nRCV_NXT)
+			    && (   gt (nSEG_SEQ+nDataLength, m_nRCV_NXT)
+				|| (   (nFlags & TCP_FLAG_FIN)
+				    && nSEG_SEQ+nDataLength == m_nRCV_NXT)))
+			{
+				u32 nDuplicate = m_nRCV_NXT-nSEG_SEQ;
+				nDataOffset += nDuplicate;
+				nDataLength -= nDuplicate;
+				nSEG_SEQ = m_nRCV_NXT;
+			}
+
+			if (   nSEG_SEQ == m_nRCV_NXT
+			    && nDataLength > 0
+			    && m_nRxBuffers >= TCP_CONFIG_RCV_BUFFERS_MAX)
+			{
+				// too many small segments are queued, drop this one,
+				// it will be retransmitted, when the application has read
+				SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
+				return 1;
+			}
+
 			if (nSEG_SEQ == m_nRCV_NXT)
 			{
 				if (nDataLength > 0)
 				{
-					m_RxQueue.Enqueue ((u8 *) pPacket+nDataOffset, nDataLength);
+					QueueReceivedData (pBuffer, nDataOffset, nDataLength);
+					u32 nBytesReceived = nDataLength;
 
-					m_nRCV_NXT += nDataLength;
+					// continue with segments, which have been received out of order
+					CNetBuffer *pNext;
+					while ((pNext = m_OutOfOrderQueue.Remove (m_nRCV_NXT+nBytesReceived)) != 0)
+					{
+						unsigned nNextLength = pNext->GetLength ();
+						m_RxQueue.Enqueue (pNext);
+						m_nRxQueued += nNextLength;
+						m_nRxBuffers++;
 
-					// m_nRCV_WND should be adjusted here (section 3.7)
+						nBytesReceived += nNextLength;
+					}
 
-					// following ACK could be piggybacked with data
-					SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
+					m_nRCV_NXT += nBytesReceived;
 
-					if (nFlags & TCP_FLAG_PUSH)
+					// the received data consumes the window (section 3.7)
+					m_nRCV_WND = nBytesReceived < m_nRCV_WND ? m_nRCV_WND-nBytesReceived : 0;
+					UpdateReceiveWindow ();
+
+					// ACK every second segment and after a gap has been filled
+					// immediately, otherwise delay it, so that it can be
+					// piggybacked with data (RFC 5681 section 4.2)
+					if (   ++m_nUnackedSegments >= TCP_DELAYED_ACK_SEGMENTS
+					    || nBytesReceived > nDataLength
+					    || !m_OutOfOrderQueue.IsEmpty ())
+					{
+						SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
+					}
+					else
+					{
+						StartTimer (TCPTimerDelayedACK, HZ_DELAYED_ACK);
+					}
+
+					if (   (nFlags & TCP_FLAG_PUSH)
+					    || nBytesReceived > nDataLength)
 					{
 						m_Event.Set ();
 					}
+
+					SignalEvent ();		// has become readable
 				}
 			}
 			else
 			{
+				if (   gt (nSEG_SEQ, m_nRCV_NXT)
+				    && nDataLength > 0)
+				{
+					// a FIN is not queued, it will be retransmitted
+					pBuffer->AddRef ();
+					pBuffer->Pull (nDataOffset);
+					pBuffer->Trim (nDataLength);
+
+					m_OutOfOrderQueue.Insert (nSEG_SEQ, pBuffer);
+				}
+
+				// duplicate ACK, reports the queued segments with SACK
 				SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 				return 1;
 			}
@@ -1268,6 +1702,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		case TCPStateEstablished:
 			NEW_STATE (TCPStateCloseWait);
 			m_Event.Set ();
+			SignalEvent ();
 			break;
 
 		case TCPStateFinWait1:
@@ -1348,54 +1783,164 @@ int CTCPConnection::NotificationReceived (TICMPNotificationType  Type,
 	StartTimer (TCPTimerTimeWait, HZ_TIMEWAIT);
 
 	m_Event.Set ();
+	SignalEvent ();
 
 	return 1;
 }
 
 boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber,
-				     const void *pData, unsigned nDataLength)
+				     CNetBuffer *pData, int nDataSum)
 {
+	if (pData == 0)
+	{
+		pData = new CNetBuffer;
+		if (pData == 0)
+		{
+			return FALSE;
+		}
+	}
+
+	unsigned nDataLength = pData->GetLength ();
+
+	s_SegmentsSent.Inc ();
+
+	if (   (nFlags & TCP_FLAG_ACK)
+	    && m_nUnackedSegments > 0)
+	{
+		// this segment acknowledges all received data
+		m_nUnackedSegments = 0;
+		StopTimer (TCPTimerDelayedACK);
+		m_bSendDelayedACK = FALSE;
+	}
+
+	// the Window Scale option is sent on SYN, on SYN-ACK only if it was received
+	boolean bWindowScale =    (nFlags & TCP_FLAG_SYN)
+			       && (   !(nFlags & TCP_FLAG_ACK)
+				   || m_bWindowScale);
+
+	boolean bSACKPermitted =    (nFlags & TCP_FLAG_SYN)
+				 && (   !(nFlags & TCP_FLAG_ACK)
+				     || m_bSACKPermitted);
+
+	u32 SACKLeftEdge[TCP_MAX_SACK_BLOCKS];
+	u32 SACKRightEdge[TCP_MAX_SACK_BLOCKS];
+	unsigned nSACKBlocks = 0;
+	if (   m_bSACKPermitted
+	    && (nFlags & (TCP_FLAG_ACK | TCP_FLAG_SYN | TCP_FLAG_RESET)) == TCP_FLAG_ACK)
+	{
+		nSACKBlocks = m_OutOfOrderQueue.GetSACKBlocks (SACKLeftEdge, SACKRightEdge,
+							       TCP_MAX_SACK_BLOCKS);
+	}
+
 	unsigned nDataOffset = 5;
 	assert (nDataOffset * 4 == sizeof (TTCPHeader));
 	if (nFlags & TCP_FLAG_SYN)
 	{
 		nDataOffset++;
 	}
+	if (bSACKPermitted)
+	{
+		nDataOffset++;
+	}
+	if (bWindowScale)
+	{
+		nDataOffset++;
+	}
+	if (nSACKBlocks > 0)
+	{
+		nDataOffset += 1 + nSACKBlocks*2;
+	}
 	unsigned nHeaderLength = nDataOffset * 4;
 	
 	unsigned nPacketLength = nHeaderLength + nDataLength;		// may wrap
 	assert (nPacketLength >= nHeaderLength);
 	assert (nHeaderLength <= FRAME_BUFFER_SIZE);
 
-	u8 TxBuffer[FRAME_BUFFER_SIZE];
-	TTCPHeader *pHeader = (TTCPHeader *) TxBuffer;
+	TTCPHeader *pHeader = (TTCPHeader *) pData->Push (nHeaderLength);
 
 	pHeader->nSourcePort	 	= le2be16 (m_nOwnPort);
 	pHeader->nDestPort	 	= le2be16 (m_nForeignPort);
 	pHeader->nSequenceNumber 	= le2be32 (nSequenceNumber);
 	pHeader->nAcknowledgmentNumber	= nFlags & TCP_FLAG_ACK ? le2be32 (nAcknowledgmentNumber) : 0;
 	pHeader->nDataOffsetFlags	= (nDataOffset << TCP_DATA_OFFSET_SHIFT) | nFlags;
-	pHeader->nWindow		= le2be16 (m_nRCV_WND);
+	// the window field in SYN segments is never scaled (RFC 7323 section 2.2)
+	u32 nWindow = nFlags & TCP_FLAG_SYN ? m_nRCV_WND : m_nRCV_WND >> m_nRCV_SCALE;
+	pHeader->nWindow		= le2be16 (min (nWindow, TCP_MAX_WINDOW));
 	pHeader->nUrgentPointer		= le2be16 (m_nSND_UP);
 
+	TTCPOption *pOption = (TTCPOption *) pHeader->Options;
 	if (nFlags & TCP_FLAG_SYN)
 	{
-		TTCPOption *pOption = (TTCPOption *) pHeader->Options;
-
 		pOption->nKind   = TCP_OPTION_MSS;
 		pOption->nLength = 4;
 		pOption->Data[0] = TCP_CONFIG_MSS >> 8;
 		pOption->Data[1] = TCP_CONFIG_MSS & 0xFF;
-	}
+		pOption = (TTCPOption *) ((u8 *) pOption+4);
+
+		if (bSACKPermitted)
+		{
+			pOption->nKind   = TCP_OPTION_NOP;
+			pOption = (TTCPOption *) ((u8 *) pOption+1);
+			pOption->nKind   = TCP_OPTION_NOP;
+
+			pOption = (TTCPOption *) ((u8 *) pOption+1);
+			pOption->nKind   = TCP_OPTION_SACK_PERM;
+			pOption->nLength = 2;
+			pOption = (TTCPOption *) ((u8 *) pOption+2);
+		}
 
-	if (nDataLength > 0)
+		if (bWindowScale)
+		{
+			pOption->nKind   = TCP_OPTION_NOP;
+
+			pOption = (TTCPOption *) ((u8 *) pOption+1);
+			pOption->nKind   = TCP_OPTION_WINDOW_SCALE;
+			pOption->nLength = 3;
+			pOption->Data[0] = TCP_CONFIG_WINDOW_SCALE;
+		}
+	}
+	else if (nSACKBlocks > 0)
 	{
-		assert (pData != 0);
-		memcpy (TxBuffer+nHeaderLength, pData, nDataLength);
+		pOption->nKind   = TCP_OPTION_NOP;
+		pOption = (TTCPOption *) ((u8 *) pOption+1);
+		pOption->nKind   = TCP_OPTION_NOP;
+
+		pOption = (TTCPOption *) ((u8 *) pOption+1);
+		pOption->nKind   = TCP_OPTION_SACK;
+		pOption->nLength = 2 + nSACKBlocks*8;
+
+		u8 *pData = pOption->Data;
+		for (unsigned i = 0; i < nSACKBlocks; i++)
+		{
+			*pData++ = SACKLeftEdge[i] >> 24;
+			*pData++ = SACKLeftEdge[i] >> 16;
+			*pData++ = SACKLeftEdge[i] >> 8;
+			*pData++ = SACKLeftEdge[i];
+			*pData++ = SACKRightEdge[i] >> 24;
+			*pData++ = SACKRightEdge[i] >> 16;
+			*pData++ = SACKRightEdge[i] >> 8;
+			*pData++ = SACKRightEdge[i];
+		}
 	}
 
 	pHeader->nChecksum = 0;		// must be 0 for calculation
-	pHeader->nChecksum = m_Checksum.Calculate (TxBuffer, nPacketLength);
+	assert (m_pNetworkLayer != 0);
+	if (m_pNetworkLayer->GetOffloadCapabilities () & NET_OFFLOAD_TX_CHECKSUM)
+	{
+		// the net device completes the checksum
+		pHeader->nChecksum = m_Checksum.PseudoHeaderSum (nPacketLength);
+		pData->SetChecksumPartial (pHeader, &pHeader->nChecksum, FALSE);
+	}
+	else if (nDataSum >= 0)
+	{
+		assert (nDataLength > 0);
+		pHeader->nChecksum = m_Checksum.Calculate (pHeader, nHeaderLength,
+							   (u16) nDataSum, nDataLength);
+	}
+	else
+	{
+		pHeader->nChecksum = m_Checksum.Calculate (pHeader, nPacketLength);
+	}
 
 #ifdef TCP_DEBUG
 	CLogger::Get ()->Write (FromTCP, LogDebug,
@@ -1413,7 +1958,72 @@ boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 n
 #endif
 
 	assert (m_pNetworkLayer != 0);
-	return m_pNetworkLayer->Send (m_ForeignIP, TxBuffer, nPacketLength, IPPROTO_TCP);
+	return m_pNetworkLayer->Send (m_ForeignIP, pData, IPPROTO_TCP);
+}
+
+void CTCPConnection::QueueReceivedData (CNetBuffer *pBuffer, unsigned nDataOffset,
+					unsigned nDataLength)
+{
+	// the segment buffer is queued without copying the data
+	assert (pBuffer != 0);
+	pBuffer->AddRef ();
+	pBuffer->Pull (nDataOffset);
+	pBuffer->Trim (nDataLength);
+
+	m_RxQueue.Enqueue (pBuffer);
+	m_nRxQueued += nDataLength;
+	m_nRxBuffers++;
+}
+
+boolean CTCPConnection::UpdateReceiveWindow (void)
+{
+	u32 nFree = m_nRCV_BUF > m_nRxQueued ? m_nRCV_BUF-m_nRxQueued : 0;
+
+	// each queued segment pins a net buffer from the global pool, independent of
+	// its length, so the window must not exceed the remaining buffers too
+	u32 nFreeBuffers =   m_nRxBuffers < TCP_CONFIG_RCV_BUFFERS_MAX
+			   ? TCP_CONFIG_RCV_BUFFERS_MAX-m_nRxBuffers : 0;
+	nFree = min (nFree, nFreeBuffers*TCP_CONFIG_MSS);
+	nFree &= ~((1U << m_nRCV_SCALE)-1);	// must be representable in scaled form
+
+	// receiver side SWS avoidance (RFC 1122 section 4.2.3.3),
+	// the right window edge is never moved to the left here
+	if (nFree < m_nRCV_WND + min (m_nRCV_BUF/2, TCP_CONFIG_MSS))
+	{
+		return FALSE;
+	}
+
+	m_nRCV_WND = nFree;
+
+	return TRUE;
+}
+
+void CTCPConnection::AdjustReceiveBuffer (unsigned nBytesRead)
+{
+	// the receive buffer is sized to hold twice the amount of data,
+	// which is read by the application within one round-trip time
+	m_nRxBytesRead += nBytesRead;
+
+	assert (m_pTimer != 0);
+	unsigned nTicks = m_pTimer->GetTicks ();
+	unsigned nElapsed = nTicks - m_nRxMeasureStart;
+
+	unsigned nRTT = max (m_RTOCalculator.GetSRTT (), 1);
+	if (nElapsed < nRTT)
+	{
+		return;
+	}
+
+	u32 nBytesPerRTT = m_nRxBytesRead * nRTT / nElapsed;
+	u32 nBufferMax = m_bWindowScale ? TCP_CONFIG_RCV_BUFFER_MAX : TCP_MAX_WINDOW;
+	u32 nBuffer = min (2*nBytesPerRTT, nBufferMax);
+	if (nBuffer > m_nRCV_BUF)
+	{
+		m_nRCV_BUF = nBuffer;
+	}
+
+	m_nRxBytesRead = 0;
+	m_nRxMeasureStart = nTicks;
 }
 
 void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
@@ -1422,9 +2032,28 @@ void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
 	unsigned nDataOffset = TCP_DATA_OFFSET (pHeader->nDataOffsetFlags)*4;
 	u8 *pHeaderEnd = (u8 *) pHeader+nDataOffset;
 
+	// the Window Scale option is negotiated, when a SYN is processed
+	boolean bNegotiate =    (pHeader->nDataOffsetFlags & TCP_FLAG_SYN)
+			     && (   m_State == TCPStateListen
+				 || m_State == TCPStateSynSent);
+	if (bNegotiate)
+	{
+		m_bWindowScale = FALSE;
+		m_nSND_SCALE = 0;
+		m_nRCV_SCALE = 0;
+
+		m_bSACKPermitted = FALSE;
+	}
+
 	TTCPOption *pOption = (TTCPOption *) pHeader->Options;
 	while ((u8 *) pOption+2 <= pHeaderEnd)
 	{
+		if (   pOption->nKind > TCP_OPTION_NOP
+		    && pOption->nLength < 2)
+		{
+			return;			// invalid option length, would loop forever
+		}
+
 		switch (pOption->nKind)
 		{
 		case TCP_OPTION_END_OF_LIST:
@@ -1434,6 +2063,54 @@ void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
 			pOption = (TTCPOption *) ((u8 *) pOption+1);
 			break;
 			
+		case TCP_OPTION_WINDOW_SCALE:
+			if (   bNegotiate
+			    && pOption->nLength == 3
+			    && (u8 *) pOption+3 <= pHeaderEnd)
+			{
+				m_bWindowScale = TRUE;
+				m_nSND_SCALE = min (pOption->Data[0], TCP_MAX_WINDOW_SCALE);
+				m_nRCV_SCALE = TCP_CONFIG_WINDOW_SCALE;
+			}
+			pOption = (TTCPOption *) ((u8 *) pOption+pOption->nLength);
+			break;
+
+		case TCP_OPTION_SACK_PERM:
+			if (   bNegotiate
+			    && pOption->nLength == 2)
+			{
+				m_bSACKPermitted = TRUE;
+			}
+			pOption = (TTCPOption *) ((u8 *) pOption+pOption->nLength);
+			break;
+
+		case TCP_OPTION_SACK:
+			if (   m_bSACKPermitted
+			    && (pHeader->nDataOffsetFlags & TCP_FLAG_ACK)
+			    && pOption->nLength >= 10
+			    && (pOption->nLength-2) % 8 == 0
+			    && (u8 *) pOption+pOption->nLength <= pHeaderEnd)
+			{
+				const u8 *pData = pOption->Data;
+				for (unsigned i = 0; i < (pOption->nLength-2u) / 8; i++, pData += 8)
+				{
+					u32 nLeftEdge  =   (u32) pData[0] << 24 | (u32) pData[1] << 16
+							 | (u32) pData[2] << 8  | pData[3];
+					u32 nRightEdge =   (u32) pData[4] << 24 | (u32) pData[5] << 16
+							 | (u32) pData[6] << 8  | pData[7];
+
+					// ignore blocks, which are invalid or acknowledged already
+					if (   lt (nLeftEdge, nRightEdge)
+					    && lt (m_nSND_UNA, nRightEdge)
+					    && le (nRightEdge, m_nSND_NXT))
+					{
+						m_SACKScoreboard.Add (nLeftEdge, nRightEdge);
+					}
+				}
+			}
+			pOption = (TTCPOption *) ((u8 *) pOption+pOption->nLength);
+			break;
+
 		case TCP_OPTION_MSS:
 			if (   pOption->nLength == 4
 			    && (u8 *) pOption+4 <= pHeaderEnd)
@@ -1457,6 +2134,124 @@ void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
 	}
 }
 
+boolean CTCPConnection::RetransmitLostSegment (void)
+{
+	// the retransmission queue is empty, when the FIN has been sent
+	if (   m_State != TCPStateEstablished
+	    && m_State != TCPStateCloseWait)
+	{
+		return FALSE;
+	}
+
+	u32 nSequenceNumber = lt (m_nHighRxt, m_nSND_UNA) ? m_nSND_UNA : m_nHighRxt;
+
+	u32 nRightEdge;
+	while (m_SACKScoreboard.IsSACKed (nSequenceNumber, &nRightEdge))
+	{
+		nSequenceNumber = nRightEdge;
+	}
+
+	// without SACK information only the first segment is considered lost
+	u32 nEnd = m_SACKScoreboard.IsEmpty () ? m_nSND_UNA+m_nSND_MSS
+					       : m_SACKScoreboard.GetHighest ();
+	if (gt (nEnd, m_nSND_NXT))
+	{
+		nEnd = m_nSND_NXT;
+	}
+
+	u32 nLeftEdge;
+	if (   m_SACKScoreboard.GetNextRange (nSequenceNumber, &nLeftEdge)
+	    && lt (nLeftEdge, nEnd))
+	{
+		nEnd = nLeftEdge;
+	}
+
+	if (!lt (nSequenceNumber, nEnd))
+	{
+		return FALSE;
+	}
+
+	unsigned nLength = min (nEnd-nSequenceNumber, GetSegmentSize ());
+
+	CNetBuffer *pBuffer = new CNetBuffer;
+	if (pBuffer == 0)
+	{
+		return FALSE;
+	}
+
+#ifdef TCP_DEBUG
+	CLogger::Get ()->Write (FromTCP, LogDebug, "Retransmitting lost segment (seq %u, len %u)",
+				nSequenceNumber-m_nISS, nLength);
+#endif
+
+	assert (nLength <= FRAME_BUFFER_SIZE);
+	m_RetransmissionQueue.Peek (pBuffer->Put (nLength), nSequenceNumber-m_nSND_UNA, nLength);
+
+	SendSegment (TCP_FLAG_ACK, nSequenceNumber, m_nRCV_NXT, pBuffer);
+	s_Retransmissions.Inc ();
+	m_nFastRetransmissions++;
+
+	m_nHighRxt = nSequenceNumber+nLength;
+
+	return TRUE;
+}
+
+u32 CTCPConnection::GetUsableWindow (void) const
+{
+	u32 nFlightSize = m_nSND_NXT-m_nSND_UNA;
+	if (nFlightSize >= m_nSND_WND)
+	{
+		return 0;
+	}
+
+	// estimate of the data in the network (RFC 6675 section 4)
+	u32 nPipe = nFlightSize - m_SACKScoreboard.GetSACKedBytes (m_nSND_NXT);
+	if (   m_bInRecovery
+	    && m_SACKScoreboard.IsEmpty ())
+	{
+		// without SACK each duplicate ACK indicates a segment, which has left the network
+		u32 nLeft = m_nDupAcks * m_nSND_MSS;
+		nPipe = nPipe > nLeft ? nPipe-nLeft : 0;
+	}
+
+	assert (m_pCongestionControl != 0);
+	u32 nCWND = m_pCongestionControl->GetWindow ();
+	if (nPipe >= nCWND)
+	{
+		return 0;
+	}
+
+	return min (m_nSND_WND-nFlightSize, nCWND-nPipe);
+}
+
+unsigned CTCPConnection::GetSegmentSize (void) const
+{
+	// RFC 1191 section 6.3
+	assert (m_pNetworkLayer != 0);
+	unsigned nMTU = m_pNetworkLayer->GetPathMTU (m_ForeignIP);
+	assert (nMTU > sizeof (TIPHeader) + TCP_HEADER_SIZE);
+
+	unsigned nSegmentSize = min (m_nSND_MSS, nMTU - sizeof (TIPHeader) - TCP_HEADER_SIZE);
+
+	// the SACK option is sent with the data too and must fit in (RFC 6691)
+	if (   m_bSACKPermitted
+	    && !m_OutOfOrderQueue.IsEmpty ())
+	{
+		u32 SACKLeftEdge[TCP_MAX_SACK_BLOCKS];
+		u32 SACKRightEdge[TCP_MAX_SACK_BLOCKS];
+		unsigned nSACKBlocks = m_OutOfOrderQueue.GetSACKBlocks (SACKLeftEdge, SACKRightEdge,
+									TCP_MAX_SACK_BLOCKS);
+		if (nSACKBlocks > 0)
+		{
+			unsigned nOptionLength = 4 + nSACKBlocks*8;	// with 2 NOPs for alignment
+			assert (nSegmentSize > nOptionLength);
+			nSegmentSize -= nOptionLength;
+		}
+	}
+
+	return nSegmentSize;
+}
+
 u32 CTCPConnection::CalculateISN (void)
 {
 	assert (m_pTimer != 0);
@@ -1554,6 +2349,10 @@ void CTCPConnection::TimerHandler (unsigned nTimer)
 		NEW_STATE (TCPStateClosed);
 		break;
 
+	case TCPTimerDelayedACK:
+		m_bSendDelayedACK = TRUE;
+		break;
+
 	case TCPTimerUser:
 	case TCPTimerUnknown:
 		assert (0);
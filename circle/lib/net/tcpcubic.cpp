@@ -0,0 +1,211 @@
+//
+// tcpcubic.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/tcpcubic.h>
+#include <circle/timer.h>
+#include <assert.h>
+
+// All calculations are done in integer arithmetic without 64-bit divisions.
+
+#define BETA_CUBIC		717		// 0.7 (in 1/1024)
+#define ALPHA_CUBIC_INV		1935		// 1 / (3 * (1-0.7) / (1+0.7)) (in 1/1024)
+
+// C * t^3 in segments (10 fractional bits) with C = 0.4 and t in milliseconds:
+//	0.4 * 1024 / 10^9 * t^3 = (440 * t^3) >> 30
+#define C_CUBIC_SCALED		440
+
+// K^3 in milliseconds^3 from (W_max - cwnd) in segments (10 fractional bits):
+//	1 / 0.4 * 10^9 / 1024
+#define K_CUBED_SCALE		2441406
+
+#define MAX_TIME_DIFF		(1U << 17)	// milliseconds, avoids overflow
+
+CTCPCubic::CTCPCubic (void)
+:	CTCPCongestionControl (TCPCongestionControlCUBIC),
+	m_nWmax (0),
+	m_nWlastMax (0),
+	m_bEpochStarted (FALSE),
+	m_nEpochStart (0),
+	m_nK (0),
+	m_nOrigin (0),
+	m_nCubicAcked (0),
+	m_nWest (0),
+	m_nWestAcked (0)
+{
+}
+
+CTCPCubic::~CTCPCubic (void)
+{
+}
+
+void CTCPCubic::DataAcknowledged (u32 nBytesAcked, unsigned nRTT)
+{
+	if (m_nCWND < m_nSSThresh)
+	{
+		SlowStart (nBytesAcked);
+
+		return;
+	}
+
+	unsigned nNow = CTimer::GetClockTicks ();
+	u32 nCWNDSegments = BytesToSegments (m_nCWND);
+
+	if (!m_bEpochStarted)			// congestion avoidance starts (section 4.2)
+	{
+		m_bEpochStarted = TRUE;
+		m_nEpochStart = nNow;
+
+		if (nCWNDSegments < m_nWmax)
+		{
+			m_nK = CubeRoot ((u64) (m_nWmax - nCWNDSegments) * K_CUBED_SCALE);
+			m_nOrigin = m_nWmax;
+		}
+		else
+		{
+			m_nK = 0;
+			m_nOrigin = nCWNDSegments;
+		}
+
+		m_nCubicAcked = 0;
+		m_nWest = m_nCWND;
+		m_nWestAcked = 0;
+	}
+
+	// target window for one RTT ahead
+	u32 nTime = (nNow - m_nEpochStart) / 1000 + nRTT * 1000 / HZ;
+	u32 nTimeDiff = nTime >= m_nK ? nTime - m_nK : m_nK - nTime;
+	if (nTimeDiff > MAX_TIME_DIFF)
+	{
+		nTimeDiff = MAX_TIME_DIFF;
+	}
+
+	u64 ulDelta = ((u64) nTimeDiff * nTimeDiff * nTimeDiff * C_CUBIC_SCALED) >> 30;
+
+	u32 nTarget;
+	if (nTime >= m_nK)
+	{
+		nTarget = m_nOrigin + (u32) ulDelta;
+	}
+	else
+	{
+		nTarget = m_nOrigin > ulDelta ? m_nOrigin - (u32) ulDelta : 0;
+	}
+
+	u32 nTargetBytes = SegmentsToBytes (nTarget);
+	if (nTargetBytes > m_nCWND + m_nCWND/2)		// limit (section 4.2)
+	{
+		nTargetBytes = m_nCWND + m_nCWND/2;
+	}
+
+	// concave or convex region: one SMSS per cwnd/(target-cwnd) acknowledged segments
+	if (nTargetBytes > m_nCWND)
+	{
+		u32 nSegments = m_nCWND / (nTargetBytes - m_nCWND);
+		u32 nThreshold = (nSegments > 0 ? nSegments : 1) * m_nMSS;
+
+		m_nCubicAcked += nBytesAcked;
+		if (m_nCubicAcked >= nThreshold)
+		{
+			m_nCubicAcked -= nThreshold;
+
+			IncreaseWindow (m_nMSS);
+		}
+	}
+
+	// Reno-friendly region (section 4.3), alpha_cubic SMSS per RTT
+	u32 nThreshold = (u32) (((u64) m_nCWND * ALPHA_CUBIC_INV) >> 10);
+	m_nWestAcked += nBytesAcked;
+	if (m_nWestAcked >= nThreshold)
+	{
+		m_nWestAcked -= nThreshold;
+		m_nWest += m_nMSS;
+	}
+
+	if (m_nWest > m_nCWND)
+	{
+		IncreaseWindow (m_nWest - m_nCWND);
+	}
+}
+
+void CTCPCubic::LossDetected (u32 nFlightSize)
+{
+	m_bEpochStarted = FALSE;
+
+	// fast convergence (section 4.7)
+	u32 nCWNDSegments = BytesToSegments (m_nCWND);
+	if (nCWNDSegments < m_nWlastMax)
+	{
+		m_nWlastMax = nCWNDSegments;
+		m_nWmax = (u32) (((u64) nCWNDSegments * (1024 + BETA_CUBIC)) >> 11);
+	}
+	else
+	{
+		m_nWlastMax = nCWNDSegments;
+		m_nWmax = nCWNDSegments;
+	}
+
+	// multiplicative decrease (section 4.6)
+	m_nSSThresh = (u32) (((u64) nFlightSize * BETA_CUBIC) >> 10);
+	if (m_nSSThresh < 2U * m_nMSS)
+	{
+		m_nSSThresh = 2 * m_nMSS;
+	}
+
+	m_nCWND = m_nSSThresh;
+}
+
+void CTCPCubic::RetransmissionTimeout (u32 nFlightSize)
+{
+	LossDetected (nFlightSize);		// section 4.8
+
+	m_nCWND = m_nMSS;			// loss window
+}
+
+u32 CTCPCubic::BytesToSegments (u32 nBytes) const
+{
+	assert (m_nMSS > 0);
+	return   (nBytes / m_nMSS) << 10
+	       | ((nBytes % m_nMSS) << 10) / m_nMSS;
+}
+
+u32 CTCPCubic::SegmentsToBytes (u32 nSegments) const
+{
+	u64 ulBytes = ((u64) nSegments * m_nMSS) >> 10;
+
+	return ulBytes < TCP_MAX_CONGESTION_WINDOW ? (u32) ulBytes : TCP_MAX_CONGESTION_WINDOW;
+}
+
+u32 CTCPCubic::CubeRoot (u64 ulValue)
+{
+	// bitwise integer cube root
+	u64 ulResult = 0;
+	for (int nShift = 63; nShift >= 0; nShift -= 3)
+	{
+		ulResult <<= 1;
+
+		u64 ulBit = 3 * ulResult * (ulResult + 1) + 1;
+		if ((ulValue >> nShift) >= ulBit)
+		{
+			ulValue -= ulBit << nShift;
+			ulResult++;
+		}
+	}
+
+	return (u32) ulResult;
+}
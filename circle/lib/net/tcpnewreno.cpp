@@ -0,0 +1,62 @@
+//
+// tcpnewreno.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/tcpnewreno.h>
+
+CTCPNewReno::CTCPNewReno (void)
+:	CTCPCongestionControl (TCPCongestionControlNewReno),
+	m_nBytesAcked (0)
+{
+}
+
+CTCPNewReno::~CTCPNewReno (void)
+{
+}
+
+void CTCPNewReno::DataAcknowledged (u32 nBytesAcked, unsigned nRTT)
+{
+	if (m_nCWND < m_nSSThresh)
+	{
+		SlowStart (nBytesAcked);
+
+		return;
+	}
+
+	// congestion avoidance, one SMSS per RTT (RFC 5681 section 3.1)
+	m_nBytesAcked += nBytesAcked;
+	if (m_nBytesAcked >= m_nCWND)
+	{
+		m_nBytesAcked -= m_nCWND;
+
+		IncreaseWindow (m_nMSS);
+	}
+}
+
+void CTCPNewReno::LossDetected (u32 nFlightSize)
+{
+	// RFC 5681 section 3.2
+	m_nSSThresh = nFlightSize / 2;
+	if (m_nSSThresh < 2U * m_nMSS)
+	{
+		m_nSSThresh = 2 * m_nMSS;
+	}
+
+	m_nCWND = m_nSSThresh;
+	m_nBytesAcked = 0;
+}
@@ -4,7 +4,7 @@
 // Generates RESET response on any received TCP segment
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -66,9 +66,13 @@ CTCPRejector::~CTCPRejector (void)
 {
 }
 
-int CTCPRejector::PacketReceived (const void *pPacket, unsigned nLength,
+int CTCPRejector::PacketReceived (CNetBuffer *pBuffer,
 				  CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol)
 {
+	assert (pBuffer != 0);
+	const void *pPacket = pBuffer->GetData ();
+	unsigned nLength = pBuffer->GetLength ();
+
 	if (nProtocol != IPPROTO_TCP)
 	{
 		return 0;
@@ -97,7 +101,8 @@ int CTCPRejector::PacketReceived (const void *pPacket, unsigned nLength,
 	m_Checksum.SetSourceAddress (*m_pNetConfig->GetIPAddress ());
 	m_Checksum.SetDestinationAddress (rSenderIP);
 
-	if (m_Checksum.Calculate (pPacket, nLength) != CHECKSUM_OK)
+	if (   !(pBuffer->GetOffloadFlags () & NET_FRAME_RX_L4_CHECKSUM_OK)
+	    && m_Checksum.Calculate (pPacket, nLength) != CHECKSUM_OK)
 	{
 		return 0;
 	}
@@ -2,7 +2,7 @@
 // transportlayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,16 +22,29 @@
 #include <circle/net/udpconnection.h>
 #include <circle/net/in.h>
 #include <circle/macros.h>
+#include <circle/util.h>
 #include <assert.h>
 
 #define OWN_PORT_MIN	60000
 #define OWN_PORT_MAX	60999
 
+#define CONNECTION_MAP_SIZE	256	// initial number of slots (grows on demand)
+#define PORT_MAP_SIZE		64
+
+struct TTransportHeader			// common start of the TCP and UDP header
+{
+	u16	nSourcePort;
+	u16	nDestPort;
+}
+PACKED;
+
 CTransportLayer::CTransportLayer (CNetConfig *pNetConfig, CNetworkLayer *pNetworkLayer)
 :	m_pNetConfig (pNetConfig),
 	m_pNetworkLayer (pNetworkLayer),
 	m_nOwnPort (OWN_PORT_MIN),
 	m_SpinLock (TASK_LEVEL),
+	m_ConnectionMap (CONNECTION_MAP_SIZE),
+	m_PortMap (PORT_MAP_SIZE),
 	m_TCPRejector (pNetConfig, pNetworkLayer)
 {
 	assert (m_pNetConfig != 0);
@@ -51,35 +64,20 @@ boolean CTransportLayer::Initialize (void)
 
 void CTransportLayer::Process (void)
 {
-	unsigned nResultLength;
 	CIPAddress Sender;
 	CIPAddress Receiver;
 	int nProtocol;
 	assert (m_pNetworkLayer != 0);
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	while (m_pNetworkLayer->Receive (Buffer, &nResultLength, &Sender, &Receiver, &nProtocol))
+	CNetBuffer *pBuffer;
+	while ((pBuffer = m_pNetworkLayer->Receive (&Sender, &Receiver, &nProtocol)) != 0)
 	{
-		unsigned i;
-		for (i = 0; i < m_pConnection.GetCount (); i++)
-		{
-			if (m_pConnection[i] == 0)
-			{
-				continue;
-			}
-
-			if (((CNetConnection *) m_pConnection[i])->PacketReceived (
-				Buffer, nResultLength, Sender, Receiver, nProtocol) != 0)
-			{
-				break;
-			}
-		}
-
-		if (i >= m_pConnection.GetCount ())
+		if (!DeliverPacket (pBuffer, Sender, Receiver, nProtocol))
 		{
 			// send RESET on not consumed TCP segment
-			m_TCPRejector.PacketReceived (Buffer, nResultLength,
-						      Sender, Receiver, nProtocol);
+			m_TCPRejector.PacketReceived (pBuffer, Sender, Receiver, nProtocol);
 		}
+
+		pBuffer->Release ();
 	}
 
 	TICMPNotificationType Type;
@@ -106,15 +104,24 @@ void CTransportLayer::Process (void)
 
 	for (unsigned i = 0; i < m_pConnection.GetCount (); i++)
 	{
-		if (m_pConnection[i] != 0)
+		CNetConnection *pConnection = (CNetConnection *) m_pConnection[i];
+		if (pConnection != 0)
 		{
-			if (!((CNetConnection *) m_pConnection[i])->IsTerminated ())
+			if (!pConnection->IsTerminated ())
 			{			
-				((CNetConnection *) m_pConnection[i])->Process ();
+				pConnection->Process ();
+
+				m_SpinLock.Acquire ();
+				UpdateConnection (pConnection);
+				m_SpinLock.Release ();
 			}
 			else
 			{
-				delete (CNetConnection *) m_pConnection[i];
+				m_SpinLock.Acquire ();
+				RemoveConnection (pConnection);
+				m_SpinLock.Release ();
+
+				delete pConnection;
 				m_pConnection[i] = 0;
 			}
 		}
@@ -175,6 +182,8 @@ int CTransportLayer::Bind (u16 nOwnPort, int nProtocol)
 	m_pConnection[i] = new CUDPConnection (m_pNetConfig, m_pNetworkLayer, nOwnPort);
 	assert (m_pConnection[i] != 0);
 
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
 	return i;
@@ -200,7 +209,6 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 
 	if (nOwnPort == 0)
 	{
-		unsigned j;
 		do
 		{
 			nOwnPort = m_nOwnPort;
@@ -208,18 +216,8 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 			{
 				m_nOwnPort = OWN_PORT_MIN;
 			}
-
-			for (j = 0; j < m_pConnection.GetCount (); j++)
-			{
-				if (   m_pConnection[j] != 0
-				    && ((CNetConnection *) m_pConnection[j])->GetOwnPort () == nOwnPort
-				    && ((CNetConnection *) m_pConnection[j])->GetProtocol () == nProtocol)
-				{
-					break;
-				}
-			}
 		}
-		while (j < m_pConnection.GetCount ());
+		while (m_PortMap.Find (GetPortKey (nOwnPort, nProtocol)) != 0);
 	}
 
 	assert (m_pNetConfig != 0);
@@ -239,9 +237,11 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 		return -1;
 	}
 
+	assert (m_pConnection[i] != 0);
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
-	assert (m_pConnection[i] != 0);
 	int nResult = ((CNetConnection *) m_pConnection[i])->Connect ();
 	if (nResult < 0)
 	{
@@ -288,6 +288,8 @@ int CTransportLayer::Listen (u16 nOwnPort, int nProtocol)
 	m_pConnection[i] = new CTCPConnection (m_pNetConfig, m_pNetworkLayer, nOwnPort);
 	assert (m_pConnection[i] != 0);
 
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
 	return i;
@@ -316,7 +318,10 @@ int CTransportLayer::Disconnect (int hConnection)
 		return -1;
 	}
 
-	return ((CNetConnection *) m_pConnection[hConnection])->Close ();
+	CNetConnection *pConnection = (CNetConnection *) m_pConnection[hConnection];
+	pConnection->SetEventHandler (0, 0);
+
+	return pConnection->Close ();
 }
 
 int CTransportLayer::Send (const void *pData, unsigned nLength, int nFlags, int hConnection)
@@ -333,7 +338,7 @@ int CTransportLayer::Send (const void *pData, unsigned nLength, int nFlags, int
 	return ((CNetConnection *) m_pConnection[hConnection])->Send (pData, nLength, nFlags);
 }
 
-int CTransportLayer::Receive (void *pBuffer, int nFlags, int hConnection)
+int CTransportLayer::Receive (void *pBuffer, unsigned nLength, int nFlags, int hConnection)
 {
 	assert (hConnection >= 0);
 	if (   hConnection >= (int) m_pConnection.GetCount ()
@@ -343,7 +348,8 @@ int CTransportLayer::Receive (void *pBuffer, int nFlags, int hConnection)
 	}
 
 	assert (pBuffer != 0);
-	return ((CNetConnection *) m_pConnection[hConnection])->Receive (pBuffer, nFlags);
+	assert (nLength > 0);
+	return ((CNetConnection *) m_pConnection[hConnection])->Receive (pBuffer, nLength, nFlags);
 }
 
 int CTransportLayer::SendTo (const void *pData, unsigned nLength, int nFlags,
@@ -362,8 +368,8 @@ int CTransportLayer::SendTo (const void *pData, unsigned nLength, int nFlags,
 									rForeignIP, nForeignPort);
 }
 
-int CTransportLayer::ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeignIP,
-				  u16 *pForeignPort, int hConnection)
+int CTransportLayer::ReceiveFrom (void *pBuffer, unsigned nLength, int nFlags,
+				  CIPAddress *pForeignIP, u16 *pForeignPort, int hConnection)
 {
 	assert (hConnection >= 0);
 	if (   hConnection >= (int) m_pConnection.GetCount ()
@@ -373,7 +379,8 @@ int CTransportLayer::ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeig
 	}
 
 	assert (pBuffer != 0);
-	return ((CNetConnection *) m_pConnection[hConnection])->ReceiveFrom (pBuffer, nFlags,
+	assert (nLength > 0);
+	return ((CNetConnection *) m_pConnection[hConnection])->ReceiveFrom (pBuffer, nLength, nFlags,
 									     pForeignIP, pForeignPort);
 }
 
@@ -389,6 +396,54 @@ int CTransportLayer::SetOptionBroadcast (boolean bAllowed, int hConnection)
 	return ((CNetConnection *) m_pConnection[hConnection])->SetOptionBroadcast (bAllowed);
 }
 
+int CTransportLayer::SetOptionNoDelay (boolean bNoDelay, int hConnection)
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	return ((CNetConnection *) m_pConnection[hConnection])->SetOptionNoDelay (bNoDelay);
+}
+
+int CTransportLayer::SetOptionCork (boolean bCork, int hConnection)
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	return ((CNetConnection *) m_pConnection[hConnection])->SetOptionCork (bCork);
+}
+
+int CTransportLayer::SetOptionCongestionControl (TTCPCongestionControl Algorithm, int hConnection)
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	return ((CNetConnection *) m_pConnection[hConnection])->SetOptionCongestionControl (Algorithm);
+}
+
+int CTransportLayer::GetConnectionInfo (TTCPConnectionInfo *pInfo, int hConnection) const
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	return ((CNetConnection *) m_pConnection[hConnection])->GetConnectionInfo (pInfo);
+}
+
 boolean CTransportLayer::IsConnected (int hConnection) const
 {
 	assert (hConnection >= 0);
@@ -401,6 +456,32 @@ boolean CTransportLayer::IsConnected (int hConnection) const
 	return ((CNetConnection *) m_pConnection[hConnection])->IsConnected ();
 }
 
+unsigned CTransportLayer::GetPollEvents (int hConnection) const
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return 0;
+	}
+
+	return ((CNetConnection *) m_pConnection[hConnection])->GetPollEvents ();
+}
+
+int CTransportLayer::SetEventHandler (int hConnection, TNetEventHandler *pHandler, void *pParam)
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	((CNetConnection *) m_pConnection[hConnection])->SetEventHandler (pHandler, pParam);
+
+	return 0;
+}
+
 const u8 *CTransportLayer::GetForeignIP (int hConnection) const
 {
 	assert (hConnection >= 0);
@@ -412,3 +493,189 @@ const u8 *CTransportLayer::GetForeignIP (int hConnection) const
 
 	return ((CNetConnection *) m_pConnection[hConnection])->GetForeignIP ();
 }
+
+boolean CTransportLayer::DeliverPacket (CNetBuffer *pBuffer, CIPAddress &rSenderIP,
+					CIPAddress &rReceiverIP, int nProtocol)
+{
+	assert (pBuffer != 0);
+	if (   (   nProtocol != IPPROTO_TCP
+		&& nProtocol != IPPROTO_UDP)
+	    || pBuffer->GetLength () < sizeof (TTransportHeader))
+	{
+		return FALSE;
+	}
+
+	const TTransportHeader *pHeader = (const TTransportHeader *) pBuffer->GetData ();
+	assert (pHeader != 0);
+
+	TConnectionKey Key;
+	Key.nForeignIP = rSenderIP;
+	Key.nForeignPort = be2le16 (pHeader->nSourcePort);
+	Key.nOwnPort = be2le16 (pHeader->nDestPort);
+	Key.nProtocol = nProtocol;
+
+	// the connection checks the packet again
+	CNetConnection **ppConnection = m_ConnectionMap.Find (Key);
+	if (   ppConnection != 0
+	    && (*ppConnection)->PacketReceived (pBuffer, rSenderIP, rReceiverIP, nProtocol) != 0)
+	{
+		return TRUE;
+	}
+
+	TPortEntry *pPortEntry = m_PortMap.Find (GetPortKey (Key.nOwnPort, nProtocol));
+	if (pPortEntry == 0)
+	{
+		return FALSE;
+	}
+
+	for (CNetConnection *pConnection = pPortEntry->pFirst; pConnection != 0;
+	     pConnection = pConnection->m_pNextOnPort)
+	{
+		if (pConnection->PacketReceived (pBuffer, rSenderIP, rReceiverIP, nProtocol) != 0)
+		{
+			// a listening connection is fully specified after receiving a SYN
+			m_SpinLock.Acquire ();
+			UpdateConnection (pConnection);
+			m_SpinLock.Release ();
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void CTransportLayer::AddConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	u32 nPortKey = GetPortKey (pConnection->m_nOwnPort, pConnection->m_nProtocol);
+
+	TPortEntry *pPortEntry = m_PortMap.Find (nPortKey);
+	if (pPortEntry == 0)
+	{
+		TPortEntry PortEntry = {0, 0};
+		m_PortMap.Set (nPortKey, PortEntry);
+
+		pPortEntry = m_PortMap.Find (nPortKey);
+		assert (pPortEntry != 0);
+	}
+
+	pPortEntry->nConnections++;
+
+	LinkConnection (pConnection);
+}
+
+void CTransportLayer::RemoveConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	UnlinkConnection (pConnection);
+
+	u32 nPortKey = GetPortKey (pConnection->m_nOwnPort, pConnection->m_nProtocol);
+
+	TPortEntry *pPortEntry = m_PortMap.Find (nPortKey);
+	assert (pPortEntry != 0);
+	assert (pPortEntry->nConnections > 0);
+	if (--pPortEntry->nConnections == 0)
+	{
+		assert (pPortEntry->pFirst == 0);
+		m_PortMap.Remove (nPortKey);
+	}
+}
+
+void CTransportLayer::UpdateConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	if (pConnection->IsFullySpecified ())
+	{
+		if (   pConnection->m_bHashed
+		    && pConnection->m_nHashedIP == (u32) pConnection->m_ForeignIP
+		    && pConnection->m_nHashedPort == pConnection->m_nForeignPort)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (!pConnection->m_bHashed)
+		{
+			return;
+		}
+	}
+
+	UnlinkConnection (pConnection);
+	LinkConnection (pConnection);
+}
+
+void CTransportLayer::LinkConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	assert (!pConnection->m_bHashed);
+
+	if (pConnection->IsFullySpecified ())
+	{
+		TConnectionKey Key;
+		Key.nForeignIP = pConnection->m_ForeignIP;
+		Key.nForeignPort = pConnection->m_nForeignPort;
+		Key.nOwnPort = pConnection->m_nOwnPort;
+		Key.nProtocol = pConnection->m_nProtocol;
+
+		// on duplicate key the connection is kept in the port map
+		if (m_ConnectionMap.Find (Key) == 0)
+		{
+			m_ConnectionMap.Set (Key, pConnection);
+
+			pConnection->m_bHashed = TRUE;
+			pConnection->m_nHashedIP = Key.nForeignIP;
+			pConnection->m_nHashedPort = Key.nForeignPort;
+
+			return;
+		}
+	}
+
+	TPortEntry *pPortEntry = m_PortMap.Find (GetPortKey (pConnection->m_nOwnPort,
+							     pConnection->m_nProtocol));
+	assert (pPortEntry != 0);
+
+	pConnection->m_pNextOnPort = pPortEntry->pFirst;
+	pPortEntry->pFirst = pConnection;
+}
+
+void CTransportLayer::UnlinkConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+
+	if (pConnection->m_bHashed)
+	{
+		TConnectionKey Key;
+		Key.nForeignIP = pConnection->m_nHashedIP;
+		Key.nForeignPort = pConnection->m_nHashedPort;
+		Key.nOwnPort = pConnection->m_nOwnPort;
+		Key.nProtocol = pConnection->m_nProtocol;
+
+		boolean bRemoved = m_ConnectionMap.Remove (Key);
+		assert (bRemoved);
+		(void) bRemoved;
+
+		pConnection->m_bHashed = FALSE;
+
+		return;
+	}
+
+	TPortEntry *pPortEntry = m_PortMap.Find (GetPortKey (pConnection->m_nOwnPort,
+							     pConnection->m_nProtocol));
+	assert (pPortEntry != 0);
+
+	for (CNetConnection **ppConnection = &pPortEntry->pFirst; *ppConnection != 0;
+	     ppConnection = &(*ppConnection)->m_pNextOnPort)
+	{
+		if (*ppConnection == pConnection)
+		{
+			*ppConnection = pConnection->m_pNextOnPort;
+			pConnection->m_pNextOnPort = 0;
+
+			return;
+		}
+	}
+
+	assert (0);
+}
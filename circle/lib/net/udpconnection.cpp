@@ -2,7 +2,7 @@
 // udpconnection.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -115,7 +115,7 @@ int CUDPConnection::Send (const void *pData, unsigned nLength, int nFlags)
 
 	unsigned nPacketLength = sizeof (TUDPHeader) + nLength;		// may wrap
 	if (   nPacketLength <= sizeof (TUDPHeader)
-	    || nPacketLength > FRAME_BUFFER_SIZE)
+	    || nPacketLength > IP_PACKET_SIZE_MAX - sizeof (TIPHeader))
 	{
 		return -1;
 	}
@@ -128,71 +128,49 @@ int CUDPConnection::Send (const void *pData, unsigned nLength, int nFlags)
 		return -1;
 	}
 
-	u8 PacketBuffer[nPacketLength];
-	TUDPHeader *pHeader = (TUDPHeader *) PacketBuffer;
+	CNetBuffer *pBuffer = new CNetBuffer (nPacketLength);
+	if (pBuffer == 0)
+	{
+		return -1;
+	}
+
+	u8 *pPacket = pBuffer->Put (nPacketLength);
+	TUDPHeader *pHeader = (TUDPHeader *) pPacket;
 
 	pHeader->nSourcePort = le2be16 (m_nOwnPort);
 	pHeader->nDestPort   = le2be16 (m_nForeignPort);
 	pHeader->nLength     = le2be16 (nPacketLength);
 	pHeader->nChecksum   = 0;
 	
-	assert (pData != 0);
-	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TUDPHeader), pData, nLength);
-
 	m_Checksum.SetSourceAddress (*m_pNetConfig->GetIPAddress ());
 	m_Checksum.SetDestinationAddress (m_ForeignIP);
-	pHeader->nChecksum = m_Checksum.Calculate (PacketBuffer, nPacketLength);
 
+	assert (pData != 0);
+	assert (nLength > 0);
 	assert (m_pNetworkLayer != 0);
-	boolean bOK = m_pNetworkLayer->Send (m_ForeignIP, PacketBuffer, nPacketLength, IPPROTO_UDP);
+	if (m_pNetworkLayer->GetOffloadCapabilities () & NET_OFFLOAD_TX_CHECKSUM)
+	{
+		// the net device completes the checksum
+		memcpy (pPacket+sizeof (TUDPHeader), pData, nLength);
+		pHeader->nChecksum = m_Checksum.PseudoHeaderSum (nPacketLength);
+		pBuffer->SetChecksumPartial (pHeader, &pHeader->nChecksum, TRUE);
+	}
+	else
+	{
+		u16 nDataSum = CChecksumCalculator::CopyAndSum (pPacket+sizeof (TUDPHeader),
+								pData, nLength);
+		pHeader->nChecksum = m_Checksum.Calculate (pPacket, sizeof (TUDPHeader),
+							   nDataSum, nLength);
+	}
+
+	boolean bOK = m_pNetworkLayer->Send (m_ForeignIP, pBuffer, IPPROTO_UDP);
 	
 	return bOK ? nLength : -1;
 }
 
-int CUDPConnection::Receive (void *pBuffer, int nFlags)
+int CUDPConnection::Receive (void *pBuffer, unsigned nLength, int nFlags)
 {
-	void *pParam;
-	unsigned nLength;
-	do
-	{
-		if (m_nErrno < 0)
-		{
-			int nErrno = m_nErrno;
-			m_nErrno = 0;
-
-			return nErrno;
-		}
-
-		assert (pBuffer != 0);
-		nLength = m_RxQueue.Dequeue (pBuffer, &pParam);
-		if (nLength == 0)
-		{
-			if (nFlags == MSG_DONTWAIT)
-			{
-				return 0;
-			}
-
-			m_Event.Clear ();
-			m_Event.Wait ();
-
-			if (m_nErrno < 0)
-			{
-				int nErrno = m_nErrno;
-				m_nErrno = 0;
-
-				return nErrno;
-			}
-		}
-	}
-	while (nLength == 0);
-
-	TUDPPrivateData *pData = (TUDPPrivateData *) pParam;
-	assert (pData != 0);
-
-	delete pData;
-
-	return nLength;
+	return ReceiveFrom (pBuffer, nLength, nFlags, 0, 0);
 }
 
 int CUDPConnection::SendTo (const void *pData, unsigned nLength, int nFlags,
@@ -220,7 +198,7 @@ int CUDPConnection::SendTo (const void *pData, unsigned nLength, int nFlags,
 
 	unsigned nPacketLength = sizeof (TUDPHeader) + nLength;		// may wrap
 	if (   nPacketLength <= sizeof (TUDPHeader)
-	    || nPacketLength > FRAME_BUFFER_SIZE)
+	    || nPacketLength > IP_PACKET_SIZE_MAX - sizeof (TIPHeader))
 	{
 		return -1;
 	}
@@ -233,32 +211,50 @@ int CUDPConnection::SendTo (const void *pData, unsigned nLength, int nFlags,
 		return -1;
 	}
 
-	u8 PacketBuffer[nPacketLength];
-	TUDPHeader *pHeader = (TUDPHeader *) PacketBuffer;
+	CNetBuffer *pBuffer = new CNetBuffer (nPacketLength);
+	if (pBuffer == 0)
+	{
+		return -1;
+	}
+
+	u8 *pPacket = pBuffer->Put (nPacketLength);
+	TUDPHeader *pHeader = (TUDPHeader *) pPacket;
 
 	pHeader->nSourcePort = le2be16 (m_nOwnPort);
 	pHeader->nDestPort   = le2be16 (nForeignPort);
 	pHeader->nLength     = le2be16 (nPacketLength);
 	pHeader->nChecksum   = 0;
 	
-	assert (pData != 0);
-	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TUDPHeader), pData, nLength);
-
 	m_Checksum.SetSourceAddress (*m_pNetConfig->GetIPAddress ());
 	m_Checksum.SetDestinationAddress (rForeignIP);
-	pHeader->nChecksum = m_Checksum.Calculate (PacketBuffer, nPacketLength);
 
+	assert (pData != 0);
+	assert (nLength > 0);
 	assert (m_pNetworkLayer != 0);
-	boolean bOK = m_pNetworkLayer->Send (rForeignIP, PacketBuffer, nPacketLength, IPPROTO_UDP);
+	if (m_pNetworkLayer->GetOffloadCapabilities () & NET_OFFLOAD_TX_CHECKSUM)
+	{
+		// the net device completes the checksum
+		memcpy (pPacket+sizeof (TUDPHeader), pData, nLength);
+		pHeader->nChecksum = m_Checksum.PseudoHeaderSum (nPacketLength);
+		pBuffer->SetChecksumPartial (pHeader, &pHeader->nChecksum, TRUE);
+	}
+	else
+	{
+		u16 nDataSum = CChecksumCalculator::CopyAndSum (pPacket+sizeof (TUDPHeader),
+								pData, nLength);
+		pHeader->nChecksum = m_Checksum.Calculate (pPacket, sizeof (TUDPHeader),
+							   nDataSum, nLength);
+	}
+
+	boolean bOK = m_pNetworkLayer->Send (rForeignIP, pBuffer, IPPROTO_UDP);
 	
 	return bOK ? nLength : -1;
 }
 
-int CUDPConnection::ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeignIP, u16 *pForeignPort)
+int CUDPConnection::ReceiveFrom (void *pBuffer, unsigned nBufferSize, int nFlags,
+				 CIPAddress *pForeignIP, u16 *pForeignPort)
 {
-	void *pParam;
-	unsigned nLength;
+	CNetBuffer *pNetBuffer;
 	do
 	{
 		if (m_nErrno < 0)
@@ -269,9 +265,8 @@ int CUDPConnection::ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeign
 			return nErrno;
 		}
 
-		assert (pBuffer != 0);
-		nLength = m_RxQueue.Dequeue (pBuffer, &pParam);
-		if (nLength == 0)
+		pNetBuffer = m_RxQueue.Dequeue ();
+		if (pNetBuffer == 0)
 		{
 			if (nFlags == MSG_DONTWAIT)
 			{
@@ -290,10 +285,19 @@ int CUDPConnection::ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeign
 			}
 		}
 	}
-	while (nLength == 0);
+	while (pNetBuffer == 0);
 
-	TUDPPrivateData *pData = (TUDPPrivateData *) pParam;
-	assert (pData != 0);
+	// the rest of a datagram, which does not fit into the buffer, is discarded
+	unsigned nLength = pNetBuffer->GetLength ();
+	if (nLength > nBufferSize)
+	{
+		nLength = nBufferSize;
+	}
+
+	assert (pBuffer != 0);
+	memcpy (pBuffer, pNetBuffer->GetData (), nLength);
+
+	TUDPPrivateData *pData = (TUDPPrivateData *) pNetBuffer->GetPrivateData ();
 
 	if (   pForeignIP != 0
 	    && pForeignPort != 0)
@@ -302,7 +306,7 @@ int CUDPConnection::ReceiveFrom (void *pBuffer, int nFlags, CIPAddress *pForeign
 		*pForeignPort = pData->nSourcePort;
 	}
 
-	delete pData;
+	pNetBuffer->Release ();
 
 	return nLength;
 }
@@ -323,14 +327,43 @@ boolean CUDPConnection::IsTerminated (void) const
 {
 	return !m_bOpen;
 }
+
+boolean CUDPConnection::IsFullySpecified (void) const
+{
+	assert (m_pNetConfig != 0);
+	return    m_bActiveOpen
+	       && !m_ForeignIP.IsBroadcast ()
+	       && m_ForeignIP != *m_pNetConfig->GetBroadcastAddress ();
+}
+
+unsigned CUDPConnection::GetPollEvents (void) const
+{
+	unsigned nEvents = SOCKET_POLL_WRITE;		// datagrams can be sent at any time
+
+	if (!m_RxQueue.IsEmpty ())
+	{
+		nEvents |= SOCKET_POLL_READ;
+	}
+
+	if (m_nErrno < 0)
+	{
+		nEvents |= SOCKET_POLL_ERROR;
+	}
+
+	return nEvents;
+}
 	
 void CUDPConnection::Process (void)
 {
 }
 
-int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
+int CUDPConnection::PacketReceived (CNetBuffer *pBuffer,
 				    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol)
 {
+	assert (pBuffer != 0);
+	const void *pPacket = pBuffer->GetData ();
+	unsigned nLength = pBuffer->GetLength ();
+
 	if (nProtocol != IPPROTO_UDP)
 	{
 		return 0;
@@ -370,7 +403,8 @@ int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
 		return -1;
 	}
 	
-	if (pHeader->nChecksum != UDP_CHECKSUM_NONE)
+	if (   pHeader->nChecksum != UDP_CHECKSUM_NONE
+	    && !(pBuffer->GetOffloadFlags () & NET_FRAME_RX_L4_CHECKSUM_OK))
 	{
 		m_Checksum.SetSourceAddress (rSenderIP);
 		m_Checksum.SetDestinationAddress (rReceiverIP);
@@ -388,17 +422,20 @@ int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
 		return 1;
 	}
 
-	nLength -= sizeof (TUDPHeader);
-	assert (nLength > 0);
+	// queue the payload without copying it
+	pBuffer->AddRef ();
+	pBuffer->Pull (sizeof (TUDPHeader));
+	assert (pBuffer->GetLength () > 0);
 
-	TUDPPrivateData *pData = new TUDPPrivateData;
-	assert (pData != 0);
+	assert (sizeof (TUDPPrivateData) <= NET_BUFFER_PRIVATE_SIZE);
+	TUDPPrivateData *pData = (TUDPPrivateData *) pBuffer->GetPrivateData ();
 	rSenderIP.CopyTo (pData->SourceAddress);
 	pData->nSourcePort = nSourcePort;
 
-	m_RxQueue.Enqueue ((u8 *) pPacket + sizeof (TUDPHeader), nLength, pData);
+	m_RxQueue.Enqueue (pBuffer);
 
 	m_Event.Set ();
+	SignalEvent ();
 
 	return 1;
 }
@@ -442,6 +479,7 @@ int CUDPConnection::NotificationReceived (TICMPNotificationType  Type,
 	m_nErrno = -1;
 
 	m_Event.Set ();
+	SignalEvent ();
 
 	return 1;
 }
@@ -0,0 +1,63 @@
+//
+// deferredworktask.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sched/deferredworktask.h>
+#include <circle/sched/scheduler.h>
+#include <assert.h>
+
+CDeferredWorkTask::CDeferredWorkTask (CDeferredWork *pDeferredWork, unsigned nMaxBatch)
+:	m_pDeferredWork (pDeferredWork),
+	m_nMaxBatch (nMaxBatch),
+	m_Event (TRUE)			// items may have been queued already
+{
+	assert (m_pDeferredWork != 0);
+
+	SetName ("deferred");
+
+	m_pDeferredWork->RegisterNotificationHandler (NotificationHandler, this, 0);
+}
+
+CDeferredWorkTask::~CDeferredWorkTask (void)
+{
+	m_pDeferredWork->RegisterNotificationHandler (0, 0, 0);
+	m_pDeferredWork = 0;
+}
+
+void CDeferredWorkTask::Run (void)
+{
+	while (1)
+	{
+		m_Event.Wait ();
+		m_Event.Clear ();
+
+		// run items in batches, so that other tasks are not starved
+		while (m_pDeferredWork->Process (m_nMaxBatch) == m_nMaxBatch && m_nMaxBatch > 0)
+		{
+			CScheduler::Get ()->Yield ();
+		}
+	}
+}
+
+void CDeferredWorkTask::NotificationHandler (void *pParam)
+{
+	CDeferredWorkTask *pThis = (CDeferredWorkTask *) pParam;
+	assert (pThis != 0);
+
+	pThis->m_Event.Set ();
+}
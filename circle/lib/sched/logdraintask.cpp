@@ -0,0 +1,84 @@
+//
+// logdraintask.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sched/logdraintask.h>
+#include <circle/sched/scheduler.h>
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
+#include <assert.h>
+
+CLogDrainTask::CLogDrainTask (unsigned nIntervalMs, unsigned nMaxBatch)
+:	m_nIntervalMs (nIntervalMs),
+	m_nMaxBatch (nMaxBatch)
+{
+	assert (m_nIntervalMs > 0);
+	assert (m_nMaxBatch > 0);
+
+	SetName ("logdrain");
+
+	CLogger::Get ()->RegisterDeferredNotificationHandler (DeferredNotificationHandler, this);
+}
+
+CLogDrainTask::~CLogDrainTask (void)
+{
+	CLogger::Get ()->RegisterDeferredNotificationHandler (0);
+}
+
+void CLogDrainTask::Run (void)
+{
+	CLogger *pLogger = CLogger::Get ();
+	assert (pLogger != 0);
+
+	while (1)
+	{
+		// clear before processing, so that no notification gets lost
+		m_Event.Clear ();
+
+		if (pLogger->ProcessDeferred (m_nMaxBatch) < m_nMaxBatch)
+		{
+			m_Event.WaitWithTimeout (m_nIntervalMs * 1000);
+		}
+		else
+		{
+			CScheduler::Get ()->Yield ();
+		}
+	}
+}
+
+void CLogDrainTask::DeferredNotificationHandler (void *pParam)
+{
+	CLogDrainTask *pThis = (CLogDrainTask *) pParam;
+	assert (pThis != 0);
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	// the scheduler must not be called from secondary cores
+	if (CMultiCoreSupport::ThisCore () != 0)
+	{
+		return;
+	}
+#endif
+
+	// the scheduler is protected against IRQs only
+	if (CurrentExecutionLevel () == FIQ_LEVEL)
+	{
+		return;
+	}
+
+	pThis->m_Event.Set ();
+}
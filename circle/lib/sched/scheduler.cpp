@@ -2,7 +2,7 @@
 // scheduler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,17 +19,25 @@
 //
 #include <circle/sched/scheduler.h>
 #include <circle/timer.h>
+#include <circle/tracer.h>
 #include <circle/logger.h>
+#include <circle/metrics.h>
 #include <circle/string.h>
 #include <circle/util.h>
 #include <assert.h>
 
 static const char FromScheduler[] = "sched";
 
+static CMetricCounter s_TaskSwitches ("circle_sched_task_switches_total",
+				      "Switches between tasks");
+static CMetricGauge s_Tasks ("circle_sched_tasks", "Number of existing tasks");
+
 CScheduler *CScheduler::s_pThis = 0;
 
 CScheduler::CScheduler (void)
 :	m_nTasks (0),
+	m_TaskIndex (MAX_TASKS * 2),
+	m_TaskByName (MAX_TASKS * 2),
 	m_pCurrent (0),
 	m_nCurrent (0),
 	m_pTaskSwitchHandler (0),
@@ -76,6 +84,11 @@ void CScheduler::Yield (void)
 		(*m_pTaskSwitchHandler) (m_pCurrent);
 	}
 
+	TRACE_END ("task");
+	TRACE_BEGIN ("task", m_nCurrent);
+
+	s_TaskSwitches.Inc ();
+
 	assert (pOldRegs != 0);
 	assert (pNewRegs != 0);
 	TaskSwitch (pOldRegs, pNewRegs);
@@ -129,30 +142,18 @@ CTask *CScheduler::GetTask (const char *pTaskName)
 {
 	assert (pTaskName != 0);
 
-	for (unsigned i = 0; i < m_nTasks; i++)
+	CTask **ppTask = m_TaskByName.Find (pTaskName);
+	if (ppTask == 0)
 	{
-		CTask *pTask = m_pTask[i];
-
-		if (   pTask != 0
-		    && strcmp (pTask->GetName (), pTaskName) == 0)
-		{
-			return pTask;
-		}
+		return 0;
 	}
 
-	return 0;
+	return *ppTask;
 }
 
 boolean CScheduler::IsValidTask (CTask *pTask)
 {
-	unsigned i;
-	for (i = 0; i < m_nTasks; i++)
-	{
-		if (m_pTask[i] != 0 && m_pTask[i] == pTask)
-			return TRUE;
-	}
-
-	return FALSE;
+	return m_TaskIndex.Find (pTask) != 0;
 }
 
 void CScheduler::RegisterTaskSwitchHandler (TSchedulerTaskHandler *pHandler)
@@ -236,43 +237,93 @@ void CScheduler::AddTask (CTask *pTask)
 		pTask->SetState(TaskStateNew);
 	}
 
+	s_Tasks.Add (1);
+
 	unsigned i;
 	for (i = 0; i < m_nTasks; i++)
 	{
 		if (m_pTask[i] == 0)
 		{
-			m_pTask[i] = pTask;
-
-			return;
+			break;
 		}
 	}
 
-	if (m_nTasks >= MAX_TASKS)
+	if (i == m_nTasks)
 	{
-		CLogger::Get ()->Write (FromScheduler, LogPanic, "System limit of tasks exceeded");
+		if (m_nTasks >= MAX_TASKS)
+		{
+			CLogger::Get ()->Write (FromScheduler, LogPanic, "System limit of tasks exceeded");
+		}
+
+		m_nTasks++;
 	}
 
-	m_pTask[m_nTasks++] = pTask;
+	m_pTask[i] = pTask;
+
+	m_TaskIndex.Set (pTask, i);
+	AddTaskName (pTask);
 }
 
 void CScheduler::RemoveTask (CTask *pTask)
 {
+	unsigned *pIndex = m_TaskIndex.Find (pTask);
+	assert (pIndex != 0);
+
+	unsigned i = *pIndex;
+	assert (i < m_nTasks);
+	assert (m_pTask[i] == pTask);
+
+	RemoveTaskName (pTask);
+	m_TaskIndex.Remove (pTask);
+
+	m_pTask[i] = 0;
+
+	s_Tasks.Sub (1);
+
+	if (i == m_nTasks-1)
+	{
+		m_nTasks--;
+	}
+}
+
+void CScheduler::AddTaskName (CTask *pTask)
+{
+	assert (pTask != 0);
+
+	// the first task with a name is found, if multiple tasks have the same name
+	if (   m_TaskIndex.Find (pTask) != 0
+	    && m_TaskByName.Find (pTask->GetName ()) == 0)
+	{
+		m_TaskByName.Set (pTask->GetName (), pTask);
+	}
+}
+
+void CScheduler::RemoveTaskName (CTask *pTask)
+{
+	assert (pTask != 0);
+
+	CTask **ppTask = m_TaskByName.Find (pTask->GetName ());
+	if (   ppTask == 0
+	    || *ppTask != pTask)
+	{
+		return;
+	}
+
+	m_TaskByName.Remove (pTask->GetName ());
+
+	// another task with the same name becomes visible
 	for (unsigned i = 0; i < m_nTasks; i++)
 	{
-		if (m_pTask[i] == pTask)
+		CTask *pOther = m_pTask[i];
+		if (   pOther != 0
+		    && pOther != pTask
+		    && strcmp (pOther->GetName (), pTask->GetName ()) == 0)
 		{
-			m_pTask[i] = 0;
-
-			if (i == m_nTasks-1)
-			{
-				m_nTasks--;
-			}
+			m_TaskByName.Set (pOther->GetName (), pOther);
 
-			return;
+			break;
 		}
 	}
-
-	assert (0);
 }
 
 boolean CScheduler::BlockTask (CTask **ppWaitListHead, unsigned nMicroSeconds)
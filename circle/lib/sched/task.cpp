@@ -2,7 +2,7 @@
 // task.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -111,7 +111,12 @@ void CTask::WaitForTermination (void)
 
 void CTask::SetName (const char *pName)
 {
+	// the scheduler uses the name buffer as key for GetTask()
+	CScheduler::Get ()->RemoveTaskName (this);
+
 	m_Name = pName;
+
+	CScheduler::Get ()->AddTaskName (this);
 }
 
 const char *CTask::GetName (void) const
@@ -2,7 +2,7 @@
 // serial.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -162,6 +162,7 @@ CSerialDevice::CSerialDevice (CInterruptSystem *pInterruptSystem, boolean bUseFI
 	m_nTxOutPtr (0),
 	m_nOptions (SERIAL_OPTION_ONLCR),
 	m_pMagic (0),
+	m_MagicReceivedWork (MagicReceivedWork, this, "serial-magic", DeferredWorkIRQ),
 	m_SpinLock (bUseFIQ ? FIQ_LEVEL : IRQ_LEVEL)
 #ifdef REALTIME
 	, m_LineSpinLock (TASK_LEVEL)
@@ -758,10 +759,28 @@ void CSerialDevice::InterruptHandler (void)
 
 	if (bMagicReceived)
 	{
-		(*m_pMagicReceivedHandler) ();
+		// deferred work is not run on exit from the FIQ handler
+		if (   CDeferredWork::Get () != 0
+		    && !m_bUseFIQ)
+		{
+			m_MagicReceivedWork.Queue ();
+		}
+		else
+		{
+			(*m_pMagicReceivedHandler) ();
+		}
 	}
 }
 
+void CSerialDevice::MagicReceivedWork (void *pParam)
+{
+	CSerialDevice *pThis = (CSerialDevice *) pParam;
+	assert (pThis != 0);
+
+	assert (pThis->m_pMagicReceivedHandler != 0);
+	(*pThis->m_pMagicReceivedHandler) ();
+}
+
 void CSerialDevice::InterruptStub (void *pParam)
 {
 	DataMemBarrier ();
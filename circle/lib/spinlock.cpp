@@ -2,7 +2,7 @@
 // spinlock.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,22 +22,87 @@
 #ifdef ARM_ALLOW_MULTI_CORE
 
 #include <circle/multicore.h>
+#include <circle/memorymap.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
 #include <assert.h>
 
 #define SPINLOCK_SAVE_POWER
 
+#define SPINLOCK_MCS_NODES	8		// per core, max. MCS locks held at once
+
+struct TSpinLockMCSNode
+{
+	TSpinLockMCSNode * volatile pNext;
+	volatile u32		    nLocked;
+}
+ALIGN (DATA_CACHE_LINE_LENGTH_MAX);
+
+static TSpinLockMCSNode s_MCSNode[CORES][SPINLOCK_MCS_NODES];
+static u32 s_nMCSNodesUsed[CORES];		// bit mask of nodes in use
+
+LOGMODULE ("spinlock");
+
 boolean CSpinLock::s_bEnabled = FALSE;
 
-CSpinLock::CSpinLock (unsigned nTargetLevel)
+#ifdef SPINLOCK_STATISTICS
+CSpinLock *CSpinLock::s_pFirstStatistics = 0;
+u32 CSpinLock::s_nStatisticsListLock = 0;
+#endif
+
+CSpinLock::CSpinLock (unsigned nTargetLevel, TSpinLockType Type)
 :	m_nTargetLevel (nTargetLevel),
-	m_nLocked (0)
+	m_Type (Type),
+	m_nLocked (0),
+	m_nNextTicket (0),
+	m_nOwnerTicket (0),
+	m_pMCSTail (0),
+	m_pMCSOwner (0)
+#ifdef SPINLOCK_STATISTICS
+	, m_pStatistics (0)
+#endif
 {
 	assert (nTargetLevel <= FIQ_LEVEL);
+	assert (Type < SpinLockTypeUnknown);
 }
 
 CSpinLock::~CSpinLock (void)
 {
 	assert (m_nLocked == 0);
+	assert (m_nNextTicket == m_nOwnerTicket);
+	assert (m_pMCSTail == 0);
+
+#ifdef SPINLOCK_STATISTICS
+	if (m_pStatistics != 0)
+	{
+		EnterCritical (FIQ_LEVEL);
+		while (__atomic_exchange_n (&s_nStatisticsListLock, 1, __ATOMIC_ACQUIRE))
+		{
+			// just wait
+		}
+
+		if (m_pStatistics->pPrev != 0)
+		{
+			m_pStatistics->pPrev->m_pStatistics->pNext = m_pStatistics->pNext;
+		}
+		else
+		{
+			assert (s_pFirstStatistics == this);
+			s_pFirstStatistics = m_pStatistics->pNext;
+		}
+
+		if (m_pStatistics->pNext != 0)
+		{
+			m_pStatistics->pNext->m_pStatistics->pPrev = m_pStatistics->pPrev;
+		}
+
+		__atomic_store_n (&s_nStatisticsListLock, 0, __ATOMIC_RELEASE);
+		LeaveCritical ();
+
+		delete m_pStatistics;
+		m_pStatistics = 0;
+	}
+#endif
 }
 
 void CSpinLock::Acquire (void)
@@ -49,83 +114,288 @@ void CSpinLock::Acquire (void)
 
 	if (s_bEnabled)
 	{
+		unsigned nSpins;
+		switch (m_Type)
+		{
+		case SpinLockTicket:
+			nSpins = AcquireTicket ();
+			break;
+
+		case SpinLockMCS:
+			nSpins = AcquireMCS ();
+			break;
+
+		default:
+			nSpins = AcquireTestAndSet ();
+			break;
+		}
+
+#ifdef SPINLOCK_STATISTICS
+		// we own the lock here, so the statistics are protected by it
+		if (m_pStatistics != 0)
+		{
+			m_pStatistics->ulAcquisitions++;
+
+			if (nSpins > 0)
+			{
+				m_pStatistics->ulContended++;
+				m_pStatistics->ulSpins += nSpins;
+			}
+
+			m_pStatistics->nAcquiredTicks = CTimer::GetClockTicks ();
+		}
+#else
+		(void) nSpins;
+#endif
+	}
+}
+
+void CSpinLock::Release (void)
+{
+	if (s_bEnabled)
+	{
+#ifdef SPINLOCK_STATISTICS
+		if (m_pStatistics != 0)
+		{
+			unsigned nHoldTicks =   CTimer::GetClockTicks ()
+					      - m_pStatistics->nAcquiredTicks;
+			if (nHoldTicks > m_pStatistics->nMaxHoldTicks)
+			{
+				m_pStatistics->nMaxHoldTicks = nHoldTicks;
+			}
+		}
+#endif
+
+		switch (m_Type)
+		{
+		case SpinLockTicket:
+			ReleaseTicket ();
+			break;
+
+		case SpinLockMCS:
+			ReleaseMCS ();
+			break;
+
+		default:
+			ReleaseTestAndSet ();
+			break;
+		}
+	}
+
+	if (m_nTargetLevel >= IRQ_LEVEL)
+	{
+		LeaveCritical ();
+	}
+}
+
+unsigned CSpinLock::AcquireTestAndSet (void)
+{
+#ifdef SPINLOCK_STATISTICS
+	if (m_pStatistics != 0)
+	{
+		// counting variant of the loop below (test-and-test-and-set)
+		unsigned nSpins = 0;
+		while (__atomic_exchange_n (&m_nLocked, 1, __ATOMIC_ACQUIRE) != 0)
+		{
+			do
+			{
+				nSpins++;
+			}
+			while (__atomic_load_n (&m_nLocked, __ATOMIC_RELAXED) != 0);
+		}
+
+		return nSpins;
+	}
+#endif
+
 #if AARCH == 32
-		// See: ARMv7-A Architecture Reference Manual, Section D7.3
-		asm volatile
-		(
-			"mov r1, %0\n"
-			"mov r2, #1\n"
-			"1: ldrex r3, [r1]\n"
-			"cmp r3, #0\n"
+	// See: ARMv7-A Architecture Reference Manual, Section D7.3
+	asm volatile
+	(
+		"mov r1, %0\n"
+		"mov r2, #1\n"
+		"1: ldrex r3, [r1]\n"
+		"cmp r3, #0\n"
 #ifdef SPINLOCK_SAVE_POWER
-			"wfene\n"
+		"wfene\n"
 #endif
-			"strexeq r3, r2, [r1]\n"
-			"cmpeq r3, #0\n"
-			"bne 1b\n"
-			"dmb\n"
+		"strexeq r3, r2, [r1]\n"
+		"cmpeq r3, #0\n"
+		"bne 1b\n"
+		"dmb\n"
 
-			: : "r" ((uintptr) &m_nLocked) : "r1", "r2", "r3"
-		);
+		: : "r" ((uintptr) &m_nLocked) : "r1", "r2", "r3"
+	);
 #else
-		// See: ARMv8-A Architecture Reference Manual, Section K10.3.1
-		asm volatile
-		(
-			"mov x1, %0\n"
-			"mov w2, #1\n"
-			"prfm pstl1keep, [x1]\n"
+	// See: ARMv8-A Architecture Reference Manual, Section K10.3.1
+	asm volatile
+	(
+		"mov x1, %0\n"
+		"mov w2, #1\n"
+		"prfm pstl1keep, [x1]\n"
 #ifdef SPINLOCK_SAVE_POWER
-			"sevl\n"
-			"1: wfe\n"
+		"sevl\n"
+		"1: wfe\n"
 #else
-			"1:\n"
+		"1:\n"
 #endif
-			"ldaxr w3, [x1]\n"
-			"cbnz w3, 1b\n"
-			"stxr w3, w2, [x1]\n"
-			"cbnz w3, 1b\n"
+		"ldaxr w3, [x1]\n"
+		"cbnz w3, 1b\n"
+		"stxr w3, w2, [x1]\n"
+		"cbnz w3, 1b\n"
 
-			: : "r" ((uintptr) &m_nLocked) : "x1", "x2", "x3"
-		);
+		: : "r" ((uintptr) &m_nLocked) : "x1", "x2", "x3"
+	);
 #endif
-	}
+
+	return 0;
 }
 
-void CSpinLock::Release (void)
+void CSpinLock::ReleaseTestAndSet (void)
 {
-	if (s_bEnabled)
-	{
 #if AARCH == 32
-		// See: ARMv7-A Architecture Reference Manual, Section D7.3
-		asm volatile
-		(
-			"mov r1, %0\n"
-			"mov r2, #0\n"
-			"dmb\n"
-			"str r2, [r1]\n"
+	// See: ARMv7-A Architecture Reference Manual, Section D7.3
+	asm volatile
+	(
+		"mov r1, %0\n"
+		"mov r2, #0\n"
+		"dmb\n"
+		"str r2, [r1]\n"
 #ifdef SPINLOCK_SAVE_POWER
-			"dsb\n"
-			"sev\n"
+		"dsb\n"
+		"sev\n"
 #endif
 
-			: : "r" ((uintptr) &m_nLocked) : "r1", "r2"
-		);
+		: : "r" ((uintptr) &m_nLocked) : "r1", "r2"
+	);
 #else
-		// See: ARMv8-A Architecture Reference Manual, Section K10.3.2
-		asm volatile
-		(
-			"mov x1, %0\n"
-			"stlr wzr, [x1]\n"
+	// See: ARMv8-A Architecture Reference Manual, Section K10.3.2
+	asm volatile
+	(
+		"mov x1, %0\n"
+		"stlr wzr, [x1]\n"
 
-			: : "r" ((uintptr) &m_nLocked) : "x1"
-		);
+		: : "r" ((uintptr) &m_nLocked) : "x1"
+	);
 #endif
+}
+
+unsigned CSpinLock::AcquireTicket (void)
+{
+	u32 nTicket = __atomic_fetch_add (&m_nNextTicket, 1, __ATOMIC_RELAXED);
+
+	unsigned nSpins = 0;
+	while (__atomic_load_n (&m_nOwnerTicket, __ATOMIC_ACQUIRE) != nTicket)
+	{
+#ifdef SPINLOCK_SAVE_POWER
+		WaitForEvent ();		// woken by SendEvent() in ReleaseTicket()
+#endif
+		nSpins++;
 	}
 
-	if (m_nTargetLevel >= IRQ_LEVEL)
+	return nSpins;
+}
+
+void CSpinLock::ReleaseTicket (void)
+{
+	// lock may have been acquired before Enable() was called
+	if (m_nOwnerTicket == __atomic_load_n (&m_nNextTicket, __ATOMIC_RELAXED))
 	{
-		LeaveCritical ();
+		return;
 	}
+
+	__atomic_store_n (&m_nOwnerTicket, m_nOwnerTicket + 1, __ATOMIC_RELEASE);
+
+#ifdef SPINLOCK_SAVE_POWER
+	DataSyncBarrier ();
+	SendEvent ();
+#endif
+}
+
+unsigned CSpinLock::AcquireMCS (void)
+{
+	// allocate a queue node of this core, we may be interrupted here,
+	// but an interrupting handler will free its nodes before returning
+	unsigned nCore = CMultiCoreSupport::ThisCore ();
+	u32 nUsed = __atomic_load_n (&s_nMCSNodesUsed[nCore], __ATOMIC_RELAXED);
+	unsigned nIndex;
+	do
+	{
+		for (nIndex = 0; nUsed & (1 << nIndex); nIndex++)
+		{
+			// find free node
+		}
+
+		assert (nIndex < SPINLOCK_MCS_NODES);
+	}
+	while (!__atomic_compare_exchange_n (&s_nMCSNodesUsed[nCore], &nUsed, nUsed | (1 << nIndex),
+					     false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	TSpinLockMCSNode *pNode = &s_MCSNode[nCore][nIndex];
+	pNode->pNext = 0;
+	pNode->nLocked = 1;
+
+	TSpinLockMCSNode *pPrev = __atomic_exchange_n (&m_pMCSTail, pNode, __ATOMIC_ACQ_REL);
+
+	unsigned nSpins = 0;
+	if (pPrev != 0)
+	{
+		__atomic_store_n (&pPrev->pNext, pNode, __ATOMIC_RELEASE);
+
+		// spin on our own node only, until the predecessor hands over the lock
+		while (__atomic_load_n (&pNode->nLocked, __ATOMIC_ACQUIRE))
+		{
+#ifdef SPINLOCK_SAVE_POWER
+			WaitForEvent ();	// woken by SendEvent() in ReleaseMCS()
+#endif
+			nSpins++;
+		}
+	}
+
+	m_pMCSOwner = pNode;
+
+	return nSpins;
+}
+
+void CSpinLock::ReleaseMCS (void)
+{
+	TSpinLockMCSNode *pNode = m_pMCSOwner;
+	if (pNode == 0)				// acquired before Enable() was called
+	{
+		return;
+	}
+
+	m_pMCSOwner = 0;
+
+	TSpinLockMCSNode *pNext = __atomic_load_n (&pNode->pNext, __ATOMIC_ACQUIRE);
+	if (pNext == 0)
+	{
+		TSpinLockMCSNode *pExpected = pNode;
+		if (!__atomic_compare_exchange_n (&m_pMCSTail, &pExpected, (TSpinLockMCSNode *) 0,
+						  false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		{
+			// a successor is just enqueuing, wait for its link
+			while ((pNext = __atomic_load_n (&pNode->pNext, __ATOMIC_ACQUIRE)) == 0)
+			{
+				// just wait
+			}
+		}
+	}
+
+	if (pNext != 0)
+	{
+		__atomic_store_n (&pNext->nLocked, 0, __ATOMIC_RELEASE);
+
+#ifdef SPINLOCK_SAVE_POWER
+		DataSyncBarrier ();
+		SendEvent ();
+#endif
+	}
+
+	// free the node, it is owned by the core, which has acquired the lock (this core)
+	unsigned nIndex = pNode - &s_MCSNode[0][0];
+	__atomic_and_fetch (&s_nMCSNodesUsed[nIndex / SPINLOCK_MCS_NODES],
+			    ~(1U << (nIndex % SPINLOCK_MCS_NODES)), __ATOMIC_RELAXED);
 }
 
 void CSpinLock::Enable (void)
@@ -134,4 +404,111 @@ void CSpinLock::Enable (void)
 	s_bEnabled = TRUE;
 }
 
+void CSpinLock::EnableStatistics (const char *pName)
+{
+#ifdef SPINLOCK_STATISTICS
+	assert (pName != 0);
+
+	if (m_pStatistics != 0)
+	{
+		m_pStatistics->pName = pName;
+
+		return;
+	}
+
+	TSpinLockStatistics *pStatistics = new TSpinLockStatistics;
+	assert (pStatistics != 0);
+
+	pStatistics->pName = pName;
+	pStatistics->ulAcquisitions = 0;
+	pStatistics->ulContended = 0;
+	pStatistics->ulSpins = 0;
+	pStatistics->nMaxHoldTicks = 0;
+	pStatistics->nAcquiredTicks = 0;
+	pStatistics->pPrev = 0;
+
+	EnterCritical (FIQ_LEVEL);
+	while (__atomic_exchange_n (&s_nStatisticsListLock, 1, __ATOMIC_ACQUIRE))
+	{
+		// just wait
+	}
+
+	pStatistics->pNext = s_pFirstStatistics;
+	if (s_pFirstStatistics != 0)
+	{
+		s_pFirstStatistics->m_pStatistics->pPrev = this;
+	}
+	s_pFirstStatistics = this;
+
+	m_pStatistics = pStatistics;
+
+	__atomic_store_n (&s_nStatisticsListLock, 0, __ATOMIC_RELEASE);
+	LeaveCritical ();
+#endif
+}
+
+void CSpinLock::DumpStatistics (unsigned nMaxLocks)
+{
+#ifdef SPINLOCK_STATISTICS
+	if (nMaxLocks == 0)
+	{
+		return;
+	}
+
+	// take a snapshot of the most contended locks (ordered by spins)
+	TSpinLockStatistics *pTop = new TSpinLockStatistics[nMaxLocks];
+	assert (pTop != 0);
+	unsigned nLocks = 0;
+
+	EnterCritical (FIQ_LEVEL);
+	while (__atomic_exchange_n (&s_nStatisticsListLock, 1, __ATOMIC_ACQUIRE))
+	{
+		// just wait
+	}
+
+	for (CSpinLock *pLock = s_pFirstStatistics; pLock != 0; pLock = pLock->m_pStatistics->pNext)
+	{
+		const TSpinLockStatistics *pStatistics = pLock->m_pStatistics;
+
+		unsigned nPos = nLocks;
+		while (   nPos > 0
+		       && pTop[nPos-1].ulSpins < pStatistics->ulSpins)
+		{
+			if (nPos < nMaxLocks)
+			{
+				pTop[nPos] = pTop[nPos-1];
+			}
+
+			nPos--;
+		}
+
+		if (nPos < nMaxLocks)
+		{
+			pTop[nPos] = *pStatistics;
+
+			if (nLocks < nMaxLocks)
+			{
+				nLocks++;
+			}
+		}
+	}
+
+	__atomic_store_n (&s_nStatisticsListLock, 0, __ATOMIC_RELEASE);
+	LeaveCritical ();
+
+	LOGNOTE ("%-20s %10s %10s %12s %8s", "Lock", "Acquired", "Contended", "Spins", "MaxHold");
+
+	for (unsigned i = 0; i < nLocks; i++)
+	{
+		LOGNOTE ("%-20s %10lu %10lu %12lu %6uus",
+			 pTop[i].pName, pTop[i].ulAcquisitions, pTop[i].ulContended,
+			 pTop[i].ulSpins, pTop[i].nMaxHoldTicks);
+	}
+
+	delete [] pTop;
+#else
+	LOGWARN ("Statistics not available (define SPINLOCK_STATISTICS)");
+#endif
+}
+
 #endif
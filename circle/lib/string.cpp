@@ -2,7 +2,7 @@
 // string.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 //
 // ftoa() inspired by Arjan van Vught <info@raspberrypi-dmx.nl>
 //
@@ -21,6 +21,7 @@
 //
 #include <circle/string.h>
 #include <circle/util.h>
+#include <assert.h>
 
 #define FORMAT_RESERVE		64	// additional bytes to allocate
 
@@ -34,128 +35,156 @@
 
 #define MAX_FLOAT_LEN		(1+MAX_NUMBER_LEN+1+MAX_PRECISION)
 
+static const char s_DecimalPairs[] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const unsigned long s_PowersOf10[MAX_PRECISION+1] =
+{
+	1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+	100000000UL, 1000000000UL,
+#if AARCH != 32
+	10000000000UL, 100000000000UL, 1000000000000UL, 10000000000000UL,
+	100000000000000UL, 1000000000000000UL, 10000000000000000UL,
+	100000000000000000UL, 1000000000000000000UL, 10000000000000000000UL
+#endif
+};
+
 CString::CString (void)
-:	m_pBuffer (0),
-	m_nSize (0)
+:	m_pBuffer (m_InlineBuffer),
+	m_nSize (STRING_INLINE_SIZE),
+	m_bExternal (FALSE)
 {
+	m_InlineBuffer[0] = '\0';
 }
 
 CString::CString (const char *pString)
+:	m_pBuffer (m_InlineBuffer),
+	m_nSize (STRING_INLINE_SIZE),
+	m_bExternal (FALSE)
 {
-	m_nSize = strlen (pString)+1;
-
-	m_pBuffer = new char[m_nSize];
-
-	strcpy (m_pBuffer, pString);
+	Assign (pString, strlen (pString));
 }
 
 CString::CString (const CString &rString)
+:	m_pBuffer (m_InlineBuffer),
+	m_nSize (STRING_INLINE_SIZE),
+	m_bExternal (FALSE)
 {
-	m_nSize = strlen (rString)+1;
-
-	m_pBuffer = new char[m_nSize];
-
-	strcpy (m_pBuffer, rString);
+	Assign (rString.m_pBuffer, strlen (rString.m_pBuffer));
 }
 
 CString::CString (CString &&rrString)
+:	m_pBuffer (m_InlineBuffer),
+	m_nSize (STRING_INLINE_SIZE),
+	m_bExternal (FALSE)
 {
-	m_nSize = rrString.m_nSize;
-	m_pBuffer = rrString.m_pBuffer;
+	*this = static_cast<CString &&> (rrString);
+}
 
-	rrString.m_nSize = 0;
-	rrString.m_pBuffer = nullptr;
+CString::CString (char *pBuffer, size_t nSize)
+:	m_pBuffer (pBuffer),
+	m_nSize (nSize),
+	m_bExternal (TRUE),
+	m_nOverflow (0)
+{
+	assert (pBuffer != 0);
+	assert (nSize > 0);
+	m_pBuffer[0] = '\0';
 }
 
 CString::~CString (void)
 {
-	delete [] m_pBuffer;
+	FreeBuffer ();
 	m_pBuffer = 0;
 }
 
 CString::operator const char *(void) const
 {
-	if (m_pBuffer != 0)
-	{
-		return m_pBuffer;
-	}
-
-	return "";
+	return m_pBuffer;
 }
 
 const char *CString::operator = (const char *pString)
 {
-	delete [] m_pBuffer;
-
-	m_nSize = strlen (pString)+1;
-
-	m_pBuffer = new char[m_nSize];
-
-	strcpy (m_pBuffer, pString);
+	Assign (pString, strlen (pString));
 
 	return m_pBuffer;
 }
 
 CString &CString::operator = (const CString &rString)
 {
-	delete [] m_pBuffer;
-
-	m_nSize = strlen (rString)+1;
-
-	m_pBuffer = new char[m_nSize];
-
-	strcpy (m_pBuffer, rString);
+	if (this != &rString)
+	{
+		Assign (rString.m_pBuffer, strlen (rString.m_pBuffer));
+	}
 
 	return *this;
 }
 
 CString &CString::operator = (CString &&rrString)
 {
-	delete [] m_pBuffer;
+	if (this == &rrString)
+	{
+		return *this;
+	}
+
+	assert (!m_bExternal);
+	assert (!rrString.m_bExternal);
+
+	if (rrString.m_pBuffer == rrString.m_InlineBuffer)
+	{
+		Assign (rrString.m_InlineBuffer, strlen (rrString.m_InlineBuffer));
+
+		return *this;
+	}
+
+	FreeBuffer ();
 
 	m_nSize = rrString.m_nSize;
 	m_pBuffer = rrString.m_pBuffer;
 
-	rrString.m_nSize = 0;
-	rrString.m_pBuffer = nullptr;
+	rrString.m_nSize = STRING_INLINE_SIZE;
+	rrString.m_pBuffer = rrString.m_InlineBuffer;
+	rrString.m_InlineBuffer[0] = '\0';
 
 	return *this;
 }
 
 size_t CString::GetLength (void) const
 {
-	if (m_pBuffer == 0)
-	{
-		return 0;
-	}
-	
 	return strlen (m_pBuffer);
 }
 
 void CString::Append (const char *pString)
 {
-	m_nSize = 1;		// for terminating '\0'
-	if (m_pBuffer != 0)
-	{
-		m_nSize += strlen (m_pBuffer);
-	}
-	m_nSize += strlen (pString);
-
-	char *pBuffer = new char[m_nSize];
+	size_t nLength = strlen (m_pBuffer);
+	size_t nAppend = strlen (pString);
 
-	if (m_pBuffer != 0)
+	if (nLength + nAppend < m_nSize)
 	{
-		strcpy (pBuffer, m_pBuffer);
-		delete [] m_pBuffer;
+		memmove (m_pBuffer + nLength, pString, nAppend+1);	// pString may be our own
+
+		return;
 	}
-	else
+
+	size_t nNewSize = nLength + nAppend + 1;
+	if (nNewSize < 2*m_nSize)
 	{
-		*pBuffer = '\0';
+		nNewSize = 2*m_nSize;
 	}
 
-	strcat (pBuffer, pString);
+	char *pBuffer = new char[nNewSize];
+
+	memcpy (pBuffer, m_pBuffer, nLength);
+	memcpy (pBuffer + nLength, pString, nAppend+1);
+
+	FreeBuffer ();
 
 	m_pBuffer = pBuffer;
+	m_nSize = nNewSize;
 }
 
 int CString::Compare (const char *pString) const
@@ -191,9 +220,6 @@ int CString::Replace (const char *pOld, const char *pNew)
 
 	CString OldString (m_pBuffer);
 
-	delete [] m_pBuffer;
-	m_nSize = FORMAT_RESERVE;
-	m_pBuffer = new char[m_nSize];
 	m_pInPtr = m_pBuffer;
 
 	const char *pReader = OldString.m_pBuffer;
@@ -243,13 +269,37 @@ void CString::Format (const char *pFormat, ...)
 	va_end (var);
 }
 
-void CString::FormatV (const char *pFormat, va_list Args)
+size_t CString::FormatBuffer (char *pBuffer, size_t nSize, const char *pFormat, ...)
 {
-	delete [] m_pBuffer;
+	va_list var;
+	va_start (var, pFormat);
 
-	m_nSize = FORMAT_RESERVE;
-	m_pBuffer = new char[m_nSize];
-	m_pInPtr = m_pBuffer;
+	size_t nResult = FormatBufferV (pBuffer, nSize, pFormat, var);
+
+	va_end (var);
+
+	return nResult;
+}
+
+size_t CString::FormatBufferV (char *pBuffer, size_t nSize, const char *pFormat, va_list Args)
+{
+	char chDummy;
+	if (nSize == 0)
+	{
+		pBuffer = &chDummy;
+		nSize = 1;
+	}
+
+	CString String (pBuffer, nSize);
+	String.FormatV (pFormat, Args);
+
+	return (String.m_pInPtr - String.m_pBuffer) + String.m_nOverflow;
+}
+
+void CString::FormatV (const char *pFormat, va_list Args)
+{
+	m_pInPtr = m_pBuffer;		// re-use the current buffer
+	m_nOverflow = 0;
 
 	while (*pFormat != '\0')
 	{
@@ -575,9 +625,39 @@ void CString::FormatV (const char *pFormat, va_list Args)
 	*m_pInPtr = '\0';
 }
 
+void CString::Assign (const char *pString, size_t nLength)
+{
+	if (nLength < m_nSize)
+	{
+		memmove (m_pBuffer, pString, nLength);		// pString may be our own
+		m_pBuffer[nLength] = '\0';
+
+		return;
+	}
+
+	char *pBuffer = new char[nLength+1];
+
+	memcpy (pBuffer, pString, nLength);
+	pBuffer[nLength] = '\0';
+
+	FreeBuffer ();
+
+	m_pBuffer = pBuffer;
+	m_nSize = nLength+1;
+}
+
+void CString::FreeBuffer (void)
+{
+	if (   m_pBuffer != m_InlineBuffer
+	    && !m_bExternal)
+	{
+		delete [] m_pBuffer;
+	}
+}
+
 void CString::PutChar (char chChar, size_t nCount)
 {
-	ReserveSpace (nCount);
+	nCount = ReserveSpace (nCount);
 
 	while (nCount--)
 	{
@@ -587,76 +667,112 @@ void CString::PutChar (char chChar, size_t nCount)
 
 void CString::PutString (const char *pString)
 {
-	size_t nLen = strlen (pString);
-	
-	ReserveSpace (nLen);
-	
-	strcpy (m_pInPtr, pString);
-	
+	size_t nLen = ReserveSpace (strlen (pString));
+
+	memcpy (m_pInPtr, pString, nLen);
+
 	m_pInPtr += nLen;
 }
 
-void CString::ReserveSpace (size_t nSpace)
+size_t CString::ReserveSpace (size_t nSpace)
 {
-	if (nSpace == 0)
+	size_t nOffset = m_pInPtr - m_pBuffer;
+	if (nOffset + nSpace < m_nSize)
 	{
-		return;
+		return nSpace;
 	}
-	
-	size_t nOffset = m_pInPtr - m_pBuffer;
-	size_t nNewSize = nOffset + nSpace + 1;
-	if (m_nSize >= nNewSize)
+
+	if (m_bExternal)
 	{
-		return;
+		size_t nFree = m_nSize - nOffset - 1;
+		m_nOverflow += nSpace - nFree;
+
+		return nFree;
 	}
-	
-	nNewSize += FORMAT_RESERVE;
+
+	size_t nNewSize = nOffset + nSpace + 1 + FORMAT_RESERVE;
+	if (nNewSize < 2*m_nSize)
+	{
+		nNewSize = 2*m_nSize;
+	}
+
 	char *pNewBuffer = new char[nNewSize];
-		
-	*m_pInPtr = '\0';
-	strcpy (pNewBuffer, m_pBuffer);
-	
-	delete [] m_pBuffer;
+
+	memcpy (pNewBuffer, m_pBuffer, nOffset);
+
+	FreeBuffer ();
 
 	m_pBuffer = pNewBuffer;
 	m_nSize = nNewSize;
 
 	m_pInPtr = m_pBuffer + nOffset;
+
+	return nSpace;
 }
 
 char *CString::ntoa (char *pDest, unsigned long ulNumber, unsigned nBase, boolean bUpcase)
 {
-	unsigned long ulDigit;
+	// the digits are generated from the end of Buffer backwards
+	char Buffer[MAX_NUMBER_LEN];
+	char *p = Buffer + MAX_NUMBER_LEN;
 
-	unsigned long ulDivisor = 1UL;
-	while (1)
+	const char *pDigits = bUpcase ? "0123456789ABCDEF" : "0123456789abcdef";
+
+	switch (nBase)
 	{
-		ulDigit = ulNumber / ulDivisor;
-		if (ulDigit < nBase)
+	case 10:
+		while (ulNumber >= 100)
 		{
-			break;
-		}
+			unsigned nPair = (unsigned) (ulNumber % 100) * 2;
+			ulNumber /= 100;
 
-		ulDivisor *= nBase;
-	}
+			*--p = s_DecimalPairs[nPair+1];
+			*--p = s_DecimalPairs[nPair];
+		}
 
-	char *p = pDest;
-	while (1)
-	{
-		ulNumber %= ulDivisor;
+		if (ulNumber >= 10)
+		{
+			*--p = s_DecimalPairs[ulNumber*2+1];
+			*--p = s_DecimalPairs[ulNumber*2];
+		}
+		else
+		{
+			*--p = '0' + ulNumber;
+		}
+		break;
 
-		*p++ = ulDigit < 10 ? '0' + ulDigit : '0' + ulDigit + 7 + (bUpcase ? 0 : 0x20);
+	case 16:
+		do
+		{
+			*--p = pDigits[ulNumber & 0xF];
+			ulNumber >>= 4;
+		}
+		while (ulNumber != 0);
+		break;
 
-		ulDivisor /= nBase;
-		if (ulDivisor == 0)
+	case 8:
+		do
 		{
-			break;
+			*--p = '0' + (ulNumber & 7);
+			ulNumber >>= 3;
 		}
+		while (ulNumber != 0);
+		break;
 
-		ulDigit = ulNumber / ulDivisor;
+	default:
+		assert (2 <= nBase && nBase <= 16);
+		do
+		{
+			*--p = pDigits[ulNumber % nBase];
+			ulNumber /= nBase;
+		}
+		while (ulNumber != 0);
+		break;
 	}
 
-	*p = '\0';
+	size_t nLength = Buffer + MAX_NUMBER_LEN - p;
+	memcpy (pDest, p, nLength);
+	pDest[nLength] = '\0';
 
 	return pDest;
 }
@@ -664,37 +780,27 @@ char *CString::ntoa (char *pDest, unsigned long ulNumber, unsigned nBase, boolea
 #if STDLIB_SUPPORT >= 1
 char *CString::lltoa (char *pDest, unsigned long long ullNumber, unsigned nBase, boolean bUpcase)
 {
-	unsigned long long ullDigit;
-
-	unsigned long long ullDivisor = 1ULL;
-	while (1)
+	if (ullNumber <= (unsigned long) -1)
 	{
-		ullDigit = ullNumber / ullDivisor;
-		if (ullDigit < nBase)
-		{
-			break;
-		}
-
-		ullDivisor *= nBase;
+		return ntoa (pDest, (unsigned long) ullNumber, nBase, bUpcase);
 	}
 
-	char *p = pDest;
-	while (1)
-	{
-		ullNumber %= ullDivisor;
-
-		*p++ = ullDigit < 10 ? '0' + ullDigit : '0' + ullDigit + 7 + (bUpcase ? 0 : 0x20);
+	char Buffer[MAX_NUMBER_LEN];
+	char *p = Buffer + MAX_NUMBER_LEN;
 
-		ullDivisor /= nBase;
-		if (ullDivisor == 0)
-		{
-			break;
-		}
+	const char *pDigits = bUpcase ? "0123456789ABCDEF" : "0123456789abcdef";
 
-		ullDigit = ullNumber / ullDivisor;
+	assert (2 <= nBase && nBase <= 16);
+	do
+	{
+		*--p = pDigits[ullNumber % nBase];
+		ullNumber /= nBase;
 	}
+	while (ullNumber != 0);
 
-	*p = '\0';
+	size_t nLength = Buffer + MAX_NUMBER_LEN - p;
+	memcpy (pDest, p, nLength);
+	pDest[nLength] = '\0';
 
 	return pDest;
 }
@@ -718,7 +824,22 @@ char *CString::ftoa (char *pDest, double fNumber, unsigned nPrecision)
 		return pDest;
 	}
 
+	if (nPrecision > MAX_PRECISION)
+	{
+		nPrecision = MAX_PRECISION;
+	}
+
+	// round the fraction to nPrecision digits, which may carry into the integer part
 	unsigned long iPart = (unsigned long) fNumber;
+	unsigned long ulPrecPow10 = s_PowersOf10[nPrecision];
+	unsigned long ulFraction =
+		(unsigned long) ((fNumber - (double) iPart) * (double) ulPrecPow10 + 0.5);
+	if (ulFraction >= ulPrecPow10)
+	{
+		ulFraction -= ulPrecPow10;
+		iPart++;
+	}
+
 	ntoa (p, iPart, 10, FALSE);
 
 	if (nPrecision == 0)
@@ -729,30 +850,13 @@ char *CString::ftoa (char *pDest, double fNumber, unsigned nPrecision)
 	p += strlen (p);
 	*p++ = '.';
 
-	if (nPrecision > MAX_PRECISION)
-	{
-		nPrecision = MAX_PRECISION;
-	}
-
-	unsigned long nPrecPow10 = 10;
-	for (unsigned i = 2; i <= nPrecision; i++)
-	{
-		nPrecPow10 *= 10;
-	}
-
-	fNumber -= (double) iPart;
-	fNumber *= (double) nPrecPow10;
-	
-	char Buffer[MAX_PRECISION+1];
-	ntoa (Buffer, (unsigned long) fNumber, 10, FALSE);
-
-	nPrecision -= strlen (Buffer);
+	// write the fraction with leading zeros from the end backwards
+	p[nPrecision] = '\0';
 	while (nPrecision--)
 	{
-		*p++ = '0';
+		p[nPrecision] = '0' + ulFraction % 10;
+		ulFraction /= 10;
 	}
 
-	strcpy (p, Buffer);
-	
 	return pDest;
 }
@@ -2,7 +2,7 @@
 // synchronize64.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,6 +18,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/synchronize.h>
+#include <circle/deferredwork.h>
 #include <circle/sysconfig.h>
 #include <assert.h>
 
@@ -38,6 +39,12 @@ unsigned CurrentExecutionLevel (void)
 		return IRQ_LEVEL;
 	}
 
+	// deferred IRQ work runs with IRQs enabled, but still in IRQ context
+	if (CDeferredWork::IsIRQWorkActive ())
+	{
+		return IRQ_LEVEL;
+	}
+
 	return TASK_LEVEL;
 }
 
@@ -2,7 +2,7 @@
 // timer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -309,7 +309,7 @@ boolean CTimer::GetUniversalTime (unsigned *pSeconds, unsigned *pMicroSeconds)
 	return TRUE;
 }
 
-CString *CTimer::GetTimeString (void)
+CString *CTimer::GetTimeString (unsigned nTicksAgo)
 {
 	m_TimeSpinLock.Acquire ();
 
@@ -324,6 +324,22 @@ CString *CTimer::GetTimeString (void)
 		return 0;
 	}
 
+	if (nTicksAgo > 0)
+	{
+		unsigned nSecondsAgo = nTicksAgo / HZ;
+		nTicksAgo %= HZ;
+
+		nTicks %= HZ;
+		if (nTicksAgo > nTicks)
+		{
+			nTicks += HZ;
+			nSecondsAgo++;
+		}
+
+		nTicks -= nTicksAgo;
+		nTime = nTime > nSecondsAgo ? nTime-nSecondsAgo : 0;
+	}
+
 	unsigned nSecond = nTime % 60;
 	nTime /= 60;
 	unsigned nMinute = nTime % 60;
@@ -2,7 +2,7 @@
 // tracer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,35 +19,58 @@
 //
 #include <circle/tracer.h>
 #include <circle/timer.h>
+#include <circle/multicore.h>
 #include <circle/logger.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
 
 static const char FromTracer[] = "trace";
 
+#define EXPORT_CHUNK_SIZE	4096		// bytes written to target at once
+
 CTracer *CTracer::s_pThis = 0;
 
 CTracer::CTracer (unsigned nDepth, boolean bStopIfFull)
-: 	m_nDepth (nDepth),
+: 	m_nDepth (1),
 	m_bStopIfFull (bStopIfFull),
 	m_bActive (FALSE),
-	m_nStartTicks (0),
-	m_nEntries (0),
-	m_nCurrent (0)
+	m_nStartTimestamp (0),
+	m_nTimestampFrequency (GetTimestampFrequency ())
 {
-	s_pThis = this;
+	assert (nDepth > 0);
+	while (m_nDepth < nDepth)
+	{
+		m_nDepth <<= 1;
+	}
+
+	for (unsigned nCore = 0; nCore < TRACER_CORES; nCore++)
+	{
+		m_Ring[nCore].pEntry = new TTraceEntry[m_nDepth];
+		assert (m_Ring[nCore].pEntry != 0);
+
+		m_Ring[nCore].nWritten = 0;
+		m_Ring[nCore].nDropped = 0;
+		m_Ring[nCore].nRead = 0;
+	}
 
-	m_pEntry = new TTraceEntry[nDepth];
+	s_pThis = this;
 }
 
 CTracer::~CTracer (void)
 {
-	delete [] m_pEntry;
-
 	s_pThis = 0;
+
+	for (unsigned nCore = 0; nCore < TRACER_CORES; nCore++)
+	{
+		delete [] m_Ring[nCore].pEntry;
+		m_Ring[nCore].pEntry = 0;
+	}
 }
 
 void CTracer::Start (void)
 {
-	m_nStartTicks = CTimer::Get ()->GetClockTicks ();
+	m_nStartTimestamp = GetTimestamp ();
 
 	m_bActive = TRUE;
 }
@@ -60,64 +83,305 @@ void CTracer::Stop (void)
 }
 
 void CTracer::Event (unsigned nID, unsigned nParam1, unsigned nParam2, unsigned nParam3, unsigned nParam4)
+{
+	Record (TraceEventGeneric, nID, 0, nParam1, nParam2, nParam3, nParam4);
+}
+
+void CTracer::SpanBegin (const char *pName, unsigned nParam)
+{
+	Record (TraceEventBegin, 0, pName, nParam);
+}
+
+void CTracer::SpanEnd (const char *pName)
+{
+	Record (TraceEventEnd, 0, pName);
+}
+
+void CTracer::Instant (const char *pName, unsigned nParam)
+{
+	Record (TraceEventInstant, 0, pName, nParam);
+}
+
+void CTracer::Counter (const char *pName, unsigned nValue)
+{
+	Record (TraceEventCounter, 0, pName, nValue);
+}
+
+void CTracer::Record (TTraceEventType Type, unsigned nID, const char *pName,
+		      unsigned nParam1, unsigned nParam2, unsigned nParam3, unsigned nParam4)
+{
+	if (!m_bActive)
+	{
+		return;
+	}
+
+	// Each core writes to its own ring only. The atomic increment reserves
+	// the entry against an interrupting handler on the same core.
+	TRing *pRing = &m_Ring[ThisCore ()];
+	u32 nIndex = __atomic_fetch_add (&pRing->nWritten, 1, __ATOMIC_RELAXED);
+	if (   nIndex >= m_nDepth
+	    && m_bStopIfFull)
+	{
+		__atomic_fetch_add (&pRing->nDropped, 1, __ATOMIC_RELAXED);
+
+		return;
+	}
+
+	TTraceEntry *pEntry = &pRing->pEntry[nIndex & (m_nDepth-1)];
+
+	pEntry->nTimestamp = GetTimestamp ();
+	pEntry->nType      = Type;
+	pEntry->nEventID   = nID;
+	pEntry->pName      = pName;
+	pEntry->nParam[0]  = nParam1;
+	pEntry->nParam[1]  = nParam2;
+	pEntry->nParam[2]  = nParam3;
+	pEntry->nParam[3]  = nParam4;
+}
+
+void CTracer::Dump (void)
 {
 	if (m_bActive)
 	{
-		if (m_nEntries < m_nDepth)
+		Stop ();
+	}
+	
+	CLogger *pLogger = CLogger::Get ();
+
+	RewindEntries ();
+
+	const TTraceEntry *pEntry;
+	unsigned nCore;
+	for (unsigned i = 1; (pEntry = GetNextEntry (&nCore)) != 0; i++)
+	{
+		double fTime = ToMicroSeconds (pEntry->nTimestamp - m_nStartTimestamp);
+		unsigned nSeconds = (unsigned) (fTime / 1000000.0);
+		unsigned nMicroSeconds = (unsigned) (fTime - nSeconds * 1000000.0);
+
+		if (pEntry->nType == TraceEventGeneric)
 		{
-			m_nEntries++;
+			pLogger->Write (FromTracer, LogNotice, "%2u: %2u.%06u %u %2u %08X %08X %08X %08X",
+					i, nSeconds, nMicroSeconds, nCore,
+					pEntry->nEventID, pEntry->nParam[0], pEntry->nParam[1],
+					pEntry->nParam[2], pEntry->nParam[3]);
 		}
-		else if (m_bStopIfFull)
+		else
 		{
-			m_bActive = FALSE;
+			static const char Type[] = "GBEIC";
+			assert (pEntry->nType < TraceEventUnknown);
 
-			return;
+			pLogger->Write (FromTracer, LogNotice, "%2u: %2u.%06u %u %c %s %u",
+					i, nSeconds, nMicroSeconds, nCore,
+					Type[pEntry->nType], pEntry->pName, pEntry->nParam[0]);
 		}
+	}
 
-		TTraceEntry *pEntry = m_pEntry + m_nCurrent;
-
-		pEntry->nClockTicks = CTimer::Get ()->GetClockTicks () - m_nStartTicks;
-		pEntry->nEventID    = nID;
-		pEntry->nParam[0]   = nParam1;
-		pEntry->nParam[1]   = nParam2;
-		pEntry->nParam[2]   = nParam3;
-		pEntry->nParam[3]   = nParam4;
-
-		if (++m_nCurrent == m_nDepth)
-		{
-			m_nCurrent = 0;
-		}
+	unsigned nDropped = GetDropped ();
+	if (nDropped > 0)
+	{
+		pLogger->Write (FromTracer, LogWarning, "%u events dropped", nDropped);
 	}
 }
 
-void CTracer::Dump (void)
+boolean CTracer::ExportChromeTrace (CDevice *pTarget)
 {
+	assert (pTarget != 0);
+
 	if (m_bActive)
 	{
 		Stop ();
 	}
-	
-	CLogger *pLogger = CLogger::Get ();
 
-	unsigned nEvent = 0;
-	if (m_nEntries == m_nDepth)
+	CString Buffer;
+	Buffer.Append ("{\"traceEvents\":[\n");
+
+	for (unsigned nCore = 0; nCore < TRACER_CORES; nCore++)
 	{
-		nEvent = m_nCurrent;
+		CString Event;
+		Event.Format ("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+			      "\"args\":{\"name\":\"Core %u\"}},\n", nCore, nCore);
+		Buffer.Append (Event);
 	}
-	
-	for (unsigned i = 1; i <= m_nEntries; i++)
-	{	
-		TTraceEntry *pEntry = m_pEntry + nEvent;
 
-		pLogger->Write (FromTracer, LogNotice, "%2u: %2u.%06u %2u %08X %08X %08X %08X",
-				i, pEntry->nClockTicks / CLOCKHZ, pEntry->nClockTicks % CLOCKHZ,
-				pEntry->nEventID, pEntry->nParam[0], pEntry->nParam[1], pEntry->nParam[2], pEntry->nParam[3]);
+	RewindEntries ();
+
+	const TTraceEntry *pEntry;
+	unsigned nCore;
+	while ((pEntry = GetNextEntry (&nCore)) != 0)
+	{
+		double fTime = ToMicroSeconds (pEntry->nTimestamp - m_nStartTimestamp);
+
+		CString Event;
+		switch (pEntry->nType)
+		{
+		case TraceEventGeneric:
+			if (pEntry->nEventID == TRACER_EVENT_STOP)
+			{
+				continue;
+			}
+
+			Event.Format ("{\"name\":\"event %u\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+				      "\"pid\":0,\"tid\":%u,\"args\":{\"p1\":\"%08X\",\"p2\":\"%08X\","
+				      "\"p3\":\"%08X\",\"p4\":\"%08X\"}},\n",
+				      pEntry->nEventID, fTime, nCore, pEntry->nParam[0],
+				      pEntry->nParam[1], pEntry->nParam[2], pEntry->nParam[3]);
+			break;
+
+		case TraceEventBegin:
+			Event.Format ("{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,"
+				      "\"pid\":0,\"tid\":%u,\"args\":{\"param\":%u}},\n",
+				      pEntry->pName, fTime, nCore, pEntry->nParam[0]);
+			break;
+
+		case TraceEventInstant:
+			Event.Format ("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+				      "\"pid\":0,\"tid\":%u,\"args\":{\"param\":%u}},\n",
+				      pEntry->pName, fTime, nCore, pEntry->nParam[0]);
+			break;
+
+		case TraceEventEnd:
+			Event.Format ("{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":0,\"tid\":%u},\n",
+				      pEntry->pName, fTime, nCore);
+			break;
+
+		case TraceEventCounter:
+			Event.Format ("{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":0,\"tid\":%u,"
+				      "\"args\":{\"value\":%u}},\n",
+				      pEntry->pName, fTime, nCore, pEntry->nParam[0]);
+			break;
+
+		default:
+			assert (0);
+			continue;
+		}
+
+		Buffer.Append (Event);
+
+		if (Buffer.GetLength () >= EXPORT_CHUNK_SIZE)
+		{
+			if (pTarget->Write (Buffer, Buffer.GetLength ()) != (int) Buffer.GetLength ())
+			{
+				return FALSE;
+			}
 
-		nEvent = (nEvent+1) % m_nDepth;
+			Buffer = "";
+		}
 	}
+
+	// closing metadata entry avoids a trailing comma
+	CString Event;
+	Event.Format ("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+		      "\"args\":{\"name\":\"Circle\"}}\n],\"displayTimeUnit\":\"ns\","
+		      "\"otherData\":{\"dropped\":%u}}\n", GetDropped ());
+	Buffer.Append (Event);
+
+	return pTarget->Write (Buffer, Buffer.GetLength ()) == (int) Buffer.GetLength ();
+}
+
+unsigned CTracer::GetDropped (void) const
+{
+	unsigned nDropped = 0;
+	for (unsigned nCore = 0; nCore < TRACER_CORES; nCore++)
+	{
+		nDropped += m_Ring[nCore].nDropped;
+	}
+
+	return nDropped;
 }
 
 CTracer *CTracer::Get (void)
 {
 	return s_pThis;
 }
+
+const TTraceEntry *CTracer::GetNextEntry (unsigned *pCore)
+{
+	const TTraceEntry *pResult = 0;
+
+	for (unsigned nCore = 0; nCore < TRACER_CORES; nCore++)
+	{
+		TRing *pRing = &m_Ring[nCore];
+
+		unsigned nEntries = pRing->nWritten;
+		if (nEntries > m_nDepth)
+		{
+			nEntries = m_nDepth;
+		}
+
+		if (pRing->nRead >= nEntries)
+		{
+			continue;
+		}
+
+		// oldest entry first, if the ring has wrapped
+		unsigned nIndex = pRing->nRead;
+		if (   pRing->nWritten > m_nDepth
+		    && !m_bStopIfFull)
+		{
+			nIndex += pRing->nWritten;
+		}
+
+		const TTraceEntry *pEntry = &pRing->pEntry[nIndex & (m_nDepth-1)];
+		if (   pResult == 0
+		    || (s64) (pEntry->nTimestamp - pResult->nTimestamp) < 0)
+		{
+			pResult = pEntry;
+			*pCore = nCore;
+		}
+	}
+
+	if (pResult != 0)
+	{
+		m_Ring[*pCore].nRead++;
+	}
+
+	return pResult;
+}
+
+void CTracer::RewindEntries (void)
+{
+	for (unsigned nCore = 0; nCore < TRACER_CORES; nCore++)
+	{
+		m_Ring[nCore].nRead = 0;
+	}
+}
+
+double CTracer::ToMicroSeconds (u64 nTimestamp) const
+{
+	// avoids the 64-bit integer conversion helper of libgcc on AArch32
+	double fTicks =   (double) (u32) (nTimestamp >> 32) * 4294967296.0
+			+ (double) (u32) nTimestamp;
+
+	return fTicks * 1000000.0 / m_nTimestampFrequency;
+}
+
+unsigned CTracer::GetClockTicks (void)
+{
+	return CTimer::GetClockTicks ();
+}
+
+u32 CTracer::GetTimestampFrequency (void)
+{
+#if RASPPI >= 2 && defined (USE_PHYSICAL_COUNTER)
+#if AARCH == 32
+	u32 nCNTFRQ;
+	asm volatile ("mrc p15, 0, %0, c14, c0, 0" : "=r" (nCNTFRQ));
+#else
+	u64 nCNTFRQ;
+	asm volatile ("mrs %0, CNTFRQ_EL0" : "=r" (nCNTFRQ));
+#endif
+
+	return (u32) nCNTFRQ;
+#else
+	return CLOCKHZ;
+#endif
+}
+
+unsigned CTracer::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
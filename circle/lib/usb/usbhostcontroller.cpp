@@ -2,7 +2,7 @@
 // usbhostcontroller.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #include <circle/usb/usbhcirootport.h>
 #include <circle/usb/usbstandardhub.h>
 #include <circle/timer.h>
+#include <circle/metrics.h>
 #include <assert.h>
 
 struct TPortStatusEvent
@@ -34,6 +35,11 @@ struct TPortStatusEvent
 	};
 };
 
+static CMetricCounter s_Transfers ("circle_usb_transfers_total",
+				   "Blocking USB transfers (control and bulk/interrupt)");
+static CMetricCounter s_TransferErrors ("circle_usb_transfer_errors_total",
+					"Failed blocking USB transfers");
+
 boolean CUSBHostController::s_bPlugAndPlay;
 
 CUSBHostController *CUSBHostController::s_pThis = 0;
@@ -107,12 +113,16 @@ int CUSBHostController::ControlMessage (CUSBEndpoint *pEndpoint,
 
 	int nResult = -1;
 
+	s_Transfers.Inc ();
+
 	if (SubmitBlockingRequest (&URB))
 	{
 		nResult = URB.GetResultLength ();
 	}
 	else
 	{
+		s_TransferErrors.Inc ();
+
 		assert (pEndpoint != 0);
 		pEndpoint->ResetPID ();
 	}
@@ -127,8 +137,12 @@ int CUSBHostController::Transfer (CUSBEndpoint *pEndpoint, void *pBuffer, unsign
 {
 	CUSBRequest URB (pEndpoint, pBuffer, nBufSize);
 
+	s_Transfers.Inc ();
+
 	if (!SubmitBlockingRequest (&URB, nTimeoutMs))
 	{
+		s_TransferErrors.Inc ();
+
 		return -1;
 	}
 
@@ -2,7 +2,7 @@
 // util.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -38,11 +38,37 @@ void *memmove (void *pDest, const void *pSrc, size_t nLength)
 		return pDest;
 	}
 
+#if AARCH == 64
+	// memcpy() copies forward, but its unaligned head and overlapping tail accesses
+	// of blocks > 64 bytes may hit the source, if it is less than 64 bytes ahead.
+	// Copy in pieces of the distance then, which do not overlap.
+	if (   pchDest < pchSrc
+	    && pchSrc < pchDest + 64
+	    && nLength > 64)
+	{
+		size_t nDistance = pchSrc - pchDest;
+		while (nLength > 0)
+		{
+			size_t nChunk = nLength < nDistance ? nLength : nDistance;
+
+			memcpy (pchDest, pchSrc, nChunk);
+
+			pchDest += nChunk;
+			pchSrc += nChunk;
+			nLength -= nChunk;
+		}
+
+		return pDest;
+	}
+#endif
+
 	return memcpy (pDest, pSrc, nLength);
 }
 
 #if STDLIB_SUPPORT <= 1
 
+#if AARCH == 32		// AArch64 versions are in util_fast.S
+
 int memcmp (const void *pBuffer1, const void *pBuffer2, size_t nLength)
 {
 	const unsigned char *p1 = (const unsigned char *) pBuffer1;
@@ -78,6 +104,25 @@ size_t strlen (const char *pString)
 	return nResult;
 }
 
+void *memchr (const void *pBuffer, int nValue, size_t nLength)
+{
+	const unsigned char *p = (const unsigned char *) pBuffer;
+
+	while (nLength-- > 0)
+	{
+		if (*p == (unsigned char) nValue)
+		{
+			return (void *) p;
+		}
+
+		p++;
+	}
+
+	return 0;
+}
+
+#endif
+
 int strcmp (const char *pString1, const char *pString2)
 {
 	while (   *pString1 != '\0'
@@ -2,7 +2,7 @@
 // tftpbootserver.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -81,6 +81,7 @@ boolean CTFTPBootServer::FileCreate (const char *pFileName)
 	}
 
 	m_nCurrentOffset = 0;
+	m_CRC.Reset ();
 	m_bFileOpen = TRUE;
 
 	return TRUE;
@@ -90,7 +91,8 @@ boolean CTFTPBootServer::FileClose (void)
 {
 	assert (m_bFileOpen);
 
-	CLogger::Get ()->Write (FromBootServer, LogDebug, "%lu bytes received", m_nCurrentOffset);
+	CLogger::Get ()->Write (FromBootServer, LogDebug, "%u bytes received (CRC32 %08X)",
+				m_nCurrentOffset, m_CRC.Get ());
 
 	m_bFileOpen = FALSE;
 
@@ -120,6 +122,7 @@ int CTFTPBootServer::FileWrite (const void *pBuffer, unsigned nCount)
 
 	assert (pBuffer != 0);
 	memcpy (m_pKernelBuffer + m_nCurrentOffset, pBuffer, nCount);
+	m_CRC.Update (pBuffer, nCount);
 	m_nCurrentOffset += nCount;
 
 	return nCount;
@@ -2,7 +2,7 @@
 // tftpbootserver.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 
 #include <circle/net/tftpdaemon.h>
 #include <circle/net/netsubsystem.h>
+#include <circle/checksum.h>
 #include <circle/types.h>
 
 class CTFTPBootServer : public CTFTPDaemon
@@ -42,6 +43,8 @@ private:
 	boolean m_bFileOpen;
 	u8 *m_pKernelBuffer;
 	unsigned m_nCurrentOffset;
+
+	CCRC32 m_CRC;
 };
 
 #endif
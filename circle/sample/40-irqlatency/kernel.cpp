@@ -96,7 +96,7 @@ TShutdownMode CKernel::Run (void)
 {
 	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
 
-	m_Latency.Start (SAMPLE_RATE_HZ);
+	m_Latency.Start (SAMPLE_RATE_HZ, TRUE);	// with statistics of all connected IRQs
 
 	// start timer to elapse after 5 seconds
 	m_Timer.StartKernelTimer (5 * HZ, TimerHandler, 0, this);
@@ -0,0 +1,501 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/net/checksumcalculator.h>
+#include <circle/sched/mutex.h>
+#include <circle/spinlock.h>
+#include <circle/tracer.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define BUFFER_SIZE		0x100000
+#define BYTES_PER_CASE		(8 * 0x100000)	// memory moved per memcpy/memset case
+#define MIN_ITERATIONS		16
+
+#define FILE_SIZE		(4 * 0x100000)
+#define FILE_NAME		"USB:/bench.bin"
+
+#define DRIVE			"USB:"
+#define RAMDISK_NAME		"umsd1"		// mounted as drive "USB:" by FatFs
+
+// prevents the compiler from removing the benchmarked operation
+#define DO_NOT_OPTIMIZE(var)	asm volatile ("" :: "r" (var) : "memory")
+
+static const char FromKernel[] = "bench";
+
+static const unsigned MemorySizes[] = {16, 64, 256, 1024, 4096, 65536, BUFFER_SIZE};
+static const unsigned HeapSizes[] = {32, 256, 4096, 65536};
+static const unsigned ChecksumSizes[] = {64, 1500, 65536};
+static const unsigned FileChunkSizes[] = {4096, 65536};
+
+static double ToDouble (u64 nValue)	// without u64 conversion helpers on AArch32
+{
+	return (double) (u32) (nValue >> 32) * 4294967296.0 + (double) (u32) nValue;
+}
+
+class CYieldTask : public CTask
+{
+public:
+	CYieldTask (unsigned nYields)
+	:	m_nYields (nYields)
+	{
+	}
+
+	void Run (void)
+	{
+		for (unsigned i = 0; i < m_nYields; i++)
+		{
+			CScheduler::Get ()->Yield ();
+		}
+	}
+
+private:
+	unsigned m_nYields;
+};
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_pResultTarget (0),
+	m_RAMDisk (RAMDISK_SIZE),
+	m_nTimestampFrequency (0),
+	m_nResults (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_RAMDisk.Initialize ();
+	}
+
+	if (bOK)
+	{
+		m_DeviceNameService.AddDevice (RAMDISK_NAME, &m_RAMDisk, TRUE);
+	}
+
+#ifdef USE_QEMU_SEMIHOSTING
+	m_pResultTarget = &m_HostFile;
+#else
+	m_pResultTarget = &m_Serial;
+#endif
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_nTimestampFrequency = CTracer::GetTimestampFrequency ();
+	assert (m_nTimestampFrequency > 0);
+
+	CString Header;
+	Header.Format ("# circle-bench raspi=%u aarch=%u timer=%uHz\n",
+		       RASPPI, AARCH, m_nTimestampFrequency);
+	Output (Header);
+	Output ("# bench,group,case,iterations,ns_per_op,mb_per_s\n");
+
+	BenchMemory ();
+	BenchHeap ();
+	BenchContextSwitch ();
+	BenchLocks ();
+	BenchChecksum ();
+	BenchFormat ();
+	BenchFileSystem ();
+
+	CString Footer;
+	Footer.Format ("# done results=%u\n", m_nResults);
+	Output (Footer);
+
+	m_Logger.Write (FromKernel, LogNotice, "%u results written", m_nResults);
+
+	return ShutdownHalt;
+}
+
+void CKernel::BenchMemory (void)
+{
+	// space for unaligned access behind the buffers
+	u8 *pSource = new u8[BUFFER_SIZE + 64];
+	u8 *pDest = new u8[BUFFER_SIZE + 64];
+	assert (pSource != 0);
+	assert (pDest != 0);
+
+	memset (pSource, 0x55, BUFFER_SIZE + 64);
+	memset (pDest, 0, BUFFER_SIZE + 64);
+
+	for (unsigned i = 0; i < sizeof MemorySizes / sizeof MemorySizes[0]; i++)
+	{
+		unsigned nSize = MemorySizes[i];
+		unsigned nIterations = BYTES_PER_CASE / nSize;
+		if (nIterations < MIN_ITERATIONS)
+		{
+			nIterations = MIN_ITERATIONS;
+		}
+
+		CString Case;
+
+		// aligned
+		u64 nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < nIterations; n++)
+		{
+			memcpy (pDest, pSource, nSize);
+			DO_NOT_OPTIMIZE (pDest);
+		}
+		Case.Format ("%u/aligned", nSize);
+		Report ("memcpy", Case, nIterations, CTracer::GetTimestamp () - nStart, nSize);
+
+		// source and destination at different unaligned offsets
+		nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < nIterations; n++)
+		{
+			memcpy (pDest + 3, pSource + 1, nSize);
+			DO_NOT_OPTIMIZE (pDest);
+		}
+		Case.Format ("%u/unaligned", nSize);
+		Report ("memcpy", Case, nIterations, CTracer::GetTimestamp () - nStart, nSize);
+
+		nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < nIterations; n++)
+		{
+			memset (pDest, n, nSize);
+			DO_NOT_OPTIMIZE (pDest);
+		}
+		Case.Format ("%u/aligned", nSize);
+		Report ("memset", Case, nIterations, CTracer::GetTimestamp () - nStart, nSize);
+
+		nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < nIterations; n++)
+		{
+			memset (pDest + 3, n, nSize);
+			DO_NOT_OPTIMIZE (pDest);
+		}
+		Case.Format ("%u/unaligned", nSize);
+		Report ("memset", Case, nIterations, CTracer::GetTimestamp () - nStart, nSize);
+	}
+
+	delete [] pDest;
+	delete [] pSource;
+}
+
+void CKernel::BenchHeap (void)
+{
+	static const unsigned Iterations = 10000;
+	static const unsigned BatchSize = 256;
+
+	u8 *pBlock[BatchSize];
+
+	for (unsigned i = 0; i < sizeof HeapSizes / sizeof HeapSizes[0]; i++)
+	{
+		unsigned nSize = HeapSizes[i];
+
+		CString Case;
+
+		// allocate and free the same block
+		u64 nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < Iterations; n++)
+		{
+			u8 *p = new u8[nSize];
+			DO_NOT_OPTIMIZE (p);
+			delete [] p;
+		}
+		Case.Format ("%u/single", nSize);
+		Report ("heap", Case, Iterations, CTracer::GetTimestamp () - nStart);
+
+		// allocate a number of blocks, before freeing them
+		nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < Iterations / BatchSize; n++)
+		{
+			for (unsigned j = 0; j < BatchSize; j++)
+			{
+				pBlock[j] = new u8[nSize];
+				DO_NOT_OPTIMIZE (pBlock[j]);
+			}
+
+			for (unsigned j = 0; j < BatchSize; j++)
+			{
+				delete [] pBlock[j];
+			}
+		}
+		Case.Format ("%u/batch%u", nSize, BatchSize);
+		Report ("heap", Case, Iterations / BatchSize * BatchSize,
+			CTracer::GetTimestamp () - nStart);
+	}
+}
+
+void CKernel::BenchContextSwitch (void)
+{
+	static const unsigned Yields = 100000;
+
+	// two tasks yield to each other, while the main task waits for them
+	u64 nStart = CTracer::GetTimestamp ();
+
+	CTask *pTask1 = new CYieldTask (Yields);
+	CTask *pTask2 = new CYieldTask (Yields);
+	assert (pTask1 != 0);
+	assert (pTask2 != 0);
+
+	pTask1->WaitForTermination ();
+	pTask2->WaitForTermination ();
+
+	Report ("sched", "yield", 2*Yields, CTracer::GetTimestamp () - nStart);
+}
+
+void CKernel::BenchLocks (void)
+{
+	static const unsigned Iterations = 1000000;
+
+	CSpinLock SpinLockIRQ (IRQ_LEVEL);
+	u64 nStart = CTracer::GetTimestamp ();
+	for (unsigned n = 0; n < Iterations; n++)
+	{
+		SpinLockIRQ.Acquire ();
+		SpinLockIRQ.Release ();
+	}
+	Report ("lock", "spinlock/irq", Iterations, CTracer::GetTimestamp () - nStart);
+
+	CSpinLock SpinLockTask (TASK_LEVEL);
+	nStart = CTracer::GetTimestamp ();
+	for (unsigned n = 0; n < Iterations; n++)
+	{
+		SpinLockTask.Acquire ();
+		SpinLockTask.Release ();
+	}
+	Report ("lock", "spinlock/task", Iterations, CTracer::GetTimestamp () - nStart);
+
+	CMutex Mutex;
+	nStart = CTracer::GetTimestamp ();
+	for (unsigned n = 0; n < Iterations; n++)
+	{
+		Mutex.Acquire ();
+		Mutex.Release ();
+	}
+	Report ("lock", "mutex", Iterations, CTracer::GetTimestamp () - nStart);
+}
+
+void CKernel::BenchChecksum (void)
+{
+	static const unsigned BytesPerCase = 0x400000;
+
+	u8 *pBuffer = new u8[65536];
+	assert (pBuffer != 0);
+
+	for (unsigned i = 0; i < 65536; i++)
+	{
+		pBuffer[i] = (u8) (i * 7);
+	}
+
+	for (unsigned i = 0; i < sizeof ChecksumSizes / sizeof ChecksumSizes[0]; i++)
+	{
+		unsigned nSize = ChecksumSizes[i];
+		unsigned nIterations = BytesPerCase / nSize;
+
+		u64 nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < nIterations; n++)
+		{
+			u16 usChecksum = CChecksumCalculator::SimpleCalculate (pBuffer, nSize);
+			DO_NOT_OPTIMIZE (usChecksum);
+		}
+
+		CString Case;
+		Case.Format ("%u", nSize);
+		Report ("checksum", Case, nIterations, CTracer::GetTimestamp () - nStart, nSize);
+	}
+
+	delete [] pBuffer;
+}
+
+void CKernel::BenchFormat (void)
+{
+	static const unsigned Iterations = 10000;
+
+	CString String;
+
+	u64 nStart = CTracer::GetTimestamp ();
+	for (unsigned n = 0; n < Iterations; n++)
+	{
+		String.Format ("%s:%u", "counter", n);
+	}
+	Report ("format", "string+unsigned", Iterations, CTracer::GetTimestamp () - nStart);
+
+	nStart = CTracer::GetTimestamp ();
+	for (unsigned n = 0; n < Iterations; n++)
+	{
+		String.Format ("%08X %-10d %5u", n, -(int) n, n);
+	}
+	Report ("format", "hex+padded", Iterations, CTracer::GetTimestamp () - nStart);
+
+	nStart = CTracer::GetTimestamp ();
+	for (unsigned n = 0; n < Iterations; n++)
+	{
+		String.Format ("%.3f", n * 0.001);
+	}
+	Report ("format", "float", Iterations, CTracer::GetTimestamp () - nStart);
+}
+
+void CKernel::BenchFileSystem (void)
+{
+	if (f_mount (&m_FileSystem, DRIVE, 1) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot mount RAM disk");
+
+		return;
+	}
+
+	u8 *pBuffer = new u8[FileChunkSizes[1]];
+	assert (pBuffer != 0);
+	memset (pBuffer, 0xAA, FileChunkSizes[1]);
+
+	for (unsigned i = 0; i < sizeof FileChunkSizes / sizeof FileChunkSizes[0]; i++)
+	{
+		unsigned nChunkSize = FileChunkSizes[i];
+		unsigned nChunks = FILE_SIZE / nChunkSize;
+
+		FIL File;
+		if (f_open (&File, FILE_NAME, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+		{
+			m_Logger.Write (FromKernel, LogError, "Cannot create file");
+
+			break;
+		}
+
+		u64 nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < nChunks; n++)
+		{
+			unsigned nBytesWritten;
+			if (   f_write (&File, pBuffer, nChunkSize, &nBytesWritten) != FR_OK
+			    || nBytesWritten != nChunkSize)
+			{
+				m_Logger.Write (FromKernel, LogError, "Write error");
+
+				break;
+			}
+		}
+		f_close (&File);
+
+		CString Case;
+		Case.Format ("write/%u", nChunkSize);
+		Report ("fatfs", Case, nChunks, CTracer::GetTimestamp () - nStart, nChunkSize);
+
+		if (f_open (&File, FILE_NAME, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+		{
+			m_Logger.Write (FromKernel, LogError, "Cannot open file");
+
+			break;
+		}
+
+		nStart = CTracer::GetTimestamp ();
+		for (unsigned n = 0; n < nChunks; n++)
+		{
+			unsigned nBytesRead;
+			if (   f_read (&File, pBuffer, nChunkSize, &nBytesRead) != FR_OK
+			    || nBytesRead != nChunkSize)
+			{
+				m_Logger.Write (FromKernel, LogError, "Read error");
+
+				break;
+			}
+		}
+		f_close (&File);
+
+		Case.Format ("read/%u", nChunkSize);
+		Report ("fatfs", Case, nChunks, CTracer::GetTimestamp () - nStart, nChunkSize);
+	}
+
+	delete [] pBuffer;
+
+	f_unlink (FILE_NAME);
+	f_mount (0, DRIVE, 0);
+}
+
+void CKernel::Report (const char *pGroup, const char *pCase, unsigned nIterations, u64 nTicks,
+		      unsigned nBytesPerIteration)
+{
+	assert (nIterations > 0);
+
+	double fSeconds = ToDouble (nTicks) / m_nTimestampFrequency;
+	double fNanoSecondsPerOp = fSeconds * 1000000000.0 / nIterations;
+
+	double fMBPerSecond = 0.0;
+	if (   nBytesPerIteration != 0
+	    && fSeconds > 0.0)
+	{
+		fMBPerSecond = (double) nBytesPerIteration * nIterations / fSeconds / 1000000.0;
+	}
+
+	CString Line;
+	Line.Format ("bench,%s,%s,%u,%.3f,%.3f\n", pGroup, pCase, nIterations,
+		     fNanoSecondsPerOp, fMBPerSecond);
+	Output (Line);
+
+	m_Logger.Write (FromKernel, LogNotice, "%-8s %-18s %10.3f ns/op %10.3f MB/s",
+			pGroup, pCase, fNanoSecondsPerOp, fMBPerSecond);
+
+	m_nResults++;
+}
+
+void CKernel::Output (const char *pLine)
+{
+	assert (m_pResultTarget != 0);
+	assert (pLine != 0);
+
+	m_pResultTarget->Write (pLine, strlen (pLine));
+}
@@ -0,0 +1,103 @@
+//
+// kernel.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _kernel_h
+#define _kernel_h
+
+#include <circle/actled.h>
+#include <circle/koptions.h>
+#include <circle/devicenameservice.h>
+#include <circle/screen.h>
+#include <circle/serial.h>
+#include <circle/exceptionhandler.h>
+#include <circle/interrupt.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/sched/scheduler.h>
+#include <circle/types.h>
+#include <fatfs/ff.h>
+#include "ramdisk.h"
+
+// Define this to write the results to stdout of the QEMU host (requires -semihosting).
+// Otherwise the results are written to the serial interface.
+//#define USE_QEMU_SEMIHOSTING
+
+#ifdef USE_QEMU_SEMIHOSTING
+	#include <qemu/qemuhostfile.h>
+#endif
+
+#define RAMDISK_SIZE		(16 * 0x100000)
+
+enum TShutdownMode
+{
+	ShutdownNone,
+	ShutdownHalt,
+	ShutdownReboot
+};
+
+class CKernel
+{
+public:
+	CKernel (void);
+	~CKernel (void);
+
+	boolean Initialize (void);
+
+	TShutdownMode Run (void);
+
+private:
+	void BenchMemory (void);
+	void BenchHeap (void);
+	void BenchContextSwitch (void);
+	void BenchLocks (void);
+	void BenchChecksum (void);
+	void BenchFormat (void);
+	void BenchFileSystem (void);
+
+	// writes one result line "bench,group,case,iterations,ns_per_op,mb_per_s"
+	void Report (const char *pGroup, const char *pCase, unsigned nIterations, u64 nTicks,
+		     unsigned nBytesPerIteration = 0);
+	void Output (const char *pLine);
+
+private:
+	// do not change this order
+	CActLED			m_ActLED;
+	CKernelOptions		m_Options;
+	CDeviceNameService	m_DeviceNameService;
+	CScreenDevice		m_Screen;
+	CSerialDevice		m_Serial;
+	CExceptionHandler	m_ExceptionHandler;
+	CInterruptSystem	m_Interrupt;
+	CTimer			m_Timer;
+	CLogger			m_Logger;
+	CScheduler		m_Scheduler;
+
+#ifdef USE_QEMU_SEMIHOSTING
+	CQEMUHostFile		m_HostFile;
+#endif
+	CDevice			*m_pResultTarget;
+
+	CRAMDisk		m_RAMDisk;
+	FATFS			m_FileSystem;
+
+	u32 m_nTimestampFrequency;
+	unsigned m_nResults;
+};
+
+#endif
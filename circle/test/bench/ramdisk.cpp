@@ -0,0 +1,185 @@
+//
+// ramdisk.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "ramdisk.h"
+#include <circle/macros.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define RESERVED_SECTORS	1
+#define NUMBER_OF_FATS		2
+#define ROOT_ENTRIES		512
+#define SECTORS_PER_CLUSTER	4
+
+struct TFAT16BootSector
+{
+	u8	JumpBoot[3];
+	char	OEMName[8];
+	u16	BytesPerSector;
+	u8	SectorsPerCluster;
+	u16	ReservedSectors;
+	u8	NumberOfFATs;
+	u16	RootEntries;
+	u16	TotalSectors16;
+	u8	Media;
+	u16	FATSize16;
+	u16	SectorsPerTrack;
+	u16	NumberOfHeads;
+	u32	HiddenSectors;
+	u32	TotalSectors32;
+	u8	DriveNumber;
+	u8	Reserved1;
+	u8	BootSignature;
+	u32	VolumeID;
+	char	VolumeLabel[11];
+	char	FileSystemType[8];
+	u8	BootCode[448];
+	u16	Signature;
+}
+PACKED;
+
+ASSERT_STATIC (sizeof (TFAT16BootSector) == RAMDISK_SECTOR_SIZE);
+
+CRAMDisk::CRAMDisk (unsigned nSize)
+:	m_nSize (nSize),
+	m_pData (0),
+	m_nOffset (0)
+{
+	assert (m_nSize % RAMDISK_SECTOR_SIZE == 0);
+}
+
+CRAMDisk::~CRAMDisk (void)
+{
+	delete [] m_pData;
+	m_pData = 0;
+}
+
+boolean CRAMDisk::Initialize (void)
+{
+	assert (m_pData == 0);
+	m_pData = new u8[m_nSize];
+	if (m_pData == 0)
+	{
+		return FALSE;
+	}
+
+	return Format ();
+}
+
+int CRAMDisk::Read (void *pBuffer, size_t nCount)
+{
+	assert (m_pData != 0);
+	if (   m_nOffset > m_nSize
+	    || nCount > m_nSize - m_nOffset)
+	{
+		return -1;
+	}
+
+	memcpy (pBuffer, m_pData + m_nOffset, nCount);
+	m_nOffset += nCount;
+
+	return nCount;
+}
+
+int CRAMDisk::Write (const void *pBuffer, size_t nCount)
+{
+	assert (m_pData != 0);
+	if (   m_nOffset > m_nSize
+	    || nCount > m_nSize - m_nOffset)
+	{
+		return -1;
+	}
+
+	memcpy (m_pData + m_nOffset, pBuffer, nCount);
+	m_nOffset += nCount;
+
+	return nCount;
+}
+
+u64 CRAMDisk::Seek (u64 ullOffset)
+{
+	if (ullOffset > m_nSize)
+	{
+		return (u64) -1;
+	}
+
+	m_nOffset = (unsigned) ullOffset;
+
+	return ullOffset;
+}
+
+u64 CRAMDisk::GetSize (void) const
+{
+	return m_nSize;
+}
+
+boolean CRAMDisk::Format (void)
+{
+	assert (m_pData != 0);
+	memset (m_pData, 0, m_nSize);
+
+	unsigned nTotalSectors = m_nSize / RAMDISK_SECTOR_SIZE;
+	unsigned nRootSectors = ROOT_ENTRIES * 32 / RAMDISK_SECTOR_SIZE;
+
+	// the FAT covers the data area (2 bytes per cluster plus 2 reserved entries)
+	unsigned nDataSectors = nTotalSectors - RESERVED_SECTORS - nRootSectors;
+	unsigned nClusters = nDataSectors / SECTORS_PER_CLUSTER;
+	unsigned nFATSectors = ((nClusters+2) * 2 + RAMDISK_SECTOR_SIZE-1) / RAMDISK_SECTOR_SIZE;
+	nClusters = (nDataSectors - NUMBER_OF_FATS*nFATSectors) / SECTORS_PER_CLUSTER;
+
+	// cluster count range of FAT16
+	if (   nClusters < 4085
+	    || nClusters > 65524
+	    || nTotalSectors > 0xFFFF)
+	{
+		return FALSE;
+	}
+
+	TFAT16BootSector *pBoot = (TFAT16BootSector *) m_pData;
+	pBoot->JumpBoot[0] = 0xEB;
+	pBoot->JumpBoot[1] = 0x3C;
+	pBoot->JumpBoot[2] = 0x90;
+	memcpy (pBoot->OEMName, "CIRCLE  ", sizeof pBoot->OEMName);
+	pBoot->BytesPerSector = RAMDISK_SECTOR_SIZE;
+	pBoot->SectorsPerCluster = SECTORS_PER_CLUSTER;
+	pBoot->ReservedSectors = RESERVED_SECTORS;
+	pBoot->NumberOfFATs = NUMBER_OF_FATS;
+	pBoot->RootEntries = ROOT_ENTRIES;
+	pBoot->TotalSectors16 = nTotalSectors;
+	pBoot->Media = 0xF8;
+	pBoot->FATSize16 = nFATSectors;
+	pBoot->SectorsPerTrack = 63;
+	pBoot->NumberOfHeads = 255;
+	pBoot->DriveNumber = 0x80;
+	pBoot->BootSignature = 0x29;
+	pBoot->VolumeID = 0x12345678;
+	memcpy (pBoot->VolumeLabel, "RAMDISK    ", sizeof pBoot->VolumeLabel);
+	memcpy (pBoot->FileSystemType, "FAT16   ", sizeof pBoot->FileSystemType);
+	pBoot->Signature = 0xAA55;
+
+	// media descriptor and end-of-chain marker in the first two FAT entries
+	for (unsigned i = 0; i < NUMBER_OF_FATS; i++)
+	{
+		u16 *pFAT = (u16 *) (m_pData + (RESERVED_SECTORS + i*nFATSectors) * RAMDISK_SECTOR_SIZE);
+		pFAT[0] = 0xFFF8;
+		pFAT[1] = 0xFFFF;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,55 @@
+//
+// ramdisk.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _ramdisk_h
+#define _ramdisk_h
+
+#include <circle/device.h>
+#include <circle/types.h>
+
+#define RAMDISK_SECTOR_SIZE	512
+
+class CRAMDisk : public CDevice		/// Block device in memory, formatted with FAT16
+{
+public:
+	/// \param nSize Size of the disk in bytes (multiple of RAMDISK_SECTOR_SIZE)
+	CRAMDisk (unsigned nSize);
+	~CRAMDisk (void);
+
+	/// \brief Allocate and format the disk
+	/// \return Operation successful?
+	boolean Initialize (void);
+
+	int Read (void *pBuffer, size_t nCount);
+	int Write (const void *pBuffer, size_t nCount);
+
+	u64 Seek (u64 ullOffset);
+	u64 GetSize (void) const;
+
+private:
+	boolean Format (void);
+
+private:
+	unsigned m_nSize;
+	u8 *m_pData;
+
+	unsigned m_nOffset;
+};
+
+#endif